@@ -201,6 +201,16 @@ public:
                 .withSetter(ProfileLevelSetter, mSize, mFrameRate, mBitrate)
                 .build());
 
+        addParameter(
+                DefineParam(mParallelism, C2_PARAMKEY_ENCODING_PARALLELISM)
+                .withDefault(new C2StreamEncodingParallelismTuning::output(0u, 0, 0))
+                .withFields({
+                    C2F(mParallelism, threads).inRange(0, CODEC_MAX_CORES),
+                    C2F(mParallelism, slices).inRange(0, MAX_SLICES),
+                })
+                .withSetter(ParallelismSetter)
+                .build());
+
         addParameter(
                 DefineParam(mRequestSync, C2_PARAMKEY_REQUEST_SYNC_FRAME)
                 .withDefault(new C2StreamRequestSyncFrameTuning::output(0u, C2_FALSE))
@@ -380,6 +390,15 @@ public:
         return res;
     }
 
+    static C2R ParallelismSetter(
+            bool mayBlock, C2P<C2StreamEncodingParallelismTuning::output> &me) {
+        (void)mayBlock;
+        C2R res = C2R::Ok();
+        res.plus(me.F(me.v.threads).validatePossible(me.v.threads));
+        res.plus(me.F(me.v.slices).validatePossible(me.v.slices));
+        return res;
+    }
+
     static C2R GopSetter(bool mayBlock, C2P<C2StreamGopTuning::output> &me) {
         (void)mayBlock;
         for (size_t i = 0; i < me.v.flexCount(); ++i) {
@@ -539,6 +558,9 @@ public:
     std::shared_ptr<C2StreamBitrateInfo::output> getBitrate_l() const { return mBitrate; }
     std::shared_ptr<C2StreamRequestSyncFrameTuning::output> getRequestSync_l() const { return mRequestSync; }
     std::shared_ptr<C2StreamGopTuning::output> getGop_l() const { return mGop; }
+    std::shared_ptr<C2StreamEncodingParallelismTuning::output> getParallelism_l() const {
+        return mParallelism;
+    }
     std::shared_ptr<C2StreamPictureQuantizationTuning::output> getPictureQuantization_l() const
     { return mPictureQuantization; }
     std::shared_ptr<C2StreamColorAspectsInfo::output> getCodedColorAspects_l() const {
@@ -555,6 +577,7 @@ private:
     std::shared_ptr<C2StreamProfileLevelInfo::output> mProfileLevel;
     std::shared_ptr<C2StreamSyncFrameIntervalTuning::output> mSyncFramePeriod;
     std::shared_ptr<C2StreamGopTuning::output> mGop;
+    std::shared_ptr<C2StreamEncodingParallelismTuning::output> mParallelism;
     std::shared_ptr<C2StreamPictureQuantizationTuning::output> mPictureQuantization;
     std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
     std::shared_ptr<C2StreamColorAspectsInfo::output> mCodedColorAspects;
@@ -1151,6 +1174,7 @@ c2_status_t C2SoftAvcEnc::initEncoder() {
     c2_status_t errType = C2_OK;
 
     std::shared_ptr<C2StreamGopTuning::output> gop;
+    std::shared_ptr<C2StreamEncodingParallelismTuning::output> parallelism;
     {
         IntfImpl::Lock lock = mIntf->lock();
         mSize = mIntf->getSize_l();
@@ -1162,6 +1186,7 @@ c2_status_t C2SoftAvcEnc::initEncoder() {
         mIDRInterval = mIntf->getSyncFramePeriod_l();
         gop = mIntf->getGop_l();
         mColorAspects = mIntf->getCodedColorAspects_l();
+        parallelism = mIntf->getParallelism_l();
     }
     if (gop && gop->flexCount() > 0) {
         uint32_t syncInterval = 1;
@@ -1184,6 +1209,24 @@ c2_status_t C2SoftAvcEnc::initEncoder() {
     uint32_t width = mSize->width;
     uint32_t height = mSize->height;
 
+    if (parallelism) {
+        if (parallelism->threads > 0) {
+            mNumCores = parallelism->threads;
+        }
+        if (parallelism->slices > 1) {
+            // Split the frame into slices of whole macroblock rows so that
+            // the slices of a frame can be encoded on different cores.
+            uint32_t mbRows = (height + 15) / 16;
+            uint32_t mbCols = (width + 15) / 16;
+            uint32_t rowsPerSlice = std::max(1u, (mbRows + parallelism->slices - 1)
+                    / parallelism->slices);
+            mSliceMode = IVE_SLICE_MODE_BLOCKS;
+            mSliceParam = rowsPerSlice * mbCols;
+        }
+        ALOGV("Parallelism: cores %zu slice mode %d param %u",
+              mNumCores, mSliceMode, mSliceParam);
+    }
+
     mStride = width;
 
     // Assume worst case output buffer size to be equal to number of bytes in input
@@ -30,6 +30,7 @@
 namespace android {
 
 #define CODEC_MAX_CORES          4
+#define MAX_SLICES               16
 #define LEN_STATUS_BUFFER        (10  * 1024)
 #define MAX_VBV_BUFF_SIZE        (120 * 16384)
 #define MAX_NUM_IO_BUFS           3
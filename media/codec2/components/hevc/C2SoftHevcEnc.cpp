@@ -99,6 +99,16 @@ class C2SoftHevcEnc::IntfImpl : public SimpleInterface<void>::BaseParams {
                 .withSetter(GopSetter)
                 .build());
 
+        addParameter(
+                DefineParam(mParallelism, C2_PARAMKEY_ENCODING_PARALLELISM)
+                .withDefault(new C2StreamEncodingParallelismTuning::output(0u, 0, 0))
+                .withFields({
+                    C2F(mParallelism, threads).inRange(0, CODEC_MAX_CORES),
+                    C2F(mParallelism, slices).equalTo(0),
+                })
+                .withSetter(ParallelismSetter)
+                .build());
+
         addParameter(
                 DefineParam(mActualInputDelay, C2_PARAMKEY_INPUT_DELAY)
                 .withDefault(new C2PortActualDelayTuning::input(
@@ -271,6 +281,15 @@ class C2SoftHevcEnc::IntfImpl : public SimpleInterface<void>::BaseParams {
         return C2R::Ok();
     }
 
+    static C2R ParallelismSetter(
+            bool mayBlock, C2P<C2StreamEncodingParallelismTuning::output> &me) {
+        (void)mayBlock;
+        C2R res = C2R::Ok();
+        res.plus(me.F(me.v.threads).validatePossible(me.v.threads));
+        res.plus(me.F(me.v.slices).validatePossible(me.v.slices));
+        return res;
+    }
+
     static C2R BitrateSetter(bool mayBlock,
                              C2P<C2StreamBitrateInfo::output>& me) {
         (void)mayBlock;
@@ -455,6 +474,9 @@ class C2SoftHevcEnc::IntfImpl : public SimpleInterface<void>::BaseParams {
     std::shared_ptr<C2StreamGopTuning::output> getGop_l() const {
         return mGop;
     }
+    std::shared_ptr<C2StreamEncodingParallelismTuning::output> getParallelism_l() const {
+        return mParallelism;
+    }
     static C2R ColorAspectsSetter(bool mayBlock, C2P<C2StreamColorAspectsInfo::input> &me) {
         (void)mayBlock;
         if (me.v.range > C2Color::RANGE_OTHER) {
@@ -556,6 +578,7 @@ class C2SoftHevcEnc::IntfImpl : public SimpleInterface<void>::BaseParams {
     std::shared_ptr<C2StreamProfileLevelInfo::output> mProfileLevel;
     std::shared_ptr<C2StreamSyncFrameIntervalTuning::output> mSyncFramePeriod;
     std::shared_ptr<C2StreamGopTuning::output> mGop;
+    std::shared_ptr<C2StreamEncodingParallelismTuning::output> mParallelism;
     std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
     std::shared_ptr<C2StreamColorAspectsInfo::output> mCodedColorAspects;
     std::shared_ptr<C2StreamPictureQuantizationTuning::output> mPictureQuantization;
@@ -717,6 +740,10 @@ c2_status_t C2SoftHevcEnc::initEncParams() {
     mEncParams.s_coding_tools_prms.i4_max_i_open_gop_period = mIDRInterval;
     mEncParams.s_coding_tools_prms.i4_max_cra_open_gop_period = mIInterval;
     mIvVideoColorFormat = IV_YUV_420P;
+    if (mParallelism && mParallelism->threads > 0) {
+        mNumCores = mParallelism->threads;
+        ALOGV("Parallelism: cores %zu", mNumCores);
+    }
     mEncParams.s_multi_thrd_prms.i4_max_num_cores = mNumCores;
     mEncParams.s_out_strm_prms.i4_codec_profile = mHevcEncProfile;
     mEncParams.s_lap_prms.i4_rc_look_ahead_pics = DEFAULT_RC_LOOKAHEAD;
@@ -826,6 +853,7 @@ c2_status_t C2SoftHevcEnc::initEncoder() {
         mComplexity = mIntf->getComplexity_l();
         mQuality = mIntf->getQuality_l();
         mGop = mIntf->getGop_l();
+        mParallelism = mIntf->getParallelism_l();
         mRequestSync = mIntf->getRequestSync_l();
         mColorAspects = mIntf->getCodedColorAspects_l();
         mQpBounds = mIntf->getPictureQuantization_l();;
@@ -284,6 +284,9 @@ enum C2ParamIndexKind : C2Param::type_index_t {
 
     // allow tunnel peek behavior to be unspecified for app compatibility
     kParamIndexTunnelPeekMode, // tunnel mode, enum
+
+    // encoder threading and slicing
+    kParamIndexEncodingParallelism, // encoders, struct
 };
 
 }
@@ -2540,6 +2543,31 @@ typedef C2StreamParam<C2Info, C2SimpleValueStruct<int32_t>, kParamIndexAverageBl
         C2AndroidStreamAverageBlockQuantizationInfo;
 constexpr char C2_PARAMKEY_AVERAGE_QP[] = "coded.average-qp";
 
+/**
+ * Encoding parallelism.
+ *
+ * Allows trading compression efficiency for throughput in software encoders,
+ * e.g. for bulk transcoding on many-core hosts.
+ */
+struct C2EncodingParallelismStruct {
+    inline C2EncodingParallelismStruct()
+        : threads(0), slices(0) {}
+
+    inline C2EncodingParallelismStruct(uint32_t threads_, uint32_t slices_)
+        : threads(threads_), slices(slices_) {}
+
+    uint32_t threads; ///< worker threads (0 for component default)
+    uint32_t slices;  ///< slices (or tiles) per frame (0 for a single slice)
+
+    DEFINE_AND_DESCRIBE_C2STRUCT(EncodingParallelism)
+    C2FIELD(threads, "threads")
+    C2FIELD(slices, "slices")
+};
+
+typedef C2StreamParam<C2Tuning, C2EncodingParallelismStruct, kParamIndexEncodingParallelism>
+        C2StreamEncodingParallelismTuning;
+constexpr char C2_PARAMKEY_ENCODING_PARALLELISM[] = "coding.parallelism";
+
 /// @}
 
 #endif  // C2CONFIG_H_
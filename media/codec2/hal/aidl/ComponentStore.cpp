@@ -364,8 +364,19 @@ void ComponentStore::reportComponentBirth(Component* component) {
 // Called from within the destructor of `component`. No virtual function calls
 // are made on `component` here.
 void ComponentStore::reportComponentDeath(Component* component) {
-    std::lock_guard<std::mutex> lock(mComponentRosterMutex);
-    mComponentRoster.erase(component);
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(mComponentRosterMutex);
+        mComponentRoster.erase(component);
+        idle = mComponentRoster.empty();
+    }
+    if (idle) {
+        // Nothing is left to reuse recycled linear buffers; give the memory back.
+        size_t released = TrimCodec2PlatformLinearAllocator();
+        if (released > 0) {
+            LOG(VERBOSE) << "released " << released << " bytes of cached linear buffers";
+        }
+    }
 }
 
 // Dumps component traits.
@@ -461,6 +472,13 @@ binder_status_t ComponentStore::dump(
             }
         }
 
+        // Dump linear allocator counters.
+        std::string linearAllocator = DumpCodec2PlatformLinearAllocator();
+        if (!linearAllocator.empty()) {
+            out << indent << "Linear allocator:" << std::endl << std::endl;
+            out << indent << indent << linearAllocator << std::endl << std::endl;
+        }
+
         out << "End of dump -- C2ComponentStore: "
                 << mStore->getName() << std::endl;
     }
@@ -2542,6 +2542,9 @@ void CCodec::onMessageReceived(const sp<AMessage> &msg) {
                     mCallback->onMetricsUpdated(mMetrics);
                 }
             }
+            if (sp<AMessage> depthMetrics = mChannel->getUpdatedPipelineDepthMetrics()) {
+                mCallback->onMetricsUpdated(depthMetrics);
+            }
             break;
         }
         case kWhatWatch: {
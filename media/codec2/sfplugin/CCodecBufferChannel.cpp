@@ -51,6 +51,7 @@
 #include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/MediaCodecConstants.h>
+#include <media/stagefright/MediaCodecMetricsConstants.h>
 #include <media/stagefright/SkipCutBuffer.h>
 #include <media/stagefright/SurfaceUtils.h>
 #include <media/MediaCodecBuffer.h>
@@ -90,58 +91,126 @@ static bool areRenderMetricsEnabled() {
     return v == "true";
 }
 
+static bool isAdaptivePipelineDepthEnabled() {
+    std::string v = GetServerConfigurableFlag(
+            "media_native", "ccodec_adaptive_pipeline_depth", "false");
+    return v == "true";
+}
+
 }  // namespace
 
 CCodecBufferChannel::QueueGuard::QueueGuard(
         CCodecBufferChannel::QueueSync &sync) : mSync(sync) {
-    Mutex::Autolock l(mSync.mGuardLock);
-    // At this point it's guaranteed that mSync is not under state transition,
-    // as we are holding its mutex.
-
-    Mutexed<CCodecBufferChannel::QueueSync::Counter>::Locked count(mSync.mCount);
-    if (count->value == -1) {
-        mRunning = false;
-    } else {
-        ++count->value;
-        mRunning = true;
-    }
+    // Take a reference without any lock as long as the sync object is running
+    // and not being stopped. Guards created while stop() is in progress get
+    // the STOPPED state immediately.
+    int32_t count = mSync.mCount.load(std::memory_order_relaxed);
+    do {
+        if (count < 0 || (count & QueueSync::kStopping)) {
+            mRunning = false;
+            return;
+        }
+    } while (!mSync.mCount.compare_exchange_weak(
+            count, count + 1, std::memory_order_acquire, std::memory_order_relaxed));
+    mRunning = true;
 }
 
 CCodecBufferChannel::QueueGuard::~QueueGuard() {
     if (mRunning) {
-        // We are not holding mGuardLock at this point so that QueueSync::stop() can
-        // keep holding the lock until mCount reaches zero.
-        Mutexed<CCodecBufferChannel::QueueSync::Counter>::Locked count(mSync.mCount);
-        --count->value;
-        count->cond.broadcast();
+        int32_t prev = mSync.mCount.fetch_sub(1, std::memory_order_release);
+        if (prev == (QueueSync::kStopping | 1)) {
+            // We were the last guard that QueueSync::stop() is waiting on.
+            Mutex::Autolock l(mSync.mDrainLock);
+            mSync.mDrained.broadcast();
+        }
     }
 }
 
 void CCodecBufferChannel::QueueSync::start() {
     Mutex::Autolock l(mGuardLock);
     // If stopped, it goes to running state; otherwise no-op.
-    Mutexed<Counter>::Locked count(mCount);
-    if (count->value == -1) {
-        count->value = 0;
-    }
+    int32_t stopped = -1;
+    (void)mCount.compare_exchange_strong(stopped, 0);
 }
 
 void CCodecBufferChannel::QueueSync::stop() {
     Mutex::Autolock l(mGuardLock);
-    Mutexed<Counter>::Locked count(mCount);
-    if (count->value == -1) {
+    if (mCount.load() == -1) {
         // no-op
         return;
     }
-    // Holding mGuardLock here blocks creation of additional QueueGuard objects, so
-    // mCount can only decrement. In other words, threads that acquired the lock
-    // are allowed to finish execution but additional threads trying to acquire
-    // the lock at this point will block, and then get QueueGuard at STOPPED
-    // state.
-    while (count->value != 0) {
-        count.waitForCondition(count->cond);
+    // Setting kStopping blocks creation of additional running QueueGuard
+    // objects, so the count can only decrement. In other words, threads that
+    // acquired a guard are allowed to finish execution but additional threads
+    // get QueueGuard at STOPPED state.
+    mCount.fetch_or(kStopping);
+    {
+        Mutex::Autolock drainLock(mDrainLock);
+        while (mCount.load() != kStopping) {
+            mDrained.wait(mDrainLock);
+        }
+    }
+    mCount.store(-1);
+}
+
+// FrameRotations
+
+CCodecBufferChannel::FrameRotations::FrameRotations()
+    : mOverflowSize(0u),
+      mLoggedOverflow(false) {
+    clear();
+}
+
+void CCodecBufferChannel::FrameRotations::set(uint64_t frameIndex, int32_t rotation) {
+    // Slot value layout: (frameIndex + 1) << 2 | quarters; zero means empty.
+    uint64_t quarters = (rotation / 90) & 3;
+    uint64_t old = mSlots[frameIndex % kNumSlots].exchange(
+            ((frameIndex + 1) << 2) | quarters, std::memory_order_acq_rel);
+    if (old == 0u) {
+        return;
+    }
+    // An earlier frame has not been rendered yet; keep its rotation aside.
+    std::lock_guard<std::mutex> lock(mOverflowLock);
+    if (!mLoggedOverflow) {
+        ALOGW("more than %zu frames with rotation pending; tracking the rest under a lock",
+              kNumSlots);
+        mLoggedOverflow = true;
+    }
+    mOverflow[(old >> 2) - 1] = old & 3;
+    mOverflowSize.store(mOverflow.size(), std::memory_order_release);
+}
+
+bool CCodecBufferChannel::FrameRotations::take(uint64_t frameIndex, uint32_t *quarters) {
+    std::atomic_uint64_t &slot = mSlots[frameIndex % kNumSlots];
+    uint64_t value = slot.load(std::memory_order_acquire);
+    bool found = (value >> 2) == frameIndex + 1
+            && slot.compare_exchange_strong(value, 0u, std::memory_order_acq_rel);
+    if (found) {
+        *quarters = value & 3;
+    }
+    if (mOverflowSize.load(std::memory_order_acquire) == 0u) {
+        return found;
+    }
+    std::lock_guard<std::mutex> lock(mOverflowLock);
+    // Frames are rendered in order; earlier entries belong to dropped frames.
+    auto it = mOverflow.lower_bound(frameIndex);
+    if (!found && it != mOverflow.end() && it->first == frameIndex) {
+        *quarters = it->second;
+        found = true;
+        ++it;
+    }
+    mOverflow.erase(mOverflow.begin(), it);
+    mOverflowSize.store(mOverflow.size(), std::memory_order_release);
+    return found;
+}
+
+void CCodecBufferChannel::FrameRotations::clear() {
+    for (std::atomic_uint64_t &slot : mSlots) {
+        slot.store(0u, std::memory_order_relaxed);
     }
-    count->value = -1;
+    std::lock_guard<std::mutex> lock(mOverflowLock);
+    mOverflow.clear();
+    mOverflowSize.store(0u, std::memory_order_release);
 }
 
 // Input
@@ -161,6 +230,8 @@ CCodecBufferChannel::CCodecBufferChannel(
       mHasPresentFenceTimes(false),
       mRenderingDepth(3u),
       mMetaMode(MODE_NONE),
+      mAdaptivePipelineDepth(isAdaptivePipelineDepthEnabled()),
+      mReportedAdaptiveStats{0u, 0u, 0u, 0u},
       mInputMetEos(false),
       mSendEncryptedInfoBuffer(false) {
     {
@@ -292,9 +363,7 @@ status_t CCodecBufferChannel::queueInputBufferInternal(
                 // change rotation to counter-clock wise.
                 rotation = ((rotation <= 0) ? 0 : 360) - rotation;
 
-                Mutexed<OutputSurface>::Locked output(mOutputSurface);
-                uint64_t frameIndex = work->input.ordinal.frameIndex.peeku();
-                output->rotation[frameIndex] = rotation;
+                mFrameRotations.set(work->input.ordinal.frameIndex.peeku(), rotation);
             }
             work->input.buffers.push_back(c2buffer);
             if (encryptedBlock) {
@@ -352,12 +421,20 @@ status_t CCodecBufferChannel::queueInputBufferInternal(
         ScopedTrace trace(ATRACE_TAG, android::base::StringPrintf(
                 "CCodecBufferChannel::queue(%s@ts=%lld)", mName, (long long)timeUs).c_str());
         {
-            Mutexed<PipelineWatcher>::Locked watcher(mPipelineWatcher);
+            // Copy the input buffer references before taking the watcher lock,
+            // which is shared with the work-done path.
+            std::vector<std::vector<std::shared_ptr<C2Buffer>>> inputBuffers;
+            inputBuffers.reserve(items.size());
+            for (const std::unique_ptr<C2Work> &work : items) {
+                inputBuffers.emplace_back(work->input.buffers);
+            }
             PipelineWatcher::Clock::time_point now = PipelineWatcher::Clock::now();
+            Mutexed<PipelineWatcher>::Locked watcher(mPipelineWatcher);
+            size_t i = 0;
             for (const std::unique_ptr<C2Work> &work : items) {
                 watcher->onWorkQueued(
                         work->input.ordinal.frameIndex.peeku(),
-                        std::vector(work->input.buffers),
+                        std::move(inputBuffers[i++]),
                         now);
             }
         }
@@ -814,19 +891,13 @@ status_t CCodecBufferChannel::renderOutputBuffer(
     bool flip = rotation && (rotation->flip & 1);
     uint32_t quarters = ((rotation ? rotation->value : 0) / 90) & 3;
 
-    {
-        Mutexed<OutputSurface>::Locked output(mOutputSurface);
-        if (output->surface == nullptr) {
-            ALOGI("[%s] cannot render buffer without surface", mName);
-            return OK;
-        }
-        int64_t frameIndex;
-        buffer->meta()->findInt64("frameIndex", &frameIndex);
-        if (output->rotation.count(frameIndex) != 0) {
-            auto it = output->rotation.find(frameIndex);
-            quarters = (it->second / 90) & 3;
-            output->rotation.erase(it);
-        }
+    if (mOutputSurface.lock()->surface == nullptr) {
+        ALOGI("[%s] cannot render buffer without surface", mName);
+        return OK;
+    }
+    int64_t frameIndex;
+    if (buffer->meta()->findInt64("frameIndex", &frameIndex)) {
+        (void)mFrameRotations.take(frameIndex, &quarters);
     }
 
     uint32_t transform = 0;
@@ -1629,6 +1700,7 @@ status_t CCodecBufferChannel::start(
                 .pipelineDelay(pipelineDelayValue)
                 .outputDelay(outputDelayValue)
                 .smoothnessFactor(kSmoothnessFactor)
+                .adaptiveSmoothness(mAdaptivePipelineDepth && !mTunneled)
                 .tunneled(mTunneled);
         watcher->flush();
     }
@@ -1778,6 +1850,7 @@ void CCodecBufferChannel::reset() {
         Mutexed<Output>::Locked output(mOutput);
         output->buffers.reset();
     }
+    mFrameRotations.clear();
     // reset the frames that are being tracked for onFrameRendered callbacks
     mTrackedFrames.clear();
 }
@@ -2430,6 +2503,24 @@ void CCodecBufferChannel::resetBuffersPixelFormat(bool isEncoder) {
     }
 }
 
+sp<AMessage> CCodecBufferChannel::getUpdatedPipelineDepthMetrics() {
+    if (!mAdaptivePipelineDepth) {
+        return nullptr;
+    }
+    PipelineWatcher::AdaptiveStats stats = mPipelineWatcher.lock()->adaptiveStats();
+    if (stats.numGrown == mReportedAdaptiveStats.numGrown
+            && stats.numShrunk == mReportedAdaptiveStats.numShrunk) {
+        return nullptr;
+    }
+    mReportedAdaptiveStats = stats;
+    sp<AMessage> metrics = new AMessage;
+    metrics->setInt32(kCodecPipelineDepth, stats.current);
+    metrics->setInt32(kCodecPipelineDepthMin, stats.min);
+    metrics->setInt32(kCodecPipelineDepthIncreases, stats.numGrown);
+    metrics->setInt32(kCodecPipelineDepthDecreases, stats.numShrunk);
+    return metrics;
+}
+
 status_t toStatusT(c2_status_t c2s, c2_operation_t c2op) {
     // C2_OK is always translated to OK.
     if (c2s == C2_OK) {
@@ -18,9 +18,12 @@
 
 #define CCODEC_BUFFER_CHANNEL_H_
 
+#include <array>
+#include <atomic>
 #include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <C2Buffer.h>
@@ -217,6 +220,14 @@ public:
 
     void resetBuffersPixelFormat(bool isEncoder);
 
+    /**
+     * Get the statistics of the adaptive pipeline depth as metrics.
+     *
+     * @return metrics if the statistics changed since the last call;
+     *         nullptr otherwise.
+     */
+    sp<AMessage> getUpdatedPipelineDepthMetrics();
+
 private:
     uint32_t getInputBuffersPixelFormat();
 
@@ -232,13 +243,17 @@ private:
      *     supposed to return immediately.
      * - At RUNNING state (after start())
      *   - Each QueueGuard object
+     *
+     * QueueGuard objects are created and destroyed on every queue, render and
+     * work-done call, so the guard count is an atomic and guards never take a
+     * lock unless stop() is waiting for them to drain.
      */
     class QueueSync {
     public:
         /**
          * At construction the sync object is in STOPPED state.
          */
-        inline QueueSync() {}
+        inline QueueSync() : mCount(-1) {}
         ~QueueSync() = default;
 
         /**
@@ -255,14 +270,16 @@ private:
         void stop();
 
     private:
+        // Set on |mCount| while stop() waits for running guards to drain.
+        static constexpr int32_t kStopping = 1 << 30;
+
         Mutex mGuardLock;
 
-        struct Counter {
-            inline Counter() : value(-1) {}
-            int32_t value;
-            Condition cond;
-        };
-        Mutexed<Counter> mCount;
+        // -1 at STOPPED state; otherwise the number of running guards,
+        // possibly with kStopping set.
+        std::atomic_int32_t mCount;
+        Mutex mDrainLock;
+        Condition mDrained;
 
         friend class CCodecBufferChannel::QueueGuard;
     };
@@ -278,6 +295,48 @@ private:
         bool mRunning;
     };
 
+    /**
+     * Rotation requested per frame by the client through the "cvo" input
+     * meta. Written on the client thread in queueInputBuffer and consumed on
+     * the render path, so it lives outside of |mOutputSurface| to keep the
+     * queue and render paths from contending on the same lock.
+     *
+     * Each slot is an atomic tagged with the frame index. If a frame maps to
+     * a slot still holding an earlier frame's rotation (more than kNumSlots
+     * frames in flight), the earlier entry moves to a locked overflow map;
+     * entries there are dropped once a later frame is rendered.
+     */
+    class FrameRotations {
+    public:
+        FrameRotations();
+
+        /**
+         * Record |rotation| (in counter-clockwise degrees) for |frameIndex|.
+         */
+        void set(uint64_t frameIndex, int32_t rotation);
+
+        /**
+         * Retrieve and remove the rotation recorded for |frameIndex|.
+         *
+         * \return true iff a rotation was recorded for |frameIndex|.
+         */
+        bool take(uint64_t frameIndex, uint32_t *quarters);
+
+        /**
+         * Discard all recorded rotations.
+         */
+        void clear();
+
+    private:
+        static constexpr size_t kNumSlots = 256;
+        std::array<std::atomic_uint64_t, kNumSlots> mSlots;
+
+        std::mutex mOverflowLock;
+        std::map<uint64_t, uint32_t> mOverflow;  // guarded by mOverflowLock
+        std::atomic_size_t mOverflowSize;
+        bool mLoggedOverflow;  // guarded by mOverflowLock
+    };
+
     struct TrackedFrame {
         uint64_t number;
         int64_t mediaTimeUs;
@@ -358,9 +417,9 @@ private:
         sp<Surface> surface;
         uint32_t generation;
         int maxDequeueBuffers;
-        std::map<uint64_t, int> rotation;
     };
     Mutexed<OutputSurface> mOutputSurface;
+    FrameRotations mFrameRotations;
     int mRenderingDepth;
 
     struct BlockPools {
@@ -377,6 +436,8 @@ private:
     MetaMode mMetaMode;
 
     Mutexed<PipelineWatcher> mPipelineWatcher;
+    bool mAdaptivePipelineDepth;
+    PipelineWatcher::AdaptiveStats mReportedAdaptiveStats;
 
     std::atomic_bool mInputMetEos;
     std::once_flag mRenderWarningFlag;
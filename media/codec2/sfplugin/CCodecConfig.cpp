@@ -962,6 +962,10 @@ void CCodecConfig::initializeStandardParams() {
         .limitTo(D::ENCODER & (D::CONFIG | D::PARAM)));
     add(ConfigMapper(KEY_QUALITY, C2_PARAMKEY_QUALITY, "value")
         .limitTo(D::ENCODER & (D::CONFIG | D::PARAM)));
+    add(ConfigMapper("android._encoding-threads", C2_PARAMKEY_ENCODING_PARALLELISM, "threads")
+        .limitTo(D::VIDEO & D::ENCODER & D::CONFIG));
+    add(ConfigMapper("android._encoding-slices", C2_PARAMKEY_ENCODING_PARALLELISM, "slices")
+        .limitTo(D::VIDEO & D::ENCODER & D::CONFIG));
     add(ConfigMapper(KEY_FLAC_COMPRESSION_LEVEL, C2_PARAMKEY_COMPLEXITY, "value")
         .limitTo(D::AUDIO & D::ENCODER));
     add(ConfigMapper(KEY_COMPLEXITY, C2_PARAMKEY_COMPLEXITY, "value")
@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "PipelineWatcher"
 
+#include <algorithm>
 #include <numeric>
 
 #include <log/log.h>
@@ -25,6 +26,24 @@
 
 namespace android {
 
+namespace {
+
+// Number of completed work items between two shrinking decisions.
+constexpr uint32_t kAdaptationWindow = 60;
+
+// Weight of a new sample in the moving averages, as a shift (1/8).
+constexpr int kAverageShift = 3;
+
+template <typename T>
+T movingAverage(T avg, T sample) {
+    if (avg == T::zero()) {
+        return sample;
+    }
+    return avg + (sample - avg) / (1 << kAverageShift);
+}
+
+}  // namespace
+
 PipelineWatcher &PipelineWatcher::inputDelay(uint32_t value) {
     mInputDelay = value;
     return *this;
@@ -42,6 +61,8 @@ PipelineWatcher &PipelineWatcher::outputDelay(uint32_t value) {
 
 PipelineWatcher &PipelineWatcher::smoothnessFactor(uint32_t value) {
     mSmoothnessFactor = value;
+    mEffectiveSmoothnessFactor = value;
+    mAdaptiveStats = { value, value, 0u, 0u };
     return *this;
 }
 
@@ -50,6 +71,34 @@ PipelineWatcher &PipelineWatcher::tunneled(bool value) {
     return *this;
 }
 
+PipelineWatcher &PipelineWatcher::adaptiveSmoothness(bool value) {
+    mAdaptive = value;
+    if (!mAdaptive) {
+        mEffectiveSmoothnessFactor = mSmoothnessFactor;
+    }
+    return *this;
+}
+
+PipelineWatcher::AdaptiveStats PipelineWatcher::adaptiveStats() const {
+    return mAdaptiveStats;
+}
+
+void PipelineWatcher::adjustSmoothness(uint32_t value) {
+    if (value == mEffectiveSmoothnessFactor) {
+        return;
+    }
+    ALOGV("adjustSmoothness: %u -> %u", mEffectiveSmoothnessFactor, value);
+    if (value > mEffectiveSmoothnessFactor) {
+        ++mAdaptiveStats.numGrown;
+    } else {
+        ++mAdaptiveStats.numShrunk;
+    }
+    mEffectiveSmoothnessFactor = value;
+    mAdaptiveStats.current = value;
+    mAdaptiveStats.min = std::min(mAdaptiveStats.min, value);
+    mFramesSinceAdjustment = 0;
+}
+
 void PipelineWatcher::onWorkQueued(
         uint64_t frameIndex,
         std::vector<std::shared_ptr<C2Buffer>> &&buffers,
@@ -64,6 +113,19 @@ void PipelineWatcher::onWorkQueued(
               (unsigned long long)frameIndex);
         (void)mFramesInPipeline.erase(it);
     }
+    if (mAdaptive) {
+        if (mLastQueuedAt != Clock::time_point()) {
+            mAvgQueueInterval = movingAverage(mAvgQueueInterval, queuedAt - mLastQueuedAt);
+        }
+        mLastQueuedAt = queuedAt;
+        // The component drained everything while we were holding back input:
+        // the current depth is too shallow.
+        if (mFramesInPipeline.empty() && mInputGated
+                && mEffectiveSmoothnessFactor < mSmoothnessFactor) {
+            adjustSmoothness(mEffectiveSmoothnessFactor + 1);
+        }
+        mInputGated = false;
+    }
     (void)mFramesInPipeline.try_emplace(frameIndex, std::move(buffers), queuedAt);
 }
 
@@ -88,7 +150,7 @@ std::shared_ptr<C2Buffer> PipelineWatcher::onInputBufferReleased(
     return buffer;
 }
 
-void PipelineWatcher::onWorkDone(uint64_t frameIndex) {
+void PipelineWatcher::onWorkDone(uint64_t frameIndex, const Clock::time_point &doneAt) {
     ALOGV("onWorkDone(frameIndex=%llu)", (unsigned long long)frameIndex);
     auto it = mFramesInPipeline.find(frameIndex);
     if (it == mFramesInPipeline.end()) {
@@ -101,18 +163,40 @@ void PipelineWatcher::onWorkDone(uint64_t frameIndex) {
         }
         return;
     }
+    if (mAdaptive) {
+        mAvgLatency = movingAverage(
+                mAvgLatency, std::max(doneAt - it->second.queuedAt, Clock::duration::zero()));
+        if (++mFramesSinceAdjustment >= kAdaptationWindow
+                && mAvgQueueInterval > Clock::duration::zero()) {
+            // Number of work items needed in flight to sustain the observed
+            // input cadence, beyond what the component itself declares.
+            uint32_t needed = uint32_t(
+                    (mAvgLatency + mAvgQueueInterval - Clock::duration(1)) / mAvgQueueInterval);
+            uint32_t declared = mInputDelay + mPipelineDelay + mOutputDelay;
+            uint32_t target = needed > declared ? needed - declared : 0u;
+            target = std::clamp(target + 1, 1u, mSmoothnessFactor);
+            if (target < mEffectiveSmoothnessFactor) {
+                adjustSmoothness(mEffectiveSmoothnessFactor - 1);
+            } else {
+                mFramesSinceAdjustment = 0;
+            }
+        }
+    }
     (void)mFramesInPipeline.erase(it);
 }
 
 void PipelineWatcher::flush() {
     ALOGV("flush");
     mFramesInPipeline.clear();
+    mInputGated = false;
+    mLastQueuedAt = Clock::time_point();
 }
 
 bool PipelineWatcher::pipelineFull() const {
     if (mFramesInPipeline.size() >=
-            mInputDelay + mPipelineDelay + mOutputDelay + mSmoothnessFactor) {
+            mInputDelay + mPipelineDelay + mOutputDelay + mEffectiveSmoothnessFactor) {
         ALOGV("pipelineFull: too many frames in pipeline (%zu)", mFramesInPipeline.size());
+        mInputGated = true;
         return true;
     }
     size_t sizeWithInputReleased = std::count_if(
@@ -127,16 +211,18 @@ bool PipelineWatcher::pipelineFull() const {
                 return true;
             });
     if (sizeWithInputReleased >=
-            mPipelineDelay + mOutputDelay + mSmoothnessFactor) {
+            mPipelineDelay + mOutputDelay + mEffectiveSmoothnessFactor) {
         ALOGV("pipelineFull: too many frames in pipeline, with input released (%zu)",
               sizeWithInputReleased);
+        mInputGated = true;
         return true;
     }
 
     size_t sizeWithInputsPending = mFramesInPipeline.size() - sizeWithInputReleased;
-    if (sizeWithInputsPending > mPipelineDelay + mInputDelay + mSmoothnessFactor) {
+    if (sizeWithInputsPending > mPipelineDelay + mInputDelay + mEffectiveSmoothnessFactor) {
         ALOGV("pipelineFull: too many inputs pending (%zu) in pipeline, with inputs released (%zu)",
               sizeWithInputsPending, sizeWithInputReleased);
+        mInputGated = true;
         return true;
     }
     ALOGV("pipeline has room (total: %zu, input released: %zu)",
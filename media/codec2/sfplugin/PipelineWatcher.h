@@ -38,7 +38,14 @@ public:
           mPipelineDelay(0),
           mOutputDelay(0),
           mSmoothnessFactor(0),
-          mTunneled(false) {}
+          mTunneled(false),
+          mAdaptive(false),
+          mEffectiveSmoothnessFactor(0),
+          mInputGated(false),
+          mFramesSinceAdjustment(0),
+          mAvgLatency(Clock::duration::zero()),
+          mAvgQueueInterval(Clock::duration::zero()),
+          mAdaptiveStats{0u, 0u, 0u, 0u} {}
     ~PipelineWatcher() = default;
 
     /**
@@ -71,6 +78,33 @@ public:
      */
     PipelineWatcher &tunneled(bool value);
 
+    /**
+     * Enable or disable adaptive smoothness. When enabled, the number of extra
+     * work items allowed in the pipeline starts at the smoothness factor and
+     * is shrunk while observed latency shows the extra depth is not needed,
+     * and grown back (up to the smoothness factor) whenever gating input has
+     * starved the component.
+     *
+     * \param value true to enable adaptive smoothness
+     * \return  this object
+     */
+    PipelineWatcher &adaptiveSmoothness(bool value);
+
+    /**
+     * Statistics of the adaptive smoothness controller.
+     */
+    struct AdaptiveStats {
+        uint32_t current;   ///< current effective smoothness factor
+        uint32_t min;       ///< lowest effective smoothness factor reached
+        uint32_t numGrown;  ///< number of times the factor was increased
+        uint32_t numShrunk; ///< number of times the factor was decreased
+    };
+
+    /**
+     * \return  current statistics of the adaptive smoothness controller.
+     */
+    AdaptiveStats adaptiveStats() const;
+
     /**
      * Client queued a work item to the component.
      *
@@ -98,8 +132,9 @@ public:
      * The component finished processing a work item.
      *
      * \param frameIndex  input frame index
+     * \param doneAt      time when the work item was done
      */
-    void onWorkDone(uint64_t frameIndex);
+    void onWorkDone(uint64_t frameIndex, const Clock::time_point &doneAt = Clock::now());
 
     /**
      * Flush the pipeline.
@@ -131,6 +166,20 @@ private:
     uint32_t mSmoothnessFactor;
     bool mTunneled;
 
+    // adaptive smoothness
+    bool mAdaptive;
+    uint32_t mEffectiveSmoothnessFactor;
+    // true if pipelineFull() held back input since the last queued work
+    mutable bool mInputGated;
+    uint32_t mFramesSinceAdjustment;
+    Clock::time_point mLastQueuedAt;
+    // moving averages of work latency and the interval between queued works
+    Clock::duration mAvgLatency;
+    Clock::duration mAvgQueueInterval;
+    AdaptiveStats mAdaptiveStats;
+
+    void adjustSmoothness(uint32_t value);
+
     struct Frame {
         Frame(std::vector<std::shared_ptr<C2Buffer>> &&b,
               const Clock::time_point &q)
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <chrono>
 
 #include <binder/ProcessState.h>
 #include <gtest/gtest.h>
@@ -450,4 +451,59 @@ INSTANTIATE_TEST_CASE_P(InputSizes, MediaCodecByteBufferTest, ::testing::Values(
         COLOR_FormatYUV420PackedSemiPlanar,
         COLOR_FormatYUV420Flexible));
 
+// Streams many tiny buffers through the raw audio decoder at a synthetic 240fps
+// cadence and checks that the per-buffer overhead of the CCodec buffer channel
+// itself, as the decoder does no real work, stays well within a frame period.
+TEST_F(MediaCodecSanityTest, TestHighFrameRatePerBufferOverhead) {
+    constexpr size_t kNumFrames = 2400;
+    constexpr int64_t kFrameDurationUs = 1000000 / 240;
+    constexpr size_t kFrameSize = 16;
+
+    codec = MediaCodec::CreateByComponentName(looper, "c2.android.raw.decoder");
+    ASSERT_NE(codec, nullptr);
+    cfg->setInt32("sample-rate", 48000);
+    cfg->setInt32("channel-count", 2);
+    cfg->setString("mime", MIMETYPE_AUDIO_RAW);
+
+    ASSERT_EQ(codec->configure(cfg, nullptr, nullptr, 0), OK);
+    ASSERT_EQ(codec->start(), OK);
+
+    size_t queued = 0;
+    size_t dequeued = 0;
+    bool sawOutputEos = false;
+    auto start = std::chrono::steady_clock::now();
+    while (!sawOutputEos) {
+        size_t ix;
+        sp<MediaCodecBuffer> buf;
+        if (queued < kNumFrames && codec->dequeueInputBuffer(&ix, 0) == OK) {
+            ASSERT_EQ(codec->getInputBuffer(ix, &buf), OK);
+            ASSERT_GE(buf->capacity(), kFrameSize);
+            memset(buf->base(), 0, kFrameSize);
+            ++queued;
+            bool eos = queued == kNumFrames;
+            ASSERT_EQ(codec->queueInputBuffer(ix, 0, kFrameSize, queued * kFrameDurationUs,
+                                              eos ? BUFFER_FLAG_END_OF_STREAM : 0), OK);
+        }
+        size_t offset, size;
+        int64_t ts;
+        uint32_t flags;
+        status_t err = codec->dequeueOutputBuffer(&ix, &offset, &size, &ts, &flags,
+                                                  queued < kNumFrames ? 0 : 1000000);
+        if (err == OK) {
+            ++dequeued;
+            sawOutputEos = (flags & BUFFER_FLAG_END_OF_STREAM) != 0;
+            ASSERT_EQ(codec->releaseOutputBuffer(ix), OK);
+        } else if (err != -EAGAIN
+                && err != INFO_FORMAT_CHANGED && err != INFO_OUTPUT_BUFFERS_CHANGED) {
+            FAIL() << "dequeueOutputBuffer failed: " << err;
+        }
+    }
+    auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    EXPECT_GE(dequeued, kNumFrames - 1);
+    // A round trip must leave most of the frame period to the codec itself.
+    EXPECT_LT(elapsedUs / (int64_t)queued, kFrameDurationUs / 4)
+            << queued << " buffers in " << elapsedUs << " us";
+}
+
 } // namespace android
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PipelineWatcher.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+using namespace std::chrono_literals;
+
+class PipelineWatcherTest : public ::testing::Test {
+public:
+    PipelineWatcherTest() : mBase(PipelineWatcher::Clock::now()) {
+        mWatcher.inputDelay(0).pipelineDelay(0).outputDelay(0)
+                .smoothnessFactor(4).adaptiveSmoothness(true);
+    }
+
+protected:
+    // Queue and complete |count| frames at the given cadence and latency.
+    void runFrames(size_t count,
+                   PipelineWatcher::Clock::duration interval,
+                   PipelineWatcher::Clock::duration latency) {
+        for (size_t i = 0; i < count; ++i) {
+            mWatcher.onWorkQueued(mFrameIndex, {}, mBase);
+            mWatcher.onWorkDone(mFrameIndex, mBase + latency);
+            ++mFrameIndex;
+            mBase += interval;
+        }
+    }
+
+    PipelineWatcher mWatcher;
+    PipelineWatcher::Clock::time_point mBase;
+    uint64_t mFrameIndex = 0;
+};
+
+TEST_F(PipelineWatcherTest, NotAdaptiveKeepsSmoothnessFactor) {
+    mWatcher.adaptiveSmoothness(false);
+    runFrames(300, 10ms, 1ms);
+    PipelineWatcher::AdaptiveStats stats = mWatcher.adaptiveStats();
+    EXPECT_EQ(4u, stats.current);
+    EXPECT_EQ(0u, stats.numShrunk);
+}
+
+TEST_F(PipelineWatcherTest, ShrinksWhenLatencyIsLow) {
+    runFrames(300, 10ms, 1ms);
+    PipelineWatcher::AdaptiveStats stats = mWatcher.adaptiveStats();
+    // One frame is needed to keep up with the cadence, plus one extra.
+    EXPECT_EQ(2u, stats.current);
+    EXPECT_EQ(2u, stats.min);
+    EXPECT_EQ(2u, stats.numShrunk);
+    EXPECT_EQ(0u, stats.numGrown);
+}
+
+TEST_F(PipelineWatcherTest, KeepsDepthWhenLatencyIsHigh) {
+    runFrames(300, 10ms, 35ms);
+    PipelineWatcher::AdaptiveStats stats = mWatcher.adaptiveStats();
+    EXPECT_EQ(4u, stats.current);
+    EXPECT_EQ(0u, stats.numShrunk);
+}
+
+TEST_F(PipelineWatcherTest, GrowsWhenGatingStarvesComponent) {
+    runFrames(300, 10ms, 1ms);
+    ASSERT_EQ(2u, mWatcher.adaptiveStats().current);
+
+    mWatcher.onWorkQueued(mFrameIndex, {}, mBase);
+    mWatcher.onWorkQueued(mFrameIndex + 1, {}, mBase);
+    EXPECT_TRUE(mWatcher.pipelineFull());
+    mWatcher.onWorkDone(mFrameIndex, mBase + 1ms);
+    mWatcher.onWorkDone(mFrameIndex + 1, mBase + 1ms);
+    mFrameIndex += 2;
+
+    // The component went idle while input was held back.
+    mWatcher.onWorkQueued(mFrameIndex, {}, mBase + 10ms);
+    PipelineWatcher::AdaptiveStats stats = mWatcher.adaptiveStats();
+    EXPECT_EQ(3u, stats.current);
+    EXPECT_EQ(1u, stats.numGrown);
+}
+
+} // namespace android
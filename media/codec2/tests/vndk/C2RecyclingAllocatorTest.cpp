@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <C2Buffer.h>
+#include <C2PlatformSupport.h>
+#include <C2RecyclingAllocator.h>
+
+namespace android {
+
+namespace {
+
+const C2MemoryUsage kUsage(C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE);
+
+}  // namespace
+
+// The BLOB (gralloc) allocator stands in for ion/DMA-BUF heaps, which may not be accessible to
+// the test process.
+class C2RecyclingAllocatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::shared_ptr<C2AllocatorStore> store = GetCodec2PlatformAllocatorStore();
+        ASSERT_EQ(C2_OK, store->fetchAllocator(C2PlatformAllocatorStore::BLOB, &mBackingAllocator));
+        ASSERT_NE(nullptr, mBackingAllocator);
+    }
+
+    std::shared_ptr<C2Allocator> mBackingAllocator;
+};
+
+TEST(C2RecyclingAllocatorSizeClassTest, SizeClass) {
+    EXPECT_EQ(4096u, C2RecyclingLinearAllocator::SizeClass(0));
+    EXPECT_EQ(4096u, C2RecyclingLinearAllocator::SizeClass(1));
+    EXPECT_EQ(4096u, C2RecyclingLinearAllocator::SizeClass(4096));
+    EXPECT_EQ(5120u, C2RecyclingLinearAllocator::SizeClass(4097));
+    EXPECT_EQ(8192u, C2RecyclingLinearAllocator::SizeClass(8192));
+    EXPECT_EQ(10240u, C2RecyclingLinearAllocator::SizeClass(8193));
+    EXPECT_EQ(0x180000u, C2RecyclingLinearAllocator::SizeClass(0x17ffff));
+    // rounding of large allocations is capped at 64 KiB
+    EXPECT_EQ(0x810000u, C2RecyclingLinearAllocator::SizeClass(0x800001));
+    for (uint32_t capacity = 1; capacity < (1u << 24); capacity = capacity * 3 / 2 + 1) {
+        uint32_t sizeClass = C2RecyclingLinearAllocator::SizeClass(capacity);
+        EXPECT_GE(sizeClass, capacity);
+        EXPECT_LE(sizeClass, std::max(capacity + std::min(capacity / 4, 65536u), 4096u));
+        EXPECT_EQ(sizeClass, C2RecyclingLinearAllocator::SizeClass(sizeClass));
+    }
+}
+
+TEST_F(C2RecyclingAllocatorTest, ReusesReleasedAllocations) {
+    C2RecyclingLinearAllocator allocator(mBackingAllocator, 1 << 20);
+    EXPECT_EQ(mBackingAllocator->getId(), allocator.getId());
+
+    std::shared_ptr<C2LinearAllocation> allocation;
+    ASSERT_EQ(C2_OK, allocator.newLinearAllocation(5000, kUsage, &allocation));
+    ASSERT_NE(nullptr, allocation);
+    EXPECT_GE(allocation->capacity(), 5000u);
+    const C2LinearAllocation *first = allocation.get();
+    allocation.reset();
+
+    C2RecyclingLinearAllocator::Stats stats = allocator.getStats();
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.cachedCount);
+    EXPECT_EQ(5120u, stats.cachedBytes);
+
+    // same size class
+    ASSERT_EQ(C2_OK, allocator.newLinearAllocation(5100, kUsage, &allocation));
+    EXPECT_EQ(first, allocation.get());
+
+    // different size class
+    std::shared_ptr<C2LinearAllocation> other;
+    ASSERT_EQ(C2_OK, allocator.newLinearAllocation(4000, kUsage, &other));
+    EXPECT_NE(first, other.get());
+
+    stats = allocator.getStats();
+    EXPECT_EQ(3u, stats.allocations);
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(0u, stats.cachedCount);
+    EXPECT_EQ(0u, stats.cachedBytes);
+
+    // recycled allocations remain usable
+    void *addr = nullptr;
+    ASSERT_EQ(C2_OK, allocation->map(0, 5100, kUsage, nullptr, &addr));
+    ASSERT_NE(nullptr, addr);
+    memset(addr, 0x5a, 5100);
+    ASSERT_EQ(C2_OK, allocation->unmap(addr, 5100, nullptr));
+}
+
+TEST_F(C2RecyclingAllocatorTest, EvictsLeastRecentlyReleased) {
+    C2RecyclingLinearAllocator allocator(mBackingAllocator, 3 * 4096);
+
+    std::vector<std::shared_ptr<C2LinearAllocation>> allocations(4);
+    std::vector<const C2LinearAllocation *> raw;
+    for (std::shared_ptr<C2LinearAllocation> &allocation : allocations) {
+        ASSERT_EQ(C2_OK, allocator.newLinearAllocation(4096, kUsage, &allocation));
+        raw.push_back(allocation.get());
+    }
+    // release in index order; raw[0] is the one evicted
+    for (std::shared_ptr<C2LinearAllocation> &allocation : allocations) {
+        allocation.reset();
+    }
+
+    C2RecyclingLinearAllocator::Stats stats = allocator.getStats();
+    EXPECT_EQ(3u, stats.cachedCount);
+    EXPECT_EQ(3 * 4096u, stats.cachedBytes);
+    EXPECT_EQ(1u, stats.evictions);
+
+    // most recently released allocation is handed out first
+    std::shared_ptr<C2LinearAllocation> allocation;
+    ASSERT_EQ(C2_OK, allocator.newLinearAllocation(4096, kUsage, &allocation));
+    EXPECT_EQ(raw.back(), allocation.get());
+    allocation.reset();
+
+    EXPECT_EQ(2 * 4096u, allocator.trim(4096));
+    stats = allocator.getStats();
+    EXPECT_EQ(1u, stats.cachedCount);
+    EXPECT_EQ(3u, stats.evictions);
+
+    EXPECT_EQ(4096u, allocator.trim());
+    EXPECT_EQ(0u, allocator.getStats().cachedBytes);
+
+    // allocations larger than the cache are not kept
+    ASSERT_EQ(C2_OK, allocator.newLinearAllocation(4 * 4096, kUsage, &allocation));
+    allocation.reset();
+    EXPECT_EQ(0u, allocator.getStats().cachedBytes);
+    EXPECT_FALSE(allocator.dump().empty());
+}
+
+TEST_F(C2RecyclingAllocatorTest, AllocationsOutliveAllocator) {
+    std::shared_ptr<C2LinearAllocation> allocation;
+    {
+        C2RecyclingLinearAllocator allocator(mBackingAllocator, 1 << 20);
+        ASSERT_EQ(C2_OK, allocator.newLinearAllocation(4096, kUsage, &allocation));
+    }
+    EXPECT_GE(allocation->capacity(), 4096u);
+    allocation.reset();
+}
+
+} // namespace android
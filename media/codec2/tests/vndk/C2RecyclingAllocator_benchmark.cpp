@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <C2Buffer.h>
+#include <C2PlatformSupport.h>
+#include <C2RecyclingAllocator.h>
+
+using namespace android;
+
+namespace {
+
+constexpr int kInFlight = 8;
+
+const C2MemoryUsage kUsage(C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE);
+
+// Returns the resident set size of this process in KiB, or 0 if unknown.
+size_t getRssKb() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    if (!(statm >> size >> resident)) {
+        return 0;
+    }
+    return resident * (getpagesize() / 1024);
+}
+
+// The BLOB (gralloc) allocator stands in for ion/DMA-BUF heaps, which may not be accessible to
+// the benchmark process.
+std::shared_ptr<C2Allocator> getBackingAllocator() {
+    std::shared_ptr<C2Allocator> allocator;
+    GetCodec2PlatformAllocatorStore()->fetchAllocator(C2PlatformAllocatorStore::BLOB, &allocator);
+    return allocator;
+}
+
+// Allocates with |kInFlight| allocations outstanding, as a component cycling through its output
+// buffers would.
+void runAllocations(benchmark::State& state, C2Allocator *allocator) {
+    uint32_t capacity = state.range(0);
+    std::vector<std::shared_ptr<C2LinearAllocation>> inFlight(kInFlight);
+    size_t rssBefore = getRssKb();
+    size_t i = 0;
+    for (auto _ : state) {
+        std::shared_ptr<C2LinearAllocation> &allocation = inFlight[i++ % kInFlight];
+        allocation.reset();
+        if (allocator->newLinearAllocation(capacity, kUsage, &allocation) != C2_OK) {
+            state.SkipWithError("allocation failed");
+            break;
+        }
+    }
+    state.counters["rss_delta_kb"] = (double)getRssKb() - rssBefore;
+}
+
+}  // namespace
+
+static void BM_Allocate(benchmark::State& state) {
+    std::shared_ptr<C2Allocator> allocator = getBackingAllocator();
+    if (allocator == nullptr) {
+        state.SkipWithError("no BLOB allocator");
+        return;
+    }
+    runAllocations(state, allocator.get());
+}
+
+static void BM_AllocateRecycling(benchmark::State& state) {
+    std::shared_ptr<C2Allocator> backing = getBackingAllocator();
+    if (backing == nullptr) {
+        state.SkipWithError("no BLOB allocator");
+        return;
+    }
+    C2RecyclingLinearAllocator allocator(backing, 2 * kInFlight * state.range(0));
+    runAllocations(state, &allocator);
+    C2RecyclingLinearAllocator::Stats stats = allocator.getStats();
+    state.counters["hit_ratio"] = stats.allocations ? (double)stats.hits / stats.allocations : 0;
+}
+
+BENCHMARK(BM_Allocate)->Arg(4096)->Arg(65536)->Arg(1 << 20);
+BENCHMARK(BM_AllocateRecycling)->Arg(4096)->Arg(65536)->Arg(1 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "C2RecyclingAllocator"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <C2RecyclingAllocator.h>
+
+#include <android-base/stringprintf.h>
+#include <utils/Log.h>
+
+namespace android {
+
+namespace {
+
+constexpr uint32_t kMinSizeClass = 4096;
+// Bounds the rounding waste of large allocations, e.g. 4K frames, at the cost of more classes.
+constexpr uint64_t kMaxSizeClassStep = 65536;
+
+}  // namespace
+
+struct C2RecyclingLinearAllocator::Cache {
+    // (usage, size class)
+    typedef std::pair<uint64_t, uint32_t> Key;
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<C2LinearAllocation> allocation;
+    };
+
+    explicit Cache(size_t maxBytes) : mMaxBytes(maxBytes) {}
+
+    /**
+     * Takes the most recently released allocation for |key| out of the cache.
+     */
+    std::shared_ptr<C2LinearAllocation> take(const Key &key) {
+        std::lock_guard<std::mutex> lock(mLock);
+        ++mStats.allocations;
+        auto it = mFree.find(key);
+        if (it == mFree.end() || it->second.empty()) {
+            ++mStats.misses;
+            return nullptr;
+        }
+        std::list<Entry>::iterator entry = it->second.back();
+        it->second.pop_back();
+        std::shared_ptr<C2LinearAllocation> allocation = std::move(entry->allocation);
+        mLru.erase(entry);
+        mStats.cachedBytes -= key.second;
+        --mStats.cachedCount;
+        ++mStats.hits;
+        return allocation;
+    }
+
+    /**
+     * Records an allocation that was not served from the cache as failed.
+     */
+    void onAllocationFailed() {
+        std::lock_guard<std::mutex> lock(mLock);
+        --mStats.allocations;
+    }
+
+    /**
+     * Returns a released allocation to the cache, evicting the least recently used allocations
+     * if the cache would grow beyond its limit.
+     */
+    void put(const Key &key, std::shared_ptr<C2LinearAllocation> allocation) {
+        std::vector<std::shared_ptr<C2LinearAllocation>> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (key.second > mMaxBytes) {
+                ++mStats.evictions;
+                evicted.push_back(std::move(allocation));
+            } else {
+                evict_l(mMaxBytes - key.second, &evicted);
+                mLru.push_front({key, std::move(allocation)});
+                mFree[key].push_back(mLru.begin());
+                mStats.cachedBytes += key.second;
+                ++mStats.cachedCount;
+            }
+        }
+        // backing allocations are freed outside of the lock
+    }
+
+    size_t trim(size_t targetBytes) {
+        std::vector<std::shared_ptr<C2LinearAllocation>> evicted;
+        size_t released;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            released = evict_l(targetBytes, &evicted);
+        }
+        return released;
+    }
+
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(mLock);
+        Stats stats = mStats;
+        stats.maxCachedBytes = mMaxBytes;
+        return stats;
+    }
+
+private:
+    size_t evict_l(size_t targetBytes, std::vector<std::shared_ptr<C2LinearAllocation>> *evicted) {
+        size_t released = 0;
+        while (mStats.cachedBytes > targetBytes && !mLru.empty()) {
+            Entry &entry = mLru.back();
+            std::vector<std::list<Entry>::iterator> &free = mFree[entry.key];
+            // the least recently released entry of a key is the first one of its free list
+            free.erase(free.begin());
+            if (free.empty()) {
+                mFree.erase(entry.key);
+            }
+            released += entry.key.second;
+            mStats.cachedBytes -= entry.key.second;
+            --mStats.cachedCount;
+            ++mStats.evictions;
+            evicted->push_back(std::move(entry.allocation));
+            mLru.pop_back();
+        }
+        return released;
+    }
+
+    mutable std::mutex mLock;
+    const size_t mMaxBytes;
+    // released allocations, most recently released first
+    std::list<Entry> mLru;
+    // released allocations by key, most recently released last
+    std::map<Key, std::vector<std::list<Entry>::iterator>> mFree;
+    Stats mStats{};
+};
+
+C2RecyclingLinearAllocator::C2RecyclingLinearAllocator(
+        const std::shared_ptr<C2Allocator> &allocator, size_t maxCachedBytes)
+    : mAllocator(allocator),
+      mCache(std::make_shared<Cache>(maxCachedBytes)) {
+}
+
+C2RecyclingLinearAllocator::~C2RecyclingLinearAllocator() {
+    trim(0);
+}
+
+C2Allocator::id_t C2RecyclingLinearAllocator::getId() const {
+    return mAllocator->getId();
+}
+
+C2String C2RecyclingLinearAllocator::getName() const {
+    return mAllocator->getName();
+}
+
+std::shared_ptr<const C2Allocator::Traits> C2RecyclingLinearAllocator::getTraits() const {
+    return mAllocator->getTraits();
+}
+
+bool C2RecyclingLinearAllocator::checkHandle(const C2Handle* const o) const {
+    return mAllocator->checkHandle(o);
+}
+
+// static
+uint32_t C2RecyclingLinearAllocator::SizeClass(uint32_t capacity) {
+    if (capacity <= kMinSizeClass) {
+        return kMinSizeClass;
+    }
+    // use 4 classes per power of 2 to keep the overhead at or below 25%, and at most 64 KiB
+    uint64_t size = capacity;
+    int msb = 63 - __builtin_clzll(size - 1);
+    uint64_t step = std::min<uint64_t>(1ull << (msb - 2), kMaxSizeClassStep);
+    size = (size + step - 1) & ~(step - 1);
+    return size > UINT32_MAX ? capacity : size;
+}
+
+c2_status_t C2RecyclingLinearAllocator::newLinearAllocation(
+        uint32_t capacity, C2MemoryUsage usage,
+        std::shared_ptr<C2LinearAllocation> *allocation) {
+    if (allocation == nullptr) {
+        return C2_BAD_VALUE;
+    }
+    allocation->reset();
+
+    const Cache::Key key{usage.expected, SizeClass(capacity)};
+    std::shared_ptr<C2LinearAllocation> backing = mCache->take(key);
+    if (!backing) {
+        c2_status_t err = mAllocator->newLinearAllocation(key.second, usage, &backing);
+        if (err == C2_NO_MEMORY) {
+            size_t released = mCache->trim(0);
+            if (released > 0) {
+                ALOGD("allocation of %u bytes failed; released %zu cached bytes and retrying",
+                      key.second, released);
+                err = mAllocator->newLinearAllocation(key.second, usage, &backing);
+            }
+        }
+        if (err != C2_OK) {
+            mCache->onAllocationFailed();
+            return err;
+        }
+    }
+
+    // Hand out the backing allocation itself so that its handle and mapping behavior are
+    // unchanged. The deleter owns a reference to the backing allocation that is moved back into
+    // the cache once the last user releases it.
+    C2LinearAllocation *raw = backing.get();
+    std::weak_ptr<Cache> weakCache = mCache;
+    *allocation = std::shared_ptr<C2LinearAllocation>(
+            raw,
+            [weakCache, key, backing = std::move(backing)](C2LinearAllocation *) mutable {
+                std::shared_ptr<Cache> cache = weakCache.lock();
+                if (cache) {
+                    cache->put(key, std::move(backing));
+                }
+                backing.reset();
+            });
+    return C2_OK;
+}
+
+c2_status_t C2RecyclingLinearAllocator::priorLinearAllocation(
+        const C2Handle *handle,
+        std::shared_ptr<C2LinearAllocation> *allocation) {
+    // imported allocations are owned by their originator and are never recycled
+    return mAllocator->priorLinearAllocation(handle, allocation);
+}
+
+size_t C2RecyclingLinearAllocator::trim(size_t targetBytes) {
+    return mCache->trim(targetBytes);
+}
+
+C2RecyclingLinearAllocator::Stats C2RecyclingLinearAllocator::getStats() const {
+    return mCache->getStats();
+}
+
+std::string C2RecyclingLinearAllocator::dump() const {
+    Stats stats = getStats();
+    return base::StringPrintf(
+            "%s (recycling): allocations=%llu hits=%llu misses=%llu evictions=%llu "
+            "cached=%zu (%zu/%zu bytes)",
+            getName().c_str(),
+            (unsigned long long)stats.allocations, (unsigned long long)stats.hits,
+            (unsigned long long)stats.misses, (unsigned long long)stats.evictions,
+            stats.cachedCount, stats.cachedBytes, stats.maxCachedBytes);
+}
+
+} // namespace android
@@ -29,6 +29,7 @@
 #include <C2IgbaBufferPriv.h>
 #include <C2PlatformStorePluginLoader.h>
 #include <C2PlatformSupport.h>
+#include <C2RecyclingAllocator.h>
 #include <codec2/common/HalSelection.h>
 #include <cutils/properties.h>
 #include <util/C2InterfaceHelper.h>
@@ -38,6 +39,7 @@
 #include <dlfcn.h>
 #include <unistd.h> // getpagesize
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -89,6 +91,11 @@ private:
     std::shared_ptr<C2Allocator> fetchIonAllocator();
     std::shared_ptr<C2Allocator> fetchDmaBufAllocator();
 
+    /// returns a shared-singleton recycling wrapper of the ion/dmabuf allocator if enabled,
+    /// or |allocator| otherwise
+    std::shared_ptr<C2Allocator> fetchRecyclingLinearAllocator(
+            const std::shared_ptr<C2Allocator> &allocator);
+
     /// returns a shared-singleton gralloc allocator
     std::shared_ptr<C2Allocator> fetchGrallocAllocator();
 
@@ -149,6 +156,7 @@ c2_status_t C2PlatformAllocatorStoreImpl::fetchAllocator(
             *allocator = fetchIonAllocator();
         else
             *allocator = fetchDmaBufAllocator();
+        *allocator = fetchRecyclingLinearAllocator(*allocator);
         break;
 
     case C2PlatformAllocatorStore::GRALLOC:
@@ -187,8 +195,10 @@ namespace {
 
 std::mutex gIonAllocatorMutex;
 std::mutex gDmaBufAllocatorMutex;
+std::mutex gRecyclingLinearAllocatorMutex;
 std::weak_ptr<C2AllocatorIon> gIonAllocator;
 std::weak_ptr<C2DmaBufAllocator> gDmaBufAllocator;
+std::weak_ptr<C2RecyclingLinearAllocator> gRecyclingLinearAllocator;
 
 void UseComponentStoreForIonAllocator(
         const std::shared_ptr<C2AllocatorIon> allocator,
@@ -362,6 +372,42 @@ std::shared_ptr<C2Allocator> C2PlatformAllocatorStoreImpl::fetchDmaBufAllocator(
     return allocator;
 }
 
+std::shared_ptr<C2Allocator> C2PlatformAllocatorStoreImpl::fetchRecyclingLinearAllocator(
+        const std::shared_ptr<C2Allocator> &allocator) {
+    // Recycled buffers are not cleared and may still be mapped by their previous (remote) user,
+    // so this is opt-in.
+    static const size_t kMaxCachedBytes =
+            std::max(property_get_int32("debug.c2.recycle_linear_max_kb", 0), 0) * 1024ull;
+    if (kMaxCachedBytes == 0 || allocator == nullptr) {
+        return allocator;
+    }
+    std::lock_guard<std::mutex> lock(gRecyclingLinearAllocatorMutex);
+    std::shared_ptr<C2RecyclingLinearAllocator> recycling = gRecyclingLinearAllocator.lock();
+    if (recycling == nullptr) {
+        recycling = std::make_shared<C2RecyclingLinearAllocator>(allocator, kMaxCachedBytes);
+        gRecyclingLinearAllocator = recycling;
+    }
+    return recycling;
+}
+
+std::string DumpCodec2PlatformLinearAllocator() {
+    std::shared_ptr<C2RecyclingLinearAllocator> recycling;
+    {
+        std::lock_guard<std::mutex> lock(gRecyclingLinearAllocatorMutex);
+        recycling = gRecyclingLinearAllocator.lock();
+    }
+    return recycling ? recycling->dump() : std::string();
+}
+
+size_t TrimCodec2PlatformLinearAllocator() {
+    std::shared_ptr<C2RecyclingLinearAllocator> recycling;
+    {
+        std::lock_guard<std::mutex> lock(gRecyclingLinearAllocatorMutex);
+        recycling = gRecyclingLinearAllocator.lock();
+    }
+    return recycling ? recycling->trim(0) : 0;
+}
+
 std::shared_ptr<C2Allocator> C2PlatformAllocatorStoreImpl::fetchBlobAllocator() {
     static std::mutex mutex;
     static std::weak_ptr<C2Allocator> blobAllocator;
@@ -21,6 +21,7 @@
 #include <C2ComponentFactory.h>
 
 #include <memory>
+#include <string>
 
 #include <android-base/unique_fd.h>
 
@@ -253,6 +254,22 @@ int GetCodec2PoolMask();
  */
 C2PlatformAllocatorStore::id_t GetPreferredLinearAllocatorId(int poolMask);
 
+/**
+ * Returns a summary of the allocation counters of the platform linear allocator if recycling of
+ * linear allocations is enabled via property "debug.c2.recycle_linear_max_kb".
+ * \retval empty string if recycling is disabled or the allocator is not in use
+ */
+std::string DumpCodec2PlatformLinearAllocator();
+
+/**
+ * Releases cached linear allocations of the platform linear allocator. The component stores call
+ * this when their last component is released; it may also be called under memory pressure. This
+ * is a no-op if recycling of linear allocations is disabled.
+ *
+ * \return the number of bytes released
+ */
+size_t TrimCodec2PlatformLinearAllocator();
+
 } // namespace android
 
 #endif // STAGEFRIGHT_CODEC2_PLATFORM_SUPPORT_H_
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STAGEFRIGHT_CODEC2_RECYCLING_ALLOCATOR_H_
+#define STAGEFRIGHT_CODEC2_RECYCLING_ALLOCATOR_H_
+
+#include <memory>
+#include <string>
+
+#include <C2Buffer.h>
+
+namespace android {
+
+/**
+ * Linear allocator that keeps released allocations of a backing linear allocator (e.g. ion or
+ * DMA-BUF heaps) in a cache and hands them out again for subsequent allocations of the same size
+ * class and usage, saving the kernel allocation, zeroing and fd setup on the hot path.
+ *
+ * Requested capacities are rounded up to size classes (4 KiB minimum) with an overhead of at most
+ * 25% or 64 KiB, whichever is less, so allocations returned by this allocator may be larger than
+ * requested. The rounding applies whether or not the allocation is served from the cache. The cache is bounded by a
+ * maximum number of cached bytes; least recently released allocations are evicted first. All
+ * cached allocations are also dropped (and the allocation retried) when the backing allocator
+ * fails to allocate, and trim() can be called to release memory under memory pressure.
+ *
+ * \note Recycled allocations are not cleared. Contents written by a previous user remain visible
+ *       to the next user, and a remote process that kept a mapping of a released buffer can still
+ *       access it. Use only where all users of the buffers are trusted.
+ */
+class C2RecyclingLinearAllocator : public C2Allocator {
+public:
+    /// Allocation and cache counters.
+    struct Stats {
+        uint64_t allocations;   ///< number of successful newLinearAllocation calls
+        uint64_t hits;          ///< number of allocations served from the cache
+        uint64_t misses;        ///< number of allocations forwarded to the backing allocator
+        uint64_t evictions;     ///< number of cached allocations released to the backing allocator
+        size_t cachedCount;     ///< number of allocations currently in the cache
+        size_t cachedBytes;     ///< total capacity of allocations currently in the cache
+        size_t maxCachedBytes;  ///< maximum total capacity of cached allocations
+    };
+
+    /**
+     * Creates a recycling allocator.
+     *
+     * \param allocator      backing linear allocator
+     * \param maxCachedBytes maximum total capacity of released allocations to keep around
+     */
+    C2RecyclingLinearAllocator(
+            const std::shared_ptr<C2Allocator> &allocator, size_t maxCachedBytes);
+
+    virtual ~C2RecyclingLinearAllocator() override;
+
+    virtual id_t getId() const override;
+
+    virtual C2String getName() const override;
+
+    virtual std::shared_ptr<const Traits> getTraits() const override;
+
+    virtual c2_status_t newLinearAllocation(
+            uint32_t capacity, C2MemoryUsage usage,
+            std::shared_ptr<C2LinearAllocation> *allocation) override;
+
+    virtual c2_status_t priorLinearAllocation(
+            const C2Handle *handle,
+            std::shared_ptr<C2LinearAllocation> *allocation) override;
+
+    virtual bool checkHandle(const C2Handle* const o) const override;
+
+    /**
+     * Releases least recently used cached allocations until at most |targetBytes| remain cached.
+     *
+     * \return the number of bytes released
+     */
+    size_t trim(size_t targetBytes = 0);
+
+    /// Returns a snapshot of the allocation counters.
+    Stats getStats() const;
+
+    /// Returns a human readable summary of the allocation counters.
+    std::string dump() const;
+
+    /// Returns the size class (capacity actually allocated) for a requested capacity.
+    static uint32_t SizeClass(uint32_t capacity);
+
+private:
+    struct Cache;
+
+    std::shared_ptr<C2Allocator> mAllocator;
+    // Outstanding allocations only hold a weak reference to the cache, so allocations that
+    // outlive this allocator are released to the backing allocator directly.
+    std::shared_ptr<Cache> mCache;
+};
+
+} // namespace android
+
+#endif // STAGEFRIGHT_CODEC2_RECYCLING_ALLOCATOR_H_
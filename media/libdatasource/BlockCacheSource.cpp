@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "BlockCacheSource"
+
+#include <algorithm>
+
+#include <cutils/properties.h>
+#include <datasource/BlockCacheSource.h>
+#include <utils/Log.h>
+
+namespace android {
+
+// static
+sp<DataSource> BlockCacheSource::Wrap(const sp<DataSource> &source) {
+    if (source == NULL) {
+        return source;
+    }
+
+    ssize_t blockSizeKb = 0;
+    ssize_t numBlocks = 0;
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.block-cache-params", value, NULL)
+            && sscanf(value, "%zd/%zd", &blockSizeKb, &numBlocks) != 2) {
+        ALOGE("Failed to parse block cache parameters from '%s'.", value);
+        return source;
+    }
+
+    if (blockSizeKb <= 0 || numBlocks <= 0) {
+        return source;
+    }
+
+    return new BlockCacheSource(source, blockSizeKb * 1024, numBlocks);
+}
+
+BlockCacheSource::BlockCacheSource(
+        const sp<DataSource> &source, size_t blockSize, size_t numBlocks)
+    : mSource(source),
+      mBlockSize(std::max(blockSize, (size_t)1)),
+      mNumBlocks(std::max(numBlocks, (size_t)2)),
+      mUseCount(0),
+      mStats{},
+      mStopping(false) {
+    mName = String8::format("BlockCacheSource(%s)", mSource->toString().c_str());
+    for (Stream &stream : mStreams) {
+        stream.mNextOffset = -1;
+        stream.mLastUse = 0;
+    }
+}
+
+BlockCacheSource::~BlockCacheSource() {
+    stop();
+    ALOGV("%s: %llu reads, %llu block hits, %llu block misses, %llu prefetches, "
+          "%llu source reads",
+          mName.c_str(),
+          (unsigned long long)mStats.mReads, (unsigned long long)mStats.mBlockHits,
+          (unsigned long long)mStats.mBlockMisses, (unsigned long long)mStats.mPrefetches,
+          (unsigned long long)mStats.mSourceReads);
+}
+
+status_t BlockCacheSource::initCheck() const {
+    return mSource->initCheck();
+}
+
+status_t BlockCacheSource::getSize(off64_t *size) {
+    return mSource->getSize(size);
+}
+
+uint32_t BlockCacheSource::flags() {
+    return mSource->flags();
+}
+
+void BlockCacheSource::close() {
+    stop();
+    mSource->close();
+}
+
+String8 BlockCacheSource::getUri() {
+    return mSource->getUri();
+}
+
+String8 BlockCacheSource::getMIMEType() const {
+    return mSource->getMIMEType();
+}
+
+status_t BlockCacheSource::getAvailableSize(off64_t offset, off64_t *size) {
+    return mSource->getAvailableSize(offset, size);
+}
+
+BlockCacheSource::Stats BlockCacheSource::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
+ssize_t BlockCacheSource::readAt(off64_t offset, void *data, size_t size) {
+    if (offset < 0) {
+        return UNKNOWN_ERROR;
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    ++mStats.mReads;
+    bool sequential = onRead_l(offset, size);
+
+    if (size > mBlockSize) {
+        // Large reads gain nothing from the cache; read them directly.
+        ++mStats.mSourceReads;
+        lock.unlock();
+        return mSource->readAt(offset, data, size);
+    }
+
+    size_t copied = 0;
+    int64_t index = offset / mBlockSize;
+    while (copied < size) {
+        std::shared_ptr<Block> block = getBlock_l(lock, index);
+        if (block->mLength < 0) {
+            return copied > 0 ? (ssize_t)copied : block->mLength;
+        }
+
+        size_t blockOffset = (offset + copied) - index * mBlockSize;
+        if ((size_t)block->mLength <= blockOffset) {
+            break;
+        }
+        size_t n = std::min(size - copied, (size_t)block->mLength - blockOffset);
+        memcpy((uint8_t *)data + copied, block->mData.data() + blockOffset, n);
+        copied += n;
+
+        if ((size_t)block->mLength < mBlockSize) {
+            // end of source
+            break;
+        }
+        ++index;
+    }
+
+    if (sequential && copied == size && size > 0) {
+        schedulePrefetch_l((offset + size - 1) / mBlockSize + 1);
+    }
+
+    return copied;
+}
+
+std::shared_ptr<BlockCacheSource::Block> BlockCacheSource::getBlock_l(
+        std::unique_lock<std::mutex> &lock, int64_t index) {
+    auto it = mBlocks.find(index);
+    if (it != mBlocks.end()) {
+        ++mStats.mBlockHits;
+        std::shared_ptr<Block> block = it->second;
+        touch_l(index);
+        // the block may still be loading on the prefetch worker or another reader
+        mCondition.wait(lock, [&block] { return block->mLength != Block::kLoading; });
+        return block;
+    }
+
+    ++mStats.mBlockMisses;
+    std::shared_ptr<Block> block = std::make_shared<Block>();
+    block->mLength = Block::kLoading;
+    mBlocks.emplace(index, block);
+    mLru.push_back(index);
+    evict_l();
+    loadBlock_l(lock, index, block);
+    return block;
+}
+
+void BlockCacheSource::loadBlock_l(
+        std::unique_lock<std::mutex> &lock, int64_t index, const std::shared_ptr<Block> &block) {
+    ++mStats.mSourceReads;
+    lock.unlock();
+    // block is not visible to other threads until mLength is set
+    block->mData.resize(mBlockSize);
+    ssize_t n = mSource->readAt(index * mBlockSize, block->mData.data(), mBlockSize);
+    lock.lock();
+
+    block->mLength = n;
+    if (n < (ssize_t)mBlockSize) {
+        // Do not keep partial blocks or errors around; the next read retries the source.
+        auto it = mBlocks.find(index);
+        if (it != mBlocks.end() && it->second == block) {
+            mBlocks.erase(it);
+            mLru.remove(index);
+        }
+    }
+    mCondition.notify_all();
+}
+
+void BlockCacheSource::touch_l(int64_t index) {
+    if (mLru.back() != index) {
+        mLru.remove(index);
+        mLru.push_back(index);
+    }
+}
+
+void BlockCacheSource::evict_l() {
+    while (mBlocks.size() > mNumBlocks && !mLru.empty()) {
+        // readers still holding a reference to the block keep it alive
+        mBlocks.erase(mLru.front());
+        mLru.pop_front();
+    }
+}
+
+bool BlockCacheSource::onRead_l(off64_t offset, size_t size) {
+    ++mUseCount;
+    Stream *oldest = &mStreams[0];
+    for (Stream &stream : mStreams) {
+        // Small forward skips (e.g. over box headers or samples of other tracks in the same
+        // block) still count as sequential.
+        if (stream.mNextOffset >= 0 && offset >= stream.mNextOffset
+                && offset - stream.mNextOffset < (off64_t)mBlockSize) {
+            stream.mNextOffset = offset + size;
+            stream.mLastUse = mUseCount;
+            return true;
+        }
+        if (stream.mLastUse < oldest->mLastUse) {
+            oldest = &stream;
+        }
+    }
+    oldest->mNextOffset = offset + size;
+    oldest->mLastUse = mUseCount;
+    return false;
+}
+
+void BlockCacheSource::schedulePrefetch_l(int64_t index) {
+    if (mStopping || mBlocks.count(index)
+            || std::find(mPrefetchQueue.begin(), mPrefetchQueue.end(), index)
+                    != mPrefetchQueue.end()) {
+        return;
+    }
+    off64_t size;
+    if (mSource->getSize(&size) == OK && index * (off64_t)mBlockSize >= size) {
+        return;
+    }
+
+    if (mPrefetchQueue.size() >= kMaxPendingPrefetches) {
+        // the oldest requests are the least likely to be still useful
+        mPrefetchQueue.pop_front();
+    }
+    mPrefetchQueue.push_back(index);
+    if (!mWorker.joinable()) {
+        mWorker = std::thread(&BlockCacheSource::workerLoop, this);
+    }
+    mWorkerCondition.notify_one();
+}
+
+void BlockCacheSource::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+        mPrefetchQueue.clear();
+        mWorkerCondition.notify_one();
+    }
+    if (mWorker.joinable()) {
+        mWorker.join();
+    }
+}
+
+void BlockCacheSource::workerLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mWorkerCondition.wait(lock, [this] { return mStopping || !mPrefetchQueue.empty(); });
+        if (mStopping) {
+            break;
+        }
+        int64_t index = mPrefetchQueue.front();
+        mPrefetchQueue.pop_front();
+        if (mBlocks.count(index)) {
+            continue;
+        }
+
+        ++mStats.mPrefetches;
+        std::shared_ptr<Block> block = std::make_shared<Block>();
+        block->mLength = Block::kLoading;
+        mBlocks.emplace(index, block);
+        // prefetched blocks are the most likely to be used next
+        mLru.push_back(index);
+        evict_l();
+        loadBlock_l(lock, index, block);
+    }
+}
+
+}  // namespace android
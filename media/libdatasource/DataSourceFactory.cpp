@@ -17,6 +17,7 @@
 #define LOG_TAG "DataSource"
 
 
+#include <datasource/BlockCacheSource.h>
 #include <datasource/DataSourceFactory.h>
 #include <datasource/DataURISource.h>
 #include <datasource/HTTPBase.h>
@@ -110,7 +111,7 @@ sp<DataSource> DataSourceFactory::CreateFromURI(
 
 sp<DataSource> DataSourceFactory::CreateFromFd(int fd, int64_t offset, int64_t length) {
     sp<FileSource> source = new FileSource(fd, offset, length);
-    return source->initCheck() != OK ? nullptr : source;
+    return source->initCheck() != OK ? nullptr : BlockCacheSource::Wrap(source);
 }
 
 sp<DataSource> DataSourceFactory::CreateMediaHTTP(const sp<MediaHTTPService> &httpService) {
@@ -128,7 +129,7 @@ sp<DataSource> DataSourceFactory::CreateMediaHTTP(const sp<MediaHTTPService> &ht
 }
 
 sp<DataSource> DataSourceFactory::CreateFileSource(const char *uri) {
-    return new FileSource(uri);
+    return BlockCacheSource::Wrap(new FileSource(uri));
 }
 
 }  // namespace android
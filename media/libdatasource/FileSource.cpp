@@ -18,11 +18,13 @@
 #define LOG_TAG "FileSource"
 #include <utils/Log.h>
 
+#include <cutils/properties.h>
 #include <datasource/FileSource.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/FoundationUtils.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -33,7 +35,10 @@ FileSource::FileSource(const char *filename)
     : mFd(-1),
       mOffset(0),
       mLength(-1),
-      mName("<null>") {
+      mName("<null>"),
+      mMapBase(nullptr),
+      mMapSize(0),
+      mMapped(nullptr) {
 
     if (filename) {
         mName = String8::format("FileSource(%s)", filename);
@@ -43,6 +48,7 @@ FileSource::FileSource(const char *filename)
 
     if (mFd >= 0) {
         mLength = lseek64(mFd, 0, SEEK_END);
+        mapFile();
     } else {
         ALOGE("Failed to open file '%s'. (%s)", filename, strerror(errno));
     }
@@ -52,7 +58,10 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
     : mFd(fd),
       mOffset(offset),
       mLength(length),
-      mName("<null>") {
+      mName("<null>"),
+      mMapBase(nullptr),
+      mMapSize(0),
+      mMapped(nullptr) {
     ALOGV("fd=%d (%s), offset=%lld, length=%lld",
             fd, nameForFd(fd).c_str(), (long long) offset, (long long) length);
 
@@ -87,9 +96,15 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
             (long long) mOffset,
             (long long) mLength);
 
+    mapFile();
 }
 
 FileSource::~FileSource() {
+    if (mMapBase != nullptr) {
+        munmap(mMapBase, mMapSize);
+        mMapBase = nullptr;
+        mMapped = nullptr;
+    }
     if (mFd >= 0) {
         ::close(mFd);
         mFd = -1;
@@ -100,12 +115,63 @@ status_t FileSource::initCheck() const {
     return mFd >= 0 ? OK : NO_INIT;
 }
 
+void FileSource::mapFile() {
+    // Mapping is opt-in: a mapped file that gets truncated by its owner
+    // raises SIGBUS on access instead of returning a read error.
+    if (mFd < 0 || mLength <= 0
+            || !property_get_bool("media.stagefright.filesource.mmap", false)) {
+        return;
+    }
+    struct stat s;
+    if (fstat(mFd, &s) != 0 || !S_ISREG(s.st_mode)) {
+        return;
+    }
+    const int64_t pageSize = sysconf(_SC_PAGESIZE);
+    const int64_t start = mOffset & ~(pageSize - 1);
+    const uint64_t mapSize = (uint64_t)(mOffset - start) + mLength;
+    if (mapSize > SIZE_MAX / 4) {
+        // do not exhaust the address space of 32-bit processes
+        return;
+    }
+    void *base = mmap64(nullptr, mapSize, PROT_READ, MAP_SHARED, mFd, start);
+    if (base == MAP_FAILED) {
+        ALOGW("%s: mmap failed (%s), using pread", mName.c_str(), strerror(errno));
+        return;
+    }
+    mMapBase = base;
+    mMapSize = mapSize;
+    mMapped = (const uint8_t *)base + (mOffset - start);
+    ALOGV("%s: mapped %zu bytes", mName.c_str(), mMapSize);
+}
+
+void FileSource::setAccessPattern(AccessPattern pattern) {
+    if (mFd < 0) {
+        return;
+    }
+    if (mMapBase != nullptr) {
+        int advice = pattern == kAccessSequential ? MADV_SEQUENTIAL
+                : pattern == kAccessRandom ? MADV_RANDOM : MADV_NORMAL;
+        if (madvise(mMapBase, mMapSize, advice) != 0) {
+            ALOGV("madvise(%d) failed (%s)", advice, strerror(errno));
+        }
+    } else {
+        int advice = pattern == kAccessSequential ? POSIX_FADV_SEQUENTIAL
+                : pattern == kAccessRandom ? POSIX_FADV_RANDOM : POSIX_FADV_NORMAL;
+        int err = posix_fadvise64(mFd, mOffset, mLength > 0 ? mLength : 0, advice);
+        if (err != 0) {
+            ALOGV("posix_fadvise(%d) failed (%s)", advice, strerror(err));
+        }
+    }
+}
+
 ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
     if (mFd < 0) {
         return NO_INIT;
     }
 
-    Mutex::Autolock autoLock(mLock);
+    // mFd, mOffset and mLength do not change after construction, and
+    // readAt_l uses pread64, so concurrent reads (e.g. from several track
+    // threads) do not need to be serialized.
     if (mLength >= 0) {
         if (offset < 0) {
             return UNKNOWN_ERROR;
@@ -122,18 +188,24 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
 }
 
 ssize_t FileSource::readAt_l(off64_t offset, void *data, size_t size) {
-    off64_t result = lseek64(mFd, offset + mOffset, SEEK_SET);
+    if (mMapped != nullptr && offset >= 0 && mLength >= 0 && offset < mLength) {
+        size_t numAvailable = mLength - offset;
+        if (size > numAvailable) {
+            size = numAvailable;
+        }
+        memcpy(data, mMapped + offset, size);
+        return size;
+    }
+
+    ssize_t result = TEMP_FAILURE_RETRY(pread64(mFd, data, size, offset + mOffset));
     if (result == -1) {
-        ALOGE("seek to %lld failed", (long long)(offset + mOffset));
+        ALOGE("read at %lld failed (%s)", (long long)(offset + mOffset), strerror(errno));
         return UNKNOWN_ERROR;
     }
-
-    return ::read(mFd, data, size);
+    return result;
 }
 
 status_t FileSource::getSize(off64_t *size) {
-    Mutex::Autolock autoLock(mLock);
-
     if (mFd < 0) {
         return NO_INIT;
     }
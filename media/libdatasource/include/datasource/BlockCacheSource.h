@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLOCK_CACHE_SOURCE_H_
+
+#define BLOCK_CACHE_SOURCE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <media/DataSource.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/String8.h>
+
+namespace android {
+
+// Read-ahead block cache for local data sources.
+//
+// Extractors issue many small reads (sample table entries, 188-byte transport
+// stream packets, box headers). This source serves them from a small LRU cache
+// of fixed-size blocks read from the wrapped source. Reads that continue where
+// an earlier read ended are considered sequential, and the next block of such
+// a stream is prefetched on a worker thread. Up to kMaxStreams concurrent
+// sequential streams (e.g. one per track) are tracked.
+//
+// Reads larger than a block bypass the cache. Blocks shorter than the block
+// size (i.e. at the end of the source) are not cached, so that sources that are
+// still growing are not served stale data.
+struct BlockCacheSource : public DataSource {
+    // Wraps |source| in a block cache configured by the
+    // "media.stagefright.block-cache-params" property ("<block size KB>/<# blocks>",
+    // e.g. "64/16"). Caching is off unless the property is set; returns |source|
+    // itself if it is disabled.
+    static sp<DataSource> Wrap(const sp<DataSource> &source);
+
+    BlockCacheSource(const sp<DataSource> &source, size_t blockSize, size_t numBlocks);
+
+    virtual status_t initCheck() const;
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size);
+
+    virtual status_t getSize(off64_t *size);
+
+    virtual uint32_t flags();
+
+    virtual void close();
+
+    virtual String8 toString() {
+        return mName;
+    }
+
+    virtual String8 getUri();
+
+    virtual String8 getMIMEType() const;
+
+    virtual status_t getAvailableSize(off64_t offset, off64_t *size);
+
+    struct Stats {
+        uint64_t mReads;            // # of readAt() calls
+        uint64_t mBlockHits;        // # of block lookups served from the cache
+        uint64_t mBlockMisses;      // # of block lookups that had to wait for a source read
+        uint64_t mPrefetches;       // # of blocks read ahead on the worker thread
+        uint64_t mSourceReads;      // # of reads issued to the wrapped source
+    };
+
+    Stats getStats();
+
+protected:
+    virtual ~BlockCacheSource();
+
+private:
+    enum {
+        kMaxStreams = 4,
+        kMaxPendingPrefetches = 4,
+    };
+
+    struct Block {
+        std::vector<uint8_t> mData;
+        // bytes read into mData, or an error. kLoading while the block is being read.
+        ssize_t mLength;
+        static constexpr ssize_t kLoading = -0x7fffffff;
+    };
+
+    struct Stream {
+        off64_t mNextOffset;
+        uint64_t mLastUse;
+    };
+
+    const sp<DataSource> mSource;
+    const size_t mBlockSize;
+    const size_t mNumBlocks;
+    String8 mName;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    // cached blocks by block index, and block indices in LRU order (most recent last)
+    std::map<int64_t, std::shared_ptr<Block>> mBlocks;
+    std::list<int64_t> mLru;
+    Stream mStreams[kMaxStreams];
+    uint64_t mUseCount;
+    Stats mStats;
+
+    // prefetch worker
+    std::condition_variable mWorkerCondition;
+    std::deque<int64_t> mPrefetchQueue;
+    std::thread mWorker;
+    bool mStopping;
+
+    // Returns the block with index |index|, reading it from the source if needed.
+    std::shared_ptr<Block> getBlock_l(std::unique_lock<std::mutex> &lock, int64_t index);
+    // Reads block |index| into |block| without holding the lock.
+    void loadBlock_l(std::unique_lock<std::mutex> &lock, int64_t index,
+                     const std::shared_ptr<Block> &block);
+    void touch_l(int64_t index);
+    void evict_l();
+    // Updates the stream cursors with a read, and returns true if the read is sequential.
+    bool onRead_l(off64_t offset, size_t size);
+    void schedulePrefetch_l(int64_t index);
+    void stop();
+    void workerLoop();
+
+    DISALLOW_EVIL_CONSTRUCTORS(BlockCacheSource);
+};
+
+}  // namespace android
+
+#endif  // BLOCK_CACHE_SOURCE_H_
@@ -28,6 +28,13 @@ namespace android {
 
 class FileSource : public DataSource {
 public:
+    // Expected access pattern of the file, see setAccessPattern().
+    enum AccessPattern {
+        kAccessNormal,
+        kAccessSequential,
+        kAccessRandom,
+    };
+
     FileSource(const char *filename);
     // FileSource takes ownership and will close the fd
     FileSource(int fd, int64_t offset, int64_t length);
@@ -46,8 +53,19 @@ public:
         return mName;
     }
 
+    // Advises the kernel of the expected access pattern, so that read-ahead
+    // can be tuned (madvise() if the file is mapped, posix_fadvise() otherwise).
+    void setAccessPattern(AccessPattern pattern);
+
+    // Returns true if reads are served from a read-only mapping of the file.
+    bool isMapped() const {
+        return mMapped != nullptr;
+    }
+
 protected:
     virtual ~FileSource();
+    // Reads with pread64(), so it does not require mLock to be held. mLock is
+    // only used by subclasses that keep additional state.
     virtual ssize_t readAt_l(off64_t offset, void *data, size_t size);
 
     int mFd;
@@ -58,6 +76,13 @@ protected:
 private:
     String8 mName;
 
+    // read-only mapping of the file if enabled by "media.stagefright.filesource.mmap"
+    void *mMapBase;
+    size_t mMapSize;
+    const uint8_t *mMapped;
+
+    void mapFile();
+
     FileSource(const FileSource &);
     FileSource &operator=(const FileSource &);
 };
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "BlockCacheSourceTest"
+
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <datasource/BlockCacheSource.h>
+#include <utils/Log.h>
+
+namespace android {
+
+namespace {
+
+constexpr size_t kBlockSize = 4096;
+constexpr size_t kNumBlocks = 8;
+
+// In-memory source that counts the reads it serves.
+struct MemorySource : public DataSource {
+    explicit MemorySource(size_t size) : mData(size), mReads(0) {
+        for (size_t i = 0; i < size; ++i) {
+            mData[i] = (uint8_t)(i * 31 + (i >> 8));
+        }
+    }
+
+    virtual status_t initCheck() const { return OK; }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        ++mReads;
+        if (offset < 0) {
+            return UNKNOWN_ERROR;
+        }
+        if ((size_t)offset >= mData.size()) {
+            return 0;
+        }
+        size = std::min(size, mData.size() - (size_t)offset);
+        memcpy(data, mData.data() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData.size();
+        return OK;
+    }
+
+    std::vector<uint8_t> mData;
+    std::atomic<size_t> mReads;
+};
+
+}  // namespace
+
+class BlockCacheSourceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mMemorySource = new MemorySource(64 * kBlockSize + 100);
+        mSource = new BlockCacheSource(mMemorySource, kBlockSize, kNumBlocks);
+    }
+
+    void expectRead(off64_t offset, size_t size) {
+        std::vector<uint8_t> buffer(size);
+        size_t expected = 0;
+        if ((size_t)offset < mMemorySource->mData.size()) {
+            expected = std::min(size, mMemorySource->mData.size() - (size_t)offset);
+        }
+        ASSERT_EQ((ssize_t)expected, mSource->readAt(offset, buffer.data(), size))
+                << "offset " << offset << " size " << size;
+        EXPECT_TRUE(expected == 0
+                || !memcmp(mMemorySource->mData.data() + offset, buffer.data(), expected))
+                << "offset " << offset << " size " << size;
+    }
+
+    sp<MemorySource> mMemorySource;
+    sp<BlockCacheSource> mSource;
+};
+
+TEST_F(BlockCacheSourceTest, ReadsMatchSource) {
+    // within a block, straddling blocks, larger than a block, and at the end of the source
+    expectRead(0, 8);
+    expectRead(kBlockSize - 4, 8);
+    expectRead(3 * kBlockSize + 10, kBlockSize);
+    expectRead(5, 3 * kBlockSize);
+    expectRead(64 * kBlockSize + 90, 188);
+    expectRead(64 * kBlockSize + 100, 4);
+    expectRead(70 * kBlockSize, 4);
+    // the partial last block is not cached, but still served correctly
+    expectRead(64 * kBlockSize, 100);
+}
+
+TEST_F(BlockCacheSourceTest, SmallReadsHitTheCache) {
+    for (off64_t offset = 0; offset + 8 <= (off64_t)kBlockSize; offset += 8) {
+        expectRead(offset, 8);
+    }
+    BlockCacheSource::Stats stats = mSource->getStats();
+    EXPECT_EQ(kBlockSize / 8, stats.mReads);
+    EXPECT_EQ(1u, stats.mBlockMisses);
+    EXPECT_EQ(kBlockSize / 8 - 1, stats.mBlockHits);
+}
+
+TEST_F(BlockCacheSourceTest, SequentialReadsAreBatched) {
+    // transport stream style sequential reads of a whole source
+    constexpr size_t kPacketSize = 188;
+    size_t numReads = 0;
+    for (off64_t offset = 0; (size_t)offset < mMemorySource->mData.size();
+            offset += kPacketSize) {
+        expectRead(offset, kPacketSize);
+        ++numReads;
+    }
+    mSource->close();
+
+    BlockCacheSource::Stats stats = mSource->getStats();
+    ALOGV("%zu reads, %llu hits, %llu misses, %llu prefetches, %llu source reads",
+          numReads, (unsigned long long)stats.mBlockHits,
+          (unsigned long long)stats.mBlockMisses, (unsigned long long)stats.mPrefetches,
+          (unsigned long long)stats.mSourceReads);
+    EXPECT_EQ(numReads, stats.mReads);
+    EXPECT_EQ(stats.mSourceReads, mMemorySource->mReads.load());
+    // at most one source read per block (plus retries of the partial last block)
+    EXPECT_LE(mMemorySource->mReads.load(), 64u + numReads / (kBlockSize / kPacketSize));
+    EXPECT_LT(mMemorySource->mReads.load() * 10, numReads);
+}
+
+TEST_F(BlockCacheSourceTest, InterleavedStreams) {
+    // two tracks read sequentially from different parts of the source
+    for (off64_t offset = 0; offset < 16 * (off64_t)kBlockSize; offset += 512) {
+        expectRead(offset, 512);
+        expectRead(32 * kBlockSize + offset, 512);
+    }
+    BlockCacheSource::Stats stats = mSource->getStats();
+    EXPECT_LE(stats.mSourceReads, 2 * 16u + 2 * 4u);
+}
+
+TEST_F(BlockCacheSourceTest, RandomReads) {
+    std::minstd_rand random(1);
+    std::uniform_int_distribution<off64_t> offsets(
+            0, mMemorySource->mData.size() + kBlockSize - 1);
+    std::uniform_int_distribution<size_t> sizes(1, 2 * kBlockSize);
+    for (int i = 0; i < 2000; ++i) {
+        off64_t offset = offsets(random);
+        expectRead(offset, sizes(random));
+    }
+}
+
+}  // namespace android
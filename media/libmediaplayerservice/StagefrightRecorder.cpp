@@ -57,6 +57,7 @@
 #include <media/stagefright/MediaCodecSource.h>
 #include <media/stagefright/OggWriter.h>
 #include <media/stagefright/PersistentSurface.h>
+#include <media/stagefright/RecordingLatencyTracker.h>
 #include <media/MediaProfiles.h>
 #include <camera/CameraParameters.h>
 
@@ -212,6 +213,10 @@ void StagefrightRecorder::updateMetrics() {
         mMetricsItem->setInt64(kRecorderPaused, (mDurationPausedUs+500)/1000 );
         mMetricsItem->setInt32(kRecorderNumPauses, mNPauses);
     }
+
+    if (mLatencyTracker != NULL) {
+        mLatencyTracker->reportMetrics(mMetricsItem, "android.media.mediarecorder.");
+    }
 }
 
 void StagefrightRecorder::flushAndResetMetrics(bool reinitialize) {
@@ -1437,8 +1442,19 @@ sp<MediaCodecSource> StagefrightRecorder::createAudioSource() {
     }
     format->setInt32("priority", 0 /* realtime */);
 
+    // Let the source read the captured audio straight into the encoder input
+    // buffers rather than copy it over. Off by default until validated on
+    // devices, as the AudioRecord callback then writes to codec memory.
+    uint32_t flags = 0;
+    if (::android::base::GetBoolProperty("media.recorder.lend-audio-input-buffers", false)) {
+        flags |= MediaCodecSource::FLAG_LEND_INPUT_BUFFERS;
+    }
     sp<MediaCodecSource> audioEncoder =
-            MediaCodecSource::Create(mLooper, format, audioSource);
+            MediaCodecSource::Create(mLooper, format, audioSource, NULL /* persistentSurface */,
+                    flags);
+    if (audioEncoder != NULL && audioEncoder->getInputBufferProvider() != NULL) {
+        audioSource->setBufferProvider(audioEncoder->getInputBufferProvider());
+    }
     sp<AudioSystem::AudioDeviceCallback> callback = mAudioDeviceCallback.promote();
     if (mDeviceCallbackEnabled && callback != 0) {
         audioSource->addAudioDeviceCallback(callback);
@@ -2182,6 +2198,14 @@ status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
         writer = mp4writer = new MPEG4Writer(mOutputFd);
     }
 
+    mLatencyTracker.clear();
+    if (::android::base::GetBoolProperty("media.stagefright.record-stats", false)) {
+        mLatencyTracker = new RecordingLatencyTracker();
+        if (mp4writer != NULL) {
+            mp4writer->setLatencyTracker(mLatencyTracker);
+        }
+    }
+
     if (mVideoSource < VIDEO_SOURCE_LIST_END) {
         setDefaultVideoEncoderIfNecessary();
 
@@ -2197,6 +2221,9 @@ status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
             return err;
         }
 
+        if (mLatencyTracker != NULL) {
+            encoder->setLatencyTracker(mLatencyTracker);
+        }
         writer->addSource(encoder);
         mVideoEncoderSource = encoder;
         mTotalBitRate += mVideoBitRate;
@@ -2210,6 +2237,9 @@ status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
     if (!disableAudio && mAudioSource != AUDIO_SOURCE_CNT) {
         err = setupAudioEncoder(writer);
         if (err != OK) return err;
+        if (mLatencyTracker != NULL) {
+            mAudioEncoderSource->setLatencyTracker(mLatencyTracker);
+        }
         mTotalBitRate += mAudioBitRate;
     }
 
@@ -2415,6 +2445,7 @@ status_t StagefrightRecorder::stop() {
     mPersistentSurface.clear();
     mAudioEncoderSource.clear();
     mVideoEncoderSource.clear();
+    mLatencyTracker.clear();
 
     if (mOutputFd >= 0) {
         ::close(mOutputFd);
@@ -2680,6 +2711,21 @@ status_t StagefrightRecorder::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     Bit rate (bps): %d\n", mVideoBitRate);
     result.append(buffer);
+    if (mLatencyTracker != NULL) {
+        snprintf(buffer, SIZE, "   Latency\n");
+        result.append(buffer);
+        result.append(mLatencyTracker->dump().c_str());
+        // Stages that are never traced in this configuration
+        result.append("     not traced: audio encoder");
+        if (mVideoSource == VIDEO_SOURCE_SURFACE) {
+            // Surface input bypasses MediaCodecSource's puller and input buffers
+            result.append(", video source-to-encoder, video encoder");
+        }
+        if (mOutputFormat == OUTPUT_FORMAT_WEBM) {
+            result.append(", encoder-to-writer");
+        }
+        result.append("\n");
+    }
     ::write(fd, result.c_str(), result.size());
     return OK;
 }
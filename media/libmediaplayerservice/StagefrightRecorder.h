@@ -42,6 +42,7 @@ struct MediaSource;
 struct MediaWriter;
 class MetaData;
 struct AudioSource;
+struct RecordingLatencyTracker;
 class MediaProfiles;
 struct ALooper;
 
@@ -176,6 +177,9 @@ private:
     int64_t mTotalPausedDurationUs;
     sp<MediaCodecSource> mAudioEncoderSource;
     sp<MediaCodecSource> mVideoEncoderSource;
+    // Set when media.stagefright.record-stats is enabled for an MPEG4 or
+    // WebM recording.
+    sp<RecordingLatencyTracker> mLatencyTracker;
 
     bool mStarted;
     // Needed when GLFrames are encoded.
@@ -17,6 +17,7 @@
 #define LOG_TAG "PlayerServuceDataSourceFactory"
 
 
+#include <datasource/BlockCacheSource.h>
 #include <datasource/PlayerServiceDataSourceFactory.h>
 #include <datasource/PlayerServiceFileSource.h>
 #include <datasource/PlayerServiceMediaHTTP.h>
@@ -55,7 +56,13 @@ sp<DataSource> PlayerServiceDataSourceFactory::CreateMediaHTTP(
 }
 
 sp<DataSource> PlayerServiceDataSourceFactory::CreateFileSource(const char *uri) {
-    return new PlayerServiceFileSource(uri);
+    sp<PlayerServiceFileSource> source = new PlayerServiceFileSource(uri);
+    // Forward-locked content is decrypted by the source itself; keep the
+    // decrypted data out of the block cache.
+    if (source->isDrmProtected()) {
+        return source;
+    }
+    return BlockCacheSource::Wrap(source);
 }
 
 }  // namespace android
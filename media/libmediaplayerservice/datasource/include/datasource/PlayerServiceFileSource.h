@@ -39,6 +39,9 @@ public:
 
     static bool requiresDrm(int fd, int64_t offset, int64_t length, const char *mime);
 
+    // Returns true if reads are decrypted through a DRM session.
+    bool isDrmProtected() const { return mDecryptHandle != NULL; }
+
 protected:
     virtual ~PlayerServiceFileSource();
 
@@ -182,7 +182,7 @@ void AudioSource::releaseQueuedFrames_l() {
     List<MediaBuffer *>::iterator it;
     while (!mBuffersReceived.empty()) {
         it = mBuffersReceived.begin();
-        (*it)->release();
+        releaseBuffer_l(*it);
         mBuffersReceived.erase(it);
     }
 }
@@ -341,7 +341,7 @@ void AudioSource::signalBufferReturned(MediaBufferBase *buffer) {
     Mutex::Autolock autoLock(mLock);
     --mNumClientOwnedBuffers;
     buffer->setObserver(0);
-    buffer->release();
+    releaseBuffer_l(buffer);
     mFrameEncodingCompletionCondition.signal();
     return;
 }
@@ -429,7 +429,7 @@ size_t AudioSource::onMoreData(const AudioRecord::Buffer& audioBuffer) {
         } else {
             numLostBytes = 0;
         }
-        MediaBuffer *lostAudioBuffer = new MediaBuffer(bufferSize);
+        MediaBuffer *lostAudioBuffer = acquireBuffer_l(bufferSize);
         memset(lostAudioBuffer->data(), 0, bufferSize);
         lostAudioBuffer->set_range(0, bufferSize);
         mNumFramesLost += bufferSize / mRecord->frameSize();
@@ -441,7 +441,7 @@ size_t AudioSource::onMoreData(const AudioRecord::Buffer& audioBuffer) {
         return audioBuffer.size();
     }
 
-    MediaBuffer *buffer = new MediaBuffer(audioBuffer.size());
+    MediaBuffer *buffer = acquireBuffer_l(audioBuffer.size());
     memcpy((uint8_t *) buffer->data(),
             audioBuffer.data(), audioBuffer.size());
     buffer->set_range(0, audioBuffer.size());
@@ -449,6 +449,29 @@ size_t AudioSource::onMoreData(const AudioRecord::Buffer& audioBuffer) {
     return audioBuffer.size();
 }
 
+void AudioSource::setBufferProvider(const sp<MediaBufferProvider> &provider) {
+    Mutex::Autolock autoLock(mLock);
+    mBufferProvider = provider;
+}
+
+MediaBuffer *AudioSource::acquireBuffer_l(size_t size) {
+    MediaBuffer *buffer = NULL;
+    if (mBufferProvider != NULL) {
+        buffer = mBufferProvider->acquireBuffer(size);
+    }
+    if (buffer == NULL) {
+        buffer = new MediaBuffer(size);
+    }
+    return buffer;
+}
+
+void AudioSource::releaseBuffer_l(MediaBufferBase *buffer) {
+    if (mBufferProvider != NULL) {
+        mBufferProvider->returnBuffer(buffer);
+    }
+    buffer->release();
+}
+
 void AudioSource::queueInputBuffer_l(MediaBuffer *buffer, int64_t timeUs) {
     const size_t bufferSize = buffer->range_length();
     const size_t frameSize = mRecord->frameSize();
@@ -22,6 +22,7 @@
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AWriteQueue.h>
 #include <media/stagefright/foundation/ByteUtils.h>
 #include <media/stagefright/MPEG2TSWriter.h>
 #include <media/stagefright/MediaBuffer.h>
@@ -29,6 +30,7 @@
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MetaData.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 
 #include <media/esds/ESDS.h>
 
@@ -444,7 +446,7 @@ bool MPEG2TSWriter::SourceInfo::eosReceived() const {
 ////////////////////////////////////////////////////////////////////////////////
 
 MPEG2TSWriter::MPEG2TSWriter(int fd)
-    : mFile(fdopen(dup(fd), "wb")),
+    : mFd(dup(fd)),
       mWriteCookie(NULL),
       mWriteFunc(NULL),
       mStarted(false),
@@ -459,7 +461,7 @@ MPEG2TSWriter::MPEG2TSWriter(int fd)
 MPEG2TSWriter::MPEG2TSWriter(
         void *cookie,
         ssize_t (*write)(void *cookie, const void *data, size_t size))
-    : mFile(NULL),
+    : mFd(-1),
       mWriteCookie(cookie),
       mWriteFunc(write),
       mStarted(false),
@@ -472,10 +474,21 @@ MPEG2TSWriter::MPEG2TSWriter(
 }
 
 void MPEG2TSWriter::init() {
-    CHECK(mFile != NULL || mWriteFunc != NULL);
+    CHECK(mFd >= 0 || mWriteFunc != NULL);
 
     initCrcTable();
 
+    if (mFd >= 0) {
+        // TS packets are written from the queue's thread, so that slow
+        // storage does not hold up the looper.
+        mWriteQueue = new AWriteQueue(mFd);
+        status_t err = mWriteQueue->start("MPEG2TSWriterIO");
+        if (err != OK) {
+            ALOGW("Writing packets on the looper, write queue failed to start:%d", err);
+            mWriteQueue.clear();
+        }
+    }
+
     mLooper = new ALooper;
     mLooper->setName("MPEG2TSWriter");
 
@@ -493,9 +506,16 @@ MPEG2TSWriter::~MPEG2TSWriter() {
     mLooper->unregisterHandler(mReflector->id());
     mLooper->stop();
 
-    if (mFile != NULL) {
-        fclose(mFile);
-        mFile = NULL;
+    if (mWriteQueue != NULL) {
+        status_t err = mWriteQueue->stop();
+        if (err != OK) {
+            ALOGE("failed to write TS packets: %s", strerror(-err));
+        }
+        mWriteQueue.clear();
+    }
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
     }
 }
 
@@ -526,6 +546,9 @@ status_t MPEG2TSWriter::start(MetaData *param ) {
     mNumTSPacketsWritten = 0;
     mNumTSPacketsBeforeMeta = 0;
 
+    initProgramAssociationTable();
+    initProgramMap();
+
     for (size_t i = 0; i < mSources.size(); ++i) {
         sp<AMessage> notify =
             new AMessage(kWhatSourceNotify, mReflector);
@@ -546,6 +569,9 @@ status_t MPEG2TSWriter::reset() {
     }
     mStarted = false;
 
+    if (mWriteQueue != NULL && mWriteQueue->flush() != OK) {
+        return ERROR_IO;
+    }
     return OK;
 }
 
@@ -661,7 +687,7 @@ void MPEG2TSWriter::onMessageReceived(const sp<AMessage> &msg) {
     }
 }
 
-void MPEG2TSWriter::writeProgramAssociationTable() {
+void MPEG2TSWriter::initProgramAssociationTable() {
     // 0x47
     // transport_error_indicator = b0
     // payload_unit_start_indicator = b1
@@ -698,22 +724,26 @@ void MPEG2TSWriter::writeProgramAssociationTable() {
         0x00, 0x00, 0x00, 0x00   // b???? ???? ???? ???? ???? ???? ???? ????
     };
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-    memcpy(buffer->data(), kData, sizeof(kData));
+    uint8_t *packet = mProgramAssociationTable;
+    memset(packet, 0xff, kTSPacketSize);
+    memcpy(packet, kData, sizeof(kData));
+
+    // The CRC does not cover the continuity counter.
+    uint32_t crc = htonl(crc32(&packet[5], 12));
+    memcpy(&packet[17], &crc, sizeof(crc));
+}
+
+void MPEG2TSWriter::writeProgramAssociationTable() {
+    uint8_t *packet = appendPackets(1);
+    memcpy(packet, mProgramAssociationTable, kTSPacketSize);
 
     if (++mPATContinuityCounter == 16) {
         mPATContinuityCounter = 0;
     }
-    buffer->data()[3] |= mPATContinuityCounter;
-
-    uint32_t crc = htonl(crc32(&buffer->data()[5], 12));
-    memcpy(&buffer->data()[17], &crc, sizeof(crc));
-
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), (ssize_t)buffer->size());
+    packet[3] |= mPATContinuityCounter;
 }
 
-void MPEG2TSWriter::writeProgramMap() {
+void MPEG2TSWriter::initProgramMap() {
     // 0x47
     // transport_error_indicator = b0
     // payload_unit_start_indicator = b1
@@ -755,24 +785,19 @@ void MPEG2TSWriter::writeProgramMap() {
         0xe0, 0x00, 0xf0, 0x00   // b111? ???? ???? ???? 1111 0000 0000 0000
     };
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-    memcpy(buffer->data(), kData, sizeof(kData));
-
-    if (++mPMTContinuityCounter == 16) {
-        mPMTContinuityCounter = 0;
-    }
-    buffer->data()[3] |= mPMTContinuityCounter;
+    uint8_t *packet = mProgramMap;
+    memset(packet, 0xff, kTSPacketSize);
+    memcpy(packet, kData, sizeof(kData));
 
     size_t section_length = 5 * mSources.size() + 4 + 9;
-    buffer->data()[6] |= section_length >> 8;
-    buffer->data()[7] = section_length & 0xff;
+    packet[6] |= section_length >> 8;
+    packet[7] = section_length & 0xff;
 
     static const unsigned kPCR_PID = 0x1e1;
-    buffer->data()[13] |= (kPCR_PID >> 8) & 0x1f;
-    buffer->data()[14] = kPCR_PID & 0xff;
+    packet[13] |= (kPCR_PID >> 8) & 0x1f;
+    packet[14] = kPCR_PID & 0xff;
 
-    uint8_t *ptr = &buffer->data()[sizeof(kData)];
+    uint8_t *ptr = &packet[sizeof(kData)];
     for (size_t i = 0; i < mSources.size(); ++i) {
         *ptr++ = mSources.editItemAt(i)->streamType();
 
@@ -783,10 +808,18 @@ void MPEG2TSWriter::writeProgramMap() {
         *ptr++ = 0x00;
     }
 
-    uint32_t crc = htonl(crc32(&buffer->data()[5], 12+mSources.size()*5));
-    memcpy(&buffer->data()[17+mSources.size()*5], &crc, sizeof(crc));
+    uint32_t crc = htonl(crc32(&packet[5], 12+mSources.size()*5));
+    memcpy(&packet[17+mSources.size()*5], &crc, sizeof(crc));
+}
 
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), (ssize_t)buffer->size());
+void MPEG2TSWriter::writeProgramMap() {
+    uint8_t *packet = appendPackets(1);
+    memcpy(packet, mProgramMap, kTSPacketSize);
+
+    if (++mPMTContinuityCounter == 16) {
+        mPMTContinuityCounter = 0;
+    }
+    packet[3] |= mPMTContinuityCounter;
 }
 
 void MPEG2TSWriter::writeAccessUnit(
@@ -826,14 +859,8 @@ void MPEG2TSWriter::writeAccessUnit(
     // reserved = b1
     // the first fragment of "buffer" follows
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-
     const unsigned PID = 0x1e0 + sourceIndex + 1;
 
-    const unsigned continuity_counter =
-        mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
-
     // XXX if there are multiple streams of a kind (more than 1 audio or
     // more than 1 video) they need distinct stream_ids.
     const unsigned stream_id =
@@ -855,7 +882,18 @@ void MPEG2TSWriter::writeAccessUnit(
         PES_packet_length = 0;
     }
 
-    uint8_t *ptr = buffer->data();
+    // The first packet carries the PES header and up to 170 bytes of
+    // "buffer", each following packet up to 184 bytes.
+    size_t numPackets = 1;
+    if (accessUnit->size() > 188 - 18) {
+        numPackets += (accessUnit->size() - (188 - 18) + 183) / 184;
+    }
+    uint8_t *packet = appendPackets(numPackets);
+
+    const unsigned continuity_counter =
+        mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
+
+    uint8_t *ptr = packet;
     *ptr++ = 0x47;
     *ptr++ = 0x40 | (PID >> 8);
     *ptr++ = PID & 0xff;
@@ -865,6 +903,7 @@ void MPEG2TSWriter::writeAccessUnit(
         *ptr++ = paddingSize - 1;
         if (paddingSize >= 2) {
             *ptr++ = 0x00;
+            memset(ptr, 0xff, paddingSize - 2);
             ptr += paddingSize - 2;
         }
     }
@@ -883,7 +922,7 @@ void MPEG2TSWriter::writeAccessUnit(
     *ptr++ = (PTS >> 7) & 0xff;
     *ptr++ = ((PTS & 0x7f) << 1) | 1;
 
-    size_t sizeLeft = buffer->data() + buffer->size() - ptr;
+    size_t sizeLeft = packet + kTSPacketSize - ptr;
     size_t copy = accessUnit->size();
     if (copy > sizeLeft) {
         copy = sizeLeft;
@@ -891,8 +930,6 @@ void MPEG2TSWriter::writeAccessUnit(
 
     memcpy(ptr, accessUnit->data(), copy);
 
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), (ssize_t)buffer->size());
-
     size_t offset = copy;
     while (offset < accessUnit->size()) {
         bool lastAccessUnit = ((accessUnit->size() - offset) < 184);
@@ -907,12 +944,12 @@ void MPEG2TSWriter::writeAccessUnit(
         // continuity_counter = b????
         // the fragment of "buffer" follows.
 
-        memset(buffer->data(), 0xff, buffer->size());
+        packet += kTSPacketSize;
 
         const unsigned continuity_counter =
             mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
 
-        ptr = buffer->data();
+        ptr = packet;
         *ptr++ = 0x47;
         *ptr++ = 0x00 | (PID >> 8);
         *ptr++ = PID & 0xff;
@@ -925,22 +962,24 @@ void MPEG2TSWriter::writeAccessUnit(
             *ptr++ = paddingSize - 1;
             if (paddingSize >= 2) {
                 *ptr++ = 0x00;
+                memset(ptr, 0xff, paddingSize - 2);
                 ptr += paddingSize - 2;
             }
         }
 
-        size_t sizeLeft = buffer->data() + buffer->size() - ptr;
+        size_t sizeLeft = packet + kTSPacketSize - ptr;
         size_t copy = accessUnit->size() - offset;
         if (copy > sizeLeft) {
             copy = sizeLeft;
         }
 
         memcpy(ptr, accessUnit->data() + offset, copy);
-        CHECK_EQ(internalWrite(buffer->data(), buffer->size()),
-                 (ssize_t)buffer->size());
 
         offset += copy;
     }
+    CHECK(packet + kTSPacketSize == mPackets->data() + mPackets->size());
+
+    writePackets();
 }
 
 void MPEG2TSWriter::writeTS() {
@@ -952,6 +991,38 @@ void MPEG2TSWriter::writeTS() {
     }
 }
 
+uint8_t *MPEG2TSWriter::appendPackets(size_t numPackets) {
+    size_t size = (mPackets == NULL ? 0 : mPackets->size()) + numPackets * kTSPacketSize;
+    if (mPackets == NULL || size > mPackets->capacity()) {
+        // Grow geometrically, a run of key frames of increasing size should
+        // not copy the batch over and over again.
+        size_t capacity = mPackets == NULL ? 0 : 2 * mPackets->capacity();
+        sp<ABuffer> packets = new ABuffer(capacity > size ? capacity : size);
+        if (mPackets != NULL) {
+            memcpy(packets->data(), mPackets->data(), mPackets->size());
+            packets->setRange(0, mPackets->size());
+        } else {
+            packets->setRange(0, 0);
+        }
+        mPackets = packets;
+    }
+
+    uint8_t *packets = mPackets->data() + mPackets->size();
+    mPackets->setRange(0, size);
+    return packets;
+}
+
+void MPEG2TSWriter::writePackets() {
+    if (mPackets == NULL || mPackets->size() == 0) {
+        return;
+    }
+
+    CHECK_EQ(internalWrite(mPackets->data(), mPackets->size()), (ssize_t)mPackets->size());
+
+    mNumTSPacketsWritten += mPackets->size() / kTSPacketSize;
+    mPackets->setRange(0, 0);
+}
+
 void MPEG2TSWriter::initCrcTable() {
     uint32_t poly = 0x04C11DB7;
 
@@ -980,8 +1051,22 @@ uint32_t MPEG2TSWriter::crc32(const uint8_t *p_start, size_t length) {
 }
 
 ssize_t MPEG2TSWriter::internalWrite(const void *data, size_t size) {
-    if (mFile != NULL) {
-        return fwrite(data, 1, size, mFile);
+    if (mWriteQueue != NULL) {
+        return mWriteQueue->write(data, size) == OK ? (ssize_t)size : -1;
+    }
+
+    if (mFd >= 0) {
+        // The write queue failed to start, write directly.
+        size_t written = 0;
+        while (written < size) {
+            ssize_t n = TEMP_FAILURE_RETRY(
+                    write(mFd, (const uint8_t *)data + written, size - written));
+            if (n <= 0) {
+                return -1;
+            }
+            written += n;
+        }
+        return size;
     }
 
     return (*mWriteFunc)(mWriteCookie, data, size);
@@ -22,6 +22,7 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
@@ -30,6 +31,7 @@
 
 #include <utils/Log.h>
 
+#include <atomic>
 #include <functional>
 
 #include <media/stagefright/MediaSource.h>
@@ -46,6 +48,7 @@
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaCodecConstants.h>
 #include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/RecordingLatencyTracker.h>
 #include <media/stagefright/Utils.h>
 #include <media/mediarecorder.h>
 #include <cutils/properties.h>
@@ -103,6 +106,54 @@ static const uint8_t kHevcNalUnitTypes[5] = {
 /* uncomment to include build in meta */
 //#define SHOW_MODEL_BUILD 1
 
+// Builds boxes in memory, for the fragment headers that are written to the
+// file in one piece together with the sample data they describe.
+class MemoryBoxWriter {
+public:
+    void beginBox(const char *fourcc) {
+        mBoxes.push_back(mData.size());
+        writeInt32(0);
+        writeFourcc(fourcc);
+    }
+
+    void endBox() {
+        CHECK(!mBoxes.empty());
+        setInt32(mBoxes.back(), mData.size() - mBoxes.back());
+        mBoxes.pop_back();
+    }
+
+    void writeInt32(uint32_t x) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            mData.push_back((x >> shift) & 0xff);
+        }
+    }
+
+    void writeInt64(uint64_t x) {
+        writeInt32(x >> 32);
+        writeInt32(x & 0xffffffff);
+    }
+
+    void writeFourcc(const char *fourcc) {
+        CHECK_EQ(strlen(fourcc), 4u);
+        mData.insert(mData.end(), fourcc, fourcc + 4);
+    }
+
+    // Replace the value written at |offset| by writeInt32().
+    void setInt32(size_t offset, uint32_t x) {
+        CHECK_LE(offset + 4, mData.size());
+        for (size_t i = 0; i < 4; ++i) {
+            mData[offset + i] = (x >> (8 * (3 - i))) & 0xff;
+        }
+    }
+
+    const uint8_t *data() const { return mData.data(); }
+    size_t size() const { return mData.size(); }
+
+private:
+    std::vector<uint8_t> mData;
+    std::vector<size_t> mBoxes;
+};
+
 class MPEG4Writer::Track {
     struct TrackId {
         TrackId(uint32_t aId)
@@ -159,6 +210,7 @@ public:
     bool isAvif() const { return mIsAvif; }
     bool isHeif() const { return mIsHeif; }
     bool isAudio() const { return mIsAudio; }
+    bool isVideo() const { return mIsVideo; }
     bool isMPEG4() const { return mIsMPEG4; }
     bool usePrefix() const { return mIsAvc || mIsHevc || mIsHeic || mIsDovi; }
     bool isExifData(MediaBufferBase *buffer, uint32_t *tiffHdrOffset) const;
@@ -172,107 +224,92 @@ public:
     const char *getTrackType() const;
     void resetInternal();
     int64_t trackMetaDataSize();
+    // Write a 'traf' box for the given samples of a fragment, where
+    // |nextTimeUs| is the decoding time of the sample after them, or -1 if
+    // the track ends. Return the size of the sample data, and the position
+    // of the data offset that the caller is to fill in.
+    uint64_t writeTrafBox(MemoryBoxWriter *moof, const List<MediaBuffer *> &samples,
+            int64_t nextTimeUs, size_t *dataOffsetPos) const;
+    void setHasFragmentSamples(bool hasSamples) { mHasFragmentSamples = hasSamples; }
+    size_t getSampleTableSizeBytes() const;
 
 private:
-    // A helper class to handle faster write box with table entries
+    // A helper class to handle faster write box with table entries.
+    // The entries are kept compressed: each value is stored as the varint
+    // encoded difference to the value in the same column of the previous
+    // entry, and runs of entries with the same differences as the previous
+    // one, such as evenly spaced sync samples, as a repeat count. The table
+    // is only expanded while it is written out.
     template<class TYPE, unsigned ENTRY_SIZE>
     // ENTRY_SIZE: # of values in each entry
     struct ListTableEntries {
         static_assert(ENTRY_SIZE > 0, "ENTRY_SIZE must be positive");
+        // @arg elementCapacity # of entries that a block of storage is sized
+        // for, at about two bytes per value.
         ListTableEntries(uint32_t elementCapacity)
-            : mElementCapacity(elementCapacity),
+            : mBlockSize(elementCapacity * ENTRY_SIZE * 2 + kMaxEncodedSize),
             mTotalNumTableEntries(0),
             mNumValuesInCurrEntry(0),
-            mCurrTableEntriesElement(NULL) {
-            CHECK_GT(mElementCapacity, 0u);
-            // Ensure no integer overflow on allocation in add().
-            CHECK_LT(ENTRY_SIZE, UINT32_MAX / mElementCapacity);
+            mNumRepeats(0),
+            mCurrBlock(NULL),
+            mCurrBlockSize(0),
+            mAllocatedBytes(0),
+            mCountOnly(false) {
+            CHECK_GT(elementCapacity, 0u);
+            // Ensure no integer overflow on the block size.
+            CHECK_LT(elementCapacity, (UINT32_MAX - kMaxEncodedSize) / (ENTRY_SIZE * 2));
+            for (unsigned i = 0; i < ENTRY_SIZE; ++i) {
+                mLastEntry[i] = 0;
+                mLastDelta[i] = 0;
+            }
         }
 
         // Free the allocated memory.
         ~ListTableEntries() {
             while (!mTableEntryList.empty()) {
-                typename List<TYPE *>::iterator it = mTableEntryList.begin();
+                typename List<uint8_t *>::iterator it = mTableEntryList.begin();
                 delete[] (*it);
                 mTableEntryList.erase(it);
             }
         }
 
-        // Replace the value at the given position by the given value.
-        // There must be an existing value at the given position.
-        // @arg value must be in network byte order
-        // @arg pos location the value must be in.
-        void set(const TYPE& value, uint32_t pos) {
-            CHECK_LT(pos, mTotalNumTableEntries * ENTRY_SIZE);
-
-            typename List<TYPE *>::iterator it = mTableEntryList.begin();
-            uint32_t iterations = (pos / (mElementCapacity * ENTRY_SIZE));
-            while (it != mTableEntryList.end() && iterations > 0) {
-                ++it;
-                --iterations;
+        // Store a single value.
+        // @arg value in host byte order.
+        void add(TYPE value) {
+            CHECK_LT(mNumValuesInCurrEntry, ENTRY_SIZE);
+            if (mCountOnly) {
+                if (++mNumValuesInCurrEntry == ENTRY_SIZE) {
+                    ++mTotalNumTableEntries;
+                    mNumValuesInCurrEntry = 0;
+                }
+                return;
             }
-            CHECK(it != mTableEntryList.end());
-            CHECK_EQ(iterations, 0u);
-
-            (*it)[(pos % (mElementCapacity * ENTRY_SIZE))] = value;
-        }
-
-        // Get the value at the given position by the given value.
-        // @arg value the retrieved value at the position in network byte order.
-        // @arg pos location the value must be in.
-        // @return true if a value is found.
-        bool get(TYPE& value, uint32_t pos) const {
-            if (pos >= mTotalNumTableEntries * ENTRY_SIZE) {
-                return false;
+            mCurrEntry[mNumValuesInCurrEntry++] = value;
+            if (mNumValuesInCurrEntry < ENTRY_SIZE) {
+                return;
             }
-
-            typename List<TYPE *>::iterator it = mTableEntryList.begin();
-            uint32_t iterations = (pos / (mElementCapacity * ENTRY_SIZE));
-            while (it != mTableEntryList.end() && iterations > 0) {
-                ++it;
-                --iterations;
+            mNumValuesInCurrEntry = 0;
+
+            int64_t delta[ENTRY_SIZE];
+            bool repeat = mTotalNumTableEntries > 0;
+            for (unsigned i = 0; i < ENTRY_SIZE; ++i) {
+                delta[i] = (int64_t)mCurrEntry[i] - (int64_t)mLastEntry[i];
+                repeat = repeat && delta[i] == mLastDelta[i];
+                mLastEntry[i] = mCurrEntry[i];
+                mLastDelta[i] = delta[i];
             }
-            CHECK(it != mTableEntryList.end());
-            CHECK_EQ(iterations, 0u);
-
-            value = (*it)[(pos % (mElementCapacity * ENTRY_SIZE))];
-            return true;
-        }
-
-        // adjusts all values by |adjust(value)|
-        void adjustEntries(
-                std::function<void(size_t /* ix */, TYPE(& /* entry */)[ENTRY_SIZE])> update) {
-            size_t nEntries = mTotalNumTableEntries + mNumValuesInCurrEntry / ENTRY_SIZE;
-            size_t ix = 0;
-            for (TYPE *entryArray : mTableEntryList) {
-                size_t num = std::min(nEntries, (size_t)mElementCapacity);
-                for (size_t i = 0; i < num; ++i) {
-                    update(ix++, (TYPE(&)[ENTRY_SIZE])(*entryArray));
-                    entryArray += ENTRY_SIZE;
-                }
-                nEntries -= num;
+            ++mTotalNumTableEntries;
+            if (repeat) {
+                ++mNumRepeats;
+                return;
             }
-        }
 
-        // Store a single value.
-        // @arg value must be in network byte order.
-        void add(const TYPE& value) {
-            CHECK_LT(mNumValuesInCurrEntry, mElementCapacity);
-            uint32_t nEntries = mTotalNumTableEntries % mElementCapacity;
-            uint32_t nValues  = mNumValuesInCurrEntry % ENTRY_SIZE;
-            if (nEntries == 0 && nValues == 0) {
-                mCurrTableEntriesElement = new TYPE[ENTRY_SIZE * mElementCapacity];
-                CHECK(mCurrTableEntriesElement != NULL);
-                mTableEntryList.push_back(mCurrTableEntriesElement);
-            }
-
-            uint32_t pos = nEntries * ENTRY_SIZE + nValues;
-            mCurrTableEntriesElement[pos] = value;
-
-            ++mNumValuesInCurrEntry;
-            if ((mNumValuesInCurrEntry % ENTRY_SIZE) == 0) {
-                ++mTotalNumTableEntries;
-                mNumValuesInCurrEntry = 0;
+            // The lowest bit of the first varint tells runs from entries.
+            flushRepeats();
+            reserve(ENTRY_SIZE * kMaxEncodedSize);
+            putVarint((zigzag(delta[0]) << 1));
+            for (unsigned i = 1; i < ENTRY_SIZE; ++i) {
+                putVarint(zigzag(delta[i]));
             }
         }
 
@@ -280,32 +317,155 @@ private:
         // 1. the number of entries goes first
         // 2. followed by the values in the table enties in order
         // @arg writer the writer to actual write to the storage
-        void write(MPEG4Writer *writer) const {
-            CHECK_EQ(mNumValuesInCurrEntry % ENTRY_SIZE, 0u);
-            uint32_t nEntries = mTotalNumTableEntries;
-            writer->writeInt32(nEntries);
-            for (typename List<TYPE *>::iterator it = mTableEntryList.begin();
-                it != mTableEntryList.end(); ++it) {
-                CHECK_GT(nEntries, 0u);
-                if (nEntries >= mElementCapacity) {
-                    writer->write(*it, sizeof(TYPE) * ENTRY_SIZE, mElementCapacity);
-                    nEntries -= mElementCapacity;
-                } else {
-                    writer->write(*it, sizeof(TYPE) * ENTRY_SIZE, nEntries);
-                    break;
+        // @arg update if set, is called for each entry in host byte order
+        // before it is written, to adjust the values written out.
+        void write(MPEG4Writer *writer,
+                std::function<void(TYPE(& /* entry */)[ENTRY_SIZE])> update = nullptr) const {
+            if (mCountOnly) {
+                writer->writeInt32(0);
+                return;
+            }
+            CHECK_EQ(mNumValuesInCurrEntry, 0u);
+            writer->writeInt32(mTotalNumTableEntries);
+
+            TYPE entries[kWriteBatchEntries][ENTRY_SIZE];
+            size_t numEntries = 0;
+            TYPE entry[ENTRY_SIZE];
+            int64_t delta[ENTRY_SIZE];
+            for (unsigned i = 0; i < ENTRY_SIZE; ++i) {
+                entry[i] = 0;
+                delta[i] = 0;
+            }
+            auto emit = [&]() {
+                for (unsigned i = 0; i < ENTRY_SIZE; ++i) {
+                    entry[i] = (TYPE)((int64_t)entry[i] + delta[i]);
+                    entries[numEntries][i] = entry[i];
+                }
+                if (update) {
+                    update(entries[numEntries]);
+                }
+                for (unsigned i = 0; i < ENTRY_SIZE; ++i) {
+                    entries[numEntries][i] = toNetworkOrder(entries[numEntries][i]);
+                }
+                if (++numEntries == kWriteBatchEntries) {
+                    writer->write(entries, sizeof(TYPE) * ENTRY_SIZE, numEntries);
+                    numEntries = 0;
+                }
+            };
+
+            typename List<size_t>::const_iterator sizeIt = mBlockSizeList.begin();
+            for (typename List<uint8_t *>::const_iterator it = mTableEntryList.begin();
+                    it != mTableEntryList.end(); ++it, ++sizeIt) {
+                const uint8_t *data = *it;
+                const uint8_t *end = data +
+                        (sizeIt == mBlockSizeList.end() ? mCurrBlockSize : *sizeIt);
+                while (data < end) {
+                    uint64_t first = getVarint(&data);
+                    if (first & 1) {
+                        for (uint64_t n = first >> 1; n > 0; --n) {
+                            emit();
+                        }
+                        continue;
+                    }
+                    delta[0] = unzigzag(first >> 1);
+                    for (unsigned i = 1; i < ENTRY_SIZE; ++i) {
+                        delta[i] = unzigzag(getVarint(&data));
+                    }
+                    emit();
                 }
             }
+            // The last run is still pending.
+            for (uint32_t n = mNumRepeats; n > 0; --n) {
+                emit();
+            }
+            if (numEntries > 0) {
+                writer->write(entries, sizeof(TYPE) * ENTRY_SIZE, numEntries);
+            }
         }
 
         // Return the number of entries in the table.
         uint32_t count() const { return mTotalNumTableEntries; }
 
+        // Return the memory allocated for the entries. Safe to call from
+        // other threads than the one adding entries.
+        size_t allocatedBytes() const { return mAllocatedBytes; }
+
+        // Only count the entries added from now on, and write out an empty
+        // table. Used for the sample tables of fragmented files, whose
+        // samples are described in the fragments instead.
+        void setCountOnly() { mCountOnly = true; }
+
     private:
-        uint32_t         mElementCapacity;  // # entries in an element
+        // A 64-bit varint takes up to 10 bytes.
+        static const size_t kMaxEncodedSize = 10;
+        static const size_t kWriteBatchEntries = 256;
+
+        static uint64_t zigzag(int64_t x) {
+            return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+        }
+        static int64_t unzigzag(uint64_t x) {
+            return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+        }
+        static uint32_t toNetworkOrder(uint32_t x) { return htonl(x); }
+        static off64_t toNetworkOrder(off64_t x) { return hton64(x); }
+
+        static uint64_t getVarint(const uint8_t **data) {
+            uint64_t x = 0;
+            for (unsigned shift = 0;; shift += 7) {
+                uint8_t byte = *(*data)++;
+                x |= (uint64_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return x;
+                }
+            }
+        }
+
+        void putVarint(uint64_t x) {
+            uint8_t *data = mCurrBlock + mCurrBlockSize;
+            while (x >= 0x80) {
+                *data++ = (x & 0x7f) | 0x80;
+                x >>= 7;
+            }
+            *data++ = x;
+            mCurrBlockSize = data - mCurrBlock;
+        }
+
+        // Make room for |size| bytes in the current block.
+        void reserve(size_t size) {
+            if (mCurrBlock != NULL && mCurrBlockSize + size <= mBlockSize) {
+                return;
+            }
+            if (mCurrBlock != NULL) {
+                mBlockSizeList.push_back(mCurrBlockSize);
+            }
+            mCurrBlock = new uint8_t[mBlockSize];
+            CHECK(mCurrBlock != NULL);
+            mAllocatedBytes += mBlockSize;
+            mTableEntryList.push_back(mCurrBlock);
+            mCurrBlockSize = 0;
+        }
+
+        void flushRepeats() {
+            if (mNumRepeats > 0) {
+                reserve(kMaxEncodedSize);
+                putVarint(((uint64_t)mNumRepeats << 1) | 1);
+                mNumRepeats = 0;
+            }
+        }
+
+        uint32_t         mBlockSize;        // # bytes in a block
         uint32_t         mTotalNumTableEntries;
         uint32_t         mNumValuesInCurrEntry;  // up to ENTRY_SIZE
-        TYPE             *mCurrTableEntriesElement;
-        mutable List<TYPE *>     mTableEntryList;
+        uint32_t         mNumRepeats;       // entries pending in the current run
+        uint8_t          *mCurrBlock;
+        size_t           mCurrBlockSize;    // # bytes used in mCurrBlock
+        std::atomic<size_t> mAllocatedBytes;
+        bool             mCountOnly;
+        TYPE             mCurrEntry[ENTRY_SIZE];
+        TYPE             mLastEntry[ENTRY_SIZE];
+        int64_t          mLastDelta[ENTRY_SIZE];
+        List<uint8_t *>  mTableEntryList;
+        List<size_t>     mBlockSizeList;    // # bytes used in all but the last block
 
         DISALLOW_EVIL_CONSTRUCTORS(ListTableEntries);
     };
@@ -331,6 +491,10 @@ private:
     bool mIsMPEG4;
     bool mGotStartKeyFrame;
     bool mIsMalformed;
+    // Whether the first fragment has samples of the track. Set by the writer
+    // thread, as the sample tables keep changing while the moov box of a
+    // fragmented file is written.
+    bool mHasFragmentSamples;
     TrackId mTrackId;
     int64_t mTrackDurationUs;
     int64_t mMaxChunkDurationUs;
@@ -409,7 +573,7 @@ private:
     size_t mNumTiles, mTileIndex;
 
     // Update the audio track's drift information.
-    void updateDriftTime(const sp<MetaData>& meta);
+    void updateDriftTime(const MetaDataBase& meta);
 
     void dumpTimeStamps();
 
@@ -535,6 +699,14 @@ void MPEG4Writer::initInternal(int fd, bool isFirstSession) {
     mSendNotify = false;
     mWriteSeekErr = false;
     mFallocateErr = false;
+    mPendingWrites.clear();
+    mPendingPrefixes.clear();
+    mPendingPrefixes.reserve(IOV_MAX);
+    mPendingWriteBytes = 0;
+    mBatchWrites = false;
+    mFragmentDurationUs = 0;
+    mFragmentSequenceNumber = 0;
+    mMehdOffset = 0;
     // Reset following variables for all the sessions and they will be
     // initialized in start(MetaData *param).
     mIsRealTimeRecording = true;
@@ -952,6 +1124,17 @@ status_t MPEG4Writer::start(MetaData *param) {
     CHECK_GT(mTimeScale, 0);
     ALOGV("movie time scale: %d", mTimeScale);
 
+    int64_t fragmentDurationUs;
+    if (param && param->findInt64(kKeyFragmentDurationUs, &fragmentDurationUs) &&
+            fragmentDurationUs > 0) {
+        if (mHasMoovBox && !mHasFileLevelMeta) {
+            mFragmentDurationUs = fragmentDurationUs;
+            ALOGI("fragment duration: %" PRId64 " us", mFragmentDurationUs);
+        } else {
+            ALOGW("Fragmented files are not supported with image tracks");
+        }
+    }
+
     /*
      * When the requested file size limit is small, the priority
      * is to meet the file size limit requirement, rather than
@@ -962,6 +1145,14 @@ status_t MPEG4Writer::start(MetaData *param) {
         (mMaxFileSizeLimitBytes != 0 &&
          mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes);
 
+    /*
+     * A fragmented file is streamable as it is, with the moov box written
+     * ahead of the first fragment. There is no single mdat box either.
+     */
+    if (isFragmented()) {
+        mStreamableFile = false;
+    }
+
     /*
      * mWriteBoxToMemory is true if the amount of data in a file-level meta or
      * moov box is smaller than the reserved free space at the beginning of a
@@ -1067,7 +1258,9 @@ status_t MPEG4Writer::start(MetaData *param) {
 
     mOffset = mMdatOffset;
     seekOrPostError(mFd, mMdatOffset, SEEK_SET);
-    write("\x00\x00\x00\x01mdat????????", 16);
+    if (!isFragmented()) {
+        write("\x00\x00\x00\x01mdat????????", 16);
+    }
 
     /* Confirm whether the writing of the initial file atoms, ftyp and free,
      * are written to the file properly by posting kWhatNoIOErrorSoFar to the
@@ -1129,6 +1322,24 @@ status_t MPEG4Writer::stopWriterThread() {
         err = UNKNOWN_ERROR;
     }
     mWriterThreadStarted = false;
+
+    // Tracks are stopped by now, so nothing else gets queued.
+    if (mWriteQueue != nullptr) {
+        status_t queueErr = mWriteQueue->stop();
+        AWriteQueue::Stats stats = mWriteQueue->getStats();
+        ALOGD("Write queue: %" PRIu64 " bytes in %" PRIu64 " writes, longest write %" PRId64
+              " us, %" PRIu64 " stalls for %" PRId64 " us, longest stall %" PRId64 " us",
+              stats.bytesWritten, stats.writes, stats.maxWriteUs,
+              stats.stalls, stats.totalStallUs, stats.maxStallUs);
+        mWriteQueue.clear();
+        if (queueErr != OK && !mWriteSeekErr) {
+            ALOGE("stopWriterThread write queue error:%s(%d)", std::strerror(-queueErr), -queueErr);
+            mWriteSeekErr = true;
+            if (err == OK) {
+                err = ERROR_IO;
+            }
+        }
+    }
     return err;
 }
 
@@ -1362,12 +1573,16 @@ status_t MPEG4Writer::reset(bool stopSource, bool waitForAnyPreviousCallToComple
         return mResetStatus;
     }
 
-    // Fix up the size of the 'mdat' chunk.
-    seekOrPostError(mFd, mMdatOffset + 8, SEEK_SET);
-    uint64_t size = mOffset - mMdatOffset;
-    size = hton64(size);
-    writeOrPostError(mFd, &size, 8);
-    seekOrPostError(mFd, mOffset, SEEK_SET);
+    if (isFragmented()) {
+        finishFragments(maxDurationUs);
+    } else {
+        // Fix up the size of the 'mdat' chunk.
+        seekOrPostError(mFd, mMdatOffset + 8, SEEK_SET);
+        uint64_t size = mOffset - mMdatOffset;
+        size = hton64(size);
+        writeOrPostError(mFd, &size, 8);
+        seekOrPostError(mFd, mOffset, SEEK_SET);
+    }
     mMdatEndOffset = mOffset;
 
     // Construct file-level meta and moov box now
@@ -1390,7 +1605,7 @@ status_t MPEG4Writer::reset(bool stopSource, bool waitForAnyPreviousCallToComple
         }
     }
 
-    if (mHasMoovBox) {
+    if (mHasMoovBox && !isFragmented()) {
         writeMoovBox(maxDurationUs);
         // mWriteBoxToMemory could be set to false in
         // MPEG4Writer::write() method
@@ -1502,24 +1717,28 @@ void MPEG4Writer::writeMoovBox(int64_t durationUs) {
         writeUdtaBox();
     }
     writeMoovLevelMetaBox();
-    // Loop through all the tracks to get the global time offset if there is
-    // any ctts table appears in a video track.
-    int64_t minCttsOffsetTimeUs = kMaxCttsOffsetTimeUs;
-    for (List<Track *>::iterator it = mTracks.begin();
-        it != mTracks.end(); ++it) {
-        if (!(*it)->isHeif()) {
-            minCttsOffsetTimeUs =
-                std::min(minCttsOffsetTimeUs, (*it)->getMinCttsOffsetTimeUs());
+    // Fragments carry signed composition offsets, and the ones of samples
+    // still to come are not known yet, so the start time is not adjusted.
+    if (!isFragmented()) {
+        // Loop through all the tracks to get the global time offset if there is
+        // any ctts table appears in a video track.
+        int64_t minCttsOffsetTimeUs = kMaxCttsOffsetTimeUs;
+        for (List<Track *>::iterator it = mTracks.begin();
+            it != mTracks.end(); ++it) {
+            if (!(*it)->isHeif()) {
+                minCttsOffsetTimeUs =
+                    std::min(minCttsOffsetTimeUs, (*it)->getMinCttsOffsetTimeUs());
+            }
         }
-    }
-    ALOGI("Adjust the moov start time from %lld us -> %lld us", (long long)mStartTimestampUs,
-          (long long)(mStartTimestampUs + minCttsOffsetTimeUs - kMaxCttsOffsetTimeUs));
-    // Adjust movie start time.
-    mStartTimestampUs += minCttsOffsetTimeUs - kMaxCttsOffsetTimeUs;
+        ALOGI("Adjust the moov start time from %lld us -> %lld us", (long long)mStartTimestampUs,
+              (long long)(mStartTimestampUs + minCttsOffsetTimeUs - kMaxCttsOffsetTimeUs));
+        // Adjust movie start time.
+        mStartTimestampUs += minCttsOffsetTimeUs - kMaxCttsOffsetTimeUs;
 
-    // Add mStartTimeOffsetBFramesUs(-ve or zero) to the start offset of tracks.
-    mStartTimeOffsetBFramesUs = minCttsOffsetTimeUs - kMaxCttsOffsetTimeUs;
-    ALOGV("mStartTimeOffsetBFramesUs :%" PRId32, mStartTimeOffsetBFramesUs);
+        // Add mStartTimeOffsetBFramesUs(-ve or zero) to the start offset of tracks.
+        mStartTimeOffsetBFramesUs = minCttsOffsetTimeUs - kMaxCttsOffsetTimeUs;
+        ALOGV("mStartTimeOffsetBFramesUs :%" PRId32, mStartTimeOffsetBFramesUs);
+    }
 
     for (List<Track *>::iterator it = mTracks.begin();
         it != mTracks.end(); ++it) {
@@ -1527,9 +1746,33 @@ void MPEG4Writer::writeMoovBox(int64_t durationUs) {
             (*it)->writeTrackHeader();
         }
     }
+    if (isFragmented()) {
+        writeMvexBox();
+    }
     endBox();  // moov
 }
 
+void MPEG4Writer::writeMvexBox() {
+    beginBox("mvex");
+    beginBox("mehd");
+    writeInt32(0x01000000);  // version=1, flags=0
+    mMehdOffset = mOffset;
+    writeInt64(0);           // fragment duration, set in finishFragments()
+    endBox();  // mehd
+    for (List<Track *>::iterator it = mTracks.begin();
+        it != mTracks.end(); ++it) {
+        beginBox("trex");
+        writeInt32(0);       // version=0, flags=0
+        writeInt32((*it)->getTrackId().getId());
+        writeInt32(1);       // default sample description index
+        writeInt32(0);       // default sample duration
+        writeInt32(0);       // default sample size
+        writeInt32(0);       // default sample flags
+        endBox();  // trex
+    }
+    endBox();  // mvex
+}
+
 void MPEG4Writer::writeFtypBox(MetaData *param) {
     beginBox("ftyp");
 
@@ -1650,6 +1893,7 @@ off64_t MPEG4Writer::addSample_l(
         ALOGV("mOffset:%lld, mMaxOffsetAppend:%lld, bytesWritten:%lld", (long long)mOffset,
                   (long long)mMaxOffsetAppend, (long long)*bytesWritten);
         mMaxOffsetAppend = std::max(mOffset, mMaxOffsetAppend);
+        flushPendingWrites_l();
         seekOrPostError(mFd, mMaxOffsetAppend, SEEK_SET);
         return offset;
     }
@@ -1660,16 +1904,18 @@ off64_t MPEG4Writer::addSample_l(
         addMultipleLengthPrefixedSamples_l(buffer);
     } else {
         if (tiffHdrOffset > 0) {
-            tiffHdrOffset = htonl(tiffHdrOffset);
-            writeOrPostError(mFd, &tiffHdrOffset, 4);  // exif_tiff_header_offset field
+            queuePrefix_l(tiffHdrOffset, 4);  // exif_tiff_header_offset field
             mOffset += 4;
         }
 
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(),
-                         buffer->range_length());
+        queueWrite_l((const uint8_t*)buffer->data() + buffer->range_offset(),
+                     buffer->range_length());
 
         mOffset += buffer->range_length();
     }
+    if (!mBatchWrites) {
+        flushPendingWrites_l();
+    }
     *bytesWritten = mOffset - old_offset;
 
     ALOGV("mOffset:%lld, old_offset:%lld, bytesWritten:%lld", (long long)mOffset,
@@ -1704,9 +1950,7 @@ void MPEG4Writer::addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer) {
     while (getNextNALUnit(&data, &searchSize, &nextNalStart,
             &nextNalSize, true) == OK) {
         size_t currentNalSize = nextNalStart - currentNalStart - 4 /* strip start-code */;
-        MediaBuffer *nalBuf = new MediaBuffer((void *)currentNalStart, currentNalSize);
-        addLengthPrefixedSample_l(nalBuf);
-        nalBuf->release();
+        addLengthPrefixedSample_l(currentNalStart, currentNalSize);
 
         currentNalStart = nextNalStart;
     }
@@ -1714,35 +1958,70 @@ void MPEG4Writer::addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer) {
     size_t currentNalOffset = currentNalStart - dataStart;
     buffer->set_range(buffer->range_offset() + currentNalOffset,
             buffer->range_length() - currentNalOffset);
-    addLengthPrefixedSample_l(buffer);
+    addLengthPrefixedSample_l(
+            (const uint8_t *)buffer->data() + buffer->range_offset(), buffer->range_length());
 }
 
-void MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
-    ALOGV("alp:buffer->range_length:%lld", (long long)buffer->range_length());
-    size_t length = buffer->range_length();
+size_t MPEG4Writer::getLengthPrefixedSampleSize(MediaBuffer *buffer) const {
+    // Every NAL unit gets a length prefix in place of its start code, so the
+    // size differs from the buffer size for multiple NAL units and 2 byte
+    // lengths. Walk the NAL units like addMultipleLengthPrefixedSamples_l().
+    const uint8_t *dataStart = (const uint8_t *)buffer->data() + buffer->range_offset();
+    const uint8_t *currentNalStart = dataStart;
+    const uint8_t *nextNalStart;
+    const uint8_t *data = dataStart;
+    size_t nextNalSize;
+    size_t searchSize = buffer->range_length();
+    size_t prefixSize = mUse4ByteNalLength ? 4 : 2;
+    size_t size = 0;
+
+    while (getNextNALUnit(&data, &searchSize, &nextNalStart,
+            &nextNalSize, true) == OK) {
+        size += nextNalStart - currentNalStart - 4 /* strip start-code */ + prefixSize;
+        currentNalStart = nextNalStart;
+    }
+    return size + (dataStart + buffer->range_length() - currentNalStart) + prefixSize;
+}
+
+void MPEG4Writer::addLengthPrefixedSample_l(const uint8_t *data, size_t length) {
+    ALOGV("alp:length:%zu", length);
     if (mUse4ByteNalLength) {
         ALOGV("mUse4ByteNalLength");
-        uint8_t x[4];
-        x[0] = length >> 24;
-        x[1] = (length >> 16) & 0xff;
-        x[2] = (length >> 8) & 0xff;
-        x[3] = length & 0xff;
-        writeOrPostError(mFd, &x, 4);
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(), length);
+        queuePrefix_l(length, 4);
+        queueWrite_l(data, length);
         mOffset += length + 4;
     } else {
         ALOGV("mUse2ByteNalLength");
         CHECK_LT(length, 65536u);
 
-        uint8_t x[2];
-        x[0] = length >> 8;
-        x[1] = length & 0xff;
-        writeOrPostError(mFd, &x, 2);
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(), length);
+        queuePrefix_l(length, 2);
+        queueWrite_l(data, length);
         mOffset += length + 2;
     }
 }
 
+void MPEG4Writer::queueWrite_l(const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    mPendingWrites.push_back({const_cast<void *>(data), size});
+    mPendingWriteBytes += size;
+    if (mPendingWrites.size() >= IOV_MAX) {
+        flushPendingWrites_l();
+    }
+}
+
+void MPEG4Writer::queuePrefix_l(uint32_t value, size_t size) {
+    // There are never more prefixes than queued writes, so this stays within
+    // the IOV_MAX entries reserved in initInternal().
+    mPendingPrefixes.emplace_back();
+    uint8_t *prefix = mPendingPrefixes.back().data();
+    for (size_t i = 0; i < size; ++i) {
+        prefix[i] = (value >> (8 * (size - 1 - i))) & 0xff;
+    }
+    queueWrite_l(prefix, size);
+}
+
 size_t MPEG4Writer::write(
         const void *ptr, size_t size, size_t nmemb) {
 
@@ -1779,6 +2058,7 @@ size_t MPEG4Writer::write(
 }
 
 void MPEG4Writer::writeOrPostError(int fd, const void* buf, size_t count) {
+    drainWriteQueueOrPostError();
     if (mWriteSeekErr == true)
         return;
 
@@ -1808,7 +2088,89 @@ void MPEG4Writer::writeOrPostError(int fd, const void* buf, size_t count) {
     WARN_UNLESS(msg->post() == OK, "writeOrPostError:error posting ERROR_IO");
 }
 
+void MPEG4Writer::flushPendingWrites_l() {
+    if (mPendingWrites.empty())
+        return;
+    if (mWriteSeekErr == true) {
+        mPendingWrites.clear();
+        mPendingPrefixes.clear();
+        mPendingWriteBytes = 0;
+        return;
+    }
+
+    struct iovec *iov = mPendingWrites.data();
+    int iovcnt = mPendingWrites.size();
+    const size_t count = mPendingWriteBytes;
+    size_t totalWritten = 0;
+    ssize_t bytesWritten = 0;
+    auto beforeTP = std::chrono::high_resolution_clock::now();
+    if (mWriteQueue != nullptr) {
+        // The queue copies the data, and only blocks when it is full.
+        status_t err = mWriteQueue->writev(iov, iovcnt);
+        if (err == OK) {
+            totalWritten = count;
+        } else {
+            errno = -err;
+        }
+        iovcnt = 0;
+    }
+    while (iovcnt > 0) {
+        bytesWritten = ::writev(mFd, iov, iovcnt);
+        if (bytesWritten <= 0)
+            break;
+        totalWritten += bytesWritten;
+        // Resume a short write from the first byte not yet written.
+        size_t n = bytesWritten;
+        while (iovcnt > 0 && n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    auto afterTP = std::chrono::high_resolution_clock::now();
+    auto writeDuration =
+            std::chrono::duration_cast<std::chrono::microseconds>(afterTP - beforeTP).count();
+    mWriteDurationPQ.emplace(writeDuration);
+    if (mWriteDurationPQ.size() > kWriteDurationsCount) {
+        mWriteDurationPQ.pop();
+    }
+
+    mPendingWrites.clear();
+    mPendingPrefixes.clear();
+    mPendingWriteBytes = 0;
+    if (totalWritten == count)
+        return;
+    mWriteSeekErr = true;
+    ALOGE("flushPendingWrites_l bytesWritten:%zu, count:%zu, error:%s(%d)", totalWritten, count,
+          std::strerror(errno), errno);
+
+    // Can't guarantee that file is usable or write would succeed anymore, hence signal to stop.
+    sp<AMessage> msg = new AMessage(kWhatIOError, mReflector);
+    msg->setInt32("err", ERROR_IO);
+    WARN_UNLESS(msg->post() == OK, "flushPendingWrites_l:error posting ERROR_IO");
+}
+
+void MPEG4Writer::drainWriteQueueOrPostError() {
+    if (mWriteQueue == nullptr || mWriteSeekErr == true)
+        return;
+    status_t err = mWriteQueue->flush();
+    if (err == OK)
+        return;
+    mWriteSeekErr = true;
+    ALOGE("drainWriteQueueOrPostError error:%s(%d)", std::strerror(-err), -err);
+
+    // Can't guarantee that file is usable or write would succeed anymore, hence signal to stop.
+    sp<AMessage> msg = new AMessage(kWhatIOError, mReflector);
+    msg->setInt32("err", ERROR_IO);
+    WARN_UNLESS(msg->post() == OK, "drainWriteQueueOrPostError:error posting ERROR_IO");
+}
+
 void MPEG4Writer::seekOrPostError(int fd, off64_t offset, int whence) {
+    drainWriteQueueOrPostError();
     if (mWriteSeekErr == true)
         return;
     off64_t resOffset = lseek64(fd, offset, whence);
@@ -2196,6 +2558,15 @@ size_t MPEG4Writer::numTracks() {
     return mTracks.size();
 }
 
+size_t MPEG4Writer::getSampleTableSizeBytes() {
+    Mutex::Autolock autolock(mLock);
+    size_t bytes = 0;
+    for (List<Track *>::iterator it = mTracks.begin(); it != mTracks.end(); ++it) {
+        bytes += (*it)->getSampleTableSizeBytes();
+    }
+    return bytes;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 MPEG4Writer::Track::Track(
@@ -2209,6 +2580,7 @@ MPEG4Writer::Track::Track(
       mStarted(false),
       mGotStartKeyFrame(false),
       mIsMalformed(false),
+      mHasFragmentSamples(false),
       mTrackId(aTrackId),
       mTrackDurationUs(0),
       mEstimatedTrackSizeBytes(0),
@@ -2299,6 +2671,7 @@ void MPEG4Writer::Track::resetInternal() {
     mStarted = false;
     mGotStartKeyFrame = false;
     mIsMalformed = false;
+    mHasFragmentSamples = false;
     mTrackDurationUs = 0;
     mEstimatedTrackSizeBytes = 0;
     mSamplesHaveSameSize = false;
@@ -2356,29 +2729,29 @@ void MPEG4Writer::Track::updateTrackSizeEstimate() {
 
 void MPEG4Writer::Track::addOneStscTableEntry(
         size_t chunkId, size_t sampleId) {
-    mStscTableEntries->add(htonl(chunkId));
-    mStscTableEntries->add(htonl(sampleId));
-    mStscTableEntries->add(htonl(1));
+    mStscTableEntries->add(chunkId);
+    mStscTableEntries->add(sampleId);
+    mStscTableEntries->add(1);
 }
 
 void MPEG4Writer::Track::addOneStssTableEntry(size_t sampleId) {
-    mStssTableEntries->add(htonl(sampleId));
+    mStssTableEntries->add(sampleId);
 }
 
 void MPEG4Writer::Track::addOneSttsTableEntry(size_t sampleCount, int32_t delta) {
     if (delta == 0) {
         ALOGW("0-duration samples found: %zu", sampleCount);
     }
-    mSttsTableEntries->add(htonl(sampleCount));
-    mSttsTableEntries->add(htonl(delta));
+    mSttsTableEntries->add(sampleCount);
+    mSttsTableEntries->add(delta);
 }
 
 void MPEG4Writer::Track::addOneCttsTableEntry(size_t sampleCount, int32_t sampleOffset) {
     if (!mIsVideo) {
         return;
     }
-    mCttsTableEntries->add(htonl(sampleCount));
-    mCttsTableEntries->add(htonl(sampleOffset));
+    mCttsTableEntries->add(sampleCount);
+    mCttsTableEntries->add(sampleOffset);
 }
 
 void MPEG4Writer::Track::addOneElstTableEntry(
@@ -2386,9 +2759,9 @@ void MPEG4Writer::Track::addOneElstTableEntry(
     ALOGV("segmentDuration:%u, mediaTime:%d", segmentDuration, mediaTime);
     ALOGV("mediaRate :%" PRId16 ", mediaRateFraction :%" PRId16 ", Ored %u", mediaRate,
         mediaRateFraction, ((((uint32_t)mediaRate) << 16) | ((uint32_t)mediaRateFraction)));
-    mElstTableEntries->add(htonl(segmentDuration));
-    mElstTableEntries->add(htonl(mediaTime));
-    mElstTableEntries->add(htonl((((uint32_t)mediaRate) << 16) | (uint32_t)mediaRateFraction));
+    mElstTableEntries->add(segmentDuration);
+    mElstTableEntries->add(mediaTime);
+    mElstTableEntries->add((((uint32_t)mediaRate) << 16) | (uint32_t)mediaRateFraction);
 }
 
 status_t MPEG4Writer::setupAndStartLooper() {
@@ -2462,7 +2835,7 @@ bool MPEG4Writer::Track::isExifData(
 
 void MPEG4Writer::Track::addChunkOffset(off64_t offset) {
     CHECK(!mIsHeif);
-    mCo64TableEntries->add(hton64(offset));
+    mCo64TableEntries->add(offset);
 }
 
 void MPEG4Writer::Track::addItemOffsetAndSize(off64_t offset, size_t size, bool isExif) {
@@ -2787,10 +3160,12 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     ALOGV("writeChunkToFile: %" PRId64 " from %s track",
         chunk->mTimeStampUs, chunk->mTrack->getTrackType());
 
+    // Gather the whole chunk, including the length prefixes of each NAL unit,
+    // into as few writev() calls as possible.
+    mBatchWrites = true;
     int32_t isFirstSample = true;
-    while (!chunk->mSamples.empty()) {
-        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
-
+    for (List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+         it != chunk->mSamples.end(); ++it) {
         uint32_t tiffHdrOffset;
         if (!(*it)->meta_data().findInt32(
                 kKeyExifTiffOffset, (int32_t*)&tiffHdrOffset)) {
@@ -2808,7 +3183,14 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
             chunk->mTrack->addChunkOffset(offset);
             isFirstSample = false;
         }
+    }
+    flushPendingWrites_l();
+    mBatchWrites = false;
 
+    // The queued writes point into the samples, so release them only now.
+    while (!chunk->mSamples.empty()) {
+        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+        traceSampleWritten(chunk->mTrack->isVideo(), *it);
         (*it)->release();
         (*it) = NULL;
         chunk->mSamples.erase(it);
@@ -2816,6 +3198,19 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     chunk->mSamples.clear();
 }
 
+void MPEG4Writer::setLatencyTracker(const sp<RecordingLatencyTracker> &tracker) {
+    mLatencyTracker = tracker;
+}
+
+void MPEG4Writer::traceSampleWritten(bool isVideo, MediaBuffer *sample) {
+    int64_t encoderOutputTimeUs;
+    if (mLatencyTracker != NULL
+            && sample->meta_data().findInt64(kKeyEncoderOutputTime, &encoderOutputTimeUs)) {
+        mLatencyTracker->record(isVideo, RecordingLatencyTracker::kStageEncoderToWriter,
+                ALooper::GetNowUs() - encoderOutputTimeUs);
+    }
+}
+
 void MPEG4Writer::writeAllChunks() {
     ALOGV("writeAllChunks");
     size_t outstandingChunks = 0;
@@ -2886,6 +3281,23 @@ void MPEG4Writer::threadFunc() {
     }
 
     Mutex::Autolock autoLock(mLock);
+    if (isFragmented()) {
+        while (!mDone) {
+            if (!writeNextFragment_l(false /* flush */)) {
+                mChunkReadyCondition.wait(mLock);
+            }
+        }
+        while (writeNextFragment_l(true /* flush */)) {
+        }
+        sendSessionSummary();
+        for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+             it != mChunkInfos.end(); ++it) {
+            CHECK(it->mChunks.empty() || it->mChunks.begin()->mSamples.empty());
+        }
+        mChunkInfos.clear();
+        return;
+    }
+
     while (!mDone) {
         Chunk chunk;
         bool chunkFound = false;
@@ -2915,6 +3327,219 @@ void MPEG4Writer::threadFunc() {
     mOffset = std::max(mOffset, mMaxOffsetAppend);
 }
 
+ssize_t MPEG4Writer::getFragmentChunkCount_l(const ChunkInfo &info, int64_t endTimeUs) const {
+    // Fragments start with a sync sample, and with at least one sample of
+    // each track that has not ended, as readers take a track without samples
+    // in a fragment as ended.
+    ssize_t count = 0;
+    for (List<Chunk>::const_iterator it = info.mChunks.begin();
+         it != info.mChunks.end(); ++it, ++count) {
+        if (it->mSamples.empty()) {
+            return count;  // end of track
+        }
+        int32_t isSync = false;
+        if (count > 0 && it->mTimeStampUs >= endTimeUs &&
+                (*it->mSamples.begin())->meta_data().findInt32(kKeyIsSyncFrame, &isSync) &&
+                isSync) {
+            return count;
+        }
+    }
+    return -1;
+}
+
+bool MPEG4Writer::writeNextFragment_l(bool flush) {
+    // Cut fragments at the sync samples of the first video track if there is
+    // one, otherwise of the first track that has not ended.
+    ChunkInfo *lead = NULL;
+    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+         it != mChunkInfos.end(); ++it) {
+        bool ended = it->mChunks.empty() ? flush : it->mChunks.begin()->mSamples.empty();
+        if (!ended && (lead == NULL || (it->mTrack->isVideo() && !lead->mTrack->isVideo()))) {
+            lead = &*it;
+        }
+    }
+    if (lead == NULL || lead->mChunks.empty()) {
+        return false;
+    }
+
+    int64_t endTimeUs = lead->mChunks.begin()->mTimeStampUs + mFragmentDurationUs;
+    ssize_t leadCount = getFragmentChunkCount_l(*lead, endTimeUs);
+    if (leadCount < 0) {
+        if (!flush) {
+            return false;
+        }
+        leadCount = lead->mChunks.size();
+        endTimeUs = INT64_MAX;
+    } else {
+        List<Chunk>::iterator it = lead->mChunks.begin();
+        for (ssize_t i = 0; i < leadCount; ++i) {
+            ++it;
+        }
+        if (!it->mSamples.empty()) {
+            endTimeUs = it->mTimeStampUs;
+        }
+    }
+
+    // Other tracks need to be buffered up to the end of the fragment too.
+    std::vector<ssize_t> counts;
+    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+         it != mChunkInfos.end(); ++it) {
+        ssize_t count = (&*it == lead) ? leadCount : getFragmentChunkCount_l(*it, endTimeUs);
+        if (count < 0) {
+            if (!flush) {
+                return false;
+            }
+            count = it->mChunks.size();
+        }
+        counts.push_back(count);
+    }
+
+    struct TrackFragment {
+        Track *mTrack;
+        List<MediaBuffer *> mSamples;
+        int64_t mNextTimeUs;  // decoding time of the next sample, -1 at the end of the track
+    };
+    std::vector<TrackFragment> fragments;
+    size_t index = 0;
+    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+         it != mChunkInfos.end(); ++it, ++index) {
+        if (counts[index] == 0) {
+            continue;
+        }
+        fragments.emplace_back();
+        TrackFragment &fragment = fragments.back();
+        fragment.mTrack = it->mTrack;
+        for (ssize_t i = 0; i < counts[index]; ++i) {
+            List<Chunk>::iterator chunkIt = it->mChunks.begin();
+            fragment.mSamples.push_back(*chunkIt->mSamples.begin());
+            int64_t interChunkTimeUs = chunkIt->mTimeStampUs - it->mPrevChunkTimestampUs;
+            if (interChunkTimeUs > it->mMaxInterChunkDurUs) {
+                it->mMaxInterChunkDurUs = interChunkTimeUs;
+            }
+            it->mPrevChunkTimestampUs = chunkIt->mTimeStampUs;
+            it->mChunks.erase(chunkIt);
+        }
+        fragment.mNextTimeUs = -1;
+        if (!it->mChunks.empty() && !it->mChunks.begin()->mSamples.empty()) {
+            fragment.mNextTimeUs = it->mChunks.begin()->mTimeStampUs;
+        }
+    }
+    if (fragments.empty()) {
+        return false;
+    }
+
+    if (mFragmentSequenceNumber == 0) {
+        // Every track has delivered its first sample or ended by now, so the
+        // start times and the formats the moov box is made of no longer
+        // change; the sample tables do, and are not read for it.
+        index = 0;
+        for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+             it != mChunkInfos.end(); ++it, ++index) {
+            it->mTrack->setHasFragmentSamples(counts[index] > 0);
+        }
+    }
+
+    // Track threads keep buffering while the fragment is written. Writing the
+    // moov box also takes the lock to look up the start times of the tracks.
+    mLock.unlock();
+
+    if (mFragmentSequenceNumber == 0) {
+        writeMoovBox(0);
+    }
+    ++mFragmentSequenceNumber;
+
+    MemoryBoxWriter moof;
+    std::vector<size_t> dataOffsetPos(fragments.size());
+    std::vector<uint64_t> dataSizes(fragments.size());
+    uint64_t mdatSize = 8;
+    moof.beginBox("moof");
+    moof.beginBox("mfhd");
+    moof.writeInt32(0);  // version=0, flags=0
+    moof.writeInt32(mFragmentSequenceNumber);
+    moof.endBox();  // mfhd
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        dataSizes[i] = fragments[i].mTrack->writeTrafBox(
+                &moof, fragments[i].mSamples, fragments[i].mNextTimeUs, &dataOffsetPos[i]);
+        mdatSize += dataSizes[i];
+    }
+    moof.endBox();  // moof
+
+    // Sample data offsets are relative to the start of the moof box, and are
+    // signed 32 bit values.
+    bool largeMdat = mdatSize > UINT32_MAX;
+    uint64_t dataOffset = moof.size() + (largeMdat ? 16 : 8);
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        if (dataOffset > INT32_MAX) {
+            ALOGE("Fragment %" PRIu32 " is too large, data offset %" PRIu64,
+                    mFragmentSequenceNumber, dataOffset);
+            for (size_t j = 0; j < fragments.size(); ++j) {
+                for (List<MediaBuffer *>::iterator it = fragments[j].mSamples.begin();
+                     it != fragments[j].mSamples.end(); ++it) {
+                    (*it)->release();
+                }
+            }
+            // The file can't describe the samples, hence signal to stop.
+            mWriteSeekErr = true;
+            sp<AMessage> msg = new AMessage(kWhatIOError, mReflector);
+            msg->setInt32("err", ERROR_MALFORMED);
+            WARN_UNLESS(msg->post() == OK, "writeNextFragment_l:error posting ERROR_MALFORMED");
+            mLock.lock();
+            return true;
+        }
+        moof.setInt32(dataOffsetPos[i], dataOffset);
+        dataOffset += dataSizes[i];
+    }
+    if (largeMdat) {
+        moof.writeInt32(1);
+        moof.writeFourcc("mdat");
+        moof.writeInt64(mdatSize + 8);
+    } else {
+        moof.writeInt32(mdatSize);
+        moof.writeFourcc("mdat");
+    }
+
+    // Gather the headers and all samples of the fragment into as few
+    // writev() calls as possible.
+    mBatchWrites = true;
+    queueWrite_l(moof.data(), moof.size());
+    mOffset += moof.size();
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        for (List<MediaBuffer *>::iterator it = fragments[i].mSamples.begin();
+             it != fragments[i].mSamples.end(); ++it) {
+            size_t bytesWritten;
+            addSample_l(*it, fragments[i].mTrack->usePrefix(), 0 /* tiffHdrOffset */,
+                    &bytesWritten);
+        }
+    }
+    flushPendingWrites_l();
+    mBatchWrites = false;
+
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        for (List<MediaBuffer *>::iterator it = fragments[i].mSamples.begin();
+             it != fragments[i].mSamples.end(); ++it) {
+            traceSampleWritten(fragments[i].mTrack->isVideo(), *it);
+            (*it)->release();
+        }
+    }
+
+    mLock.lock();
+    return true;
+}
+
+void MPEG4Writer::finishFragments(int64_t durationUs) {
+    // Without any samples, no fragment has written the moov box yet.
+    if (mFragmentSequenceNumber == 0) {
+        writeMoovBox(0);
+    }
+
+    // The overall duration is only known now.
+    seekOrPostError(mFd, mMehdOffset, SEEK_SET);
+    uint64_t duration = hton64((durationUs * mTimeScale + 5E5) / 1E6);
+    writeOrPostError(mFd, &duration, 8);
+    seekOrPostError(mFd, mOffset, SEEK_SET);
+    ALOGI("%" PRIu32 " fragments were written to the file", mFragmentSequenceNumber);
+}
+
 status_t MPEG4Writer::startWriterThread() {
     ALOGV("startWriterThread");
 
@@ -2930,6 +3555,13 @@ status_t MPEG4Writer::startWriterThread() {
         mChunkInfos.push_back(info);
     }
 
+    mWriteQueue = new AWriteQueue(mFd);
+    status_t err = mWriteQueue->start("MPEG4WriterIO");
+    if (err != OK) {
+        ALOGW("Writing samples on the writer thread, write queue failed to start:%d", err);
+        mWriteQueue.clear();
+    }
+
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -3017,6 +3649,16 @@ status_t MPEG4Writer::Track::start(MetaData *params) {
     mMaxChunkDurationUs = 0;
     mLastDecodingTimeUs = -1;
 
+    if (mOwner->isFragmented()) {
+        // Samples are described in the fragments, only keep the counts.
+        mStszTableEntries->setCountOnly();
+        mCo64TableEntries->setCountOnly();
+        mStscTableEntries->setCountOnly();
+        mStssTableEntries->setCountOnly();
+        mSttsTableEntries->setCountOnly();
+        mCttsTableEntries->setCountOnly();
+    }
+
     pthread_create(&mThread, &attr, ThreadWrapper, this);
     pthread_attr_destroy(&attr);
 
@@ -3460,9 +4102,9 @@ status_t MPEG4Writer::Track::getDolbyVisionProfile() {
  * weight to more recently drift time. The filter coefficients, 0.5 and 0.5,
  * are heuristically determined.
  */
-void MPEG4Writer::Track::updateDriftTime(const sp<MetaData>& meta) {
+void MPEG4Writer::Track::updateDriftTime(const MetaDataBase& meta) {
     int64_t driftTimeUs = 0;
-    if (meta->findInt64(kKeyDriftTime, &driftTimeUs)) {
+    if (meta.findInt64(kKeyDriftTime, &driftTimeUs)) {
         int64_t prevDriftTimeUs = mOwner->getDriftTimeUs();
         int64_t timeUs = (driftTimeUs + prevDriftTimeUs) >> 1;
         mOwner->setDriftTimeUs(timeUs);
@@ -3509,6 +4151,7 @@ status_t MPEG4Writer::Track::threadEntry() {
     int64_t lastSampleDurationUs = -1;      // Duration calculated from EOS buffer and its timestamp
     int64_t lastSampleDurationTicks = -1;   // Timescale based ticks
     int64_t sampleFileOffset = -1;
+    int64_t heldSampleTimeUs = 0;           // Decoding time of the sample held back for fragments
 
     if (mIsAudio) {
         prctl(PR_SET_NAME, (unsigned long)"MP4WtrAudTrkThread", 0, 0, 0);
@@ -3525,7 +4168,9 @@ status_t MPEG4Writer::Track::threadEntry() {
         androidSetThreadPriority(0 /* tid (0 = current) */, ANDROID_PRIORITY_BACKGROUND);
     }
 
-    sp<MetaData> meta_data;
+    // reused for every sample, so that copying the sample metadata does not
+    // allocate once its storage has grown to fit
+    MetaDataBase meta_data;
 
     status_t err = OK;
     MediaBufferBase *buffer;
@@ -3659,6 +4304,12 @@ status_t MPEG4Writer::Track::threadEntry() {
         }
         if (!buffer->meta_data().findInt64(kKeySampleFileOffset, &sampleFileOffset)) {
             sampleFileOffset = -1;
+        } else if (mOwner->isFragmented()) {
+            ALOGE("Samples at given file offsets are not supported in fragmented files");
+            buffer->release();
+            mSource->stop();
+            mIsMalformed = true;
+            break;
         }
         int64_t lastSample = -1;
         if (!buffer->meta_data().findInt64(kKeyLastSampleIndexInChunk, &lastSample)) {
@@ -3691,7 +4342,12 @@ status_t MPEG4Writer::Track::threadEntry() {
         }
         copy->set_range(0, buffer->range_length());
 
-        meta_data = new MetaData(buffer->meta_data());
+        meta_data = buffer->meta_data();
+        int64_t encoderOutputTimeUs;
+        if (mOwner->mLatencyTracker != NULL
+                && meta_data.findInt64(kKeyEncoderOutputTime, &encoderOutputTimeUs)) {
+            copy->meta_data().setInt64(kKeyEncoderOutputTime, encoderOutputTimeUs);
+        }
         buffer->release();
         buffer = NULL;
         if (isExif) {
@@ -3744,8 +4400,8 @@ status_t MPEG4Writer::Track::threadEntry() {
             mOwner->notifyApproachingLimit();
         }
         int32_t isSync = false;
-        meta_data->findInt32(kKeyIsSyncFrame, &isSync);
-        CHECK(meta_data->findInt64(kKeyTime, &timestampUs));
+        meta_data.findInt32(kKeyIsSyncFrame, &isSync);
+        CHECK(meta_data.findInt64(kKeyTime, &timestampUs));
         timestampUs += mFirstSampleStartOffsetUs;
 
         // For video, skip the first several non-key frames until getting the first key frame.
@@ -3807,7 +4463,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                  * Composition time offset = composition time - decoding time
                  */
                 int64_t decodingTimeUs;
-                CHECK(meta_data->findInt64(kKeyDecodingTime, &decodingTimeUs));
+                CHECK(meta_data.findInt64(kKeyDecodingTime, &decodingTimeUs));
                 decodingTimeUs -= previousPausedDurationUs;
 
                 // ensure non-negative, monotonic decoding time
@@ -3937,7 +4593,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                     timestampUs += deltaUs;
                 }
             }
-            mStszTableEntries->add(htonl(sampleSize));
+            mStszTableEntries->add(sampleSize);
 
             if (mStszTableEntries->count() > 2) {
 
@@ -3973,6 +4629,24 @@ status_t MPEG4Writer::Track::threadEntry() {
                 trackProgressStatus(timestampUs);
             }
         }
+        if (mOwner->isFragmented()) {
+            // The writer thread groups the samples of all tracks into
+            // fragments, with the timing recorded here.
+            MetaDataBase &sampleMeta = copy->meta_data();
+            sampleMeta.setInt64(kKeyDecodingTime, timestampUs);
+            sampleMeta.setInt64(kKeyTime, mIsVideo ?
+                    timestampUs + cttsOffsetTimeUs - kMaxCttsOffsetTimeUs : timestampUs);
+            sampleMeta.setInt32(kKeyIsSyncFrame, isSync || !mIsVideo);
+            // Hold back the latest sample, as the duration of the last sample
+            // is only known at the end of the track.
+            if (!mChunkSamples.empty()) {
+                bufferChunk(heldSampleTimeUs);
+            }
+            mChunkSamples.push_back(copy);
+            heldSampleTimeUs = timestampUs;
+            continue;
+        }
+
         if (!hasMultipleTracks) {
             size_t bytesWritten;
             off64_t offset = mOwner->addSample_l(
@@ -3985,6 +4659,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                     addChunkOffset(offset);
                 }
             }
+            mOwner->traceSampleWritten(mIsVideo, copy);
             copy->release();
             copy = NULL;
             continue;
@@ -4027,6 +4702,18 @@ status_t MPEG4Writer::Track::threadEntry() {
 
     mOwner->trackProgressStatus(mTrackId.getId(), -1, err);
 
+    if (mOwner->isFragmented()) {
+        // Hand over the last sample with its duration, followed by an empty
+        // chunk to tell the writer thread that the track has ended.
+        if (!mChunkSamples.empty()) {
+            int64_t durationUs = lastSampleDurationUs >= 0 ? lastSampleDurationUs :
+                    (mStszTableEntries->count() > 1 ? lastDurationUs : 0);
+            mChunkSamples.back()->meta_data().setInt64(kKeyDuration, durationUs);
+            bufferChunk(heldSampleTimeUs);
+        }
+        bufferChunk(heldSampleTimeUs);
+    }
+
     // Add final entries only for non-empty tracks.
     if (mStszTableEntries->count() > 0) {
         if (mIsHeif) {
@@ -4259,6 +4946,12 @@ int64_t MPEG4Writer::Track::getDurationUs() const {
     return mTrackDurationUs + getStartTimeOffsetTimeUs() + mOwner->getStartTimeOffsetBFramesUs();
 }
 
+size_t MPEG4Writer::Track::getSampleTableSizeBytes() const {
+    return mStszTableEntries->allocatedBytes() + mCo64TableEntries->allocatedBytes() +
+            mStscTableEntries->allocatedBytes() + mStssTableEntries->allocatedBytes() +
+            mSttsTableEntries->allocatedBytes() + mCttsTableEntries->allocatedBytes();
+}
+
 int64_t MPEG4Writer::Track::getEstimatedTrackSizeBytes() const {
     return mEstimatedTrackSizeBytes;
 }
@@ -4377,7 +5070,9 @@ int64_t MPEG4Writer::Track::getMinCttsOffsetTimeUs() {
 void MPEG4Writer::Track::writeStblBox() {
     mOwner->beginBox("stbl");
     // Add subboxes for only non-empty and well-formed tracks.
-    if (mStszTableEntries->count() > 0 && !isTrackMalFormed()) {
+    bool hasSamples = mOwner->isFragmented() ? mHasFragmentSamples :
+            mStszTableEntries->count() > 0 && !isTrackMalFormed();
+    if (hasSamples) {
         mOwner->beginBox("stsd");
         mOwner->writeInt32(0);               // version=0, flags=0
         mOwner->writeInt32(1);               // entry count
@@ -4390,7 +5085,9 @@ void MPEG4Writer::Track::writeStblBox() {
         }
         mOwner->endBox();  // stsd
         writeSttsBox();
-        if (mIsVideo) {
+        // Sample tables of fragmented files are empty, where an empty stss
+        // would mean that there are no sync samples.
+        if (mIsVideo && !mOwner->isFragmented()) {
             writeCttsBox();
             writeStssBox();
         }
@@ -4763,7 +5460,8 @@ void MPEG4Writer::Track::writeTkhdBox(uint32_t now) {
     mOwner->writeInt32(now);           // modification time
     mOwner->writeInt32(mTrackId.getId()); // track id starts with 1
     mOwner->writeInt32(0);             // reserved
-    int64_t trakDurationUs = getDurationUs();
+    // The duration of fragmented files is in the mehd box only.
+    int64_t trakDurationUs = mOwner->isFragmented() ? 0 : getDurationUs();
     int32_t mvhdTimeScale = mOwner->getTimeScale();
     int32_t tkhdDuration =
         (trakDurationUs * mvhdTimeScale + 5E5) / 1E6;
@@ -4852,7 +5550,10 @@ void MPEG4Writer::Track::writeEdtsBox() {
     ALOGV("movieStartOffsetBFramesUs:%" PRId32, movieStartOffsetBFramesUs);
 
     // This media/track's real duration (sum of duration of all samples in this track).
-    uint32_t tkhdDurationTicks = (mTrackDurationUs * mvhdTimeScale + 5E5) / 1E6;
+    // Edits of fragmented files extend to the end of the track, whose
+    // duration is not known when the moov box is written.
+    uint32_t tkhdDurationTicks = mOwner->isFragmented() ? 0 :
+            (mTrackDurationUs * mvhdTimeScale + 5E5) / 1E6;
     ALOGV("mTrackDurationUs:%" PRId64 "us", mTrackDurationUs);
 
     int64_t movieStartTimeUs = mOwner->getStartTimestampUs();
@@ -4881,7 +5582,8 @@ void MPEG4Writer::Track::writeEdtsBox() {
             int32_t firstSampleOffsetTicks =
                     (mFirstSampleStartOffsetUs * mvhdTimeScale + 5E5) / 1E6;
             // samples before 0 don't count in for duration, hence subtract firstSampleOffsetTicks.
-            addOneElstTableEntry(tkhdDurationTicks - firstSampleOffsetTicks, mediaTime, 1, 0);
+            addOneElstTableEntry(mOwner->isFragmented() ? 0 :
+                    tkhdDurationTicks - firstSampleOffsetTicks, mediaTime, 1, 0);
         } else {
             // Track starting at zero.
             ALOGV("No edit list entry required for this track");
@@ -4966,7 +5668,7 @@ void MPEG4Writer::Track::writeEdtsBox() {
 }
 
 void MPEG4Writer::Track::writeMdhdBox(uint32_t now) {
-    int64_t trakDurationUs = getDurationUs();
+    int64_t trakDurationUs = mOwner->isFragmented() ? 0 : getDurationUs();
     int64_t mdhdDuration = (trakDurationUs * mTimeScale + 5E5) / 1E6;
     mOwner->beginBox("mdhd");
 
@@ -5131,6 +5833,86 @@ int32_t MPEG4Writer::Track::getStartTimeOffsetScaledTime() const {
     return (getStartTimeOffsetTimeUs() * mTimeScale + 500000LL) / 1000000LL;
 }
 
+uint64_t MPEG4Writer::Track::writeTrafBox(
+        MemoryBoxWriter *moof, const List<MediaBuffer *> &samples,
+        int64_t nextTimeUs, size_t *dataOffsetPos) const {
+    enum {
+        kDefaultBaseIsMoof                  = 0x20000,
+        kDataOffsetPresent                  = 0x01,
+        kSampleDurationPresent              = 0x100,
+        kSampleSizePresent                  = 0x200,
+        kSampleFlagsPresent                 = 0x400,
+        kSampleCompositionTimeOffsetPresent = 0x800,
+    };
+    // sample_depends_on and sample_is_non_sync_sample, ISO/IEC 14496-12 8.8.3.1
+    static const uint32_t kSyncSampleFlags = 0x02000000;
+    static const uint32_t kNonSyncSampleFlags = 0x01010000;
+
+    auto toTicks = [this](int64_t timeUs) {
+        return (timeUs * mTimeScale + 500000LL) / 1000000LL;
+    };
+
+    CHECK(!samples.empty());
+    int64_t decodingTimeUs;
+    CHECK((*samples.begin())->meta_data().findInt64(kKeyDecodingTime, &decodingTimeUs));
+
+    moof->beginBox("traf");
+    moof->beginBox("tfhd");
+    moof->writeInt32(kDefaultBaseIsMoof);  // version=0
+    moof->writeInt32(mTrackId.getId());
+    moof->endBox();  // tfhd
+
+    moof->beginBox("tfdt");
+    moof->writeInt32(0x01000000);  // version=1, flags=0
+    moof->writeInt64(toTicks(decodingTimeUs));
+    moof->endBox();  // tfdt
+
+    moof->beginBox("trun");
+    uint32_t flags = kDataOffsetPresent | kSampleDurationPresent | kSampleSizePresent |
+            kSampleFlagsPresent;
+    if (mIsVideo) {
+        // Version 1 for signed composition time offsets.
+        moof->writeInt32(0x01000000 | flags | kSampleCompositionTimeOffsetPresent);
+    } else {
+        moof->writeInt32(flags);
+    }
+    moof->writeInt32(samples.size());
+    *dataOffsetPos = moof->size();
+    moof->writeInt32(0);  // data offset, filled in by the caller
+    uint64_t dataSize = 0;
+    for (List<MediaBuffer *>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+        const MetaDataBase &meta = (*it)->meta_data();
+        int64_t presentationTimeUs;
+        int32_t isSync;
+        CHECK(meta.findInt64(kKeyTime, &presentationTimeUs));
+        CHECK(meta.findInt32(kKeyIsSyncFrame, &isSync));
+
+        List<MediaBuffer *>::const_iterator next = it;
+        int64_t nextDecodingTimeUs = nextTimeUs;
+        if (++next != samples.end()) {
+            CHECK((*next)->meta_data().findInt64(kKeyDecodingTime, &nextDecodingTimeUs));
+        } else if (nextDecodingTimeUs < 0) {
+            int64_t durationUs = 0;
+            meta.findInt64(kKeyDuration, &durationUs);
+            nextDecodingTimeUs = decodingTimeUs + durationUs;
+        }
+        size_t sampleSize = usePrefix() ?
+                mOwner->getLengthPrefixedSampleSize(*it) : (*it)->range_length();
+
+        moof->writeInt32(toTicks(nextDecodingTimeUs) - toTicks(decodingTimeUs));
+        moof->writeInt32(sampleSize);
+        moof->writeInt32(isSync ? kSyncSampleFlags : kNonSyncSampleFlags);
+        if (mIsVideo) {
+            moof->writeInt32(toTicks(presentationTimeUs) - toTicks(decodingTimeUs));
+        }
+        dataSize += sampleSize;
+        decodingTimeUs = nextDecodingTimeUs;
+    }
+    moof->endBox();  // trun
+    moof->endBox();  // traf
+    return dataSize;
+}
+
 void MPEG4Writer::Track::writeSttsBox() {
     mOwner->beginBox("stts");
     mOwner->writeInt32(0);  // version=0, flags=0
@@ -5158,9 +5940,9 @@ void MPEG4Writer::Track::writeCttsBox() {
     int64_t deltaTimeUs = mMinCttsOffsetTimeUs;
     ALOGV("ctts deltaTimeUs:%" PRId64, deltaTimeUs);
     int64_t delta = (deltaTimeUs * mTimeScale + 500000LL) / 1000000LL;
-    mCttsTableEntries->adjustEntries([delta](size_t /* ix */, uint32_t (&value)[2]) {
+    mCttsTableEntries->write(mOwner, [delta](uint32_t (&value)[2]) {
         // entries are <count, ctts> pairs; adjust only ctts
-        uint32_t duration = htonl(value[1]); // back to host byte order
+        uint32_t duration = value[1];
         // Prevent overflow and underflow
         if (delta > duration) {
             duration = 0;
@@ -5169,9 +5951,8 @@ void MPEG4Writer::Track::writeCttsBox() {
         } else {
             duration -= delta;
         }
-        value[1] = htonl(duration);
+        value[1] = duration;
     });
-    mCttsTableEntries->write(mOwner);
     mOwner->endBox();  // ctts
 }
 
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MediaCodecInputBufferPool"
+#include <utils/Log.h>
+
+#include <media/MediaCodecBuffer.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaCodecInputBufferPool.h>
+
+namespace android {
+
+MediaCodecInputBufferPool::MediaCodecInputBufferPool()
+    : mFlushed(false),
+      mNumSourceBuffers(0) {
+}
+
+void MediaCodecInputBufferPool::addFreeBuffer(
+        size_t index, const sp<MediaCodecBuffer> &buffer) {
+    Mutex::Autolock autoLock(mLock);
+    if (mFlushed) {
+        return;
+    }
+    Entry entry = { index, buffer, false /* claimed */ };
+    mFreeBuffers.push_back(entry);
+}
+
+bool MediaCodecInputBufferPool::takeFreeBuffer(
+        size_t *index, sp<MediaCodecBuffer> *buffer) {
+    Mutex::Autolock autoLock(mLock);
+    if (mFreeBuffers.empty()) {
+        return false;
+    }
+    *index = mFreeBuffers.begin()->mIndex;
+    *buffer = mFreeBuffers.begin()->mBuffer;
+    mFreeBuffers.erase(mFreeBuffers.begin());
+    return true;
+}
+
+bool MediaCodecInputBufferPool::claimBuffer(
+        MediaBufferBase *mbuf, size_t *index, sp<MediaCodecBuffer> *buffer) {
+    Mutex::Autolock autoLock(mLock);
+    ssize_t i = mLentBuffers.indexOfKey(mbuf);
+    if (i < 0 || mLentBuffers.valueAt(i).mClaimed || mFlushed) {
+        return false;
+    }
+    Entry &entry = mLentBuffers.editValueAt(i);
+    entry.mClaimed = true;
+    *index = entry.mIndex;
+    *buffer = entry.mBuffer;
+    return true;
+}
+
+void MediaCodecInputBufferPool::flush() {
+    Mutex::Autolock autoLock(mLock);
+    mFlushed = true;
+    mFreeBuffers.clear();
+}
+
+MediaBuffer *MediaCodecInputBufferPool::acquireBuffer(size_t size) {
+    Mutex::Autolock autoLock(mLock);
+    // A buffer of the source waits for a free input buffer to be copied into.
+    // Lending those out to buffers queued behind it could starve it, so do not
+    // lend any until the source has returned its own buffers.
+    if (mNumSourceBuffers == 0) {
+        for (List<Entry>::iterator it = mFreeBuffers.begin(); it != mFreeBuffers.end(); ++it) {
+            if (it->mBuffer->capacity() >= size) {
+                MediaBuffer *mbuf = new MediaBuffer(it->mBuffer->base(), it->mBuffer->capacity());
+                mLentBuffers.add(mbuf, *it);
+                mFreeBuffers.erase(it);
+                return mbuf;
+            }
+        }
+    }
+    ++mNumSourceBuffers;
+    return NULL;
+}
+
+void MediaCodecInputBufferPool::returnBuffer(MediaBufferBase *mbuf) {
+    Mutex::Autolock autoLock(mLock);
+    ssize_t i = mLentBuffers.indexOfKey(mbuf);
+    if (i < 0) {
+        if (mNumSourceBuffers > 0) {
+            --mNumSourceBuffers;
+        }
+        return;
+    }
+    // dropped by the source or before reaching the encoder, lend it again
+    if (!mLentBuffers.valueAt(i).mClaimed && !mFlushed) {
+        mFreeBuffers.push_back(mLentBuffers.valueAt(i));
+    }
+    mLentBuffers.removeItemsAt(i);
+}
+
+}  // namespace android
@@ -32,12 +32,15 @@
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/ColorUtils.h>
 #include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferProvider.h>
 #include <media/stagefright/MediaCodec.h>
+#include <media/stagefright/MediaCodecInputBufferPool.h>
 #include <media/stagefright/MediaCodecConstants.h>
 #include <media/stagefright/MediaCodecList.h>
 #include <media/stagefright/MediaCodecSource.h>
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MetaData.h>
+#include <media/stagefright/RecordingLatencyTracker.h>
 #include <media/stagefright/Utils.h>
 
 namespace android {
@@ -50,6 +53,8 @@ const int kStopTimeoutUs = 300000; // allow 1 sec for shutting down encoder
 // allow maximum 1 sec for stop time offset. This limits the the delay in the
 // input source.
 const int kMaxStopTimeOffsetUs = 1000000;
+// samples in flight in the encoder at most when tracing latency
+const size_t kMaxTracedEncoderInputs = 64;
 
 struct MediaCodecSource::Puller : public AHandler {
     explicit Puller(const sp<MediaSource> &source);
@@ -62,6 +67,9 @@ struct MediaCodecSource::Puller : public AHandler {
     void resume();
     status_t setStopTimeUs(int64_t stopTimeUs);
     bool readBuffer(MediaBufferBase **buffer);
+    // Like readBuffer(), but leaves the buffer in the queue.
+    bool peekBuffer(MediaBufferBase **buffer);
+    void setStampReadTime(bool stamp) { mStampReadTime = stamp; }
 
 protected:
     virtual void onMessageReceived(const sp<AMessage> &msg);
@@ -79,6 +87,7 @@ private:
     sp<AMessage> mNotify;
     sp<ALooper> mLooper;
     bool mIsAudio;
+    bool mStampReadTime;
 
     struct Queue {
         Queue()
@@ -109,7 +118,8 @@ private:
 MediaCodecSource::Puller::Puller(const sp<MediaSource> &source)
     : mSource(source),
       mLooper(new ALooper()),
-      mIsAudio(false)
+      mIsAudio(false),
+      mStampReadTime(false)
 {
     sp<MetaData> meta = source->getFormat();
     const char *mime;
@@ -152,6 +162,16 @@ bool MediaCodecSource::Puller::readBuffer(MediaBufferBase **mbuf) {
     return queue->readBuffer(mbuf);
 }
 
+bool MediaCodecSource::Puller::peekBuffer(MediaBufferBase **mbuf) {
+    Mutexed<Queue>::Locked queue(mQueue);
+    if (queue->mReadBuffers.empty()) {
+        *mbuf = NULL;
+        return false;
+    }
+    *mbuf = *queue->mReadBuffers.begin();
+    return true;
+}
+
 status_t MediaCodecSource::Puller::postSynchronouslyAndReturnError(
         const sp<AMessage> &msg) {
     sp<AMessage> response;
@@ -293,6 +313,9 @@ void MediaCodecSource::Puller::onMessageReceived(const sp<AMessage> &msg) {
             queue.unlock();
             MediaBufferBase *mbuf = NULL;
             status_t err = mSource->read(&mbuf);
+            if (mStampReadTime && err == OK && mbuf != NULL) {
+                mbuf->meta_data().setInt64(kKeySourceReadTime, ALooper::GetNowUs());
+            }
             queue.lock();
 
             queue->mReadPendingSince = 0;
@@ -359,6 +382,17 @@ status_t MediaCodecSource::setInputBufferTimeOffset(int64_t timeOffsetUs) {
     return postSynchronouslyAndReturnError(msg);
 }
 
+void MediaCodecSource::setLatencyTracker(const sp<RecordingLatencyTracker> &tracker) {
+    mLatencyTracker = tracker;
+    if (mPuller != NULL) {
+        mPuller->setStampReadTime(tracker != NULL);
+    }
+}
+
+sp<MediaBufferProvider> MediaCodecSource::getInputBufferProvider() {
+    return mInputBufferPool;
+}
+
 int64_t MediaCodecSource::getFirstSampleSystemTimeUs() {
     sp<AMessage> msg = new AMessage(kWhatGetFirstSampleSystemTimeUs, mReflector);
     sp<AMessage> response;
@@ -514,6 +548,10 @@ status_t MediaCodecSource::initEncoder() {
     CHECK(mOutputFormat->findString("mime", &outputMIME));
     mIsVideo = outputMIME.startsWithIgnoreCase("video/");
 
+    if ((mFlags & FLAG_LEND_INPUT_BUFFERS) && !mIsVideo) {
+        mInputBufferPool = new MediaCodecInputBufferPool();
+    }
+
     AString name;
     status_t err = NO_INIT;
     if (mOutputFormat->findString("testing-name", &name)) {
@@ -625,6 +663,9 @@ void MediaCodecSource::releaseEncoder() {
         return;
     }
 
+    if (mInputBufferPool != NULL) {
+        mInputBufferPool->flush();
+    }
     mEncoder->release();
     mEncoder.clear();
 }
@@ -702,28 +743,72 @@ void MediaCodecSource::resume(int64_t resumeStartTimeUs) {
     }
 }
 
+bool MediaCodecSource::dequeueEncoderInput(
+        MediaBufferBase **mbuf, size_t *bufferIndex, sp<MediaCodecBuffer> *inbuf,
+        bool *lent) {
+    *lent = false;
+    if (mInputBufferPool == NULL) {
+        if (mAvailEncoderInputIndices.empty() || !mPuller->readBuffer(mbuf)) {
+            return false;
+        }
+        *bufferIndex = *mAvailEncoderInputIndices.begin();
+        mAvailEncoderInputIndices.erase(mAvailEncoderInputIndices.begin());
+        return true;
+    }
+
+    // A buffer read into a lent input buffer does not need a free one, so
+    // look at it before taking one.
+    MediaBufferBase *next;
+    if (!mPuller->peekBuffer(&next)) {
+        return false;
+    }
+    if (mInputBufferPool->claimBuffer(next, bufferIndex, inbuf)) {
+        *lent = true;
+    } else if (!mInputBufferPool->takeFreeBuffer(bufferIndex, inbuf)) {
+        return false;
+    }
+    CHECK(mPuller->readBuffer(mbuf) && *mbuf == next);
+    return true;
+}
+
+void MediaCodecSource::requeueEncoderInput(
+        size_t bufferIndex, const sp<MediaCodecBuffer> &inbuf) {
+    if (mInputBufferPool != NULL) {
+        mInputBufferPool->addFreeBuffer(bufferIndex, inbuf);
+    } else {
+        mAvailEncoderInputIndices.push_back(bufferIndex);
+    }
+}
+
 status_t MediaCodecSource::feedEncoderInputBuffers() {
     MediaBufferBase* mbuf = NULL;
-    while (!mAvailEncoderInputIndices.empty() && mPuller->readBuffer(&mbuf)) {
+    size_t bufferIndex;
+    sp<MediaCodecBuffer> inbuf;
+    bool lent;
+    while (dequeueEncoderInput(&mbuf, &bufferIndex, &inbuf, &lent)) {
         if (!mEncoder) {
             return BAD_VALUE;
         }
-        size_t bufferIndex = *mAvailEncoderInputIndices.begin();
-        mAvailEncoderInputIndices.erase(mAvailEncoderInputIndices.begin());
 
         int64_t timeUs = 0LL;
         uint32_t flags = 0;
+        size_t offset = 0;
         size_t size = 0;
+        int64_t readTimeUs = -1LL;
 
         if (mbuf != NULL) {
             CHECK(mbuf->meta_data().findInt64(kKeyTime, &timeUs));
+            if (mLatencyTracker != NULL
+                    && !mbuf->meta_data().findInt64(kKeySourceReadTime, &readTimeUs)) {
+                readTimeUs = -1LL;
+            }
             if (mFirstSampleSystemTimeUs < 0LL) {
                 mFirstSampleSystemTimeUs = systemTime() / 1000;
                 if (mPausePending) {
                     mPausePending = false;
                     onPause(mFirstSampleSystemTimeUs);
                     mbuf->release();
-                    mAvailEncoderInputIndices.push_back(bufferIndex);
+                    requeueEncoderInput(bufferIndex, inbuf);
                     return OK;
                 }
             }
@@ -747,8 +832,10 @@ status_t MediaCodecSource::feedEncoderInputBuffers() {
 #endif // DEBUG_DRIFT_TIME
             }
 
-            sp<MediaCodecBuffer> inbuf;
-            status_t err = mEncoder->getInputBuffer(bufferIndex, &inbuf);
+            status_t err = OK;
+            if (inbuf == NULL) {
+                err = mEncoder->getInputBuffer(bufferIndex, &inbuf);
+            }
 
             if (err != OK || inbuf == NULL || inbuf->data() == NULL
                     || mbuf->data() == NULL || mbuf->size() == 0) {
@@ -757,9 +844,14 @@ status_t MediaCodecSource::feedEncoderInputBuffers() {
                 break;
             }
 
-            size = mbuf->size();
-
-            memcpy(inbuf->data(), mbuf->data(), size);
+            if (lent) {
+                // the source read straight into the input buffer
+                offset = mbuf->range_offset();
+                size = mbuf->range_length();
+            } else {
+                size = mbuf->size();
+                memcpy(inbuf->data(), mbuf->data(), size);
+            }
 
             if (mIsVideo) {
                 int32_t ds = 0;
@@ -790,8 +882,26 @@ status_t MediaCodecSource::feedEncoderInputBuffers() {
             flags = MediaCodec::BUFFER_FLAG_EOS;
         }
 
+        if (readTimeUs >= 0) {
+            int64_t nowUs = ALooper::GetNowUs();
+            mLatencyTracker->record(
+                    mIsVideo, RecordingLatencyTracker::kStageSourceToEncoder, nowUs - readTimeUs);
+            // Audio encoders regroup the input into frames of their own, so
+            // their output can't be matched to an input buffer; the encoder
+            // stage is only traced for video.
+            if (mIsVideo) {
+                // Samples the encoder drops are never matched, keep the oldest
+                // from piling up.
+                if (mEncoderInputTimesUs.size() >= kMaxTracedEncoderInputs) {
+                    mEncoderInputTimesUs.removeItemsAt(0);
+                }
+                mEncoderInputTimesUs.add(timeUs, nowUs);
+            }
+        }
+
+        inbuf.clear();
         status_t err = mEncoder->queueInputBuffer(
-                bufferIndex, 0, size, timeUs, flags);
+                bufferIndex, offset, size, timeUs, flags);
 
         if (err != OK) {
             return err;
@@ -911,7 +1021,17 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
             int32_t index;
             CHECK(msg->findInt32("index", &index));
 
-            mAvailEncoderInputIndices.push_back(index);
+            if (mInputBufferPool != NULL) {
+                sp<MediaCodecBuffer> inbuf;
+                status_t err = mEncoder->getInputBuffer(index, &inbuf);
+                if (err != OK || inbuf == NULL || inbuf->base() == NULL) {
+                    signalEOS();
+                    break;
+                }
+                mInputBufferPool->addFreeBuffer(index, inbuf);
+            } else {
+                mAvailEncoderInputIndices.push_back(index);
+            }
             feedEncoderInputBuffers();
         } else if (cbID == MediaCodec::CB_OUTPUT_FORMAT_CHANGED) {
             status_t err = mEncoder->getOutputFormat(&mOutputFormat);
@@ -1003,6 +1123,17 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
                             timeUs, timeUs / 1E6, driftTimeUs);
                 }
                 mbuf->meta_data().setInt64(kKeyTime, timeUs);
+
+                if (mLatencyTracker != NULL) {
+                    int64_t nowUs = ALooper::GetNowUs();
+                    ssize_t index = mIsVideo ? mEncoderInputTimesUs.indexOfKey(timeUs) : -1;
+                    if (index >= 0) {
+                        mLatencyTracker->record(mIsVideo, RecordingLatencyTracker::kStageEncoder,
+                                nowUs - mEncoderInputTimesUs.valueAt(index));
+                        mEncoderInputTimesUs.removeItemsAt(index);
+                    }
+                    mbuf->meta_data().setInt64(kKeyEncoderOutputTime, nowUs);
+                }
             } else {
                 mbuf->meta_data().setInt64(kKeyTime, 0LL);
                 mbuf->meta_data().setInt32(kKeyIsCodecConfig, true);
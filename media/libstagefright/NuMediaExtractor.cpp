@@ -20,9 +20,13 @@
 
 #include <media/stagefright/NuMediaExtractor.h>
 
+#include <thread>
+
+#include <cutils/properties.h>
 #include <media/esds/ESDS.h>
 
 #include <datasource/DataSourceFactory.h>
+#include <datasource/BlockCacheSource.h>
 #include <datasource/FileSource.h>
 #include <media/DataSource.h>
 #include <media/stagefright/MediaSource.h>
@@ -30,6 +34,7 @@
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MediaExtractor.h>
@@ -50,10 +55,220 @@ NuMediaExtractor::Sample::Sample(MediaBufferBase *buffer, int64_t timeUs)
       mSampleTimeUs(timeUs) {
 }
 
+// Reads ahead on a single track. Samples are copied out of the source's
+// buffers into buffers of our own group, so that neither a deep queue nor
+// samples held by the client can starve the extractor of its buffers, and
+// buffers are recycled instead of being allocated for every sample.
+struct NuMediaExtractor::SamplePrefetcher {
+    SamplePrefetcher(const sp<IMediaSource> &source, size_t trackIndex, size_t maxQueued);
+    ~SamplePrefetcher();
+
+    // Drops all queued samples and continues reading at |seekTimeUs|.
+    void seek(int64_t seekTimeUs, MediaSource::ReadOptions::SeekMode mode);
+
+    // Blocks until a sample is available or the end of the track is reached,
+    // then moves all queued samples to the end of |samples|.
+    // Returns the final result of the track once no more samples are queued.
+    status_t dequeueSamples(std::list<Sample> *samples);
+
+    void stop();
+
+private:
+    const sp<IMediaSource> mSource;
+    const size_t mTrackIndex;
+    const size_t mMaxQueued;
+
+    // samples handed to the client are still in use, hence twice the queue size
+    MediaBufferGroup mGroup;
+
+    Mutex mLock;
+    Condition mCondition;
+    std::thread mThread;
+    bool mStopping;
+    bool mSeekPending;
+    int64_t mSeekTimeUs;
+    MediaSource::ReadOptions::SeekMode mSeekMode;
+    // bumped on seek, so that samples read before the seek are dropped
+    uint32_t mGeneration;
+    std::list<Sample> mSamples;
+    status_t mFinalResult;
+
+    void start_l();
+    void releaseSamples_l();
+    void threadLoop();
+    status_t copySample(MediaBufferBase *mbuf, Sample *sample);
+
+    DISALLOW_EVIL_CONSTRUCTORS(SamplePrefetcher);
+};
+
+NuMediaExtractor::SamplePrefetcher::SamplePrefetcher(
+        const sp<IMediaSource> &source, size_t trackIndex, size_t maxQueued)
+    : mSource(source),
+      mTrackIndex(trackIndex),
+      mMaxQueued(maxQueued),
+      mGroup(2 * maxQueued + 1 /* growthLimit */),
+      mStopping(false),
+      mSeekPending(false),
+      mSeekTimeUs(-1LL),
+      mSeekMode(MediaSource::ReadOptions::SEEK_CLOSEST_SYNC),
+      mGeneration(0),
+      mFinalResult(OK) {
+}
+
+NuMediaExtractor::SamplePrefetcher::~SamplePrefetcher() {
+    stop();
+}
+
+void NuMediaExtractor::SamplePrefetcher::start_l() {
+    if (!mThread.joinable() && !mStopping) {
+        mThread = std::thread(&SamplePrefetcher::threadLoop, this);
+    }
+}
+
+void NuMediaExtractor::SamplePrefetcher::stop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    Mutex::Autolock autoLock(mLock);
+    releaseSamples_l();
+}
+
+void NuMediaExtractor::SamplePrefetcher::releaseSamples_l() {
+    for (const Sample &sample : mSamples) {
+        sample.mBuffer->release();
+    }
+    mSamples.clear();
+}
+
+void NuMediaExtractor::SamplePrefetcher::seek(
+        int64_t seekTimeUs, MediaSource::ReadOptions::SeekMode mode) {
+    Mutex::Autolock autoLock(mLock);
+    ++mGeneration;
+    releaseSamples_l();
+    mFinalResult = OK;
+    mSeekPending = true;
+    mSeekTimeUs = seekTimeUs;
+    mSeekMode = mode;
+    start_l();
+    mCondition.broadcast();
+}
+
+status_t NuMediaExtractor::SamplePrefetcher::dequeueSamples(std::list<Sample> *samples) {
+    Mutex::Autolock autoLock(mLock);
+    start_l();
+    while (mSamples.empty() && mFinalResult == OK && !mStopping) {
+        mCondition.wait(mLock);
+    }
+    samples->splice(samples->end(), mSamples);
+    mCondition.broadcast();
+    return mStopping ? ERROR_END_OF_STREAM : mFinalResult;
+}
+
+status_t NuMediaExtractor::SamplePrefetcher::copySample(MediaBufferBase *mbuf, Sample *sample) {
+    int64_t timeUs;
+    if (!mbuf->meta_data().findInt64(kKeyTime, &timeUs)) {
+        mbuf->meta_data().dumpToLog();
+        mbuf->release();
+        return ERROR_MALFORMED;
+    }
+
+    MediaBufferBase *copy = NULL;
+    size_t size = mbuf->range_length();
+    if (mGroup.acquire_buffer(&copy, true /* nonBlocking */, size) == OK) {
+        memcpy(copy->data(), (const uint8_t *)mbuf->data() + mbuf->range_offset(), size);
+        copy->set_range(0, size);
+        copy->meta_data() = mbuf->meta_data();
+        mbuf->release();
+        mbuf = copy;
+    } else {
+        // cannot happen as long as the queue is bounded, keep the source's buffer
+        ALOGW("no free buffer to prefetch track %zu", mTrackIndex);
+    }
+
+    *sample = Sample(mbuf, timeUs);
+    return OK;
+}
+
+void NuMediaExtractor::SamplePrefetcher::threadLoop() {
+    Mutex::Autolock autoLock(mLock);
+    while (true) {
+        while (!mStopping && !mSeekPending
+                && (mFinalResult != OK || mSamples.size() >= mMaxQueued)) {
+            mCondition.wait(mLock);
+        }
+        if (mStopping) {
+            break;
+        }
+
+        MediaSource::ReadOptions options;
+        if (mSeekPending) {
+            options.setSeekTo(mSeekTimeUs, mSeekMode);
+            mSeekPending = false;
+        }
+        uint32_t generation = mGeneration;
+        size_t maxCount = mMaxQueued - mSamples.size();
+
+        mLock.unlock();
+        status_t err = OK;
+        Vector<MediaBufferBase *> mediaBuffers;
+        if (mSource->supportReadMultiple()) {
+            options.setNonBlocking();
+            err = mSource->readMultiple(&mediaBuffers, maxCount, &options);
+        } else {
+            MediaBufferBase *mbuf = NULL;
+            err = mSource->read(&mbuf, &options);
+            if (err == OK && mbuf != NULL) {
+                mediaBuffers.push_back(mbuf);
+            }
+        }
+        if (err != OK && err != ERROR_END_OF_STREAM) {
+            ALOGW("read on track %zu failed with error %d", mTrackIndex, err);
+        }
+
+        std::list<Sample> samples;
+        bool releaseRemaining = false;
+        for (size_t i = 0; i < mediaBuffers.size(); ++i) {
+            MediaBufferBase *mbuf = mediaBuffers[i];
+            if (mbuf == NULL) {
+                continue;
+            }
+            if (releaseRemaining) {
+                mbuf->release();
+                continue;
+            }
+            Sample sample;
+            if (copySample(mbuf, &sample) == OK) {
+                samples.push_back(sample);
+            } else {
+                err = ERROR_MALFORMED;
+                releaseRemaining = true;
+            }
+        }
+        mLock.lock();
+
+        if (generation != mGeneration) {
+            // seeked in the meantime
+            for (const Sample &sample : samples) {
+                sample.mBuffer->release();
+            }
+            continue;
+        }
+        mSamples.splice(mSamples.end(), samples);
+        mFinalResult = err;
+        mCondition.broadcast();
+    }
+}
+
 NuMediaExtractor::NuMediaExtractor(EntryPoint entryPoint)
     : mEntryPoint(entryPoint),
       mTotalBitrate(-1LL),
-      mDurationUs(-1LL) {
+      mDurationUs(-1LL),
+      mPrefetchEnabled(property_get_bool("media.stagefright.extractor-prefetch", false)) {
 }
 
 NuMediaExtractor::~NuMediaExtractor() {
@@ -62,6 +277,9 @@ NuMediaExtractor::~NuMediaExtractor() {
     for (size_t i = 0; i < mSelectedTracks.size(); ++i) {
         TrackInfo *info = &mSelectedTracks.editItemAt(i);
 
+        if (info->mPrefetcher != nullptr) {
+            info->mPrefetcher->stop();
+        }
         status_t err = info->mSource->stop();
         ALOGE_IF(err != OK, "error %d stopping track %zu", err, i);
     }
@@ -142,8 +360,11 @@ status_t NuMediaExtractor::setDataSource(int fd, off64_t offset, off64_t size) {
         return err;
     }
 
+    // Samples of all selected tracks are read in (interleaved) file order.
+    fileSource->setAccessPattern(FileSource::kAccessSequential);
+
     // Initialize MediaExtractor using the file source
-    return initMediaExtractor(fileSource);
+    return initMediaExtractor(BlockCacheSource::Wrap(fileSource));
 }
 
 status_t NuMediaExtractor::setDataSource(const sp<DataSource> &source) {
@@ -178,6 +399,17 @@ static String8 arrayToString(const std::vector<uint8_t> &array) {
     return result;
 }
 
+status_t NuMediaExtractor::setPrefetchEnabled(bool enabled) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (!mSelectedTracks.isEmpty()) {
+        return INVALID_OPERATION;
+    }
+
+    mPrefetchEnabled = enabled;
+    return OK;
+}
+
 status_t NuMediaExtractor::setMediaCas(const HInterfaceToken &casToken) {
     ALOGV("setMediaCas: casToken={%s}", arrayToString(casToken).c_str());
 
@@ -427,6 +659,11 @@ status_t NuMediaExtractor::selectTrack(size_t index,
         info->mTrackFlags |= kIsVorbis;
     }
 
+    if (mPrefetchEnabled) {
+        info->mPrefetcher = std::make_shared<SamplePrefetcher>(
+                source, index, info->mMaxFetchCount);
+    }
+
     if (startTimeUs >= 0) {
         fetchTrackSamples(info, startTimeUs, mode);
     }
@@ -463,6 +700,9 @@ status_t NuMediaExtractor::unselectTrack(size_t index) {
 
     releaseTrackSamples(info);
 
+    if (info->mPrefetcher != nullptr) {
+        info->mPrefetcher->stop();
+    }
     CHECK_EQ((status_t)OK, info->mSource->stop());
 
     mSelectedTracks.removeAt(i);
@@ -505,9 +745,25 @@ ssize_t NuMediaExtractor::fetchAllTrackSamples(
     TrackInfo *minInfo = NULL;
     ssize_t minIndex = ERROR_END_OF_STREAM;
 
+    if (seekTimeUs >= 0LL) {
+        // Let all prefetching tracks seek at once rather than one after the other.
+        for (size_t i = 0; i < mSelectedTracks.size(); ++i) {
+            TrackInfo *info = &mSelectedTracks.editItemAt(i);
+            if (info->mPrefetcher != nullptr) {
+                info->mFinalResult = OK;
+                releaseTrackSamples(info);
+                info->mPrefetcher->seek(seekTimeUs, mode);
+            }
+        }
+    }
+
     for (size_t i = 0; i < mSelectedTracks.size(); ++i) {
         TrackInfo *info = &mSelectedTracks.editItemAt(i);
-        fetchTrackSamples(info, seekTimeUs, mode);
+        if (info->mPrefetcher != nullptr) {
+            fetchTrackSamples(info);
+        } else {
+            fetchTrackSamples(info, seekTimeUs, mode);
+        }
 
         status_t err = info->mFinalResult;
         if (err != OK && err != ERROR_END_OF_STREAM && info->mSamples.empty()) {
@@ -549,6 +805,14 @@ void NuMediaExtractor::fetchTrackSamples(TrackInfo *info,
         return;
     }
 
+    if (info->mPrefetcher != nullptr) {
+        if (seekTimeUs >= 0LL) {
+            info->mPrefetcher->seek(seekTimeUs, mode);
+        }
+        info->mFinalResult = info->mPrefetcher->dequeueSamples(&info->mSamples);
+        return;
+    }
+
     status_t err = OK;
     Vector<MediaBufferBase *> mediaBuffers;
     if (info->mSource->supportReadMultiple()) {
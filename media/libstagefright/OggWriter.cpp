@@ -150,8 +150,7 @@ status_t OggWriter::writeOggHeaderPackets(unsigned char *buf, size_t size) {
     int ret;
     while ((ret = ogg_stream_flush((ogg_stream_state*)mOs, &og))) {
         if (!ret) break;
-        write(mFd, og.header, og.header_len);
-        write(mFd, og.body, og.body_len);
+        writePage(og.header, og.header_len, og.body, og.body_len);
     }
 
 
@@ -180,8 +179,7 @@ status_t OggWriter::writeOggHeaderPackets(unsigned char *buf, size_t size) {
 
     while ((ret = ogg_stream_flush((ogg_stream_state*)mOs, &og))) {
         if (!ret) break;
-        write(mFd, og.header, og.header_len);
-        write(mFd, og.body, og.body_len);
+        writePage(og.header, og.header_len, og.body, og.body_len);
     }
 
     free(comments);
@@ -189,6 +187,22 @@ status_t OggWriter::writeOggHeaderPackets(unsigned char *buf, size_t size) {
     return OK;
 }
 
+// Pages go through mWriteQueue, so that they are written in the order they are
+// made, whether that is before or after start().
+status_t OggWriter::writePage(const uint8_t *header, size_t headerSize,
+                              const uint8_t *body, size_t bodySize) {
+    if (mWriteQueue == NULL) {
+        mPendingPages.insert(mPendingPages.end(), header, header + headerSize);
+        mPendingPages.insert(mPendingPages.end(), body, body + bodySize);
+        return OK;
+    }
+    struct iovec iov[2] = {
+        { (void *)header, headerSize },
+        { (void *)body, bodySize },
+    };
+    return mWriteQueue->writev(iov, 2);
+}
+
 status_t OggWriter::start(MetaData* /* params */) {
     if (mInitCheck != OK) {
         return mInitCheck;
@@ -220,6 +234,22 @@ status_t OggWriter::start(MetaData* /* params */) {
     mReachedEOS = false;
     mDone = false;
 
+    // Pages are written from the queue's thread, so that slow storage does
+    // not hold up reading from the source.
+    mWriteQueue = new AWriteQueue(mFd);
+    err = mWriteQueue->start("OggWriterIO");
+    if (err == OK && !mPendingPages.empty()) {
+        err = mWriteQueue->write(mPendingPages.data(), mPendingPages.size());
+        mPendingPages.clear();
+    }
+    if (err != OK) {
+        mWriteQueue->stop();
+        mWriteQueue.clear();
+        pthread_attr_destroy(&attr);
+        mSource->stop();
+        return err;
+    }
+
     pthread_create(&mThread, &attr, ThreadWrapper, this);
     pthread_attr_destroy(&attr);
 
@@ -391,8 +421,9 @@ status_t OggWriter::threadFunc() {
         size_t n = 0;
 
         while (ogg_stream_flush((ogg_stream_state*)mOs, &og) > 0) {
-            write(mFd, og.header, og.header_len);
-            write(mFd, og.body, og.body_len);
+            if (writePage(og.header, og.header_len, og.body, og.body_len) != OK) {
+                break;
+            }
             n = n + og.header_len + og.body_len;
         }
 
@@ -422,6 +453,15 @@ status_t OggWriter::threadFunc() {
         err = ERROR_MALFORMED;
     }
 
+    status_t queueErr = mWriteQueue->stop();
+    if (queueErr != OK) {
+        ALOGE("failed to write pages: %s", strerror(-queueErr));
+        if (err == OK) {
+            err = ERROR_IO;
+        }
+    }
+    mWriteQueue.clear();
+
     close(mFd);
     mFd = -1;
     mReachedEOS = true;
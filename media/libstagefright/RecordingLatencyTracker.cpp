@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "RecordingLatencyTracker"
+#include <utils/Log.h>
+
+#include <inttypes.h>
+#include <string>
+
+#include <media/MediaMetricsItem.h>
+#include <media/stagefright/RecordingLatencyTracker.h>
+
+namespace android {
+
+// Bucket limits in us. A frame at 30fps lasts 33ms; latencies beyond a few
+// frame times are what drops frames.
+static const std::vector<int64_t> kBucketLimitsUs = {
+    0, 1000, 2000, 5000, 10000, 16000, 33000, 50000, 100000, 200000, 500000, 1000000,
+};
+
+RecordingLatencyTracker::RecordingLatencyTracker() {
+    for (int video = 0; video < 2; ++video) {
+        for (int stage = 0; stage < kNumStages; ++stage) {
+            mHistograms[video][stage].setup(kBucketLimitsUs);
+        }
+    }
+}
+
+void RecordingLatencyTracker::record(bool isVideo, Stage stage, int64_t latencyUs) {
+    if (stage < 0 || stage >= kNumStages) {
+        return;
+    }
+    Mutex::Autolock autoLock(mLock);
+    mHistograms[isVideo][stage].insert(latencyUs);
+}
+
+// static
+const char *RecordingLatencyTracker::StageName(Stage stage) {
+    switch (stage) {
+        case kStageSourceToEncoder: return "source-to-encoder";
+        case kStageEncoder:         return "encoder";
+        case kStageEncoderToWriter: return "encoder-to-writer";
+        default:                    return "unknown";
+    }
+}
+
+AString RecordingLatencyTracker::dump() const {
+    Mutex::Autolock autoLock(mLock);
+    AString result;
+    for (int video = 1; video >= 0; --video) {
+        for (int stage = 0; stage < kNumStages; ++stage) {
+            const MediaHistogram<int64_t> &h = mHistograms[video][stage];
+            if (h.getCount() == 0) {
+                continue;
+            }
+            result.append(AStringPrintf(
+                    "     %s %s latency (us): n=%" PRId64 " avg=%" PRId64 " min=%" PRId64
+                    " max=%" PRId64 " hist=%s\n",
+                    video ? "video" : "audio", StageName((Stage)stage),
+                    h.getCount(), h.getAvg(), h.getMin(), h.getMax(), h.emit().c_str()));
+        }
+    }
+    return result;
+}
+
+void RecordingLatencyTracker::reportMetrics(mediametrics::Item *item, const char *prefix) const {
+    Mutex::Autolock autoLock(mLock);
+    for (int video = 1; video >= 0; --video) {
+        for (int stage = 0; stage < kNumStages; ++stage) {
+            const MediaHistogram<int64_t> &h = mHistograms[video][stage];
+            if (h.getCount() == 0) {
+                continue;
+            }
+            std::string key = std::string(prefix) + (video ? "video" : "audio")
+                    + ".latency." + StageName((Stage)stage) + ".";
+            item->setInt64((key + "n").c_str(), h.getCount());
+            item->setInt64((key + "avg").c_str(), h.getAvg());
+            item->setInt64((key + "max").c_str(), h.getMax());
+            item->setCString((key + "hist").c_str(), h.emit().c_str());
+            item->setCString((key + "hist-buckets").c_str(), h.emitBuckets().c_str());
+        }
+    }
+}
+
+}  // namespace android
@@ -22,6 +22,7 @@
 #include <media/AudioSystem.h>
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferProvider.h>
 #include <utils/List.h>
 
 #include <system/audio.h>
@@ -88,6 +89,10 @@ struct AudioSource : public MediaSource,
 
     status_t getPortId(audio_port_handle_t *portId) const;
 
+    // Reads the captured audio into buffers from |provider| while it has any
+    // to spare, instead of into buffers of our own. Call before start().
+    void setBufferProvider(const sp<MediaBufferProvider> &provider);
+
 protected:
     virtual ~AudioSource();
 
@@ -128,6 +133,7 @@ private:
     bool mNoMoreFramesToRead;
 
     List<MediaBuffer * > mBuffersReceived;
+    sp<MediaBufferProvider> mBufferProvider;
 
     void trackMaxAmplitude(int16_t *data, int nSamples);
 
@@ -137,6 +143,10 @@ private:
         int32_t startFrame, int32_t rampDurationFrames,
         uint8_t *data,   size_t bytes);
 
+    // Returns a buffer of |size| bytes, from the buffer provider if it has
+    // one to spare.
+    MediaBuffer *acquireBuffer_l(size_t size);
+    void releaseBuffer_l(MediaBufferBase *buffer);
     void queueInputBuffer_l(MediaBuffer *buffer, int64_t timeUs);
     void releaseQueuedFrames_l();
     void waitOutstandingEncodingFrames_l();
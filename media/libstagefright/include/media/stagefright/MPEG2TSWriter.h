@@ -21,6 +21,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AWriteQueue.h>
 #include <media/stagefright/MediaWriter.h>
 
 namespace android {
@@ -53,7 +54,10 @@ private:
 
     struct SourceInfo;
 
-    FILE *mFile;
+    static const size_t kTSPacketSize = 188;
+
+    int mFd;
+    sp<AWriteQueue> mWriteQueue;
 
     void *mWriteCookie;
     ssize_t (*mWriteFunc)(void *cookie, const void *data, size_t size);
@@ -72,12 +76,26 @@ private:
     int mPMTContinuityCounter;
     uint32_t mCrcTable[256];
 
+    // The PAT and PMT packets are built once at start(), only their
+    // continuity counters change from one repetition to the next.
+    uint8_t mProgramAssociationTable[kTSPacketSize];
+    uint8_t mProgramMap[kTSPacketSize];
+
+    // TS packets are assembled back to back in here, and written out with a
+    // single call once an access unit is complete.
+    sp<ABuffer> mPackets;
+
     void init();
 
+    void initProgramAssociationTable();
+    void initProgramMap();
+
     void writeTS();
     void writeProgramAssociationTable();
     void writeProgramMap();
     void writeAccessUnit(int32_t sourceIndex, const sp<ABuffer> &buffer);
+    uint8_t *appendPackets(size_t numPackets);
+    void writePackets();
     void initCrcTable();
     uint32_t crc32(const uint8_t *start, size_t length);
 
@@ -19,6 +19,7 @@
 #define MPEG4_WRITER_H_
 
 #include <stdio.h>
+#include <sys/uio.h>
 
 #include <media/stagefright/MediaWriter.h>
 #include <utils/List.h>
@@ -26,14 +27,18 @@
 #include <map>
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AWriteQueue.h>
+#include <array>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 namespace android {
 
 struct AMessage;
 class MediaBuffer;
 struct ABuffer;
+struct RecordingLatencyTracker;
 
 class MPEG4Writer : public MediaWriter {
 public:
@@ -73,10 +78,16 @@ public:
     status_t setGeoData(int latitudex10000, int longitudex10000);
     status_t setCaptureRate(float captureFps);
     status_t setTemporalLayerCount(uint32_t layerCount);
+    // Returns the memory taken by the sample tables of all tracks, which are
+    // only counted for fragmented files.
+    size_t getSampleTableSizeBytes();
     void notifyApproachingLimit();
     virtual void setStartTimeOffsetMs(int ms) { mStartTimeOffsetMs = ms; }
     virtual int32_t getStartTimeOffsetMs() const { return mStartTimeOffsetMs; }
     virtual status_t setNextFd(int fd);
+    // Records, per sample, the time from the encoder output to the write of
+    // its chunk. Call before start().
+    void setLatencyTracker(const sp<RecordingLatencyTracker> &tracker);
 
 protected:
     virtual ~MPEG4Writer();
@@ -134,6 +145,27 @@ private:
                         std::greater<std::chrono::microseconds>> mWriteDurationPQ;
     const uint8_t kWriteDurationsCount = 5;
 
+    // Sample data queued for writing at the current file position, gathered
+    // into one ::writev() by flushPendingWrites_l(). Length prefixes point into
+    // mPendingPrefixes, which is reserved up front and never reallocates while
+    // they are queued.
+    std::vector<struct iovec> mPendingWrites;
+    std::vector<std::array<uint8_t, 4>> mPendingPrefixes;
+    size_t mPendingWriteBytes;
+    // Keep queueing across samples until the end of the chunk being written.
+    bool mBatchWrites;
+    // Sample data is handed to this queue while the writer thread runs, so
+    // that slow storage does not hold up the tracks. Everything else is
+    // written directly after draining the queue.
+    sp<AWriteQueue> mWriteQueue;
+
+    // Fragmented file writing. Samples are written in 'moof' and 'mdat' box
+    // pairs of about mFragmentDurationUs each, after a 'moov' box without
+    // samples. Tracks then only keep the sample counts of their tables.
+    int64_t mFragmentDurationUs;  // 0 unless writing a fragmented file
+    uint32_t mFragmentSequenceNumber;  // of the last written fragment
+    off64_t mMehdOffset;  // of the fragment duration, set in reset()
+
     sp<ALooper> mLooper;
     sp<AHandlerReflector<MPEG4Writer> > mReflector;
 
@@ -160,6 +192,7 @@ private:
     int64_t estimateFileLevelMetaSize(MetaData *params);
     void writeCachedBoxToFile(const char *type);
     void printWriteDurations();
+    bool isFragmented() const { return mFragmentDurationUs > 0; }
 
     struct Chunk {
         Track               *mTrack;        // Owner
@@ -264,6 +297,23 @@ private:
     // Actually write the given chunk to the file.
     void writeChunkToFile(Chunk* chunk);
 
+    sp<RecordingLatencyTracker> mLatencyTracker;
+    // Records the latency of a sample stamped with kKeyEncoderOutputTime once
+    // it has been written.
+    void traceSampleWritten(bool isVideo, MediaBuffer *sample);
+
+    // In fragmented mode, each chunk holds one sample and an empty chunk ends
+    // the track. Return the number of chunks of |info| that go into a fragment
+    // ending at |endTimeUs|, or -1 if that is not known yet.
+    ssize_t getFragmentChunkCount_l(const ChunkInfo &info, int64_t endTimeUs) const;
+
+    // Write the next fragment if enough samples are buffered for it, or any
+    // buffered samples if |flush| is set. Return true if a fragment is written.
+    bool writeNextFragment_l(bool flush);
+
+    // Write the boxes that are still missing after the last fragment.
+    void finishFragments(int64_t durationUs);
+
     // Adjust other track media clock (presumably wall clock)
     // based on audio track media clock with the drift time.
     int64_t mDriftTimeUs;
@@ -297,8 +347,19 @@ private:
     off64_t addSample_l(
             MediaBuffer *buffer, bool usePrefix,
             uint32_t tiffHdrOffset, size_t *bytesWritten);
-    void addLengthPrefixedSample_l(MediaBuffer *buffer);
+    void addLengthPrefixedSample_l(const uint8_t *data, size_t length);
     void addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer);
+    // Bytes addMultipleLengthPrefixedSamples_l() writes for |buffer|.
+    size_t getLengthPrefixedSampleSize(MediaBuffer *buffer) const;
+    // Queue |size| bytes at |data|, which must stay valid until flushed.
+    void queueWrite_l(const void *data, size_t size);
+    // Queue the low |size| bytes of |value| in big endian order.
+    void queuePrefix_l(uint32_t value, size_t size);
+    // Write all queued data by calling ::writev(), or hand it to mWriteQueue, or post error
+    // message to looper on failure.
+    void flushPendingWrites_l();
+    // Wait for mWriteQueue to drain or post error message to looper on failure.
+    void drainWriteQueueOrPostError();
     uint16_t addProperty_l(const ItemProperty &);
     status_t reserveItemId_l(size_t numItems, uint16_t *itemIdBase);
     uint16_t addItem_l(const ItemInfo &);
@@ -313,6 +374,7 @@ private:
     void writeCompositionMatrix(int32_t degrees);
     void writeMvhdBox(int64_t durationUs);
     void writeMoovBox(int64_t durationUs);
+    void writeMvexBox();
     void writeFtypBox(MetaData *param);
     void writeUdtaBox();
     void writeGeoDataBox();
@@ -56,6 +56,15 @@ public:
 
     size_t buffers() const;
 
+    // Counters of blocking acquire_buffer() calls, for dumps and benchmarks.
+    struct WaitStats {
+        uint64_t acquires;     // buffers handed out
+        uint64_t waits;        // acquires that had to wait for a returned buffer
+        int64_t totalWaitUs;
+        int64_t maxWaitUs;
+    };
+    WaitStats getWaitStats() const;
+
     // If buffer is nullptr, have acquire_buffer() check for remote release.
     virtual void signalBufferReturned(MediaBufferBase *buffer);
 
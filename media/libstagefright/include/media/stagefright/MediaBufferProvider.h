@@ -0,0 +1,55 @@
+/*
+ * Copyright 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_BUFFER_PROVIDER_H_
+
+#define MEDIA_BUFFER_PROVIDER_H_
+
+#include <utils/RefBase.h>
+
+namespace android {
+
+class MediaBuffer;
+class MediaBufferBase;
+
+// Lends buffers to a MediaSource to fill in place of buffers of its own, so
+// that the data reaches the consumer of the source without another copy.
+//
+// Both methods may be called from any thread and do not block.
+struct MediaBufferProvider : public RefBase {
+    // Returns a buffer with room for at least |size| bytes, or NULL if none is
+    // free right now, in which case the source allocates one itself. The
+    // buffer has no observer, like a MediaBuffer the source allocates.
+    virtual MediaBuffer *acquireBuffer(size_t size) = 0;
+
+    // Takes back a buffer once the source is done with it, whether or not its
+    // data was consumed. Call before releasing the buffer. This includes the
+    // buffers the source allocated itself, which the provider may wait for
+    // before lending more.
+    virtual void returnBuffer(MediaBufferBase *buffer) = 0;
+
+protected:
+    MediaBufferProvider() {}
+    virtual ~MediaBufferProvider() {}
+
+private:
+    MediaBufferProvider(const MediaBufferProvider &);
+    MediaBufferProvider &operator=(const MediaBufferProvider &);
+};
+
+}  // namespace android
+
+#endif  // MEDIA_BUFFER_PROVIDER_H_
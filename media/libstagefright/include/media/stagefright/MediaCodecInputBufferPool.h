@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_CODEC_INPUT_BUFFER_POOL_H_
+
+#define MEDIA_CODEC_INPUT_BUFFER_POOL_H_
+
+#include <media/stagefright/MediaBufferProvider.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/KeyedVector.h>
+#include <utils/List.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+class MediaCodecBuffer;
+
+// Lends the input buffers of an audio encoder to the source, which reads into
+// them directly. MediaCodecSource adds the input buffers as the encoder makes
+// them available, and claims the lent ones back as the source hands them over
+// to queue them to the encoder.
+struct MediaCodecInputBufferPool : public MediaBufferProvider {
+    MediaCodecInputBufferPool();
+
+    // Adds an input buffer of the encoder that is free to use.
+    void addFreeBuffer(size_t index, const sp<MediaCodecBuffer> &buffer);
+    // Takes a free input buffer to copy data into. Returns false if none is
+    // free.
+    bool takeFreeBuffer(size_t *index, sp<MediaCodecBuffer> *buffer);
+    // Takes back the input buffer |mbuf| was lent out for, to queue it to the
+    // encoder, before the source returns |mbuf|. Returns false if |mbuf| is
+    // not a lent input buffer.
+    bool claimBuffer(MediaBufferBase *mbuf, size_t *index, sp<MediaCodecBuffer> *buffer);
+    // Drops all input buffers once the encoder is released. Lent buffers stay
+    // valid until the source returns them.
+    void flush();
+
+    // MediaBufferProvider
+    virtual MediaBuffer *acquireBuffer(size_t size);
+    virtual void returnBuffer(MediaBufferBase *mbuf);
+
+private:
+    struct Entry {
+        size_t mIndex;
+        sp<MediaCodecBuffer> mBuffer;
+        // taken back to queue to the encoder
+        bool mClaimed;
+    };
+
+    Mutex mLock;
+    bool mFlushed;
+    List<Entry> mFreeBuffers;
+    KeyedVector<MediaBufferBase *, Entry> mLentBuffers;
+    // buffers the source allocated itself that it has not returned yet
+    size_t mNumSourceBuffers;
+
+    DISALLOW_EVIL_CONSTRUCTORS(MediaCodecInputBufferPool);
+};
+
+}  // namespace android
+
+#endif  // MEDIA_CODEC_INPUT_BUFFER_POOL_H_
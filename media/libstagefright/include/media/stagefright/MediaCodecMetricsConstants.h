@@ -25,6 +25,15 @@ namespace android {
 // NB: These are not yet exposed as public Java API constants.
 inline constexpr char kCodecPixelFormat[] =
         "android.media.mediacodec.pixel-format";
+// adaptive pipeline depth (CCodec)
+inline constexpr char kCodecPipelineDepth[] =
+        "android.media.mediacodec.pipeline-depth";
+inline constexpr char kCodecPipelineDepthMin[] =
+        "android.media.mediacodec.pipeline-depth-min";
+inline constexpr char kCodecPipelineDepthIncreases[] =
+        "android.media.mediacodec.pipeline-depth-increases";
+inline constexpr char kCodecPipelineDepthDecreases[] =
+        "android.media.mediacodec.pipeline-depth-decreases";
 
 }
 
@@ -22,6 +22,7 @@
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/foundation/Mutexed.h>
 #include <media/stagefright/PersistentSurface.h>
+#include <utils/KeyedVector.h>
 
 namespace android {
 
@@ -30,12 +31,19 @@ struct AMessage;
 struct AReplyToken;
 class IGraphicBufferProducer;
 struct MediaCodec;
+class MediaCodecBuffer;
+struct MediaCodecInputBufferPool;
+struct MediaBufferProvider;
+struct RecordingLatencyTracker;
 
 struct MediaCodecSource : public MediaSource,
                           public MediaBufferObserver {
     enum FlagBits {
         FLAG_USE_SURFACE_INPUT      = 1,
         FLAG_PREFER_SOFTWARE_CODEC  = 4,  // used for testing only
+        // Lend the encoder input buffers to the source, see
+        // getInputBufferProvider(). Audio only.
+        FLAG_LEND_INPUT_BUFFERS     = 8,
     };
 
     static sp<MediaCodecSource> Create(
@@ -50,6 +58,16 @@ struct MediaCodecSource : public MediaSource,
     status_t setInputBufferTimeOffset(int64_t timeOffsetUs);
     int64_t getFirstSampleSystemTimeUs();
 
+    // Returns a provider of the encoder input buffers for the source to read
+    // into, which saves copying its buffers into the encoder. NULL unless
+    // created with FLAG_LEND_INPUT_BUFFERS for an audio encoder.
+    sp<MediaBufferProvider> getInputBufferProvider();
+
+    // Records how long samples spend between the source and the encoder, and
+    // in the encoder, and stamps the output for the writer. Call before
+    // start().
+    void setLatencyTracker(const sp<RecordingLatencyTracker> &tracker);
+
     // MediaSource
     virtual status_t start(MetaData *params = NULL);
     virtual status_t stop();
@@ -111,6 +129,16 @@ private:
     status_t initEncoder();
     void releaseEncoder();
     status_t feedEncoderInputBuffers();
+    // Pops the next buffer of the source along with the encoder input buffer
+    // it goes into, which is the one it was read into if it was lent out.
+    // Returns false if either is not available yet. |inbuf| is set whenever
+    // mInputBufferPool is in use, and |lent| tells whether the data is
+    // already in it.
+    bool dequeueEncoderInput(
+            MediaBufferBase **mbuf, size_t *bufferIndex, sp<MediaCodecBuffer> *inbuf,
+            bool *lent);
+    // Hands back an encoder input buffer that was not queued.
+    void requeueEncoderInput(size_t bufferIndex, const sp<MediaCodecBuffer> &inbuf);
     // Resume GraphicBufferSource at resumeStartTimeUs. Buffers
     // from GraphicBufferSource with timestamp larger or equal to
     // resumeStartTimeUs will be encoded. resumeStartTimeUs uses
@@ -141,6 +169,9 @@ private:
     sp<PersistentSurface> mPersistentSurface;
     List<MediaBufferBase *> mInputBufferQueue;
     List<size_t> mAvailEncoderInputIndices;
+    // holds the available encoder input buffers instead of
+    // mAvailEncoderInputIndices with FLAG_LEND_INPUT_BUFFERS
+    sp<MediaCodecInputBufferPool> mInputBufferPool;
     List<int64_t> mDecodingTimeQueue; // decoding time (us) for video
     int64_t mInputBufferTimeOffsetUs;
     int64_t mFirstSampleSystemTimeUs;
@@ -150,6 +181,10 @@ private:
     int64_t mFirstSampleTimeUs;
     List<int64_t> mDriftTimeQueue;
 
+    sp<RecordingLatencyTracker> mLatencyTracker;
+    // time each traced sample was queued to the encoder, by timestamp
+    KeyedVector<int64_t, int64_t> mEncoderInputTimesUs;
+
     struct Output {
         Output();
         List<MediaBufferBase*> mBufferQueue;
@@ -80,6 +80,8 @@ enum {
     kKeyTargetTime        = 'tarT',  // int64_t (usecs)
     kKeyDriftTime         = 'dftT',  // int64_t (usecs)
     kKeyAnchorTime        = 'ancT',  // int64_t (usecs)
+    kKeySourceReadTime    = 'srdT',  // int64_t (usecs, ALooper::GetNowUs() when read from the source)
+    kKeyEncoderOutputTime = 'encT',  // int64_t (usecs, ALooper::GetNowUs() when output by the encoder)
     kKeyDuration          = 'dura',  // int64_t (usecs)
     kKeyPixelFormat       = 'pixf',  // int32_t
     kKeyColorFormat       = 'colf',  // int32_t
@@ -137,6 +139,9 @@ enum {
     kKeyRealTimeRecording = 'rtrc',  // bool (int32_t)
     kKeyBackgroundMode = 'bkmd',  // bool (int32_t)
 
+    // Write a fragmented mp4 file with fragments of about this duration
+    kKeyFragmentDurationUs = 'frdu',  // int64_t
+
     kKeyNumBuffers        = 'nbbf',  // int32_t
 
     // Ogg files can be tagged to be automatically looping...
@@ -18,6 +18,7 @@
 #define NU_MEDIA_EXTRACTOR_H_
 
 #include <list>
+#include <memory>
 #include <media/mediaplayer.h>
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/AudioPresentationInfo.h>
@@ -67,6 +68,12 @@ struct NuMediaExtractor : public RefBase {
 
     status_t setMediaCas(const HInterfaceToken &casToken);
 
+    // In prefetch mode every selected track is read ahead on its own thread,
+    // so that reads on the different tracks overlap instead of stalling the
+    // caller one after the other. Must be set before selecting any track.
+    // Defaults to the value of media.stagefright.extractor-prefetch.
+    status_t setPrefetchEnabled(bool enabled);
+
     size_t countTracks() const;
     status_t getTrackFormat(size_t index, sp<AMessage> *format, uint32_t flags = 0) const;
 
@@ -123,6 +130,8 @@ private:
         int64_t mSampleTimeUs;
     };
 
+    struct SamplePrefetcher;
+
     struct TrackInfo {
         sp<IMediaSource> mSource;
         size_t mTrackIndex;
@@ -132,6 +141,9 @@ private:
         std::list<Sample> mSamples;
 
         uint32_t mTrackFlags;  // bitmask of "TrackFlags"
+
+        // only set in prefetch mode
+        std::shared_ptr<SamplePrefetcher> mPrefetcher;
     };
 
     const EntryPoint mEntryPoint;
@@ -147,6 +159,7 @@ private:
     int64_t mTotalBitrate;  // in bits/sec
     int64_t mDurationUs;
     String8 mName;
+    bool mPrefetchEnabled;
 
     void setEntryPointToRemoteMediaExtractor();
 
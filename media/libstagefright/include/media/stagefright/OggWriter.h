@@ -20,7 +20,10 @@
 
 #include <stdio.h>
 
+#include <vector>
+
 #include <media/stagefright/MediaWriter.h>
+#include <media/stagefright/foundation/AWriteQueue.h>
 #include <utils/threads.h>
 
 struct OggStreamState;
@@ -43,6 +46,9 @@ protected:
 
 private:
     int mFd;
+    sp<AWriteQueue> mWriteQueue;
+    // pages made before start(), queued first once mWriteQueue exists
+    std::vector<uint8_t> mPendingPages;
     bool mHaveAllCodecSpecificData;
     status_t mInitCheck;
     sp<MediaSource> mSource;
@@ -69,6 +75,8 @@ private:
     OggWriter& operator=(const OggWriter&);
 
     status_t writeOggHeaderPackets(unsigned char *buf, size_t size);
+    status_t writePage(const uint8_t *header, size_t headerSize,
+                       const uint8_t *body, size_t bodySize);
 };
 
 }  // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RECORDING_LATENCY_TRACKER_H_
+
+#define RECORDING_LATENCY_TRACKER_H_
+
+#include <assert.h>
+
+#include <media/stagefright/MediaHistogram.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+namespace android {
+
+namespace mediametrics {
+class Item;
+}
+
+// Collects how long the samples of a recording spend between the stages of the
+// pipeline, from the source through MediaCodecSource to the writer, per track
+// type. Each stage stamps a sample with ALooper::GetNowUs() in its metadata,
+// and the next stage records the difference.
+//
+// Tracing is opt-in: the components only stamp and record samples once a
+// tracker is set on them, before they are started.
+struct RecordingLatencyTracker : public RefBase {
+    enum Stage {
+        // From the read from the source to the encoder input queue.
+        kStageSourceToEncoder,
+        // From the encoder input queue to the encoder output. Video only, as
+        // audio encoder output does not map to input buffers.
+        kStageEncoder,
+        // From the encoder output to the write of the chunk holding the sample.
+        kStageEncoderToWriter,
+        kNumStages,
+    };
+
+    RecordingLatencyTracker();
+
+    void record(bool isVideo, Stage stage, int64_t latencyUs);
+
+    // Summarizes each stage with samples, one line per stage.
+    AString dump() const;
+
+    // Sets the sample count, average, maximum and histogram of each stage with
+    // samples on |item|, with keys starting with |prefix|.
+    void reportMetrics(mediametrics::Item *item, const char *prefix) const;
+
+    static const char *StageName(Stage stage);
+
+private:
+    mutable Mutex mLock;
+    // indexed by [isVideo][stage]
+    MediaHistogram<int64_t> mHistograms[2][kNumStages];
+
+    DISALLOW_EVIL_CONSTRUCTORS(RecordingLatencyTracker);
+};
+
+}  // namespace android
+
+#endif  // RECORDING_LATENCY_TRACKER_H_
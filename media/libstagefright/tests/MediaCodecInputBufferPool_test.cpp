@@ -0,0 +1,174 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "MediaCodecInputBufferPool_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/MediaCodecBuffer.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaCodecInputBufferPool.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+namespace android {
+
+static constexpr size_t kBufferSize = 4096;
+
+class MediaCodecInputBufferPoolTest : public ::testing::Test {
+protected:
+    MediaCodecInputBufferPoolTest() : mPool(new MediaCodecInputBufferPool) {}
+
+    // Adds input buffer |index| of the encoder to the pool.
+    sp<MediaCodecBuffer> addFreeBuffer(size_t index) {
+        sp<MediaCodecBuffer> buffer = new MediaCodecBuffer(new AMessage, new ABuffer(kBufferSize));
+        mPool->addFreeBuffer(index, buffer);
+        return buffer;
+    }
+
+    // Returns |mbuf| to the pool and releases it, as the source does once it
+    // is done with it.
+    void returnBuffer(MediaBufferBase *mbuf) {
+        mPool->returnBuffer(mbuf);
+        mbuf->release();
+    }
+
+    sp<MediaCodecInputBufferPool> mPool;
+};
+
+TEST_F(MediaCodecInputBufferPoolTest, lendsDroppedBufferAgain) {
+    sp<MediaCodecBuffer> inbuf = addFreeBuffer(3);
+
+    MediaBuffer *mbuf = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(mbuf, nullptr);
+    EXPECT_EQ(mbuf->data(), inbuf->base());
+    // nothing else to lend
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    returnBuffer(new MediaBuffer(kBufferSize));
+
+    // dropped by the source without being claimed
+    returnBuffer(mbuf);
+
+    mbuf = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(mbuf, nullptr);
+    EXPECT_EQ(mbuf->data(), inbuf->base());
+    size_t index;
+    sp<MediaCodecBuffer> claimed;
+    EXPECT_TRUE(mPool->claimBuffer(mbuf, &index, &claimed));
+    EXPECT_EQ(index, 3u);
+    EXPECT_EQ(claimed, inbuf);
+    returnBuffer(mbuf);
+}
+
+TEST_F(MediaCodecInputBufferPoolTest, doesNotLendClaimedBufferAgain) {
+    sp<MediaCodecBuffer> inbuf = addFreeBuffer(1);
+
+    MediaBuffer *mbuf = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(mbuf, nullptr);
+    size_t index;
+    sp<MediaCodecBuffer> claimed;
+    ASSERT_TRUE(mPool->claimBuffer(mbuf, &index, &claimed));
+    EXPECT_EQ(index, 1u);
+    EXPECT_EQ(claimed, inbuf);
+    // already queued to the encoder
+    EXPECT_FALSE(mPool->claimBuffer(mbuf, &index, &claimed));
+    returnBuffer(mbuf);
+
+    EXPECT_FALSE(mPool->takeFreeBuffer(&index, &claimed));
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    returnBuffer(new MediaBuffer(kBufferSize));
+
+    // lent again once the encoder hands it back
+    addFreeBuffer(1);
+    mbuf = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(mbuf, nullptr);
+    returnBuffer(mbuf);
+}
+
+TEST_F(MediaCodecInputBufferPoolTest, stopsLendingWhileSourceBuffersAreOutstanding) {
+    // none free, the source allocates two buffers of its own
+    ASSERT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    MediaBuffer *sourceBuf1 = new MediaBuffer(kBufferSize);
+    ASSERT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    MediaBuffer *sourceBuf2 = new MediaBuffer(kBufferSize);
+
+    addFreeBuffer(0);
+    addFreeBuffer(1);
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    MediaBuffer *sourceBuf3 = new MediaBuffer(kBufferSize);
+
+    // the source buffers are copied into the free input buffers meanwhile
+    size_t index;
+    sp<MediaCodecBuffer> inbuf;
+    ASSERT_TRUE(mPool->takeFreeBuffer(&index, &inbuf));
+    EXPECT_EQ(index, 0u);
+    returnBuffer(sourceBuf1);
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    MediaBuffer *sourceBuf4 = new MediaBuffer(kBufferSize);
+
+    returnBuffer(sourceBuf2);
+    returnBuffer(sourceBuf3);
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    MediaBuffer *sourceBuf5 = new MediaBuffer(kBufferSize);
+    returnBuffer(sourceBuf4);
+    returnBuffer(sourceBuf5);
+
+    MediaBuffer *mbuf = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(mbuf, nullptr);
+    ASSERT_TRUE(mPool->claimBuffer(mbuf, &index, &inbuf));
+    EXPECT_EQ(index, 1u);
+    returnBuffer(mbuf);
+}
+
+TEST_F(MediaCodecInputBufferPoolTest, doesNotLendTooSmallBuffers) {
+    addFreeBuffer(0);
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize + 1), nullptr);
+    returnBuffer(new MediaBuffer(kBufferSize + 1));
+
+    size_t index;
+    sp<MediaCodecBuffer> inbuf;
+    EXPECT_TRUE(mPool->takeFreeBuffer(&index, &inbuf));
+    EXPECT_EQ(index, 0u);
+}
+
+TEST_F(MediaCodecInputBufferPoolTest, takesBackBuffersReturnedAfterFlush) {
+    addFreeBuffer(0);
+    addFreeBuffer(1);
+    MediaBuffer *dropped = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(dropped, nullptr);
+    MediaBuffer *pending = mPool->acquireBuffer(kBufferSize);
+    ASSERT_NE(pending, nullptr);
+    size_t index;
+    sp<MediaCodecBuffer> claimed;
+    ASSERT_TRUE(mPool->claimBuffer(pending, &index, &claimed));
+
+    mPool->flush();
+    // the encoder is gone, its input buffers must not be used anymore
+    addFreeBuffer(2);
+    EXPECT_FALSE(mPool->takeFreeBuffer(&index, &claimed));
+    EXPECT_FALSE(mPool->claimBuffer(dropped, &index, &claimed));
+
+    returnBuffer(dropped);
+    returnBuffer(pending);
+
+    EXPECT_EQ(mPool->acquireBuffer(kBufferSize), nullptr);
+    returnBuffer(new MediaBuffer(kBufferSize));
+    EXPECT_FALSE(mPool->takeFreeBuffer(&index, &claimed));
+}
+
+} // android
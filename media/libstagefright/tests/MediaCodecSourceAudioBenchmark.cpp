@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Records the microphone to AAC through AudioSource and MediaCodecSource the way
+// StagefrightRecorder records audio, with and without AudioSource reading into lent encoder input
+// buffers, and reports the CPU time this process spends per hour of recorded audio. The codec
+// itself runs in the media codec service, so this is the cost of moving the captured audio from
+// the AudioRecord callback into the encoder.
+//
+// AudioSource is paced by the capture, so each iteration takes as long as the recording. Run as
+// root or shell, which may record audio, with:
+//   adb shell /data/benchmarktest64/MediaCodecSourceAudioBenchmark/MediaCodecSourceAudioBenchmark
+
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <benchmark/benchmark.h>
+
+#include <android/content/AttributionSourceState.h>
+#include <binder/Binder.h>
+#include <binder/ProcessState.h>
+#include <media/stagefright/AudioSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferProvider.h>
+#include <media/stagefright/MediaCodecSource.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+using namespace android;
+using content::AttributionSourceState;
+
+static constexpr int32_t kSampleRate = 48000;
+static constexpr int32_t kChannelCount = 2;
+
+static int64_t processCpuTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Counts the buffers AudioSource reads and how many of them the encoder lent, passing the
+// requests on to the buffer provider of the encoder, if any.
+struct CountingBufferProvider : public MediaBufferProvider {
+    explicit CountingBufferProvider(const sp<MediaBufferProvider> &provider)
+        : mProvider(provider), mNumBuffers(0), mNumLentBuffers(0) {}
+
+    MediaBuffer *acquireBuffer(size_t size) override {
+        ++mNumBuffers;
+        MediaBuffer *buffer = mProvider != NULL ? mProvider->acquireBuffer(size) : NULL;
+        if (buffer != NULL) {
+            ++mNumLentBuffers;
+        }
+        return buffer;
+    }
+
+    void returnBuffer(MediaBufferBase *buffer) override {
+        if (mProvider != NULL) {
+            mProvider->returnBuffer(buffer);
+        }
+    }
+
+    const sp<MediaBufferProvider> mProvider;
+    std::atomic<size_t> mNumBuffers;
+    std::atomic<size_t> mNumLentBuffers;
+};
+
+// Arguments are the length of the recording in seconds, and whether AudioSource reads into
+// lent encoder input buffers.
+static void BM_AudioRecording(benchmark::State& state) {
+    const int64_t durationUs = state.range(0) * 1000000LL;
+    const bool lend = state.range(1);
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("audio_benchmark");
+    looper->start();
+
+    int64_t cpuTimeUs = 0;
+    size_t buffers = 0;
+    size_t lentBuffers = 0;
+    for (auto _ : state) {
+        audio_attributes_t attr = AUDIO_ATTRIBUTES_INITIALIZER;
+        attr.source = AUDIO_SOURCE_MIC;
+        AttributionSourceState attributionSource;
+        attributionSource.uid = getuid();
+        attributionSource.pid = getpid();
+        attributionSource.token = sp<BBinder>::make();
+        sp<AudioSource> source = new AudioSource(
+                &attr, attributionSource, kSampleRate, kChannelCount);
+        if (source->initCheck() != OK) {
+            state.SkipWithError("cannot open the microphone");
+            break;
+        }
+
+        int32_t maxInputSize;
+        CHECK(source->getFormat()->findInt32(kKeyMaxInputSize, &maxInputSize));
+        sp<AMessage> format = new AMessage;
+        format->setString("mime", MEDIA_MIMETYPE_AUDIO_AAC);
+        format->setInt32("channel-count", kChannelCount);
+        format->setInt32("sample-rate", kSampleRate);
+        format->setInt32("bitrate", 128000);
+        format->setInt32("max-input-size", maxInputSize);
+
+        sp<MediaCodecSource> encoder = MediaCodecSource::Create(
+                looper, format, source, NULL /* persistentSurface */,
+                lend ? MediaCodecSource::FLAG_LEND_INPUT_BUFFERS : 0);
+        if (encoder == NULL) {
+            state.SkipWithError("cannot create AAC encoder");
+            break;
+        }
+        sp<CountingBufferProvider> provider =
+                new CountingBufferProvider(encoder->getInputBufferProvider());
+        source->setBufferProvider(provider);
+
+        const int64_t cpuTimeUsAtStart = processCpuTimeUs();
+        if (encoder->start() != OK) {
+            state.SkipWithError("cannot start AAC encoder");
+            break;
+        }
+        MediaBufferBase *buffer;
+        while (encoder->read(&buffer) == OK) {
+            int64_t timeUs = 0;
+            buffer->meta_data().findInt64(kKeyTime, &timeUs);
+            buffer->release();
+            if (timeUs >= durationUs) {
+                break;
+            }
+        }
+        encoder->stop();
+        cpuTimeUs += processCpuTimeUs() - cpuTimeUsAtStart;
+
+        buffers += provider->mNumBuffers;
+        lentBuffers += provider->mNumLentBuffers;
+    }
+    looper->stop();
+
+    if (buffers > 0) {
+        state.counters["cpuSecPerRecordedHour"] =
+                cpuTimeUs / 1E6 * 3600 / (state.iterations() * durationUs / 1E6);
+        state.counters["cpuUsPerBuffer"] = (double)cpuTimeUs / buffers;
+        state.counters["lentBuffers"] = (double)lentBuffers / buffers;
+    }
+}
+
+BENCHMARK(BM_AudioRecording)
+        ->ArgNames({"seconds", "lend"})
+        ->Args({60, 0})
+        ->Args({60, 1})
+        ->Iterations(1)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+int main(int argc, char **argv) {
+    ProcessState::self()->startThreadPool();
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RecordingLatencyTracker_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/RecordingLatencyTracker.h>
+
+namespace android {
+
+using Stage = RecordingLatencyTracker::Stage;
+
+TEST(RecordingLatencyTrackerTest, dumpsNothingWithoutSamples) {
+    sp<RecordingLatencyTracker> tracker = new RecordingLatencyTracker();
+    EXPECT_EQ(tracker->dump().size(), 0u);
+}
+
+TEST(RecordingLatencyTrackerTest, dumpsOnlyStagesWithSamples) {
+    sp<RecordingLatencyTracker> tracker = new RecordingLatencyTracker();
+    tracker->record(true /* isVideo */, RecordingLatencyTracker::kStageEncoder, 12000);
+    tracker->record(true /* isVideo */, RecordingLatencyTracker::kStageEncoder, 20000);
+    tracker->record(false /* isVideo */, RecordingLatencyTracker::kStageEncoderToWriter, 400);
+
+    AString dump = tracker->dump();
+    EXPECT_NE(dump.find("video encoder latency (us): n=2 avg=16000 min=12000 max=20000"), -1)
+            << dump.c_str();
+    EXPECT_NE(dump.find("audio encoder-to-writer latency (us): n=1 avg=400"), -1)
+            << dump.c_str();
+    EXPECT_EQ(dump.find("source-to-encoder"), -1) << dump.c_str();
+    EXPECT_EQ(dump.find("video encoder-to-writer"), -1) << dump.c_str();
+}
+
+TEST(RecordingLatencyTrackerTest, ignoresUnknownStages) {
+    sp<RecordingLatencyTracker> tracker = new RecordingLatencyTracker();
+    tracker->record(true /* isVideo */, RecordingLatencyTracker::kNumStages, 1000);
+    tracker->record(true /* isVideo */, (Stage)-1, 1000);
+    EXPECT_EQ(tracker->dump().size(), 0u);
+}
+
+} // android
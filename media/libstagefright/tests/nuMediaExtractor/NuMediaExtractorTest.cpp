@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "NuMediaExtractorTest"
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include <binder/ProcessState.h>
+
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/NuMediaExtractor.h>
+#include <media/stagefright/foundation/ABuffer.h>
+
+#include "NuMediaExtractorTestEnvironment.h"
+
+using namespace android;
+
+static NuMediaExtractorTestEnvironment *gEnv = nullptr;
+
+constexpr size_t kMaxSampleSize = 4 * 1024 * 1024;
+
+struct SampleInfo {
+    size_t trackIndex;
+    int64_t timeUs;
+    size_t size;
+    uint32_t checksum;
+
+    bool operator==(const SampleInfo &other) const {
+        return trackIndex == other.trackIndex && timeUs == other.timeUs && size == other.size &&
+               checksum == other.checksum;
+    }
+};
+
+class NuMediaExtractorTest : public ::testing::TestWithParam<string> {
+  public:
+    NuMediaExtractorTest() : mFd(-1), mFileSize(0) {}
+
+    ~NuMediaExtractorTest() {
+        if (mFd >= 0) close(mFd);
+    }
+
+    void SetUp() override {
+        string inputFile = gEnv->getRes() + GetParam();
+        mFd = open(inputFile.c_str(), O_RDONLY);
+        ASSERT_GE(mFd, 0) << "Failed to open file: " << inputFile;
+
+        struct stat buf;
+        ASSERT_EQ(fstat(mFd, &buf), 0) << "Failed to get information for file: " << inputFile;
+        mFileSize = buf.st_size;
+    }
+
+    // Selects all tracks and reads all samples in the order the extractor returns them.
+    void readSamples(bool prefetch, int64_t seekTimeUs, std::vector<SampleInfo> *samples);
+
+    int32_t mFd;
+    off64_t mFileSize;
+};
+
+void NuMediaExtractorTest::readSamples(bool prefetch, int64_t seekTimeUs,
+                                       std::vector<SampleInfo> *samples) {
+    sp<NuMediaExtractor> extractor = new NuMediaExtractor(NuMediaExtractor::EntryPoint::OTHER);
+    ASSERT_EQ(extractor->setPrefetchEnabled(prefetch), (status_t)OK);
+    ASSERT_EQ(extractor->setDataSource(mFd, 0, mFileSize), (status_t)OK)
+            << "Failed to set data source";
+
+    size_t numTracks = extractor->countTracks();
+    ASSERT_GT(numTracks, 0u) << "No tracks found";
+    for (size_t i = 0; i < numTracks; ++i) {
+        ASSERT_EQ(extractor->selectTrack(i), (status_t)OK) << "Failed to select track " << i;
+    }
+    if (seekTimeUs >= 0) {
+        extractor->seekTo(seekTimeUs);
+    }
+
+    sp<ABuffer> buffer = new ABuffer(kMaxSampleSize);
+    size_t trackIndex;
+    while (extractor->getSampleTrackIndex(&trackIndex) == OK) {
+        SampleInfo info;
+        info.trackIndex = trackIndex;
+        ASSERT_EQ(extractor->getSampleTime(&info.timeUs), (status_t)OK);
+        ASSERT_EQ(extractor->readSampleData(buffer), (status_t)OK);
+        info.size = buffer->size();
+        info.checksum = 0;
+        for (size_t i = 0; i < buffer->size(); ++i) {
+            info.checksum = ((info.checksum << 1) | (info.checksum >> 31)) ^ buffer->data()[i];
+        }
+        samples->push_back(info);
+
+        status_t err = extractor->advance();
+        if (err == ERROR_END_OF_STREAM) {
+            break;
+        }
+        ASSERT_EQ(err, (status_t)OK);
+    }
+}
+
+TEST_P(NuMediaExtractorTest, PrefetchMatchesSerialRead) {
+    std::vector<SampleInfo> expected;
+    ASSERT_NO_FATAL_FAILURE(readSamples(false /* prefetch */, -1 /* seekTimeUs */, &expected));
+    ASSERT_FALSE(expected.empty()) << "No samples found";
+
+    std::vector<SampleInfo> samples;
+    ASSERT_NO_FATAL_FAILURE(readSamples(true /* prefetch */, -1 /* seekTimeUs */, &samples));
+    EXPECT_TRUE(samples == expected) << "Prefetched samples differ from serially read ones";
+
+    // seek to the middle of the clip
+    int64_t seekTimeUs = expected[expected.size() / 2].timeUs;
+    expected.clear();
+    samples.clear();
+    ASSERT_NO_FATAL_FAILURE(readSamples(false /* prefetch */, seekTimeUs, &expected));
+    ASSERT_NO_FATAL_FAILURE(readSamples(true /* prefetch */, seekTimeUs, &samples));
+    EXPECT_TRUE(samples == expected) << "Prefetched samples differ after seeking";
+}
+
+TEST_P(NuMediaExtractorTest, PrefetchThroughput) {
+    constexpr int kNumRuns = 3;
+    double samplesPerSec[2] = {0, 0};
+    size_t numSamples = 0;
+    for (bool prefetch : {false, true}) {
+        for (int run = 0; run < kNumRuns; ++run) {
+            std::vector<SampleInfo> samples;
+            auto start = std::chrono::steady_clock::now();
+            ASSERT_NO_FATAL_FAILURE(readSamples(prefetch, -1 /* seekTimeUs */, &samples));
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            numSamples = samples.size();
+            samplesPerSec[prefetch] = std::max(samplesPerSec[prefetch],
+                                               numSamples / elapsed.count());
+        }
+    }
+
+    cout << "[   INFO   ] " << GetParam() << ": " << numSamples << " samples, "
+         << samplesPerSec[false] << " samples/s serial, " << samplesPerSec[true]
+         << " samples/s with prefetch" << endl;
+}
+
+INSTANTIATE_TEST_SUITE_P(NuMediaExtractorTestAll, NuMediaExtractorTest,
+                         ::testing::Values("segment000001.ts",
+                                           "sinesweepvorbis.mkv",
+                                           "sinesweepoggmp4.mp4",
+                                           "swirl_144x136_vp9.webm",
+                                           "swirl_132x130_mpeg4.mp4"));
+
+int main(int argc, char **argv) {
+    ProcessState::self()->startThreadPool();
+    gEnv = new NuMediaExtractorTestEnvironment();
+    ::testing::AddGlobalTestEnvironment(gEnv);
+    ::testing::InitGoogleTest(&argc, argv);
+    int status = gEnv->initFromOptions(argc, argv);
+    if (status == 0) {
+        status = RUN_ALL_TESTS();
+        ALOGV("Test result = %d\n", status);
+    }
+    return status;
+}
@@ -25,6 +25,7 @@
 #include <iostream>
 
 #include <media/NdkMediaExtractor.h>
+#include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
@@ -149,7 +150,10 @@ class WriterTest {
         mDisableTest = false;
         static const std::map<std::string, standardWriters> mapWriter = {
                 {"ogg", OGG},     {"aac", AAC},      {"aac_adts", AAC_ADTS}, {"webm", WEBM},
-                {"mpeg4", MPEG4}, {"amrnb", AMR_NB}, {"amrwb", AMR_WB},      {"mpeg2Ts", MPEG2TS}};
+                {"mpeg4", MPEG4}, {"amrnb", AMR_NB}, {"amrwb", AMR_WB},      {"mpeg2Ts", MPEG2TS},
+                {"fragmentedMpeg4", MPEG4}};
+        // Fragmented mp4 output of MPEG4Writer
+        mFragmented = !writerFormat.compare("fragmentedMpeg4");
         // Find the component type
         if (mapWriter.find(writerFormat) != mapWriter.end()) {
             mWriterName = mapWriter.at(writerFormat);
@@ -192,6 +196,7 @@ class WriterTest {
     sp<MediaAdapter> mCurrentTrack[kMaxTrackCount]{};
 
     bool mDisableTest;
+    bool mFragmented;
     int32_t mNumCsds[kMaxTrackCount]{};
     int32_t mInputFrameId[kMaxTrackCount]{};
     ifstream mInputStream[kMaxTrackCount]{};
@@ -249,6 +254,9 @@ int32_t WriterTest::createWriter(int32_t fd) {
         case MPEG4:
             mWriter = new MPEG4Writer(fd);
             mFileMeta->setInt32(kKeyFileType, output_format::OUTPUT_FORMAT_MPEG_4);
+            if (mFragmented) {
+                mFileMeta->setInt64(kKeyFragmentDurationUs, kDefaultFragmentDurationUs);
+            }
             break;
         case AMR_NB:
             mWriter = new AMRWriter(fd);
@@ -578,6 +586,11 @@ TEST_P(WriteFunctionalityTest, WriterTest) {
                                             extractorBufferInfo[idx], extractedBuffer,
                                             fileSize[idx], &bytesExtracted, idx));
             ASSERT_GT(bytesExtracted, 0) << "Total bytes extracted by extractor cannot be zero";
+            if (mFragmented) {
+                // Samples of a fragment not written at stop() would go unnoticed otherwise
+                ASSERT_EQ(extractorBufferInfo[idx].size(), mBufferInfo[idx].size())
+                        << "Number of samples extracted does not match with input";
+            }
 
             ASSERT_NO_FATAL_FAILURE(
                     compareParams(param[idx], extractorParams[idx], extractorBufferInfo[idx], idx));
@@ -896,6 +909,211 @@ TEST_P(WriteFunctionalityTest, Mpeg4WriterTest) {
     close(fd);
 }
 
+class FragmentedMpeg4WriterTest : public WriterTest, public ::testing::Test {
+  public:
+    virtual void SetUp() override { setupWriterType("fragmentedMpeg4"); }
+};
+
+// Records a few hours of synthetic audio into a fragmented mp4 file. The samples
+// of a fragmented file are described with each fragment, so the writer must not
+// keep sample tables that grow with the length of the recording. The file must
+// also be readable while it is being recorded.
+TEST_F(FragmentedMpeg4WriterTest, LongRecordingMemoryTest) {
+    constexpr int32_t kSampleRate = 44100;
+    constexpr int32_t kSamplesPerFrame = 1024;
+    constexpr int64_t kRecordingDurationUs = 3ll * 3600 * 1000000;
+    constexpr int64_t kCheckpointIntervalUs = 1800ll * 1000000;
+
+    int32_t fd =
+            open(OUTPUT_FILE_NAME, O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0) << "Failed to open output file to dump writer's data";
+
+    int32_t status = createWriter(fd);
+    ASSERT_EQ((status_t)OK, status) << "Failed to create writer for mpeg4 output format";
+
+    // AAC-LC, 44.1kHz, stereo
+    const uint8_t csd[] = {0x12, 0x10};
+    sp<AMessage> format = new AMessage;
+    format->setString("mime", MEDIA_MIMETYPE_AUDIO_AAC);
+    format->setInt32("channel-count", 2);
+    format->setInt32("sample-rate", kSampleRate);
+    format->setBuffer("csd-0", ABuffer::CreateAsCopy(csd, sizeof(csd)));
+    sp<MetaData> trackMeta = new MetaData;
+    convertMessageToMetaData(format, trackMeta);
+    mCurrentTrack[0] = new MediaAdapter(trackMeta);
+    status = mWriter->addSource(mCurrentTrack[0]);
+    ASSERT_EQ((status_t)OK, status) << "Failed to add source for mpeg4 Writer";
+    status = mWriter->start(mFileMeta.get());
+    ASSERT_EQ((status_t)OK, status) << "Could not start the writer";
+
+    sp<MPEG4Writer> mp4writer = static_cast<MPEG4Writer *>(mWriter.get());
+    int64_t nextCheckpointUs = kCheckpointIntervalUs;
+    int64_t numFrames = 0;
+    for (;; numFrames++) {
+        int64_t timeUs = numFrames * kSamplesPerFrame * 1000000ll / kSampleRate;
+        if (timeUs >= kRecordingDurationUs) break;
+
+        if (timeUs >= nextCheckpointUs) {
+            // Without fragments the stsz table alone would take about 300KB
+            // per checkpoint interval.
+            ASSERT_EQ(0u, mp4writer->getSampleTableSizeBytes())
+                    << "Writer keeps sample tables, at " << timeUs << "us";
+            if (nextCheckpointUs == kCheckpointIntervalUs) {
+
+                // Read through a separate fd, to not move the writer's file offset
+                int32_t readFd = open(OUTPUT_FILE_NAME, O_RDONLY);
+                ASSERT_GE(readFd, 0) << "Failed to open writer's output file to validate";
+                struct stat buf;
+                ASSERT_EQ(0, fstat(readFd, &buf));
+                AMediaExtractor *extractor = AMediaExtractor_new();
+                ASSERT_NE(extractor, nullptr) << "Failed to create extractor";
+                ASSERT_EQ(AMEDIA_OK,
+                          AMediaExtractor_setDataSourceFd(extractor, readFd, 0, buf.st_size))
+                        << "Failed to read the file while recording";
+                ASSERT_EQ(1, AMediaExtractor_getTrackCount(extractor));
+                AMediaExtractor_selectTrack(extractor, 0);
+                ASSERT_GT(AMediaExtractor_getSampleSize(extractor), 0)
+                        << "No samples readable while recording";
+                AMediaExtractor_delete(extractor);
+                close(readFd);
+            }
+            nextCheckpointUs += kCheckpointIntervalUs;
+        }
+
+        // Vary the sample size, so that every sample has a stsz entry.
+        MediaBuffer *mediaBuffer = new MediaBuffer(8 + numFrames % 8);
+        memset(mediaBuffer->data(), 0, mediaBuffer->size());
+        // Released in MediaAdapter::signalBufferReturned().
+        mediaBuffer->add_ref();
+        MetaDataBase &sampleMetaData = mediaBuffer->meta_data();
+        sampleMetaData.setInt64(kKeyTime, timeUs);
+        sampleMetaData.setInt64(kKeyDecodingTime, timeUs);
+        sampleMetaData.setInt32(kKeyIsSyncFrame, true);
+        status = mCurrentTrack[0]->pushBuffer(mediaBuffer);
+        ASSERT_EQ((status_t)OK, status) << "mpeg4 writer failed";
+    }
+
+    mCurrentTrack[0]->stop();
+    status = mWriter->stop();
+    ASSERT_EQ((status_t)OK, status) << "Failed to stop the writer";
+    close(fd);
+
+    AMediaExtractor *extractor = AMediaExtractor_new();
+    ASSERT_NE(extractor, nullptr) << "Failed to create extractor";
+    int32_t trackCount = -1;
+    ASSERT_NO_FATAL_FAILURE(setupExtractor(extractor, OUTPUT_FILE_NAME, trackCount));
+    ASSERT_EQ(1, trackCount);
+    AMediaExtractor_selectTrack(extractor, 0);
+    int64_t numExtracted = 0;
+    int64_t lastTimeUs = -1;
+    while (AMediaExtractor_getSampleSize(extractor) >= 0) {
+        lastTimeUs = AMediaExtractor_getSampleTime(extractor);
+        numExtracted++;
+        AMediaExtractor_advance(extractor);
+    }
+    AMediaExtractor_delete(extractor);
+
+    ASSERT_EQ(numFrames, numExtracted) << "Samples extracted does not match with samples written";
+    int64_t expectedLastTimeUs = (numFrames - 1) * kSamplesPerFrame * 1000000ll / kSampleRate;
+    ASSERT_LE(abs(lastTimeUs - expectedLastTimeUs), kMpeg4MuxToleranceTimeUs)
+            << "Extracted timestamp " << lastTimeUs << " does not match with " << expectedLastTimeUs;
+}
+
+class Mpeg4SampleTableTest : public WriterTest, public ::testing::Test {
+  public:
+    virtual void SetUp() override { setupWriterType("mpeg4"); }
+};
+
+// Records an hour of synthetic 240fps video with B-frames, so that every sample
+// adds stsz and ctts entries. The sample tables are kept compressed until the
+// moov box is written, which bounds the memory used per hour of recording.
+TEST_F(Mpeg4SampleTableTest, HighFrameRateMemoryTest) {
+    constexpr int32_t kFrameRate = 240;
+    constexpr int64_t kRecordingDurationUs = 3600ll * 1000000;
+    // Uncompressed, the stsz and ctts tables alone take about 10MB per hour.
+    constexpr size_t kMaxSampleTableBytes = 6 * 1024 * 1024;
+
+    int32_t fd =
+            open(OUTPUT_FILE_NAME, O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0) << "Failed to open output file to dump writer's data";
+
+    int32_t status = createWriter(fd);
+    ASSERT_EQ((status_t)OK, status) << "Failed to create writer for mpeg4 output format";
+
+    sp<AMessage> format = new AMessage;
+    format->setString("mime", MEDIA_MIMETYPE_VIDEO_H263);
+    format->setInt32("width", 352);
+    format->setInt32("height", 288);
+    sp<MetaData> trackMeta = new MetaData;
+    convertMessageToMetaData(format, trackMeta);
+    mCurrentTrack[0] = new MediaAdapter(trackMeta);
+    status = mWriter->addSource(mCurrentTrack[0]);
+    ASSERT_EQ((status_t)OK, status) << "Failed to add source for mpeg4 Writer";
+    status = mWriter->start(mFileMeta.get());
+    ASSERT_EQ((status_t)OK, status) << "Could not start the writer";
+
+    // Frames in decoding order, as I0 P3 B1 B2 P6 B4 B5 ...
+    auto frameSize = [](int64_t frame) -> size_t { return 16 + (frame * 7919) % 256; };
+    auto presentationIndex = [](int64_t frame) -> int64_t {
+        return frame == 0 ? 0 : (frame % 3 == 1 ? frame + 2 : frame - 1);
+    };
+    auto frameTimeUs = [](int64_t index) -> int64_t { return index * 1000000 / kFrameRate; };
+
+    int64_t numFrames = 0;
+    for (;; numFrames++) {
+        int64_t timeUs = frameTimeUs(numFrames);
+        if (timeUs >= kRecordingDurationUs) break;
+
+        MediaBuffer *mediaBuffer = new MediaBuffer(frameSize(numFrames));
+        memset(mediaBuffer->data(), 0, mediaBuffer->size());
+        // Released in MediaAdapter::signalBufferReturned().
+        mediaBuffer->add_ref();
+        MetaDataBase &sampleMetaData = mediaBuffer->meta_data();
+        sampleMetaData.setInt64(kKeyTime, frameTimeUs(presentationIndex(numFrames)));
+        sampleMetaData.setInt64(kKeyDecodingTime, timeUs);
+        if (numFrames % kFrameRate == 0) {
+            sampleMetaData.setInt32(kKeyIsSyncFrame, true);
+        }
+        status = mCurrentTrack[0]->pushBuffer(mediaBuffer);
+        ASSERT_EQ((status_t)OK, status) << "mpeg4 writer failed";
+    }
+    sp<MPEG4Writer> mp4writer = static_cast<MPEG4Writer *>(mWriter.get());
+    size_t sampleTableBytes = mp4writer->getSampleTableSizeBytes();
+    ALOGV("Sample tables of an hour of recording: %zu bytes", sampleTableBytes);
+    ASSERT_GT(sampleTableBytes, 0u) << "Writer reports no sample tables";
+    ASSERT_LE(sampleTableBytes, kMaxSampleTableBytes)
+            << "Sample tables take " << sampleTableBytes << " bytes per hour";
+
+    mCurrentTrack[0]->stop();
+    status = mWriter->stop();
+    ASSERT_EQ((status_t)OK, status) << "Failed to stop the writer";
+    close(fd);
+
+    // The tables expanded into the moov box describe every sample.
+    AMediaExtractor *extractor = AMediaExtractor_new();
+    ASSERT_NE(extractor, nullptr) << "Failed to create extractor";
+    int32_t trackCount = -1;
+    ASSERT_NO_FATAL_FAILURE(setupExtractor(extractor, OUTPUT_FILE_NAME, trackCount));
+    ASSERT_EQ(1, trackCount);
+    AMediaExtractor_selectTrack(extractor, 0);
+    int64_t frame = 0;
+    for (; AMediaExtractor_getSampleSize(extractor) >= 0; frame++) {
+        ASSERT_LT(frame, numFrames) << "More samples extracted than written";
+        ASSERT_EQ((ssize_t)frameSize(frame), AMediaExtractor_getSampleSize(extractor))
+                << "Extracted size of sample " << frame << " does not match";
+        int64_t expectedTimeUs = frameTimeUs(presentationIndex(frame));
+        ASSERT_LE(abs(AMediaExtractor_getSampleTime(extractor) - expectedTimeUs),
+                  kMpeg4MuxToleranceTimeUs)
+                << "Extracted timestamp of sample " << frame << " does not match";
+        ASSERT_EQ(frame % kFrameRate == 0,
+                  (AMediaExtractor_getSampleFlags(extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC) != 0)
+                << "Extracted sync flag of sample " << frame << " does not match";
+        AMediaExtractor_advance(extractor);
+    }
+    AMediaExtractor_delete(extractor);
+    ASSERT_EQ(numFrames, frame) << "Samples extracted does not match with samples written";
+}
+
 class ListenerTest
     : public WriterTest,
       public ::testing::TestWithParam<tuple<
@@ -1066,6 +1284,18 @@ INSTANTIATE_TEST_SUITE_P(
                 make_tuple("mpeg4", H263_1, AMR_NB_1, 0.50),
                 make_tuple("mpeg4", MPEG4_1, HEVC_1, 0.75),
 
+                // Image tracks can not be fragmented
+                make_tuple("fragmentedMpeg4", AAC_1, UNUSED_ID, 1),
+                make_tuple("fragmentedMpeg4", AMR_NB_1, UNUSED_ID, 1),
+                make_tuple("fragmentedMpeg4", AVC_1, UNUSED_ID, 1),
+                make_tuple("fragmentedMpeg4", H263_1, UNUSED_ID, 1),
+                make_tuple("fragmentedMpeg4", HEVC_1, UNUSED_ID, 1),
+                make_tuple("fragmentedMpeg4", MPEG4_1, UNUSED_ID, 1),
+                make_tuple("fragmentedMpeg4", AAC_1, AVC_1, 0.25),
+                make_tuple("fragmentedMpeg4", AVC_1, AAC_1, 0.75),
+                make_tuple("fragmentedMpeg4", HEVC_1, AMR_WB_1, 0.25),
+                make_tuple("fragmentedMpeg4", MPEG4_1, HEVC_1, 0.75),
+
                 make_tuple("ogg", OPUS_1, UNUSED_ID, 1),
 
                 make_tuple("webm", OPUS_1, UNUSED_ID, 1),
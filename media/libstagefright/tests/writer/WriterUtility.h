@@ -40,6 +40,7 @@ constexpr int32_t kDefaultInterleaveDuration = 0;
 constexpr int32_t kDefaultLatitudex10000 = 500000;
 constexpr int32_t kDefaultLongitudex10000 = 1000000;
 constexpr float kDefaultFPS = 30.0f;
+constexpr int64_t kDefaultFragmentDurationUs = 2000000;
 
 struct BufferInfo {
     int32_t size;
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "WebmCues"
+
+#include "EbmlUtil.h"
+#include "WebmConstants.h"
+#include "WebmCues.h"
+#include "WebmElement.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using namespace webm;
+
+namespace {
+
+// Cue points are written into the reserved space in batches of about this size.
+const size_t kFlushThresholdBytes = 4096;
+
+// CuePoint { CueTime, CueTrackPositions { CueTrack, CueClusterPosition } }
+const size_t kMaxCuePointSize = 2 * (1 + 8) + 3 * (1 + 1 + 8);
+
+// The Cues id followed by its size, which is coded on 8 bytes so that the header does not
+// depend on how many cue points the recording ends up with.
+const size_t kCuesHeaderSize = 4 + 8;
+
+// Serializes an unsigned integer element the way WebmUnsigned does.
+size_t serializeUnsigned(uint64_t id, uint64_t value, uint8_t *buf) {
+    uint8_t *cur = buf;
+    cur += serializeCodedUnsigned(id, cur);
+    cur += serializeCodedUnsigned(encodeUnsigned(sizeOf(value)), cur);
+    cur += serializeCodedUnsigned(value, cur);
+    return cur - buf;
+}
+
+android::status_t writeFully(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? -errno : -EIO;
+        }
+        data += n;
+        size -= n;
+    }
+    return android::OK;
+}
+
+android::status_t pwriteFully(int fd, const uint8_t *data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pwrite64(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? -errno : -EIO;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return android::OK;
+}
+
+}
+
+namespace android {
+
+WebmCues::WebmCues() {
+    clear();
+}
+
+void WebmCues::reset(int fd, uint64_t offset, uint64_t reservedSize) {
+    clear();
+    mFd = fd;
+    mOffset = offset;
+    mReservedSize = reservedSize;
+    mOverflowed = reservedSize == 0;
+    mPending.reserve(kFlushThresholdBytes + kMaxCuePointSize);
+}
+
+void WebmCues::clear() {
+    mFd = -1;
+    mOffset = 0;
+    mReservedSize = 0;
+    mFlushedBytes = 0;
+    mNumCuePoints = 0;
+    mOverflowed = true;
+    mError = OK;
+    mPending.clear();
+}
+
+void WebmCues::addCuePoint(uint64_t time, int track, uint64_t clusterOffset) {
+    uint8_t positions[kMaxCuePointSize];
+    size_t positionsSize = serializeUnsigned(kMkvCueTrack, track, positions);
+    positionsSize += serializeUnsigned(
+            kMkvCueClusterPosition, clusterOffset, positions + positionsSize);
+
+    uint8_t cuePoint[kMaxCuePointSize];
+    size_t size = serializeUnsigned(kMkvCueTime, time, cuePoint);
+    size += serializeCodedUnsigned(kMkvCueTrackPositions, cuePoint + size);
+    size += serializeCodedUnsigned(encodeUnsigned(positionsSize), cuePoint + size);
+    memcpy(cuePoint + size, positions, positionsSize);
+    size += positionsSize;
+
+    uint8_t header[1 + 8];
+    size_t headerSize = serializeCodedUnsigned(kMkvCuePoint, header);
+    headerSize += serializeCodedUnsigned(encodeUnsigned(size), header + headerSize);
+    CHECK_LE(headerSize + size, kMaxCuePointSize);
+
+    mPending.insert(mPending.end(), header, header + headerSize);
+    mPending.insert(mPending.end(), cuePoint, cuePoint + size);
+    ++mNumCuePoints;
+
+    if (mPending.size() >= kFlushThresholdBytes) {
+        flush();
+    }
+}
+
+void WebmCues::flush() {
+    if (mOverflowed || mError != OK) {
+        return;
+    }
+    // Whether the cues end up in place is decided at finalize(); whatever was written into the
+    // reserved space by then can still be moved after the clusters.
+    if (kCuesHeaderSize + mFlushedBytes + mPending.size() > mReservedSize) {
+        ALOGW("cues outgrew the %" PRIu64 " bytes reserved for them after %zu cue points;"
+                " they will be written after the clusters", mReservedSize, mNumCuePoints);
+        mOverflowed = true;
+        return;
+    }
+    mError = pwriteFully(mFd, mPending.data(), mPending.size(),
+            mOffset + kCuesHeaderSize + mFlushedBytes);
+    if (mError != OK) {
+        ALOGE("failed to write cue points: %s", strerror(-mError));
+        return;
+    }
+    mFlushedBytes += mPending.size();
+    mPending.clear();
+}
+
+status_t WebmCues::finalize(uint64_t *cuesOffset) {
+    if (mError != OK) {
+        return mError;
+    }
+
+    uint64_t cuesSize = mFlushedBytes + mPending.size();
+    uint64_t totalSize = kCuesHeaderSize + cuesSize;
+    uint8_t header[kCuesHeaderSize];
+    serializeCodedUnsigned(kMkvCues, header);
+    serializeCodedUnsigned(encodeUnsigned(cuesSize, 8), header + 4);
+
+    // TRICKY Even when the cues do fit in the space we reserved, if they do not fit
+    // perfectly, we still need to check if there is enough "extra space" to write an
+    // EBML void element.
+    if (!mOverflowed && (totalSize == mReservedSize
+            || totalSize + kMinEbmlVoidSize <= mReservedSize)) {
+        status_t err = pwriteFully(mFd, mPending.data(), mPending.size(),
+                mOffset + kCuesHeaderSize + mFlushedBytes);
+        if (err == OK && totalSize < mReservedSize) {
+            // Only the header of the void element needs writing; its payload is ignored.
+            sp<WebmElement> space = new EbmlVoid(mReservedSize - totalSize);
+            uint8_t voidHeader[1 + 8];
+            size_t voidHeaderSize = serializeCodedUnsigned(kMkvVoid, voidHeader);
+            voidHeaderSize += space->serializePayloadSize(voidHeader + voidHeaderSize);
+            err = pwriteFully(mFd, voidHeader, voidHeaderSize, mOffset + totalSize);
+        }
+        // The header goes last; until then the reserved space still reads as a void element.
+        if (err == OK) {
+            err = pwriteFully(mFd, header, sizeof(header), mOffset);
+        }
+        if (err != OK) {
+            ALOGE("failed to write cues: %s", strerror(-err));
+            return err;
+        }
+        mPending.clear();
+        *cuesOffset = mOffset;
+        return OK;
+    }
+
+    // Append the cues to the file. Whatever was flushed into the reserved space is left
+    // behind the void element that still starts it.
+    off64_t offset = ::lseek64(mFd, 0, SEEK_END);
+    if (offset < 0) {
+        return -errno;
+    }
+    status_t err = writeFully(mFd, header, sizeof(header));
+    std::vector<uint8_t> buf;
+    for (uint64_t copied = 0; err == OK && copied < mFlushedBytes;) {
+        buf.resize(std::min(mFlushedBytes - copied, (uint64_t)64 * 1024));
+        ssize_t n = ::pread64(mFd, buf.data(), buf.size(), mOffset + kCuesHeaderSize + copied);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = n < 0 ? -errno : -EIO;
+            break;
+        }
+        err = writeFully(mFd, buf.data(), n);
+        copied += n;
+    }
+    if (err == OK) {
+        err = writeFully(mFd, mPending.data(), mPending.size());
+    }
+    if (err != OK) {
+        ALOGE("failed to write cues: %s", strerror(-err));
+        return err;
+    }
+    mPending.clear();
+    *cuesOffset = offset;
+    return OK;
+}
+
+} /* namespace android */
@@ -132,6 +132,13 @@ int WebmElement::write(int fd, uint64_t& size) {
     }
 }
 
+status_t WebmElement::write(const sp<AWriteQueue>& queue, uint64_t& size) {
+    uint8_t *buf = serialize(size);
+    status_t err = queue->write(buf, size);
+    delete[] buf;
+    return err;
+}
+
 //=================================================================================================
 
 WebmUnsigned::WebmUnsigned(uint64_t id, uint64_t value)
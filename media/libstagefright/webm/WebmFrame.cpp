@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "WebmFrame"
 
+#include "EbmlUtil.h"
 #include "WebmFrame.h"
 #include "WebmConstants.h"
 
@@ -27,8 +28,9 @@ using namespace android;
 using namespace webm;
 
 namespace {
-sp<ABuffer> toABuffer(MediaBufferBase *mbuf) {
-    sp<ABuffer> abuf = new ABuffer(mbuf->range_length());
+sp<ABuffer> toABuffer(MediaBufferBase *mbuf, const sp<WebmFramePool>& pool) {
+    sp<ABuffer> abuf = pool != NULL
+            ? pool->acquire(mbuf->range_length()) : new ABuffer(mbuf->range_length());
     memcpy(abuf->data(), (uint8_t*) mbuf->data() + mbuf->range_offset(), mbuf->range_length());
     return abuf;
 }
@@ -36,6 +38,71 @@ sp<ABuffer> toABuffer(MediaBufferBase *mbuf) {
 
 namespace android {
 
+// Pooled buffers are sized in pages, so that one buffer serves frames of similar sizes.
+static const size_t kPooledBufferAlignment = 4096;
+// Enough for the frames of a couple of clusters of a high bit rate video track.
+static const size_t kMaxPooledBuffers = 128;
+static const size_t kMaxPooledBytes = 8 * 1024 * 1024;
+
+WebmFramePool::WebmFramePool()
+    : mFreeBytes(0),
+      mStats() {
+}
+
+sp<ABuffer> WebmFramePool::acquire(size_t size) {
+    {
+        Mutex::Autolock autoLock(mLock);
+        ++mStats.acquires;
+        // Best fit, so that the large buffers of key frames are kept for key frames.
+        ssize_t best = -1;
+        for (size_t i = 0; i < mFree.size(); ++i) {
+            size_t capacity = mFree[i]->capacity();
+            if (capacity >= size && (best < 0 || capacity < mFree[best]->capacity())) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            sp<ABuffer> buffer = mFree[best];
+            mFree.removeAt(best);
+            mFreeBytes -= buffer->capacity();
+            buffer->setRange(0, size);
+            return buffer;
+        }
+        ++mStats.allocations;
+    }
+    size_t capacity = (size + kPooledBufferAlignment - 1) & ~(kPooledBufferAlignment - 1);
+    sp<ABuffer> buffer = new ABuffer(capacity);
+    buffer->setRange(0, size);
+    return buffer;
+}
+
+void WebmFramePool::recycle(const sp<ABuffer>& buffer) {
+    Mutex::Autolock autoLock(mLock);
+    if (buffer->capacity() > kMaxPooledBytes) {
+        return;
+    }
+    mFree.push_back(buffer);
+    mFreeBytes += buffer->capacity();
+    // Give up the smallest buffers first; they are the cheapest to allocate again.
+    while (mFree.size() > kMaxPooledBuffers || mFreeBytes > kMaxPooledBytes) {
+        size_t smallest = 0;
+        for (size_t i = 1; i < mFree.size(); ++i) {
+            if (mFree[i]->capacity() < mFree[smallest]->capacity()) {
+                smallest = i;
+            }
+        }
+        mFreeBytes -= mFree[smallest]->capacity();
+        mFree.removeAt(smallest);
+    }
+}
+
+WebmFramePool::Stats WebmFramePool::getStats() const {
+    Mutex::Autolock autoLock(mLock);
+    return mStats;
+}
+
+//=================================================================================================
+
 const sp<WebmFrame> WebmFrame::EOS = new WebmFrame();
 
 WebmFrame::WebmFrame()
@@ -46,12 +113,25 @@ WebmFrame::WebmFrame()
       mEos(true) {
 }
 
-WebmFrame::WebmFrame(int type, bool key, uint64_t absTimecode, MediaBufferBase *mbuf)
+WebmFrame::WebmFrame(
+        int type,
+        bool key,
+        uint64_t absTimecode,
+        MediaBufferBase *mbuf,
+        const sp<WebmFramePool>& pool)
     : mType(type),
       mKey(key),
       mAbsTimecode(absTimecode),
-      mData(toABuffer(mbuf)),
-      mEos(false) {
+      mData(toABuffer(mbuf, pool)),
+      mEos(false),
+      mPool(pool) {
+}
+
+WebmFrame::~WebmFrame() {
+    // Only recycle the buffer if no SimpleBlock element still refers to it.
+    if (mPool != NULL && mData->getStrongCount() == 1) {
+        mPool->recycle(mData);
+    }
 }
 
 sp<WebmElement> WebmFrame::SimpleBlock(uint64_t baseTimecode) const {
@@ -62,6 +142,25 @@ sp<WebmElement> WebmFrame::SimpleBlock(uint64_t baseTimecode) const {
             mData);
 }
 
+uint64_t WebmFrame::blockSize() const {
+    // ............................ trackNum*1 + timecode*2 + flags*1, as in WebmSimpleBlock
+    uint64_t payloadSize = mData->size() + 4;
+    return sizeOf(kMkvSimpleBlock) + sizeOf(encodeUnsigned(payloadSize)) + payloadSize;
+}
+
+size_t WebmFrame::serializeBlockHeader(uint64_t baseTimecode, uint8_t *buf) const {
+    int16_t relTimecode = mAbsTimecode - baseTimecode;
+    uint8_t *cur = buf;
+    cur += serializeCodedUnsigned(kMkvSimpleBlock, cur);
+    cur += serializeCodedUnsigned(encodeUnsigned(mData->size() + 4), cur);
+    cur += serializeCodedUnsigned(
+            encodeUnsigned(mType == kVideoType ? kVideoTrackNum : kAudioTrackNum), cur);
+    *cur++ = (relTimecode & 0xff00) >> 8;
+    *cur++ = relTimecode & 0xff;
+    *cur++ = mKey ? 0x80 : 0;
+    return cur - buf;
+}
+
 uint64_t WebmFrame::getAbsTimecode() {
     return mAbsTimecode;
 }
@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "WebmFrameThread"
 
+#include "EbmlUtil.h"
 #include "WebmConstants.h"
 #include "WebmFrameThread.h"
 
@@ -24,7 +25,10 @@
 #include <media/stagefright/foundation/ADebug.h>
 
 #include <utils/Log.h>
+#include <errno.h>
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
 
 using namespace webm;
 
@@ -72,13 +76,14 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         sp<WebmFrameSourceThread> videoThread,
         sp<WebmFrameSourceThread> audioThread,
-        List<sp<WebmElement> >& cues)
+        WebmCues& cues)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoThread->mSink),
       mAudioFrames(audioThread->mSink),
       mCues(cues),
       mStartOffsetTimecode(UINT64_MAX),
+      mWriteError(OK),
       mDone(true) {
 }
 
@@ -87,51 +92,82 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
         LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-        List<sp<WebmElement> >& cues)
+        WebmCues& cues)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoSource),
       mAudioFrames(audioSource),
       mCues(cues),
       mStartOffsetTimecode(UINT64_MAX),
+      mWriteError(OK),
       mDone(true) {
 }
 
-// Initializes a webm cluster with its starting timecode.
+// Writes a cluster holding mClusterFrames, starting at clusterTimecode.
 //
-// frames:
-//   sequence of input audio/video frames received from the source.
-//
-// clusterTimecodeL:
-//   the starting timecode of the cluster; this is the timecode of the first
-//   frame since frames are ordered by timestamp.
-//
-// children:
-//   list to hold child elements in a webm cluster (start timecode and
-//   simple blocks).
-//
-// static
-void WebmFrameSinkThread::initCluster(
-    List<const sp<WebmFrame> >& frames,
-    uint64_t& clusterTimecodeL,
-    List<sp<WebmElement> >& children) {
-    CHECK(!frames.empty() && children.empty());
-
-    const sp<WebmFrame> f = *(frames.begin());
-    clusterTimecodeL = f->mAbsTimecode;
-    WebmUnsigned *clusterTimecode = new WebmUnsigned(kMkvTimecode, clusterTimecodeL);
-    children.clear();
-    children.push_back(clusterTimecode);
-}
+// The cluster is streamed out rather than built as an element tree: the element headers are
+// serialized into mClusterHeaders and handed to the write queue together with the frame data,
+// which is copied only once, into the queue.
+status_t WebmFrameSinkThread::writeCluster(uint64_t clusterTimecode) {
+    // a cluster must contain at least one simpleblock
+    CHECK(!mClusterFrames.isEmpty());
+    if (mWriteError != OK) {
+        // the file is unusable already; drop the frames
+        mClusterFrames.clear();
+        return mWriteError;
+    }
 
-void WebmFrameSinkThread::writeCluster(List<sp<WebmElement> >& children) {
-    // children must contain at least one simpleblock and its timecode
-    CHECK_GE(children.size(), 2u);
+    sp<WebmElement> timecode = new WebmUnsigned(kMkvTimecode, clusterTimecode);
+    uint64_t size = timecode->totalSize();
+    for (size_t i = 0; i < mClusterFrames.size(); ++i) {
+        size += mClusterFrames[i]->blockSize();
+    }
 
-    uint64_t size;
-    sp<WebmElement> cluster = new WebmMaster(kMkvCluster, children);
-    cluster->write(mFd, size);
-    children.clear();
+    // cluster id and size, the timecode element, and a header per simpleblock
+    mClusterHeaders.resize(
+            4 + 8 + timecode->totalSize() + mClusterFrames.size() * WebmFrame::kMaxBlockHeaderSize);
+    mClusterIov.clear();
+    uint8_t *buf = mClusterHeaders.data();
+    uint8_t *cur = buf;
+    cur += serializeCodedUnsigned(kMkvCluster, cur);
+    cur += serializeCodedUnsigned(encodeUnsigned(size), cur);
+    cur += timecode->serializeInto(cur);
+    for (size_t i = 0; i < mClusterFrames.size(); ++i) {
+        const sp<WebmFrame> &f = mClusterFrames[i];
+        cur += f->serializeBlockHeader(clusterTimecode, cur);
+        mClusterIov.push_back({ buf, (size_t)(cur - buf) });
+        buf = cur;
+        if (f->mData->size() > 0) {
+            mClusterIov.push_back({ f->mData->data(), f->mData->size() });
+        }
+    }
+
+    status_t err = OK;
+    if (mWriteQueue != NULL) {
+        err = mWriteQueue->writev(mClusterIov.data(), mClusterIov.size());
+    } else {
+        for (size_t i = 0; i < mClusterIov.size() && err == OK; ++i) {
+            const uint8_t *data = (const uint8_t *)mClusterIov[i].iov_base;
+            size_t left = mClusterIov[i].iov_len;
+            while (left > 0) {
+                ssize_t n = ::write(mFd, data, left);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    err = n < 0 ? -errno : -EIO;
+                    break;
+                }
+                data += n;
+                left -= n;
+            }
+        }
+    }
+    if (err != OK) {
+        ALOGE("failed to write cluster: %s", strerror(-err));
+    }
+    mClusterFrames.clear();
+    return err;
 }
 
 // Write out (possibly multiple) webm cluster(s) from frames split on video key frames.
@@ -143,12 +179,13 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         return;
     }
 
-    uint64_t clusterTimecodeL;
-    List<sp<WebmElement> > children;
-    initCluster(frames, clusterTimecodeL, children);
+    // the starting timecode of the cluster is that of its first frame, since frames are
+    // ordered by timestamp.
+    uint64_t clusterTimecodeL = (*frames.begin())->mAbsTimecode;
+    mClusterFrames.clear();
 
     uint64_t cueTime = clusterTimecodeL;
-    off_t fpos = ::lseek(mFd, 0, SEEK_CUR);
+    off_t fpos = mWriteQueue != NULL ? mWriteQueue->tell() : ::lseek(mFd, 0, SEEK_CUR);
     size_t n = frames.size();
     if (!last) {
         // If we are not flushing the last sequence of outstanding frames, flushFrames
@@ -168,12 +205,15 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         }
 
         if (f->mAbsTimecode - clusterTimecodeL > INT16_MAX) {
-            writeCluster(children);
-            initCluster(frames, clusterTimecodeL, children);
+            status_t err = writeCluster(clusterTimecodeL);
+            if (mWriteError == OK) {
+                mWriteError = err;
+            }
+            clusterTimecodeL = f->mAbsTimecode;
         }
 
         frames.erase(frames.begin());
-        children.push_back(f->SimpleBlock(clusterTimecodeL));
+        mClusterFrames.push_back(f);
     }
 
     // equivalent to last==false
@@ -182,27 +222,36 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         const sp<WebmFrame> secondLastFrame = *(frames.begin());
         if (secondLastFrame->mType == kVideoType) {
             frames.erase(frames.begin());
-            children.push_back(secondLastFrame->SimpleBlock(clusterTimecodeL));
+            mClusterFrames.push_back(secondLastFrame);
         }
     }
 
-    writeCluster(children);
-    sp<WebmElement> cuePoint = WebmElement::CuePointEntry(cueTime, 1, fpos - mSegmentDataStart);
-    mCues.push_back(cuePoint);
+    status_t err = writeCluster(clusterTimecodeL);
+    if (mWriteError == OK) {
+        mWriteError = err;
+    }
+    mCues.addCuePoint(cueTime, 1, fpos - mSegmentDataStart);
 }
 
 status_t WebmFrameSinkThread::start() {
     mDone = false;
+    mWriteError = OK;
     return WebmFrameThread::start();
 }
 
 status_t WebmFrameSinkThread::stop() {
     mVideoFrames.push(WebmFrame::EOS);
     mAudioFrames.push(WebmFrame::EOS);
-    return WebmFrameThread::stop();
+    status_t err = WebmFrameThread::stop();
+    return err != OK ? err : mWriteError;
 }
 
 void WebmFrameSinkThread::run() {
+    mWriteQueue = new AWriteQueue(mFd);
+    if (mWriteQueue->start("WebmWriterIO") != OK) {
+        mWriteQueue.clear();
+    }
+
     int numVideoKeyFrames = 0;
     List<const sp<WebmFrame> > outstandingFrames;
     while (!mDone) {
@@ -244,6 +293,18 @@ void WebmFrameSinkThread::run() {
     }
     ALOGV("flushing last cluster (size %zu)", outstandingFrames.size());
     flushFrames(outstandingFrames, /* last = */ true);
+
+    // WebmWriter writes the cues and fixes up the headers once this returns.
+    if (mWriteQueue != NULL) {
+        status_t err = mWriteQueue->stop();
+        if (err != OK) {
+            ALOGE("failed to write clusters: %s", strerror(-err));
+            if (mWriteError == OK) {
+                mWriteError = err;
+            }
+        }
+        mWriteQueue.clear();
+    }
     mDone = true;
 }
 
@@ -271,6 +332,7 @@ WebmFrameMediaSourceThread::WebmFrameMediaSourceThread(
     : WebmFrameSourceThread(type, sink),
       mSource(source),
       mTimeCodeScale(timeCodeScale),
+      mFramePool(new WebmFramePool()),
       mTrackDurationUs(0) {
     clearFlags();
     mStartTimeUs = startTimeRealUs;
@@ -385,7 +447,8 @@ void WebmFrameMediaSourceThread::run() {
             mType,
             isSync,
             timestampUs * 1000 / mTimeCodeScale,
-            buffer);
+            buffer,
+            mFramePool);
         mSink.push(f);
 
         ALOGV(
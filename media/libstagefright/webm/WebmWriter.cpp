@@ -392,7 +392,10 @@ status_t WebmWriter::reset() {
         ALOGD("Duration from tracks range is [%" PRId64 ", %" PRId64 "] us", minDurationUs, maxDurationUs);
     }
 
-    mSinkThread->stop();
+    status_t sinkErr = mSinkThread->stop();
+    if (err == OK) {
+        err = sinkErr;
+    }
 
     // Do not write out movie header on error.
     if (err != OK) {
@@ -400,21 +403,15 @@ status_t WebmWriter::reset() {
         return err;
     }
 
-    sp<WebmElement> cues = new WebmMaster(kMkvCues, mCuePoints);
-    uint64_t cuesSize = cues->totalSize();
-    // TRICKY Even when the cues do fit in the space we reserved, if they do not fit
-    // perfectly, we still need to check if there is enough "extra space" to write an
-    // EBML void element.
-    if (cuesSize != mEstimatedCuesSize && cuesSize > mEstimatedCuesSize - kMinEbmlVoidSize) {
-        mCuesOffset = ::lseek(mFd, 0, SEEK_CUR);
-        cues->write(mFd, cuesSize);
-    } else {
-        uint64_t spaceSize;
-        ::lseek(mFd, mCuesOffset, SEEK_SET);
-        cues->write(mFd, cuesSize);
-        sp<WebmElement> space = new EbmlVoid(mEstimatedCuesSize - cuesSize);
-        space->write(mFd, spaceSize);
+    // Most of the cues are in place already; write out the rest and the Cues header.
+    uint64_t cuesOffset;
+    err = mCuePoints.finalize(&cuesOffset);
+    if (err != OK) {
+        ALOGE("failed to write cues: %s", strerror(-err));
+        release();
+        return err;
     }
+    mCuesOffset = cuesOffset;
 
     mCuePoints.clear();
     mStreams[kVideoIndex].mSink.clear();
@@ -610,7 +607,13 @@ status_t WebmWriter::start(MetaData *params) {
     mInfoOffset = offsets[3];
     mInfoSize = sizes[3];
     mTracksOffset = offsets[4];
-    mCuesOffset = offsets[5];
+    if (mStreamableFile) {
+        mCuesOffset = offsets[5];
+        mCuePoints.reset(mFd, mCuesOffset, mEstimatedCuesSize);
+    } else {
+        mCuesOffset = 0;
+        mCuePoints.reset(mFd, 0, 0);
+    }
 
     // start threads
     if (params) {
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBMCUES_H_
+#define WEBMCUES_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace android {
+
+// Collects the Cues element of a recording. Cue points are serialized as they are added, and
+// written into the space reserved for the Cues element ahead of the clusters once a few of them
+// have piled up, so that the memory held for them stays bounded however long the recording
+// runs. Only if the cues outgrow the reserved space are they kept in memory and written after
+// the clusters instead.
+//
+// Cue points are added from the sink thread; finalize() runs once that thread is done.
+class WebmCues {
+public:
+    WebmCues();
+
+    // Starts over for a recording to fd, with reservedSize bytes reserved for the Cues element
+    // at offset. The reserved space must hold an EbmlVoid element. reservedSize is 0 if no
+    // space was reserved.
+    void reset(int fd, uint64_t offset, uint64_t reservedSize);
+    void clear();
+
+    void addCuePoint(uint64_t time, int track, uint64_t clusterOffset);
+
+    // Writes the Cues element: into the reserved space, followed by an EbmlVoid element
+    // covering the rest of it, or else at the end of the file. Sets cuesOffset to the offset
+    // of the Cues element.
+    status_t finalize(uint64_t *cuesOffset);
+
+    size_t numCuePoints() const {
+        return mNumCuePoints;
+    }
+
+    // Serialized cue points not written to the file yet.
+    size_t pendingBytes() const {
+        return mPending.size();
+    }
+
+private:
+    int mFd;
+    uint64_t mOffset;
+    uint64_t mReservedSize;
+    // bytes of cue points written into the reserved space
+    uint64_t mFlushedBytes;
+    size_t mNumCuePoints;
+    // the cues do not fit the reserved space; they are all written at finalize()
+    bool mOverflowed;
+    status_t mError;
+    std::vector<uint8_t> mPending;
+
+    void flush();
+
+    DISALLOW_EVIL_CONSTRUCTORS(WebmCues);
+};
+
+} /* namespace android */
+#endif /* WEBMCUES_H_ */
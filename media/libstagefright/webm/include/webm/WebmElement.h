@@ -20,6 +20,7 @@
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AWriteQueue.h>
 #include <utils/List.h>
 
 namespace android {
@@ -38,6 +39,7 @@ struct WebmElement : public LightRefBase<WebmElement> {
     uint64_t serializeInto(uint8_t *buf);
     uint8_t *serialize(uint64_t& size);
     int write(int fd, uint64_t& size);
+    status_t write(const sp<AWriteQueue>& queue, uint64_t& size);
 
     static sp<WebmElement> EbmlHeader(
             int ver = 1,
@@ -19,10 +19,42 @@
 
 #include "WebmElement.h"
 
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
 namespace android {
 
+// Recycles the payload buffers of the frames of a track, so that a long recording does not
+// allocate a new buffer for every frame. A frame hands its buffer back when the last reference
+// to it goes away, on whichever thread that happens; the pool may outlive its source thread.
+struct WebmFramePool : LightRefBase<WebmFramePool> {
+    WebmFramePool();
+    ~WebmFramePool() {}
+
+    // Returns a buffer whose range is [0, size).
+    sp<ABuffer> acquire(size_t size);
+    void recycle(const sp<ABuffer>& buffer);
+
+    struct Stats {
+        uint64_t acquires;
+        uint64_t allocations;   // acquires that could not reuse a pooled buffer
+    };
+    Stats getStats() const;
+
+private:
+    mutable Mutex mLock;
+    Vector<sp<ABuffer> > mFree;
+    size_t mFreeBytes;
+    Stats mStats;
+
+    DISALLOW_EVIL_CONSTRUCTORS(WebmFramePool);
+};
+
 struct WebmFrame : LightRefBase<WebmFrame> {
 public:
+    // id, size and header of a SimpleBlock element, ahead of the frame data
+    static const size_t kMaxBlockHeaderSize = 1 + 8 + 4;
+
     const int mType;
     const bool mKey;
     uint64_t mAbsTimecode;
@@ -30,17 +62,26 @@ public:
     const bool mEos;
 
     WebmFrame();
-    WebmFrame(int type, bool key, uint64_t absTimecode, MediaBufferBase *buf);
-    ~WebmFrame() {}
+    WebmFrame(int type, bool key, uint64_t absTimecode, MediaBufferBase *buf,
+            const sp<WebmFramePool>& pool = NULL);
+    ~WebmFrame();
 
     uint64_t getAbsTimecode();
     void updateAbsTimecode(uint64_t newAbsTimecode);
     sp<WebmElement> SimpleBlock(uint64_t baseTimecode) const;
 
+    // Total size of the SimpleBlock element of this frame.
+    uint64_t blockSize() const;
+    // Serializes the SimpleBlock element of this frame up to, but not including, the frame
+    // data into buf, which must hold kMaxBlockHeaderSize bytes. Returns the bytes written.
+    size_t serializeBlockHeader(uint64_t baseTimecode, uint8_t *buf) const;
+
     bool operator<(const WebmFrame &other) const;
 
     static const sp<WebmFrame> EOS;
 private:
+    const sp<WebmFramePool> mPool;
+
     DISALLOW_EVIL_CONSTRUCTORS(WebmFrame);
 };
 
@@ -17,16 +17,21 @@
 #ifndef WEBMFRAMETHREAD_H_
 #define WEBMFRAMETHREAD_H_
 
+#include "WebmCues.h"
 #include "WebmFrame.h"
 #include "LinkedBlockingQueue.h"
 
 #include <datasource/FileSource.h>
 #include <media/stagefright/MediaSource.h>
+#include <media/stagefright/foundation/AWriteQueue.h>
 
 #include <utils/List.h>
 #include <utils/Errors.h>
 
 #include <pthread.h>
+#include <sys/uio.h>
+
+#include <vector>
 
 namespace android {
 
@@ -61,14 +66,14 @@ public:
             const uint64_t& off,
             sp<WebmFrameSourceThread> videoThread,
             sp<WebmFrameSourceThread> audioThread,
-            List<sp<WebmElement> >& cues);
+            WebmCues& cues);
 
     WebmFrameSinkThread(
             const int& fd,
             const uint64_t& off,
             LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
             LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-            List<sp<WebmElement> >& cues);
+            WebmCues& cues);
 
     void run();
     bool running() {
@@ -82,16 +87,22 @@ private:
     const uint64_t& mSegmentDataStart;
     LinkedBlockingQueue<const sp<WebmFrame> >& mVideoFrames;
     LinkedBlockingQueue<const sp<WebmFrame> >& mAudioFrames;
-    List<sp<WebmElement> >& mCues;
+    WebmCues& mCues;
     uint64_t mStartOffsetTimecode;
+    // Clusters are written from the queue's thread while the sink thread runs.
+    sp<AWriteQueue> mWriteQueue;
+    // First error writing clusters, returned by stop().
+    status_t mWriteError;
+
+    // Frames of the cluster being written, and the element headers and I/O vector it is
+    // written with; kept around so that writing a cluster does not allocate.
+    Vector<sp<WebmFrame> > mClusterFrames;
+    std::vector<uint8_t> mClusterHeaders;
+    std::vector<struct iovec> mClusterIov;
 
     volatile bool mDone;
 
-    static void initCluster(
-            List<const sp<WebmFrame> >& frames,
-            uint64_t& clusterTimecodeL,
-            List<sp<WebmElement> >& children);
-    void writeCluster(List<sp<WebmElement> >& children);
+    status_t writeCluster(uint64_t clusterTimecode);
     void flushFrames(List<const sp<WebmFrame> >& frames, bool last);
 };
 
@@ -145,6 +156,7 @@ public:
 private:
     const sp<MediaSource> mSource;
     const uint64_t mTimeCodeScale;
+    const sp<WebmFramePool> mFramePool;
     uint64_t mStartTimeUs;
 
     volatile bool mDone;
@@ -18,6 +18,7 @@
 #define WEBMWRITER_H_
 
 #include "WebmConstants.h"
+#include "WebmCues.h"
 #include "WebmFrameThread.h"
 #include "LinkedBlockingQueue.h"
 
@@ -80,7 +81,7 @@ private:
     uint64_t mEstimatedCuesSize;
 
     Mutex mLock;
-    List<sp<WebmElement> > mCuePoints;
+    WebmCues mCuePoints;
 
     enum {
         kAudioIndex     =  0,
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Records a synthetic VP9 + Opus stream through WebmFrameSinkThread the way WebmWriter does,
+// and reports the CPU time and the heap allocations each frame costs on its way to the file.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/WebmFrameThreadBenchmark/WebmFrameThreadBenchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include <benchmark/benchmark.h>
+
+#include <media/stagefright/MediaBuffer.h>
+
+#include "webm/WebmConstants.h"
+#include "webm/WebmCues.h"
+#include "webm/WebmFrameThread.h"
+
+using namespace android;
+using namespace webm;
+
+// Counts operator new calls. The data of an ABuffer is malloc()ed, so every ABuffer a frame
+// allocates stands for two allocations.
+static std::atomic<uint64_t> gAllocations(0);
+
+void *operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if (p == nullptr) {
+        abort();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// About 4 Mbps of 1080p30 VP9 with a key frame every 2 seconds, and 20 ms Opus packets.
+static constexpr int64_t kVideoFrameDurationUs = 33333;
+static constexpr int64_t kAudioFrameDurationUs = 20000;
+static constexpr int kKeyFrameInterval = 60;
+static constexpr size_t kKeyFrameSize = 100 * 1024;
+static constexpr size_t kVideoFrameSize = 12 * 1024;
+static constexpr size_t kAudioFrameSize = 160;
+
+// Space reserved for the cues, as WebmWriter reserves it for a recording of unknown length.
+static constexpr uint64_t kReservedCuesSize = 2 * 3 * 1024;
+
+static int64_t processCpuTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// The sink takes frames while both tracks have one queued, so it runs dry once either is empty.
+static void waitForSink(LinkedBlockingQueue<const sp<WebmFrame> >& videoFrames,
+        LinkedBlockingQueue<const sp<WebmFrame> >& audioFrames) {
+    while (!videoFrames.empty() && !audioFrames.empty()) {
+        usleep(1000);
+    }
+}
+
+// Arguments are the length of the recording in seconds, and whether frames take their buffers
+// from a WebmFramePool, as WebmFrameMediaSourceThread does.
+static void BM_VP9Recording(benchmark::State& state) {
+    const int64_t durationUs = state.range(0) * 1000000LL;
+    const bool pooled = state.range(1);
+
+    MediaBufferBase *videoBuffer = MediaBufferBase::Create(kKeyFrameSize);
+    MediaBufferBase *audioBuffer = MediaBufferBase::Create(kAudioFrameSize);
+    memset(videoBuffer->data(), 0x5a, kKeyFrameSize);
+    memset(audioBuffer->data(), 0xa5, kAudioFrameSize);
+
+    uint64_t frames = 0;
+    uint64_t allocations = 0;
+    int64_t cpuTimeUs = 0;
+    uint64_t poolAcquires = 0;
+    uint64_t poolAllocations = 0;
+    size_t cuePoints = 0;
+    size_t maxPendingCueBytes = 0;
+
+    for (auto _ : state) {
+        FILE *file = tmpfile();
+        if (file == nullptr) {
+            state.SkipWithError("cannot create output file");
+            break;
+        }
+        int fd = fileno(file);
+        uint64_t size;
+        sp<WebmElement> space = new EbmlVoid(kReservedCuesSize);
+        space->write(fd, size);
+        ::lseek(fd, 0, SEEK_END);
+
+        WebmCues cues;
+        cues.reset(fd, 0, kReservedCuesSize);
+        uint64_t segmentDataStart = 0;
+        LinkedBlockingQueue<const sp<WebmFrame> > videoFrames;
+        LinkedBlockingQueue<const sp<WebmFrame> > audioFrames;
+        sp<WebmFrameSinkThread> sink = new WebmFrameSinkThread(
+                fd, segmentDataStart, videoFrames, audioFrames, cues);
+        sp<WebmFramePool> videoPool = pooled ? new WebmFramePool() : NULL;
+        sp<WebmFramePool> audioPool = pooled ? new WebmFramePool() : NULL;
+
+        const uint64_t allocationsAtStart = gAllocations.load();
+        const int64_t cpuTimeUsAtStart = processCpuTimeUs();
+        sink->start();
+
+        int64_t videoTimeUs = 0;
+        int64_t audioTimeUs = 0;
+        int64_t nextWaitUs = 1000000;
+        for (int videoIndex = 0; videoTimeUs < durationUs || audioTimeUs < durationUs;) {
+            sp<WebmFrame> frame;
+            if (videoTimeUs <= audioTimeUs) {
+                bool key = videoIndex % kKeyFrameInterval == 0;
+                // vary the size of inter frames a little, as an encoder would
+                videoBuffer->set_range(
+                        0, key ? kKeyFrameSize : kVideoFrameSize + (videoIndex * 1031) % 4096);
+                frame = new WebmFrame(
+                        kVideoType, key, videoTimeUs / 1000, videoBuffer, videoPool);
+                videoFrames.push(frame);
+                videoTimeUs += kVideoFrameDurationUs;
+                ++videoIndex;
+            } else {
+                frame = new WebmFrame(
+                        kAudioType, true, audioTimeUs / 1000, audioBuffer, audioPool);
+                audioFrames.push(frame);
+                audioTimeUs += kAudioFrameDurationUs;
+            }
+            ++frames;
+            // Keep about a second of frames queued, as a real-time source would.
+            if (std::min(videoTimeUs, audioTimeUs) >= nextWaitUs) {
+                waitForSink(videoFrames, audioFrames);
+                nextWaitUs += 1000000;
+            }
+        }
+        sink->stop();
+        cuePoints += cues.numCuePoints();
+        maxPendingCueBytes = std::max(maxPendingCueBytes, cues.pendingBytes());
+
+        uint64_t cuesOffset;
+        if (cues.finalize(&cuesOffset) != OK) {
+            state.SkipWithError("failed to write cues");
+        }
+        cpuTimeUs += processCpuTimeUs() - cpuTimeUsAtStart;
+        allocations += gAllocations.load() - allocationsAtStart;
+        if (pooled) {
+            poolAcquires += videoPool->getStats().acquires + audioPool->getStats().acquires;
+            poolAllocations +=
+                    videoPool->getStats().allocations + audioPool->getStats().allocations;
+        }
+        fclose(file);
+    }
+
+    videoBuffer->release();
+    audioBuffer->release();
+
+    if (frames > 0) {
+        state.SetItemsProcessed(frames);
+        state.counters["cpuUsPerFrame"] = (double)cpuTimeUs / frames;
+        state.counters["allocsPerFrame"] = (double)allocations / frames;
+        state.counters["poolReuse"] =
+                poolAcquires == 0 ? 0 : 1.0 - (double)poolAllocations / poolAcquires;
+        state.counters["cuePoints"] = (double)cuePoints / state.iterations();
+        state.counters["maxCueBytesInMemory"] = maxPendingCueBytes;
+    }
+}
+
+BENCHMARK(BM_VP9Recording)
+        ->ArgNames({"seconds", "pooled"})
+        ->Args({60, 0})
+        ->Args({60, 1})
+        ->Args({600, 0})
+        ->Args({600, 1})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -107,7 +107,7 @@ class WebmFrameThreadUnitTest : public ::testing::TestWithParam<std::pair<int32_
     sp<WebmFrameSourceThread> mAudioThread;
     sp<WebmFrameSourceThread> mVideoThread;
 
-    List<sp<WebmElement>> mCuePoints;
+    WebmCues mCuePoints;
     sp<MediaAdapter> mSource[kMaxStreamCount];
     LinkedBlockingQueue<const sp<WebmFrame>> mVSink;
     LinkedBlockingQueue<const sp<WebmFrame>> mASink;
@@ -0,0 +1,250 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ */
+
+// Muxes a synthetic AVC + AAC recording, laid out as a writer fuzzer corpus
+// entry, through MPEG2TSWriter and reports the TS output throughput in MB/s.
+//
+// Run with:
+//   adb shell /data/benchmarktest64/mpeg2ts_writer_benchmark/mpeg2ts_writer_benchmark
+
+#include "WriterFuzzerBase.h"
+
+#include <benchmark/benchmark.h>
+#include <media/stagefright/MPEG2TSWriter.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaSource.h>
+#include <unistd.h>
+
+using namespace android;
+
+// About 4 Mbps of 30fps AVC with a key frame every second, and 48 kHz AAC.
+constexpr int64_t kVideoFrameDurationUs = 33333;
+constexpr int64_t kAudioFrameDurationUs = 21333;
+constexpr int32_t kKeyFrameInterval = 30;
+constexpr size_t kKeyFrameSize = 64 * 1024;
+constexpr size_t kVideoFrameSize = 14 * 1024;
+constexpr size_t kAudioFrameSize = 400;
+
+// Hands out the frames of one track as fast as the writer reads them.
+class FrameSource : public MediaSource {
+   public:
+    FrameSource(const char* mime, const vector<FrameData>& frames)
+        : mFormat(new MetaData), mFrames(frames), mIndex(0) {
+        mFormat->setCString(kKeyMIMEType, mime);
+    }
+
+    status_t start(MetaData* /* params */) override {
+        mIndex = 0;
+        return OK;
+    }
+
+    status_t stop() override { return OK; }
+
+    sp<MetaData> getFormat() override { return mFormat; }
+
+    status_t read(MediaBufferBase** buffer, const ReadOptions* /* options */) override {
+        if (mIndex == mFrames.size()) {
+            return ERROR_END_OF_STREAM;
+        }
+        const FrameData& frame = mFrames[mIndex++];
+        // Released by the writer, which copies the data out first.
+        MediaBuffer* mediaBuffer = new MediaBuffer((void*)frame.buf, frame.size);
+        mediaBuffer->meta_data().setInt64(kKeyTime, frame.timeUs);
+        if (frame.flags == SampleFlag::SYNC_FLAG) {
+            mediaBuffer->meta_data().setInt32(kKeyIsSyncFrame, true);
+        }
+        *buffer = mediaBuffer;
+        return OK;
+    }
+
+   private:
+    sp<MetaData> mFormat;
+    const vector<FrameData>& mFrames;
+    size_t mIndex;
+};
+
+class Mpeg2TsWriterBenchmark : public WriterFuzzerBase {
+   public:
+    ~Mpeg2TsWriterBenchmark() { delete mBufferSource; }
+
+    bool createWriter();
+
+    // Parses a corpus entry. Returns false if it has no track the writer
+    // takes.
+    bool parse(const uint8_t* data, size_t size);
+
+    // Muxes all frames of the parsed corpus entry.
+    void process();
+
+    size_t bytesWritten() const { return mBytesWritten; }
+    size_t writes() const { return mWrites; }
+
+   private:
+    size_t mBytesWritten = 0;
+    size_t mWrites = 0;
+
+    static ssize_t write(void* cookie, const void* data, size_t size);
+};
+
+ssize_t Mpeg2TsWriterBenchmark::write(void* cookie, const void* /* data */, size_t size) {
+    Mpeg2TsWriterBenchmark* benchmark = static_cast<Mpeg2TsWriterBenchmark*>(cookie);
+    benchmark->mBytesWritten += size;
+    ++benchmark->mWrites;
+    return size;
+}
+
+bool Mpeg2TsWriterBenchmark::createWriter() {
+    mWriter = new MPEG2TSWriter(this, &Mpeg2TsWriterBenchmark::write);
+    if (!mWriter) {
+        return false;
+    }
+    mFileMeta = new MetaData;
+    return true;
+}
+
+bool Mpeg2TsWriterBenchmark::parse(const uint8_t* data, size_t size) {
+    if (size < 1) {
+        return false;
+    }
+    // The number of buffers to interleave is of no use here, the writer
+    // reads the tracks in the order it writes them.
+    mBufferSource = new BufferSource(data + 1, size - 1);
+    mNumTracks = mBufferSource->getNumTracks();
+    for (int32_t idx = 0; idx < mNumTracks; ++idx) {
+        if (!mBufferSource->getTrackInfo(idx)) {
+            mNumTracks = idx;
+            break;
+        }
+    }
+    mBufferSource->getFrameInfo();
+    return mNumTracks > 0;
+}
+
+void Mpeg2TsWriterBenchmark::process() {
+    createWriter();
+    for (int32_t idx = 0; idx < mNumTracks; ++idx) {
+        sp<MediaSource> source = new FrameSource(mBufferSource->getConfigFormat(idx).mime,
+                                                 mBufferSource->getFrameList(idx));
+        mWriter->addSource(source);
+    }
+    mFileMeta->setInt32(kKeyRealTimeRecording, false);
+    mWriter->start(mFileMeta.get());
+    while (!mWriter->reachedEOS()) {
+        usleep(1000);
+    }
+    mWriter->stop();
+    mWriter.clear();
+}
+
+static void appendFrameHeader(vector<uint8_t>& entry, uint8_t trackIndex, uint8_t flags,
+                              int64_t timeUs) {
+    static constexpr char kFrameMarker[] = "_MARK_F_";
+    entry.insert(entry.end(), kFrameMarker, kFrameMarker + strlen(kFrameMarker));
+    entry.push_back(trackIndex);
+    entry.push_back(flags);
+    const uint8_t* pts = reinterpret_cast<const uint8_t*>(&timeUs);
+    entry.insert(entry.end(), pts, pts + sizeof(timeUs));
+}
+
+static void appendFrame(vector<uint8_t>& entry, uint8_t trackIndex, uint8_t flags, int64_t timeUs,
+                        size_t size) {
+    appendFrameHeader(entry, trackIndex, flags, timeUs);
+    // Keep the payload clear of anything that reads as a marker.
+    for (size_t i = 0; i < size; ++i) {
+        entry.push_back((i * 131 + timeUs) & 0x3f);
+    }
+}
+
+static uint8_t mimeIndex(const char* mime) {
+    for (size_t idx = 0; idx < size(supportedMimeTypes); ++idx) {
+        if (supportedMimeTypes[idx] == mime) {
+            return idx;
+        }
+    }
+    return 0;
+}
+
+// Lays out |durationSec| seconds of the recording as a corpus entry for
+// WriterFuzzerBase.
+static vector<uint8_t> createCorpusEntry(int64_t durationSec) {
+    vector<uint8_t> entry;
+    entry.push_back(1);  // numBuffersInterleave
+    entry.push_back(2);  // numTracks
+    const int32_t videoParams[] = {1080, 1920};
+    entry.push_back(mimeIndex(MEDIA_MIMETYPE_VIDEO_AVC));
+    entry.insert(entry.end(), reinterpret_cast<const uint8_t*>(videoParams),
+                 reinterpret_cast<const uint8_t*>(videoParams + 2));
+    const int32_t audioParams[] = {2, 48000};
+    entry.push_back(mimeIndex(MEDIA_MIMETYPE_AUDIO_AAC));
+    entry.insert(entry.end(), reinterpret_cast<const uint8_t*>(audioParams),
+                 reinterpret_cast<const uint8_t*>(audioParams + 2));
+
+    // Without an ESDS the writer takes the first audio buffer as the AAC
+    // codec specific data.
+    static constexpr uint8_t kAACCodecSpecificData[] = {0x11, 0x90};
+    appendFrameHeader(entry, 1, SampleFlag::SYNC_FLAG, 0);
+    entry.insert(entry.end(), kAACCodecSpecificData,
+                 kAACCodecSpecificData + sizeof(kAACCodecSpecificData));
+
+    const int64_t durationUs = durationSec * 1000000LL;
+    int64_t videoTimeUs = 0;
+    int64_t audioTimeUs = 0;
+    for (int32_t videoIndex = 0; videoTimeUs < durationUs || audioTimeUs < durationUs;) {
+        if (videoTimeUs <= audioTimeUs) {
+            bool key = videoIndex % kKeyFrameInterval == 0;
+            appendFrame(entry, 0, key ? SampleFlag::SYNC_FLAG : SampleFlag::DEFAULT_FLAG,
+                        videoTimeUs,
+                        key ? kKeyFrameSize : kVideoFrameSize + (videoIndex * 1031) % 4096);
+            videoTimeUs += kVideoFrameDurationUs;
+            ++videoIndex;
+        } else {
+            appendFrame(entry, 1, SampleFlag::SYNC_FLAG, audioTimeUs, kAudioFrameSize);
+            audioTimeUs += kAudioFrameDurationUs;
+        }
+    }
+    return entry;
+}
+
+static void BM_Mpeg2TsWriter(benchmark::State& state) {
+    const vector<uint8_t> entry = createCorpusEntry(state.range(0));
+    Mpeg2TsWriterBenchmark writerBenchmark;
+    if (!writerBenchmark.parse(entry.data(), entry.size())) {
+        state.SkipWithError("no track in corpus entry");
+        return;
+    }
+
+    for (auto _ : state) {
+        writerBenchmark.process();
+    }
+
+    const double bytes = writerBenchmark.bytesWritten();
+    state.counters["MB/s"] = benchmark::Counter(bytes / 1E6, benchmark::Counter::kIsRate);
+    state.counters["packetsPerWrite"] = bytes / 188 / std::max(writerBenchmark.writes(), (size_t)1);
+}
+
+BENCHMARK(BM_Mpeg2TsWriter)
+        ->ArgName("seconds")
+        ->Arg(10)
+        ->Arg(60)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -22,6 +22,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <utils/Log.h>
+#include <iterator>
 #include <thread>
 #include "AccessorImpl.h"
 #include "Connection.h"
@@ -41,6 +42,9 @@ namespace {
     static constexpr size_t kMinBufferCountForEviction = 25;
     static constexpr size_t kMaxUnusedBufferCount = 64;
     static constexpr size_t kUnusedBufferCountTarget = kMaxUnusedBufferCount - 16;
+    // # of buffers evicted at most by a periodic cache cleaning. The rest is
+    // left to the evictor thread in order to bound the time mMutex is held.
+    static constexpr size_t kMaxEvictionsPerCleanUp = 8;
 
     static constexpr nsecs_t kEvictGranularityNs = 1000000000; // 1 sec
     static constexpr nsecs_t kEvictDurationNs = 5000000000; // 5 secs
@@ -102,21 +106,12 @@ struct TransactionStatus {
 
 // Helper template methods for handling map of set.
 template<class T, class U>
-bool insert(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    auto iter = mapOfSet->find(key);
-    if (iter == mapOfSet->end()) {
-        std::set<U> valueSet{value};
-        mapOfSet->insert(std::make_pair(key, valueSet));
-        return true;
-    } else if (iter->second.find(value)  == iter->second.end()) {
-        iter->second.insert(value);
-        return true;
-    }
-    return false;
+bool insert(std::unordered_map<T, std::unordered_set<U>> *mapOfSet, T key, U value) {
+    return (*mapOfSet)[key].insert(value).second;
 }
 
 template<class T, class U>
-bool erase(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
+bool erase(std::unordered_map<T, std::unordered_set<U>> *mapOfSet, T key, U value) {
     bool ret = false;
     auto iter = mapOfSet->find(key);
     if (iter != mapOfSet->end()) {
@@ -131,7 +126,7 @@ bool erase(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
 }
 
 template<class T, class U>
-bool contains(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
+bool contains(std::unordered_map<T, std::unordered_set<U>> *mapOfSet, T key, U value) {
     auto iter = mapOfSet->find(key);
     if (iter != mapOfSet->end()) {
         auto setIter = iter->second.find(value);
@@ -165,6 +160,7 @@ ResultStatus Accessor::Impl::connect(
         const InvalidationDescriptor** invDescPtr) {
     sp<Connection> newConnection = new Connection();
     ResultStatus status = ResultStatus::CRITICAL_ERROR;
+    std::vector<std::unique_ptr<InternalBuffer>> evicted;
     {
         std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
         if (newConnection) {
@@ -188,13 +184,15 @@ ResultStatus Accessor::Impl::connect(
 
         }
         mBufferPool.processStatusMessages();
-        mBufferPool.cleanUp();
+        cleanUp_l();
         scheduleEvictIfNeeded();
+        mBufferPool.takeEvictedBuffers(&evicted);
     }
     return status;
 }
 
 ResultStatus Accessor::Impl::close(ConnectionId connectionId) {
+    std::vector<std::unique_ptr<InternalBuffer>> evicted;
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
     ALOGV("connection close %lld: %u", (long long)connectionId, mBufferPool.mInvalidation.mId);
     mBufferPool.processStatusMessages();
@@ -205,12 +203,14 @@ ResultStatus Accessor::Impl::close(ConnectionId connectionId) {
     // evict unused buffers.
     mBufferPool.cleanUp(true);
     scheduleEvictIfNeeded();
+    mBufferPool.takeEvictedBuffers(&evicted);
     return ResultStatus::OK;
 }
 
 ResultStatus Accessor::Impl::allocate(
         ConnectionId connectionId, const std::vector<uint8_t>& params,
         BufferId *bufferId, const native_handle_t** handle) {
+    std::vector<std::unique_ptr<InternalBuffer>> evicted;
     std::unique_lock<std::mutex> lock(mBufferPool.mMutex);
     mBufferPool.processStatusMessages();
     ResultStatus status = ResultStatus::OK;
@@ -230,14 +230,16 @@ ResultStatus Accessor::Impl::allocate(
         // TODO: handle ownBuffer failure
         mBufferPool.handleOwnBuffer(connectionId, *bufferId);
     }
-    mBufferPool.cleanUp();
+    cleanUp_l();
     scheduleEvictIfNeeded();
+    mBufferPool.takeEvictedBuffers(&evicted);
     return status;
 }
 
 ResultStatus Accessor::Impl::fetch(
         ConnectionId connectionId, TransactionId transactionId,
         BufferId bufferId, const native_handle_t** handle) {
+    std::vector<std::unique_ptr<InternalBuffer>> evicted;
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
     mBufferPool.processStatusMessages();
     auto found = mBufferPool.mTransactions.find(transactionId);
@@ -256,22 +258,37 @@ ResultStatus Accessor::Impl::fetch(
             }
         }
     }
-    mBufferPool.cleanUp();
+    cleanUp_l();
     scheduleEvictIfNeeded();
+    mBufferPool.takeEvictedBuffers(&evicted);
     return ResultStatus::CRITICAL_ERROR;
 }
 
 void Accessor::Impl::cleanUp(bool clearCache) {
     // transaction timeout, buffer cacheing TTL handling
+    std::vector<std::unique_ptr<InternalBuffer>> evicted;
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
     mBufferPool.processStatusMessages();
-    mBufferPool.cleanUp(clearCache);
+    if (clearCache) {
+        mBufferPool.cleanUp(true);
+    } else {
+        cleanUp_l();
+    }
+    mBufferPool.takeEvictedBuffers(&evicted);
+}
+
+void Accessor::Impl::cleanUp_l() {
+    if (mBufferPool.cleanUp()) {
+        sEvictor->addCleanUp(shared_from_this());
+    }
 }
 
 void Accessor::Impl::flush() {
+    std::vector<std::unique_ptr<InternalBuffer>> evicted;
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
     mBufferPool.processStatusMessages();
     mBufferPool.flush(shared_from_this());
+    mBufferPool.takeEvictedBuffers(&evicted);
 }
 
 void Accessor::Impl::handleInvalidateAck() {
@@ -570,7 +587,7 @@ bool Accessor::Impl::BufferPool::handleTransferResult(const BufferStatusMessage
 }
 
 void Accessor::Impl::BufferPool::processStatusMessages() {
-    std::vector<BufferStatusMessage> messages;
+    std::vector<BufferStatusMessage> &messages = mStatusMessages;
     mObserver.getBufferStatusChanges(messages);
     mTimestampUs = getTimestampNow();
     for (BufferStatusMessage& message: messages) {
@@ -725,7 +742,7 @@ ResultStatus Accessor::Impl::BufferPool::addNewBuffer(
     return ResultStatus::NO_MEMORY;
 }
 
-void Accessor::Impl::BufferPool::cleanUp(bool clearCache) {
+bool Accessor::Impl::BufferPool::cleanUp(bool clearCache) {
     if (clearCache || mTimestampUs > mLastCleanUpUs + kCleanUpDurationUs ||
             mStats.buffersNotInUse() > kMaxUnusedBufferCount) {
         mLastCleanUpUs = mTimestampUs;
@@ -740,24 +757,43 @@ void Accessor::Impl::BufferPool::cleanUp(bool clearCache) {
                   mStats.mTotalRecycles, mStats.mTotalAllocations,
                   mStats.mTotalFetches, mStats.mTotalTransfers);
         }
+        size_t evictions = 0;
         for (auto freeIt = mFreeBuffers.begin(); freeIt != mFreeBuffers.end();) {
             if (!clearCache && mStats.buffersNotInUse() <= kUnusedBufferCountTarget &&
                     (mStats.mSizeCached < kMinAllocBytesForEviction ||
                      mBuffers.size() < kMinBufferCountForEviction)) {
                 break;
             }
+            if (!clearCache && evictions >= kMaxEvictionsPerCleanUp) {
+                // leave the rest to the next clean-up.
+                mLastCleanUpUs = 0;
+                return true;
+            }
             auto it = mBuffers.find(*freeIt);
             if (it != mBuffers.end() &&
                     it->second->mOwnerCount == 0 && it->second->mTransactionCount == 0) {
                 mStats.onBufferEvicted(it->second->mAllocSize);
+                mEvictedBuffers.push_back(std::move(it->second));
                 mBuffers.erase(it);
                 freeIt = mFreeBuffers.erase(freeIt);
+                ++evictions;
             } else {
                 ++freeIt;
                 ALOGW("bufferpool2 inconsistent!");
             }
         }
     }
+    return false;
+}
+
+void Accessor::Impl::BufferPool::takeEvictedBuffers(
+        std::vector<std::unique_ptr<InternalBuffer>> *evicted) {
+    if (evicted->empty()) {
+        evicted->swap(mEvictedBuffers);
+    } else {
+        std::move(mEvictedBuffers.begin(), mEvictedBuffers.end(), std::back_inserter(*evicted));
+        mEvictedBuffers.clear();
+    }
 }
 
 void Accessor::Impl::BufferPool::invalidate(
@@ -769,6 +805,7 @@ void Accessor::Impl::BufferPool::invalidate(
             if (it != mBuffers.end() &&
                 it->second->mOwnerCount == 0 && it->second->mTransactionCount == 0) {
                 mStats.onBufferEvicted(it->second->mAllocSize);
+                mEvictedBuffers.push_back(std::move(it->second));
                 mBuffers.erase(it);
                 freeIt = mFreeBuffers.erase(freeIt);
                 continue;
@@ -905,18 +942,22 @@ void Accessor::Impl::createInvalidator() {
 
 void Accessor::Impl::evictorThread(
         std::map<const std::weak_ptr<Accessor::Impl>, nsecs_t, std::owner_less<>> &accessors,
+        std::set<std::weak_ptr<Accessor::Impl>, std::owner_less<>> &cleanUps,
         std::mutex &mutex,
         std::condition_variable &cv) {
     std::list<const std::weak_ptr<Accessor::Impl>> evictList;
+    std::list<std::weak_ptr<Accessor::Impl>> cleanUpList;
     while (true) {
         int expired = 0;
         int evicted = 0;
         {
             nsecs_t now = systemTime();
             std::unique_lock<std::mutex> lock(mutex);
-            if (accessors.size() == 0) {
+            if (accessors.size() == 0 && cleanUps.size() == 0) {
                 cv.wait(lock);
             }
+            cleanUpList.assign(cleanUps.begin(), cleanUps.end());
+            cleanUps.clear();
             auto it = accessors.begin();
             while (it != accessors.end()) {
                 if (now > (it->second + kEvictDurationNs)) {
@@ -928,6 +969,14 @@ void Accessor::Impl::evictorThread(
                 }
             }
         }
+        // finish left-over cache cleaning of busy accessors.
+        for (auto it = cleanUpList.begin(); it != cleanUpList.end(); ++it) {
+            const std::shared_ptr<Accessor::Impl> accessor = it->lock();
+            if (accessor) {
+                accessor->cleanUp(false);
+            }
+        }
+        cleanUpList.clear();
         // evict idle accessors;
         for (auto it = evictList.begin(); it != evictList.end(); ++it) {
             const std::shared_ptr<Accessor::Impl> accessor = it->lock();
@@ -948,6 +997,7 @@ Accessor::Impl::AccessorEvictor::AccessorEvictor() {
     std::thread evictor(
             evictorThread,
             std::ref(mAccessors),
+            std::ref(mCleanUps),
             std::ref(mMutex),
             std::ref(mCv));
     evictor.detach();
@@ -968,6 +1018,16 @@ void Accessor::Impl::AccessorEvictor::addAccessor(
     }
 }
 
+void Accessor::Impl::AccessorEvictor::addCleanUp(
+        const std::weak_ptr<Accessor::Impl> &impl) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    bool notify = mAccessors.empty() && mCleanUps.empty();
+    mCleanUps.insert(impl);
+    if (notify) {
+        mCv.notify_one();
+    }
+}
+
 std::unique_ptr<Accessor::Impl::AccessorEvictor> Accessor::Impl::sEvictor;
 
 void Accessor::Impl::createEvictor() {
@@ -19,6 +19,8 @@
 
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <condition_variable>
 #include <utils/Timers.h>
 #include "Accessor.h"
@@ -100,23 +102,32 @@ private:
         bool mValid;
         BufferStatusObserver mObserver;
         BufferInvalidationChannel mInvalidationChannel;
+        // Reused for draining status messages in order not to allocate per call.
+        std::vector<BufferStatusMessage> mStatusMessages;
 
-        std::map<ConnectionId, std::set<BufferId>> mUsingBuffers;
-        std::map<BufferId, std::set<ConnectionId>> mUsingConnections;
+        // Buffer/connection/transaction tracking is looked up per status
+        // message, so hashed containers are used. Only the free buffer list
+        // keeps its order so that recycling remains deterministic.
+        std::unordered_map<ConnectionId, std::unordered_set<BufferId>> mUsingBuffers;
+        std::unordered_map<BufferId, std::unordered_set<ConnectionId>> mUsingConnections;
 
-        std::map<ConnectionId, std::set<TransactionId>> mPendingTransactions;
+        std::unordered_map<ConnectionId, std::unordered_set<TransactionId>> mPendingTransactions;
         // Transactions completed before TRANSFER_TO message arrival.
         // Fetch does not occur for the transactions.
         // Only transaction id is kept for the transactions in short duration.
-        std::set<TransactionId> mCompletedTransactions;
+        std::unordered_set<TransactionId> mCompletedTransactions;
         // Currently active(pending) transations' status & information.
-        std::map<TransactionId, std::unique_ptr<TransactionStatus>>
+        std::unordered_map<TransactionId, std::unique_ptr<TransactionStatus>>
                 mTransactions;
 
-        std::map<BufferId, std::unique_ptr<InternalBuffer>> mBuffers;
+        std::unordered_map<BufferId, std::unique_ptr<InternalBuffer>> mBuffers;
         std::set<BufferId> mFreeBuffers;
         std::set<ConnectionId> mConnectionIds;
 
+        // Buffers evicted while holding mMutex. These are destroyed by the
+        // caller after releasing mMutex, since freeing allocations can be slow.
+        std::vector<std::unique_ptr<InternalBuffer>> mEvictedBuffers;
+
         struct Invalidation {
             static std::atomic<std::uint32_t> sInvSeqId;
 
@@ -365,13 +376,22 @@ private:
                 const native_handle_t **handle);
 
         /**
-         * Processes pending buffer status messages and performs periodic cache
-         * cleaning.
+         * Performs periodic cache cleaning. Unless clearCache is true, at most
+         * a bounded number of buffers are evicted per call.
          *
          * @param clearCache    if clearCache is true, it frees all buffers
          *                      waiting to be recycled.
+         *
+         * @return {@code true} when more buffers remain to be evicted,
+         *         {@code false} otherwise.
          */
-        void cleanUp(bool clearCache = false);
+        bool cleanUp(bool clearCache = false);
+
+        /**
+         * Moves buffers evicted so far to the specified list, in order to
+         * destroy them without holding the lock.
+         */
+        void takeEvictedBuffers(std::vector<std::unique_ptr<InternalBuffer>> *evicted);
 
         /**
          * Processes pending buffer status messages and invalidate all current
@@ -403,22 +423,32 @@ private:
 
     struct AccessorEvictor {
         std::map<const std::weak_ptr<Accessor::Impl>, nsecs_t, std::owner_less<>> mAccessors;
+        // Accessors which have cache cleaning left over from bounded clean-ups.
+        std::set<std::weak_ptr<Accessor::Impl>, std::owner_less<>> mCleanUps;
         std::mutex mMutex;
         std::condition_variable mCv;
 
         AccessorEvictor();
         void addAccessor(const std::weak_ptr<Accessor::Impl> &impl, nsecs_t ts);
+        void addCleanUp(const std::weak_ptr<Accessor::Impl> &impl);
     };
 
     static std::unique_ptr<AccessorEvictor> sEvictor;
 
     static void evictorThread(
         std::map<const std::weak_ptr<Accessor::Impl>, nsecs_t, std::owner_less<>> &accessors,
+        std::set<std::weak_ptr<Accessor::Impl>, std::owner_less<>> &cleanUps,
         std::mutex &mutex,
         std::condition_variable &cv);
 
     void scheduleEvictIfNeeded();
 
+    /**
+     * Performs bounded cache cleaning, and schedules the rest of it to the
+     * evictor thread if needed. mBufferPool.mMutex should be held.
+     */
+    void cleanUp_l();
+
 };
 
 }  // namespace implementation
@@ -25,6 +25,8 @@
 #include <cutils/native_handle.h>
 #include "Accessor.h"
 
+class BufferpoolUnitTest;
+
 namespace android {
 namespace hardware {
 namespace media {
@@ -99,6 +101,7 @@ private:
 
     friend struct ClientManager;
     friend struct Observer;
+    friend class ::BufferpoolUnitTest;
 };
 
 }  // namespace implementation
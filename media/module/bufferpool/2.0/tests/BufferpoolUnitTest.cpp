@@ -24,15 +24,21 @@
 #include <hidl/LegacySupport.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <unordered_set>
 #include <vector>
+#include "../BufferPoolClient.h"
 #include "allocator.h"
 
 using android::hardware::configureRpcThreadpool;
 using android::hardware::media::bufferpool::BufferPoolData;
 using android::hardware::media::bufferpool::V2_0::IClientManager;
 using android::hardware::media::bufferpool::V2_0::ResultStatus;
+using android::hardware::media::bufferpool::V2_0::implementation::Accessor;
 using android::hardware::media::bufferpool::V2_0::implementation::BufferId;
+using android::hardware::media::bufferpool::V2_0::implementation::BufferPoolClient;
 using android::hardware::media::bufferpool::V2_0::implementation::ClientManager;
 using android::hardware::media::bufferpool::V2_0::implementation::ConnectionId;
 using android::hardware::media::bufferpool::V2_0::implementation::TransactionId;
@@ -112,8 +118,61 @@ class BufferpoolUnitTest : public BufferpoolTest, public ::testing::Test {
     virtual void SetUp() override { setupBufferpoolManager(); }
 
     virtual void TearDown() override {}
+
+  protected:
+    // Opens a connection to |accessor| that stands in for a client in another
+    // process. ClientManager keeps at most one connection per pool in a
+    // process, so this uses BufferPoolClient directly.
+    std::shared_ptr<BufferPoolClient> connect(const android::sp<Accessor>& accessor);
+
+    // Allocates a buffer through |client| and transfers it to its own
+    // connection, returning the postSend + receive latency in |latencyUs|.
+    ResultStatus transfer(BufferPoolClient* client, const std::vector<uint8_t>& params,
+                          int64_t* latencyUs);
 };
 
+std::shared_ptr<BufferPoolClient> BufferpoolUnitTest::connect(
+        const android::sp<Accessor>& accessor) {
+    // No observer; nothing invalidates buffers in these tests.
+    std::shared_ptr<BufferPoolClient> client =
+            std::make_shared<BufferPoolClient>(accessor, nullptr);
+    if (!client->isValid()) {
+        return nullptr;
+    }
+    return client;
+}
+
+ResultStatus BufferpoolUnitTest::transfer(BufferPoolClient* client,
+                                          const std::vector<uint8_t>& params,
+                                          int64_t* latencyUs) {
+    native_handle_t* handle = nullptr;
+    native_handle_t* recvHandle = nullptr;
+    std::shared_ptr<BufferPoolData> buffer, receiverBuffer;
+    TransactionId transactionId;
+    int64_t postUs;
+
+    ResultStatus status = client->allocate(params, &handle, &buffer);
+    if (status != ResultStatus::OK) {
+        return status;
+    }
+    auto start = std::chrono::steady_clock::now();
+    status = client->postSend(client->getConnectionId(), buffer, &transactionId, &postUs);
+    if (status == ResultStatus::OK) {
+        status = client->receive(transactionId, buffer->mId, postUs, &recvHandle,
+                                 &receiverBuffer);
+    }
+    *latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    for (native_handle_t* h : {handle, recvHandle}) {
+        if (h) {
+            native_handle_close(h);
+            native_handle_delete(h);
+        }
+    }
+    return status;
+}
+
 class BufferpoolFunctionalityTest : public BufferpoolTest, public ::testing::Test {
   public:
     virtual void SetUp() override {
@@ -384,6 +443,65 @@ TEST_F(BufferpoolUnitTest, FlushTest) {
     timestampUs.clear();
 }
 
+// Concurrent transfer stress test.
+// Several threads, each with a connection of its own, allocate from and
+// transfer buffers through one buffer pool concurrently, so the accessor
+// drains the status queues of many clients. Reports transfer (postSend +
+// receive) latency percentiles.
+TEST_F(BufferpoolUnitTest, ConcurrentTransferLatency) {
+    constexpr int kNumTransfersPerThread = 500;
+    constexpr int kNumThreads[] = {1, 2, 4, 8};
+
+    std::vector<uint8_t> vecParams;
+    getTestAllocatorParams(&vecParams);
+
+    android::sp<Accessor> accessor = new Accessor(mAllocator);
+    ASSERT_TRUE(accessor->isValid()) << "unable to create buffer pool";
+
+    for (int numThreads : kNumThreads) {
+        std::vector<std::shared_ptr<BufferPoolClient>> clients;
+        for (int t = 0; t < numThreads; ++t) {
+            clients.push_back(connect(accessor));
+            ASSERT_NE(clients.back(), nullptr) << "unable to connect client " << t;
+        }
+
+        // gtest assertions do not abort the test from other threads, so the
+        // workers record the first failure and the results are checked here.
+        std::vector<std::vector<int64_t>> latencies(numThreads);
+        std::vector<ResultStatus> results(numThreads, ResultStatus::OK);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; ++t) {
+            threads.emplace_back([this, &vecParams, &clients, &latencies, &results, t]() {
+                for (int i = 0; i < kNumTransfersPerThread; ++i) {
+                    int64_t latencyUs;
+                    results[t] = transfer(clients[t].get(), vecParams, &latencyUs);
+                    if (results[t] != ResultStatus::OK) {
+                        return;
+                    }
+                    latencies[t].push_back(latencyUs);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (int t = 0; t < numThreads; ++t) {
+            ASSERT_EQ(results[t], ResultStatus::OK) << "transfer failed on thread " << t;
+        }
+
+        std::vector<int64_t> all;
+        for (const std::vector<int64_t>& threadLatencies : latencies) {
+            all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+        }
+        ASSERT_EQ(all.size(), (size_t)numThreads * kNumTransfersPerThread);
+        std::sort(all.begin(), all.end());
+        auto percentile = [&all](int p) { return all[(all.size() - 1) * p / 100]; };
+        ALOGI("%d clients: transfer latency p50 %lld us, p90 %lld us, p99 %lld us, max %lld us",
+              numThreads, (long long)percentile(50), (long long)percentile(90),
+              (long long)percentile(99), (long long)all.back());
+    }
+}
+
 // Buffer transfer test between processes.
 TEST_F(BufferpoolFunctionalityTest, TransferBuffer) {
     // initialize the receiver
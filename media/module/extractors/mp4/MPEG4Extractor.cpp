@@ -215,6 +215,7 @@ private:
         size_t size;
         uint32_t duration;
         int32_t compositionOffset;
+        bool isSync;
         uint8_t iv[16];
         Vector<uint32_t> clearsizes;
         Vector<uint32_t> encryptedsizes;
@@ -5876,6 +5877,8 @@ status_t MPEG4Source::parseTrackFragmentRun(off64_t offset, off64_t size) {
         kSampleFlagsPresent                 = 0x400,
         kSampleCompositionTimeOffsetPresent = 0x800,
     };
+    // sample_is_non_sync_sample, ISO/IEC 14496-12 8.8.3.1
+    static const uint32_t kSampleIsNonSyncSample = 0x10000;
 
     uint32_t flags;
     if (!mDataSource->getUInt32(offset, &flags)) {
@@ -6047,6 +6050,15 @@ status_t MPEG4Source::parseTrackFragmentRun(off64_t offset, off64_t size) {
         tmp.size = sampleSize;
         tmp.duration = sampleDuration;
         tmp.compositionOffset = sampleCtsOffset;
+        if ((flags & kFirstSampleFlagsPresent) && i == 0) {
+            tmp.isSync = !(firstSampleFlags & kSampleIsNonSyncSample);
+        } else if (flags & kSampleFlagsPresent) {
+            tmp.isSync = !(sampleFlags & kSampleIsNonSyncSample);
+        } else {
+            // Without flags of its own, only the first sample of a fragment is
+            // taken as sync.
+            tmp.isSync = mCurrentSamples.empty();
+        }
         memset(tmp.iv, 0, sizeof(tmp.iv));
         if (mCurrentSamples.add(tmp) < 0) {
             ALOGW("b/123389881 failed saving sample(n=%zu)", mCurrentSamples.size());
@@ -6764,7 +6776,7 @@ media_status_t MPEG4Source::fragmentedRead(
         }
 
         mCurrentTime += smpl->duration;
-        isSyncSample = (mCurrentSampleIndex == 0);
+        isSyncSample = smpl->isSync;
 
         status_t err = mBufferGroup->acquire_buffer(&mBuffer);
 
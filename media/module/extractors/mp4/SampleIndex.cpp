@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SampleIndex"
+//#define LOG_NDEBUG 0
+#include <utils/Log.h>
+
+#include "SampleIndex.h"
+
+namespace android {
+
+namespace {
+
+inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Deltas are computed modulo 2^64 so that malformed tables cannot overflow.
+template<typename T>
+inline uint64_t encodeDelta(T value, T base) {
+    int64_t delta;
+    __builtin_sub_overflow(value, base, &delta);
+    return zigzag(delta);
+}
+
+template<typename T>
+inline T decodeDelta(T base, uint64_t value) {
+    T result;
+    __builtin_add_overflow(base, unzigzag(value), &result);
+    return result;
+}
+
+}  // namespace
+
+SampleIndex::SampleIndex()
+    : mCount(0),
+      mLast{},
+      mCursorValid(false),
+      mCursorIndex(0),
+      mCursorPosition(0),
+      mCursor{} {
+}
+
+void SampleIndex::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        mData.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    mData.push_back((uint8_t)value);
+}
+
+uint64_t SampleIndex::getVarint(uint32_t *position) const {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = mData[(*position)++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+void SampleIndex::append(const Sample &sample, bool isChunkStart) {
+    if (mCount % 64 == 0) {
+        mSyncBits.push_back(0);
+        mChunkStartBits.push_back(0);
+    }
+    if (sample.isSync) {
+        mSyncBits[mCount / 64] |= 1ull << (mCount % 64);
+    }
+    if (isChunkStart) {
+        mChunkStartBits[mCount / 64] |= 1ull << (mCount % 64);
+    }
+
+    if (mCount % kSamplesPerBlock == 0) {
+        mAnchors.push_back({sample.offset, sample.compositionTime, (uint32_t)mData.size()});
+        putVarint(sample.size);
+        putVarint(sample.duration);
+    } else {
+        putVarint(sample.size);
+        // samples within a chunk are contiguous, so this is mostly 0
+        off64_t end;
+        __builtin_add_overflow(mLast.offset, mLast.size, &end);
+        putVarint(encodeDelta(sample.offset, end));
+        putVarint(encodeDelta(sample.compositionTime, mLast.compositionTime));
+        putVarint(encodeDelta(sample.duration, mLast.duration));
+    }
+
+    mLast = sample;
+    ++mCount;
+}
+
+void SampleIndex::decodeNext(uint32_t *position, Sample *sample) const {
+    off64_t end;
+    __builtin_add_overflow(sample->offset, sample->size, &end);
+    sample->size = getVarint(position);
+    sample->offset = decodeDelta(end, getVarint(position));
+    sample->compositionTime = decodeDelta(sample->compositionTime, getVarint(position));
+    sample->duration = decodeDelta(sample->duration, getVarint(position));
+}
+
+bool SampleIndex::getSample(uint32_t index, Sample *sample) {
+    if (index >= mCount) {
+        return false;
+    }
+
+    if (!mCursorValid || index < mCursorIndex
+            || index / kSamplesPerBlock != mCursorIndex / kSamplesPerBlock) {
+        const BlockAnchor &anchor = mAnchors[index / kSamplesPerBlock];
+        mCursorIndex = index - index % kSamplesPerBlock;
+        mCursorPosition = anchor.position;
+        mCursor.size = getVarint(&mCursorPosition);
+        mCursor.duration = getVarint(&mCursorPosition);
+        mCursor.offset = anchor.offset;
+        mCursor.compositionTime = anchor.compositionTime;
+        mCursorValid = true;
+    }
+    while (mCursorIndex < index) {
+        decodeNext(&mCursorPosition, &mCursor);
+        ++mCursorIndex;
+    }
+
+    *sample = mCursor;
+    sample->isSync = isSyncSample(index);
+    return true;
+}
+
+bool SampleIndex::getLastSampleIndexInChunk(uint32_t index, uint32_t *lastIndex) const {
+    if (index >= mCount) {
+        return false;
+    }
+    // find the next chunk start after |index|
+    uint32_t word = (index + 1) / 64;
+    if (word >= mChunkStartBits.size()) {
+        return false;
+    }
+    uint64_t bits = mChunkStartBits[word] & (~0ull << ((index + 1) % 64));
+    while (bits == 0) {
+        if (++word >= mChunkStartBits.size()) {
+            return false;
+        }
+        bits = mChunkStartBits[word];
+    }
+    uint32_t next = word * 64 + __builtin_ctzll(bits);
+    if (next >= mCount) {
+        return false;
+    }
+    *lastIndex = next - 1;
+    return true;
+}
+
+size_t SampleIndex::memoryUsage() const {
+    return mAnchors.capacity() * sizeof(BlockAnchor)
+            + mData.capacity()
+            + (mSyncBits.capacity() + mChunkStartBits.capacity()) * sizeof(uint64_t);
+}
+
+}  // namespace android
@@ -22,6 +22,8 @@
 
 #include <arpa/inet.h>
 
+#include <algorithm>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ByteUtils.h>
 
@@ -105,7 +107,11 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
             mFirstChunkSampleIndex
                 + mSamplesPerChunk * (chunk - mFirstChunk);
 
-        for (uint32_t i = 0; i < mSamplesPerChunk; ++i) {
+        if (!readChunkSampleSizes(firstChunkSampleIndex)) {
+            mCurrentChunkSampleSizes.clear();
+        }
+
+        for (uint32_t i = mCurrentChunkSampleSizes.size(); i < mSamplesPerChunk; ++i) {
             size_t sampleSize;
             if ((err = getSampleSizeDirect(
                             firstChunkSampleIndex + i, &sampleSize)) != OK) {
@@ -234,6 +240,46 @@ status_t SampleIterator::getChunkOffset(uint32_t chunk, off64_t *offset) {
     return OK;
 }
 
+bool SampleIterator::readChunkSampleSizes(uint32_t firstSampleIndex) {
+    if (mTable->mDefaultSampleSize > 0
+            || firstSampleIndex >= mTable->mNumSampleSizes
+            || mSamplesPerChunk > mTable->mNumSampleSizes - firstSampleIndex) {
+        // left to getSampleSizeDirect, which also handles truncated tables
+        return false;
+    }
+
+    size_t fieldBytes;
+    switch (mTable->mSampleSizeFieldSize) {
+        case 32: fieldBytes = 4; break;
+        case 16: fieldBytes = 2; break;
+        case 8: fieldBytes = 1; break;
+        default: return false;
+    }
+
+    // Read the sizes of all samples of the chunk with a few reads instead of
+    // one read per sample.
+    static const uint32_t kMaxSamplesPerRead = 1024;
+    uint8_t buffer[kMaxSamplesPerRead * 4];
+    mCurrentChunkSampleSizes.setCapacity(mSamplesPerChunk);
+    for (uint32_t i = 0; i < mSamplesPerChunk; i += kMaxSamplesPerRead) {
+        uint32_t count = std::min(mSamplesPerChunk - i, kMaxSamplesPerRead);
+        size_t bytes = count * fieldBytes;
+        if (mTable->mDataSource->readAt(
+                    mTable->mSampleSizeOffset + 12 + (off64_t)fieldBytes * (firstSampleIndex + i),
+                    buffer, bytes) < (ssize_t)bytes) {
+            return false;
+        }
+        for (uint32_t j = 0; j < count; ++j) {
+            switch (fieldBytes) {
+                case 4: mCurrentChunkSampleSizes.push(U32_AT(&buffer[4 * j])); break;
+                case 2: mCurrentChunkSampleSizes.push(U16_AT(&buffer[2 * j])); break;
+                default: mCurrentChunkSampleSizes.push(buffer[j]); break;
+            }
+        }
+    }
+    return true;
+}
+
 status_t SampleIterator::getSampleSizeDirect(
         uint32_t sampleIndex, size_t *size) {
     *size = 0;
@@ -21,6 +21,7 @@
 #include <limits>
 
 #include "SampleTable.h"
+#include "SampleIndex.h"
 #include "SampleIterator.h"
 
 #include <arpa/inet.h>
@@ -49,6 +50,9 @@ const uint32_t SampleTable::kSampleSizeTypeCompact = FOURCC("stz2");
 
 const off64_t kMaxOffset = std::numeric_limits<off64_t>::max();
 
+// Number of seeks after which the sample index is built.
+const uint32_t kSeeksBeforeIndexing = 2;
+
 struct SampleTable::CompositionDeltaLookup {
     CompositionDeltaLookup();
 
@@ -136,6 +140,11 @@ SampleTable::SampleTable(DataSourceHelper *source)
       mNumSyncSamples(0),
       mSyncSamples(NULL),
       mLastSyncSampleIndex(0),
+      mSampleIndex(NULL),
+      mSampleIndexFailed(false),
+      mNumSeeks(0),
+      mLastSampleFromIndex(false),
+      mLastSampleIndex(0),
       mSampleToChunkEntries(NULL),
       mTotalSize(0) {
     mSampleIterator = new SampleIterator(this);
@@ -162,6 +171,9 @@ SampleTable::~SampleTable() {
 
     delete mSampleIterator;
     mSampleIterator = NULL;
+
+    delete mSampleIndex;
+    mSampleIndex = NULL;
 }
 
 bool SampleTable::isValid() const {
@@ -719,6 +731,13 @@ status_t SampleTable::findSampleAtTime(
         uint32_t *sample_index, uint32_t flags) {
     buildSampleEntriesTable();
 
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (mNumSeeks < kSeeksBeforeIndexing && ++mNumSeeks == kSeeksBeforeIndexing) {
+            buildSampleIndex_l();
+        }
+    }
+
     if (mSampleTimeEntries == NULL) {
         return ERROR_OUT_OF_RANGE;
     }
@@ -865,23 +884,23 @@ status_t SampleTable::findSyncSampleNear(
             // this route is not used, but implement it nonetheless
             CHECK(flags == kFlagClosest);
 
-            status_t err = mSampleIterator->seekTo(start_sample_index);
+            uint64_t sample_time;
+            status_t err = getSampleTime_l(start_sample_index, &sample_time);
             if (err != OK) {
                 return err;
             }
-            uint64_t sample_time = mSampleIterator->getSampleTime();
 
-            err = mSampleIterator->seekTo(mSyncSamples[left]);
+            uint64_t upper_time;
+            err = getSampleTime_l(mSyncSamples[left], &upper_time);
             if (err != OK) {
                 return err;
             }
-            uint64_t upper_time = mSampleIterator->getSampleTime();
 
-            err = mSampleIterator->seekTo(mSyncSamples[left - 1]);
+            uint64_t lower_time;
+            err = getSampleTime_l(mSyncSamples[left - 1], &lower_time);
             if (err != OK) {
                 return err;
             }
-            uint64_t lower_time = mSampleIterator->getSampleTime();
 
             // use abs_difference for safety
             if (abs_difference(upper_time, sample_time) >
@@ -941,12 +960,116 @@ status_t SampleTable::findThumbnailSample(uint32_t *sample_index) {
 
 status_t SampleTable::getSampleSize_l(
         uint32_t sampleIndex, size_t *sampleSize) {
+    SampleIndex::Sample sample;
+    if (mSampleIndex != NULL && mSampleIndex->getSample(sampleIndex, &sample)) {
+        *sampleSize = sample.size;
+        return OK;
+    }
+
     return mSampleIterator->getSampleSizeDirect(
             sampleIndex, sampleSize);
 }
 
+status_t SampleTable::getSampleTime_l(
+        uint32_t sampleIndex, uint64_t *sampleTime) {
+    SampleIndex::Sample sample;
+    if (mSampleIndex != NULL && mSampleIndex->getSample(sampleIndex, &sample)) {
+        *sampleTime = sample.compositionTime;
+        return OK;
+    }
+
+    status_t err = mSampleIterator->seekTo(sampleIndex);
+    if (err != OK) {
+        return err;
+    }
+    *sampleTime = mSampleIterator->getSampleTime();
+    return OK;
+}
+
+status_t SampleTable::buildSampleIndex() {
+    Mutex::Autolock autoLock(mLock);
+    return buildSampleIndex_l();
+}
+
+status_t SampleTable::buildSampleIndex_l() {
+    if (mSampleIndex != NULL) {
+        return OK;
+    }
+    if (mSampleIndexFailed || mNumSampleSizes == 0) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    SampleIndex *index = new (std::nothrow) SampleIndex;
+    if (index == NULL) {
+        mSampleIndexFailed = true;
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    // Walk all samples with a separate iterator so that the state of
+    // mSampleIterator (and with it getLastSampleIndexInChunk) is unaffected.
+    SampleIterator iterator(this);
+    size_t syncSampleIndex = 0;
+    uint32_t lastChunk = 0;
+    for (uint32_t i = 0; i < mNumSampleSizes; ++i) {
+        if (iterator.seekTo(i) != OK) {
+            // Samples past a malformed entry are left to the iterator, which
+            // reports the error on lookup.
+            ALOGW("sample index stops at sample %u of %u", i, mNumSampleSizes);
+            break;
+        }
+
+        SampleIndex::Sample sample;
+        sample.offset = iterator.getSampleOffset();
+        sample.size = iterator.getSampleSize();
+        sample.compositionTime = iterator.getSampleTime();
+        sample.duration = iterator.getSampleDuration();
+        if (mSyncSampleOffset < 0) {
+            sample.isSync = true;
+        } else {
+            while (syncSampleIndex < mNumSyncSamples && mSyncSamples[syncSampleIndex] < i) {
+                ++syncSampleIndex;
+            }
+            sample.isSync = syncSampleIndex < mNumSyncSamples
+                    && mSyncSamples[syncSampleIndex] == i;
+        }
+
+        bool isChunkStart = (i == 0 || iterator.getChunkIndex() != lastChunk);
+        lastChunk = iterator.getChunkIndex();
+        index->append(sample, isChunkStart);
+
+        if ((i & 1023) == 0 && mTotalSize + index->memoryUsage() > kMaxTotalSize) {
+            ALOGE("Sample index would make sample table too large.");
+            delete index;
+            mSampleIndexFailed = true;
+            return ERROR_OUT_OF_RANGE;
+        }
+    }
+
+    if (index->count() == 0) {
+        delete index;
+        mSampleIndexFailed = true;
+        return ERROR_MALFORMED;
+    }
+
+    mTotalSize += index->memoryUsage();
+    ALOGV("indexed %u samples in %zu bytes", index->count(), index->memoryUsage());
+    mSampleIndex = index;
+    return OK;
+}
+
 uint32_t SampleTable::getLastSampleIndexInChunk() {
     Mutex::Autolock autoLock(mLock);
+
+    if (mLastSampleFromIndex) {
+        uint32_t lastIndex;
+        if (mSampleIndex->getLastSampleIndexInChunk(mLastSampleIndex, &lastIndex)) {
+            return lastIndex;
+        }
+        // the end of the last indexed chunk is only known to the iterator
+        if (mSampleIterator->seekTo(mLastSampleIndex) != OK) {
+            return mLastSampleIndex;
+        }
+    }
     return mSampleIterator->getLastSampleIndexInChunk();
 }
 
@@ -959,6 +1082,29 @@ status_t SampleTable::getMetaDataForSample(
         uint64_t *sampleDuration) {
     Mutex::Autolock autoLock(mLock);
 
+    SampleIndex::Sample sample;
+    if (mSampleIndex != NULL && mSampleIndex->getSample(sampleIndex, &sample)) {
+        if (offset) {
+            *offset = sample.offset;
+        }
+        if (size) {
+            *size = sample.size;
+        }
+        if (compositionTime) {
+            *compositionTime = sample.compositionTime;
+        }
+        if (isSyncSample) {
+            *isSyncSample = sample.isSync;
+        }
+        if (sampleDuration) {
+            *sampleDuration = sample.duration;
+        }
+        mLastSampleFromIndex = true;
+        mLastSampleIndex = sampleIndex;
+        return OK;
+    }
+    mLastSampleFromIndex = false;
+
     status_t err;
     if ((err = mSampleIterator->seekTo(sampleIndex)) != OK) {
         return err;
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SAMPLE_INDEX_H_
+
+#define SAMPLE_INDEX_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace android {
+
+// Compact in-memory index of the samples of a track.
+//
+// Samples are stored in blocks of kSamplesPerBlock. Each block starts with an
+// absolute anchor (offset and composition time of its first sample); the
+// remaining fields are varint encoded deltas against the previous sample, which
+// typically take 5-6 bytes per sample instead of the ~30 bytes of a plain
+// struct. Sync and chunk boundaries are kept in bitmaps. Any sample can be
+// looked up by decoding at most kSamplesPerBlock entries, and consecutive
+// lookups decode a single entry.
+class SampleIndex {
+public:
+    struct Sample {
+        off64_t offset;
+        size_t size;
+        uint64_t compositionTime;
+        uint64_t duration;
+        bool isSync;
+    };
+
+    SampleIndex();
+
+    // Appends the next sample in decoding order. |isChunkStart| is set for the
+    // first sample of each chunk.
+    void append(const Sample &sample, bool isChunkStart);
+
+    uint32_t count() const {
+        return mCount;
+    }
+
+    // Returns false if |index| is out of range.
+    bool getSample(uint32_t index, Sample *sample);
+
+    bool isSyncSample(uint32_t index) const {
+        return index < mCount && testBit(mSyncBits, index);
+    }
+
+    // Returns the index of the last sample in the chunk containing |index|.
+    // Returns false if the end of the chunk is not known, i.e. for the last
+    // indexed chunk.
+    bool getLastSampleIndexInChunk(uint32_t index, uint32_t *lastIndex) const;
+
+    // Approximate heap usage in bytes.
+    size_t memoryUsage() const;
+
+private:
+    enum {
+        kSamplesPerBlock = 32,
+    };
+
+    struct BlockAnchor {
+        off64_t offset;
+        uint64_t compositionTime;
+        uint32_t position;  // of the first encoded entry in mData
+    };
+
+    std::vector<BlockAnchor> mAnchors;
+    std::vector<uint8_t> mData;
+    std::vector<uint64_t> mSyncBits;
+    std::vector<uint64_t> mChunkStartBits;
+    uint32_t mCount;
+
+    // last appended sample
+    Sample mLast;
+
+    // last decoded sample and the position of the entry following it
+    bool mCursorValid;
+    uint32_t mCursorIndex;
+    uint32_t mCursorPosition;
+    Sample mCursor;
+
+    static bool testBit(const std::vector<uint64_t> &bits, uint32_t index) {
+        return (bits[index / 64] >> (index % 64)) & 1;
+    }
+
+    void putVarint(uint64_t value);
+    uint64_t getVarint(uint32_t *position) const;
+
+    // decodes the entry at |*position| following |*sample| into |*sample|
+    void decodeNext(uint32_t *position, Sample *sample) const;
+
+    SampleIndex(const SampleIndex &);
+    SampleIndex &operator=(const SampleIndex &);
+};
+
+}  // namespace android
+
+#endif  // SAMPLE_INDEX_H_
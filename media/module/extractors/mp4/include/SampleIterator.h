@@ -76,6 +76,9 @@ private:
     void reset();
     status_t findChunkRange(uint32_t sampleIndex);
     status_t getChunkOffset(uint32_t chunk, off64_t *offset);
+    // Reads the sizes of all samples of the current chunk into
+    // mCurrentChunkSampleSizes. Returns false if they have to be read one by one.
+    bool readChunkSampleSizes(uint32_t firstSampleIndex);
     status_t findSampleTimeAndDuration(uint32_t sampleIndex, uint64_t *time, uint64_t *duration);
 
     SampleIterator(const SampleIterator &);
@@ -29,6 +29,7 @@
 namespace android {
 
 class DataSourceHelper;
+class SampleIndex;
 struct SampleIterator;
 
 class SampleTable : public RefBase {
@@ -93,6 +94,12 @@ public:
         mDefaultSampleSize = sampleSize;
     }
 
+    // Builds a compact index of all samples, after which sample lookups no
+    // longer depend on the position of the sample iterator. Called on the
+    // second seek, as a single seek (e.g. for a thumbnail) does not warrant
+    // reading the complete sample table.
+    status_t buildSampleIndex();
+
 protected:
     ~SampleTable();
 
@@ -143,6 +150,14 @@ private:
 
     SampleIterator *mSampleIterator;
 
+    SampleIndex *mSampleIndex;
+    bool mSampleIndexFailed;
+    uint32_t mNumSeeks;
+    // sample of the last successful getMetaDataForSample call if it was served
+    // from mSampleIndex
+    bool mLastSampleFromIndex;
+    uint32_t mLastSampleIndex;
+
     struct SampleToChunkEntry {
         uint32_t startChunk;
         uint32_t samplesPerChunk;
@@ -164,6 +179,8 @@ private:
     }
 
     status_t getSampleSize_l(uint32_t sample_index, size_t *sample_size);
+    status_t getSampleTime_l(uint32_t sample_index, uint64_t *sample_time);
+    status_t buildSampleIndex_l();
     int32_t getCompositionTimeOffset(uint32_t sampleIndex);
 
     static int CompareIncreasingTime(const void *, const void *);
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <SampleIndex.h>
+#include <SampleTable.h>
+#include <gtest/gtest.h>
+#include <media/MediaExtractorPluginHelper.h>
+#include <media/stagefright/foundation/ByteUtils.h>
+
+namespace {
+
+using android::CDataSource;
+using android::DataSourceHelper;
+using android::FOURCC;
+using android::OK;
+using android::SampleIndex;
+using android::SampleTable;
+using android::sp;
+using android::status_t;
+
+// In-memory data source holding the sample table boxes of a synthetic track.
+class MemorySource : public DataSourceHelper {
+public:
+    MemorySource() : DataSourceHelper(static_cast<CDataSource *>(nullptr)), mReads(0) {}
+
+    ssize_t readAt(off64_t offset, void *data, size_t size) override {
+        ++mReads;
+        if (offset < 0 || (size_t)offset >= mData.size()) {
+            return 0;
+        }
+        size = std::min(size, mData.size() - (size_t)offset);
+        memcpy(data, mData.data() + offset, size);
+        return size;
+    }
+
+    status_t getSize(off64_t *size) override {
+        *size = mData.size();
+        return OK;
+    }
+
+    uint32_t flags() override {
+        return 0;
+    }
+
+    // Appends a full box payload (version/flags followed by |words|) and
+    // returns its offset.
+    off64_t addBox(const std::vector<uint32_t> &words) {
+        off64_t offset = mData.size();
+        put32(0);  // version, flags
+        for (uint32_t word : words) {
+            put32(word);
+        }
+        return offset;
+    }
+
+    size_t boxSize(const std::vector<uint32_t> &words) const {
+        return 4 + 4 * words.size();
+    }
+
+    size_t mReads;
+
+private:
+    void put32(uint32_t x) {
+        mData.push_back(x >> 24);
+        mData.push_back(x >> 16);
+        mData.push_back(x >> 8);
+        mData.push_back(x);
+    }
+
+    std::vector<uint8_t> mData;
+};
+
+// Synthetic 30 fps video track with 15 samples per chunk, a sync sample every
+// second and an IPBB composition pattern.
+struct Track {
+    static constexpr uint32_t kSamplesPerChunk = 15;
+    static constexpr uint32_t kSyncInterval = 30;
+    static constexpr uint32_t kTimescale = 30000;
+    static constexpr uint32_t kDuration = 1000;
+
+    explicit Track(uint32_t numSamples) : mNumSamples(numSamples) {
+        mNumChunks = (numSamples + kSamplesPerChunk - 1) / kSamplesPerChunk;
+        // chunks are interleaved with 1000 bytes of other data
+        off64_t offset = 0x100000;
+        for (uint32_t i = 0; i < numSamples; ++i) {
+            if (i % kSamplesPerChunk == 0) {
+                offset += 1000;
+                mChunkOffsets.push_back(offset);
+            }
+            mSizes.push_back(i % kSyncInterval == 0 ? 20000 : 500 + (i * 7919) % 5000);
+            mOffsets.push_back(offset);
+            offset += mSizes.back();
+        }
+    }
+
+    status_t setUp(MemorySource *source, SampleTable *table) const {
+        std::vector<uint32_t> stco = {mNumChunks};
+        stco.insert(stco.end(), mChunkOffsets.begin(), mChunkOffsets.end());
+        std::vector<uint32_t> stsc = {2, 1, kSamplesPerChunk, 1, mNumChunks,
+                numSamples() - (mNumChunks - 1) * kSamplesPerChunk, 1};
+        if (mNumChunks == 1) {
+            stsc = {1, 1, numSamples(), 1};
+        }
+        std::vector<uint32_t> stsz = {0, mNumSamples};
+        stsz.insert(stsz.end(), mSizes.begin(), mSizes.end());
+        std::vector<uint32_t> stts = {1, mNumSamples, kDuration};
+        std::vector<uint32_t> ctts = {mNumSamples};
+        for (uint32_t i = 0; i < mNumSamples; ++i) {
+            ctts.push_back(1);
+            ctts.push_back(compositionOffset(i));
+        }
+        std::vector<uint32_t> stss = {(mNumSamples + kSyncInterval - 1) / kSyncInterval};
+        for (uint32_t i = 0; i < mNumSamples; i += kSyncInterval) {
+            stss.push_back(i + 1);
+        }
+
+        status_t err;
+        if ((err = table->setChunkOffsetParams(
+                FOURCC("stco"), source->addBox(stco), source->boxSize(stco))) != OK
+                || (err = table->setSampleToChunkParams(
+                        source->addBox(stsc), source->boxSize(stsc))) != OK
+                || (err = table->setSampleSizeParams(
+                        FOURCC("stsz"), source->addBox(stsz), source->boxSize(stsz))) != OK
+                || (err = table->setTimeToSampleParams(
+                        source->addBox(stts), source->boxSize(stts))) != OK
+                || (err = table->setCompositionTimeToSampleParams(
+                        source->addBox(ctts), source->boxSize(ctts))) != OK
+                || (err = table->setSyncSampleParams(
+                        source->addBox(stss), source->boxSize(stss))) != OK) {
+            return err;
+        }
+        return OK;
+    }
+
+    uint32_t numSamples() const {
+        return mNumSamples;
+    }
+
+    static uint32_t compositionOffset(uint32_t i) {
+        static constexpr uint32_t kPattern[] = {1, 3, 0, 0};
+        return kPattern[i % 4] * kDuration;
+    }
+
+    uint32_t mNumSamples;
+    uint32_t mNumChunks;
+    std::vector<uint32_t> mChunkOffsets;
+    std::vector<uint32_t> mSizes;
+    std::vector<off64_t> mOffsets;
+};
+
+class SampleTableUnitTest : public ::testing::Test {
+protected:
+    void init(uint32_t numSamples) {
+        mTrack.reset(new Track(numSamples));
+        mSource.reset(new MemorySource);
+        mTable = new SampleTable(mSource.get());
+        ASSERT_EQ(OK, mTrack->setUp(mSource.get(), mTable.get()));
+        ASSERT_TRUE(mTable->isValid());
+        ASSERT_EQ(numSamples, mTable->countSamples());
+    }
+
+    void expectSample(uint32_t i) {
+        off64_t offset;
+        size_t size;
+        uint64_t time;
+        bool isSync;
+        uint64_t duration;
+        ASSERT_EQ(OK, mTable->getMetaDataForSample(i, &offset, &size, &time, &isSync, &duration))
+                << "sample " << i;
+        EXPECT_EQ(mTrack->mOffsets[i], offset) << "sample " << i;
+        EXPECT_EQ(mTrack->mSizes[i], size) << "sample " << i;
+        EXPECT_EQ((uint64_t)i * Track::kDuration + Track::compositionOffset(i), time)
+                << "sample " << i;
+        EXPECT_EQ(i % Track::kSyncInterval == 0, isSync) << "sample " << i;
+        EXPECT_EQ(Track::kDuration, duration) << "sample " << i;
+        uint32_t lastInChunk = std::min(
+                i - i % Track::kSamplesPerChunk + Track::kSamplesPerChunk - 1,
+                mTrack->numSamples() - 1);
+        EXPECT_EQ(lastInChunk, mTable->getLastSampleIndexInChunk()) << "sample " << i;
+    }
+
+    // Returns the average latency of a seek to a pseudo-random sample and
+    // reading the first few samples from the preceding sync sample, as done by
+    // MPEG4Source after finding the sample by time.
+    double measureSeekUs(int numSeeks) {
+        uint32_t seed = 1;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSeeks; ++i) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t sampleIndex = (seed >> 4) % mTrack->numSamples();
+            uint32_t syncSampleIndex;
+            EXPECT_EQ(OK, mTable->findSyncSampleNear(
+                    sampleIndex, &syncSampleIndex, SampleTable::kFlagBefore));
+            EXPECT_EQ(OK, mTable->getMetaDataForSample(syncSampleIndex, NULL, NULL, NULL));
+            for (uint32_t j = syncSampleIndex; j < syncSampleIndex + 5; ++j) {
+                mTable->getMetaDataForSample(j, NULL, NULL, NULL);
+            }
+        }
+        std::chrono::duration<double, std::micro> elapsed =
+                std::chrono::steady_clock::now() - start;
+        return elapsed.count() / numSeeks;
+    }
+
+    std::unique_ptr<Track> mTrack;
+    std::unique_ptr<MemorySource> mSource;
+    sp<SampleTable> mTable;
+};
+
+TEST(SampleIndexTest, EncodesSamples) {
+    SampleIndex index;
+    std::vector<SampleIndex::Sample> samples;
+    off64_t offset = 1000;
+    uint64_t time = 0;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        SampleIndex::Sample sample;
+        sample.size = i % 7 == 0 ? 100000 + i : 10 + i;
+        // backwards and forwards jumps between chunks
+        offset = i % 10 == 0 ? (i % 20 == 0 ? offset + 12345678 : 50 + i) : offset;
+        sample.offset = offset;
+        offset += sample.size;
+        sample.compositionTime = i % 3 == 0 ? time + 3000 : time;
+        sample.duration = i == 500 ? UINT64_MAX : 1000 + i % 2;
+        time += sample.duration == UINT64_MAX ? 1 : sample.duration;
+        sample.isSync = i % 9 == 0;
+        index.append(sample, i % 10 == 0);
+        samples.push_back(sample);
+    }
+    ASSERT_EQ(1000u, index.count());
+    EXPECT_LT(index.memoryUsage(), 1000u * sizeof(SampleIndex::Sample) / 2);
+
+    // sequential, backwards and random access
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        order.push_back(i);
+    }
+    for (uint32_t i = 1000; i-- > 0;) {
+        order.push_back(i);
+    }
+    for (uint32_t i = 0; i < 1000; ++i) {
+        order.push_back((i * 7919) % 1000);
+    }
+    for (uint32_t i : order) {
+        SampleIndex::Sample sample;
+        ASSERT_TRUE(index.getSample(i, &sample));
+        EXPECT_EQ(samples[i].offset, sample.offset) << i;
+        EXPECT_EQ(samples[i].size, sample.size) << i;
+        EXPECT_EQ(samples[i].compositionTime, sample.compositionTime) << i;
+        EXPECT_EQ(samples[i].duration, sample.duration) << i;
+        EXPECT_EQ(samples[i].isSync, sample.isSync) << i;
+    }
+    SampleIndex::Sample sample;
+    EXPECT_FALSE(index.getSample(1000, &sample));
+
+    uint32_t lastIndex;
+    ASSERT_TRUE(index.getLastSampleIndexInChunk(0, &lastIndex));
+    EXPECT_EQ(9u, lastIndex);
+    ASSERT_TRUE(index.getLastSampleIndexInChunk(63, &lastIndex));
+    EXPECT_EQ(69u, lastIndex);
+    ASSERT_TRUE(index.getLastSampleIndexInChunk(989, &lastIndex));
+    EXPECT_EQ(989u, lastIndex);
+    // end of the last chunk is unknown
+    EXPECT_FALSE(index.getLastSampleIndexInChunk(990, &lastIndex));
+    EXPECT_FALSE(index.getLastSampleIndexInChunk(999, &lastIndex));
+}
+
+TEST_F(SampleTableUnitTest, IndexMatchesIterator) {
+    init(1000);
+    for (uint32_t i = 0; i < mTrack->numSamples(); ++i) {
+        expectSample(i);
+    }
+    ASSERT_EQ(OK, mTable->buildSampleIndex());
+    for (uint32_t i = 0; i < mTrack->numSamples(); ++i) {
+        expectSample(i);
+    }
+    for (uint32_t i = mTrack->numSamples(); i-- > 0;) {
+        expectSample(i);
+    }
+    EXPECT_NE(OK, mTable->getMetaDataForSample(mTrack->numSamples(), NULL, NULL, NULL));
+}
+
+TEST_F(SampleTableUnitTest, IndexIsBuiltOnSecondSeek) {
+    init(1000);
+    uint32_t sampleIndex;
+    ASSERT_EQ(OK, mTable->findSampleAtTime(
+            0, 1000000, Track::kTimescale, &sampleIndex, SampleTable::kFlagBefore));
+    size_t reads = mSource->mReads;
+    expectSample(500);
+    EXPECT_GT(mSource->mReads, reads);
+
+    ASSERT_EQ(OK, mTable->findSampleAtTime(
+            0, 1000000, Track::kTimescale, &sampleIndex, SampleTable::kFlagBefore));
+    reads = mSource->mReads;
+    // served from the index
+    expectSample(700);
+    expectSample(100);
+    EXPECT_EQ(reads, mSource->mReads);
+}
+
+TEST_F(SampleTableUnitTest, SeekLatency) {
+    // 2.5 hours of 30 fps video
+    init(30 * 60 * 150);
+
+    constexpr int kNumSeeks = 200;
+    double iteratorUs = measureSeekUs(kNumSeeks);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ASSERT_EQ(OK, mTable->buildSampleIndex());
+    std::chrono::duration<double, std::milli> buildMs = std::chrono::steady_clock::now() - start;
+
+    double indexUs = measureSeekUs(kNumSeeks);
+    std::cout << "[   INFO   ] " << mTrack->numSamples() << " samples: seek "
+              << iteratorUs << " us without index, " << indexUs << " us with index; index built in "
+              << buildMs.count() << " ms" << std::endl;
+}
+
+}  // namespace
@@ -46,6 +46,8 @@ namespace android {
 using hardware::cas::V1_0::ICas;
 
 static const size_t kTSPacketSize = 188;
+// Number of packets read from the source at a time by feedMore().
+static const size_t kNumPacketsPerRead = 64;
 static const int kMaxDurationReadSize = 250000LL;
 static const int kMaxDurationRetry = 6;
 
@@ -250,7 +252,9 @@ MPEG2TSExtractor::MPEG2TSExtractor(DataSourceHelper *source)
     : mDataSource(source),
       mParser(new ATSParser),
       mLastSyncEvent(0),
-      mOffset(0) {
+      mOffset(0),
+      mReadBufferOffset(0),
+      mReadBufferSize(0) {
     char header;
     if (source->readAt(0, &header, 1) == 1 && header == 0x47) {
         mHeaderSkip = 0;
@@ -481,19 +485,31 @@ void MPEG2TSExtractor::init() {
 status_t MPEG2TSExtractor::feedMore(bool isInit) {
     Mutex::Autolock autoLock(mLock);
 
-    uint8_t packet[kTSPacketSize];
-    ssize_t n = mDataSource->readAt(mOffset + mHeaderSkip, packet, kTSPacketSize);
+    const size_t stride = mHeaderSkip + kTSPacketSize;
+    if (mOffset < mReadBufferOffset
+            || mOffset - mReadBufferOffset + stride > mReadBufferSize) {
+        mReadBuffer.resize(kNumPacketsPerRead * stride);
+        ssize_t n = mDataSource->readAt(mOffset, mReadBuffer.data(), mReadBuffer.size());
 
-    if (n < (ssize_t)kTSPacketSize) {
-        if (n >= 0) {
-            mParser->signalEOS(ERROR_END_OF_STREAM);
+        if (n < (ssize_t)stride) {
+            mReadBufferSize = 0;
+            if (n >= 0) {
+                mParser->signalEOS(ERROR_END_OF_STREAM);
+            }
+            return (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
         }
-        return (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
+        mReadBufferOffset = mOffset;
+        mReadBufferSize = n;
     }
 
+    // Feeds the buffered packets up to the next sync point.
+    size_t bufferOffset = mOffset - mReadBufferOffset;
     ATSParser::SyncEvent event(mOffset);
-    mOffset += mHeaderSkip + n;
-    status_t err = mParser->feedTSPacket(packet, kTSPacketSize, &event);
+    size_t consumed;
+    status_t err = mParser->feedTSPackets(
+            mReadBuffer.data() + bufferOffset, mReadBufferSize - bufferOffset, stride,
+            &event, &consumed);
+    mOffset += consumed;
     if (event.hasReturnedData()) {
         if (isInit) {
             mLastSyncEvent = event;
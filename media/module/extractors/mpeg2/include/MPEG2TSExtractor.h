@@ -28,6 +28,8 @@
 #include <utils/KeyedVector.h>
 #include <utils/Vector.h>
 
+#include <vector>
+
 namespace android {
 
 struct AMessage;
@@ -76,6 +78,12 @@ private:
 
     off64_t mOffset;
 
+    // Packets read ahead by feedMore(); mReadBuffer holds mReadBufferSize
+    // bytes of the source starting at mReadBufferOffset.
+    std::vector<uint8_t> mReadBuffer;
+    off64_t mReadBufferOffset;
+    size_t mReadBufferSize;
+
     static bool isScrambledFormat(MetaDataBase &format);
 
     void init();
@@ -20,48 +20,40 @@
 
 namespace android {
 
-// static
-AAtomizer AAtomizer::gAtomizer;
-
 // static
 const char *AAtomizer::Atomize(const char *name) {
-    return gAtomizer.atomize(name);
+    // never destroyed, as static objects may use atoms until exit
+    static AAtomizer *gAtomizer = new AAtomizer;
+    return gAtomizer->atomize(name);
 }
 
 AAtomizer::AAtomizer() {
-    for (size_t i = 0; i < 128; ++i) {
-        mAtoms.push(List<AString>());
-    }
 }
 
 const char *AAtomizer::atomize(const char *name) {
-    Mutex::Autolock autoLock(mLock);
-
-    const size_t n = mAtoms.size();
-    size_t index = AAtomizer::Hash(name) % n;
-    List<AString> &entry = mAtoms.editItemAt(index);
-    List<AString>::iterator it = entry.begin();
-    while (it != entry.end()) {
-        if ((*it) == name) {
-            return (*it).c_str();
+    std::string_view key(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(mLock);
+        auto it = mAtoms.find(key);
+        if (it != mAtoms.end()) {
+            return it->data();
+        }
+        // the table never shrinks, so once full it stays full
+        if (key.size() > kMaxAtomLength || mAtoms.size() >= kMaxAtoms) {
+            return NULL;
         }
-        ++it;
     }
 
-    entry.push_back(AString(name));
-
-    return (*--entry.end()).c_str();
-}
-
-// static
-uint32_t AAtomizer::Hash(const char *s) {
-    uint32_t sum = 0;
-    while (*s != '\0') {
-        sum = (sum * 31) + *s;
-        ++s;
+    std::unique_lock<std::shared_mutex> lock(mLock);
+    auto it = mAtoms.find(key);
+    if (it != mAtoms.end()) {
+        return it->data();
     }
-
-    return sum;
+    if (mAtoms.size() >= kMaxAtoms) {
+        return NULL;
+    }
+    // std::string keeps the terminating NUL, so the view's data is a C string
+    return mAtoms.insert(mStorage.emplace_back(key)).first->data();
 }
 
 }  // namespace android
@@ -23,8 +23,25 @@
 
 namespace android {
 
-void AHandler::deliverMessage(const sp<AMessage> &msg) {
-    setDeliveryStatus(true, msg->what(), ALooper::GetNowUs());
+// static
+const int64_t AHandler::kDispatchLatencyBucketsUs[kNumDispatchLatencyBuckets - 1] = {
+    100, 1000, 10000, 100000,
+};
+
+void AHandler::deliverMessage(const sp<AMessage> &msg, int64_t latencyUs) {
+    size_t bucket = 0;
+    while (bucket < kNumDispatchLatencyBuckets - 1
+            && latencyUs >= kDispatchLatencyBucketsUs[bucket]) {
+        ++bucket;
+    }
+    {
+        // same as setDeliveryStatus(true, ...), recording the latency under the same lock
+        AutoMutex autoLock(mLock);
+        mDeliveringMessage = true;
+        mCurrentMessageWhat = msg->what();
+        mCurrentMessageStartTimeUs = ALooper::GetNowUs();
+        ++mDispatchLatencyHistogram[bucket];
+    }
     onMessageReceived(msg);
     mMessageCounter++;
     setDeliveryStatus(false, 0, 0);
@@ -55,4 +72,14 @@ void AHandler::getDeliveryStatus(bool& delivering, uint32_t& what, int64_t& dura
             0 : ALooper::GetNowUs() - mCurrentMessageStartTimeUs;
 }
 
+void AHandler::getDispatchLatencyHistogram(uint32_t *histogram, bool clear) {
+    AutoMutex autoLock(mLock);
+    for (size_t i = 0; i < kNumDispatchLatencyBuckets; ++i) {
+        histogram[i] = mDispatchLatencyHistogram[i];
+        if (clear) {
+            mDispatchLatencyHistogram[i] = 0;
+        }
+    }
+}
+
 }  // namespace android
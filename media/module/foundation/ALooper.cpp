@@ -74,7 +74,9 @@ int64_t ALooper::getNowUs() {
 }
 
 ALooper::ALooper()
-    : mRunningLocally(false) {
+    : mNextEventSeq(0),
+      mMaxQueueDepth(0),
+      mRunningLocally(false) {
     // clean up stale AHandlers. Doing it here instead of in the destructor avoids
     // the side effect of objects being deleted from the unregister function recursively.
     gLooperRoster.unregisterStaleHandlers();
@@ -169,6 +171,86 @@ status_t ALooper::stop() {
     return OK;
 }
 
+void ALooper::setEvent_l(size_t index, Event &&event) {
+    mEventQueue[index] = std::move(event);
+    if (mEventQueue[index].mToken != nullptr) {
+        mTokenIndex[mEventQueue[index].mToken.get()] = index;
+    }
+}
+
+size_t ALooper::siftUp_l(size_t index) {
+    Event event = std::move(mEventQueue[index]);
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!event.isBefore(mEventQueue[parent])) {
+            break;
+        }
+        setEvent_l(index, std::move(mEventQueue[parent]));
+        index = parent;
+    }
+    setEvent_l(index, std::move(event));
+    return index;
+}
+
+void ALooper::siftDown_l(size_t index) {
+    const size_t n = mEventQueue.size();
+    Event event = std::move(mEventQueue[index]);
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && mEventQueue[child + 1].isBefore(mEventQueue[child])) {
+            ++child;
+        }
+        if (!mEventQueue[child].isBefore(event)) {
+            break;
+        }
+        setEvent_l(index, std::move(mEventQueue[child]));
+        index = child;
+    }
+    setEvent_l(index, std::move(event));
+}
+
+size_t ALooper::pushEvent_l(Event &&event) {
+    event.mSeq = mNextEventSeq++;
+    mEventQueue.push_back(std::move(event));
+    if (mEventQueue.size() > mMaxQueueDepth) {
+        mMaxQueueDepth = mEventQueue.size();
+    }
+    return siftUp_l(mEventQueue.size() - 1);
+}
+
+ALooper::Event ALooper::removeEvent_l(size_t index) {
+    Event event = std::move(mEventQueue[index]);
+    if (event.mToken != nullptr) {
+        mTokenIndex.erase(event.mToken.get());
+    }
+
+    // move the last event into the hole and restore the heap order
+    Event last = std::move(mEventQueue.back());
+    mEventQueue.pop_back();
+    if (index < mEventQueue.size()) {
+        bool moveUp = index > 0 && last.isBefore(mEventQueue[(index - 1) / 2]);
+        mEventQueue[index] = std::move(last);
+        if (moveUp) {
+            siftUp_l(index);
+        } else {
+            siftDown_l(index);
+        }
+    }
+    return event;
+}
+
+void ALooper::getQueueStats(size_t *depth, size_t *maxDepth, bool clear) {
+    Mutex::Autolock autoLock(mLock);
+    *depth = mEventQueue.size();
+    *maxDepth = mMaxQueueDepth;
+    if (clear) {
+        mMaxQueueDepth = mEventQueue.size();
+    }
+}
+
 void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
     Mutex::Autolock autoLock(mLock);
 
@@ -181,21 +263,14 @@ void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
         whenUs = getNowUs();
     }
 
-    List<Event>::iterator it = mEventQueue.begin();
-    while (it != mEventQueue.end() && (*it).mWhenUs <= whenUs) {
-        ++it;
-    }
-
     Event event;
     event.mWhenUs = whenUs;
     event.mMessage = msg;
     event.mToken = nullptr;
 
-    if (it == mEventQueue.begin()) {
+    if (pushEvent_l(std::move(event)) == 0) {
         mQueueChangedCondition.signal();
     }
-
-    mEventQueue.insert(it, event);
 }
 
 status_t ALooper::postUnique(const sp<AMessage> &msg, const sp<RefBase> &token, int64_t delayUs) {
@@ -215,28 +290,19 @@ status_t ALooper::postUnique(const sp<AMessage> &msg, const sp<RefBase> &token,
     // We only need to wake the loop up if we're rescheduling to the earliest event in the queue.
     // This needs to be checked now, before we reschedule the message, in case this message is
     // already at the beginning of the queue.
-    bool shouldAwakeLoop = mEventQueue.empty() || whenUs < mEventQueue.begin()->mWhenUs;
+    bool shouldAwakeLoop = mEventQueue.empty() || whenUs < mEventQueue[0].mWhenUs;
 
     // Erase any previously-posted event with this token.
-    for (auto i = mEventQueue.begin(); i != mEventQueue.end();) {
-        if (i->mToken == token) {
-            i = mEventQueue.erase(i);
-        } else {
-            ++i;
-        }
-    }
-
-    // Find the insertion point for the rescheduled message.
-    List<Event>::iterator i = mEventQueue.begin();
-    while (i != mEventQueue.end() && i->mWhenUs <= whenUs) {
-        ++i;
+    auto it = mTokenIndex.find(token.get());
+    if (it != mTokenIndex.end()) {
+        removeEvent_l(it->second);
     }
 
     Event event;
     event.mWhenUs = whenUs;
     event.mMessage = msg;
     event.mToken = token;
-    mEventQueue.insert(i, event);
+    pushEvent_l(std::move(event));
 
     // If we rescheduled the event to be earlier than the first event, then we need to wake up the
     // looper earlier than it was previously scheduled to be woken up. Otherwise, it can sleep until
@@ -250,6 +316,7 @@ status_t ALooper::postUnique(const sp<AMessage> &msg, const sp<RefBase> &token,
 bool ALooper::loop() {
 
     Event event;
+    int64_t latencyUs;
 
     {
         Mutex::Autolock autoLock(mLock);
@@ -260,7 +327,7 @@ bool ALooper::loop() {
             mQueueChangedCondition.wait(mLock);
             return true;
         }
-        int64_t whenUs = (*mEventQueue.begin()).mWhenUs;
+        int64_t whenUs = mEventQueue[0].mWhenUs;
         int64_t nowUs = getNowUs();
 
         if (whenUs > nowUs) {
@@ -273,11 +340,11 @@ bool ALooper::loop() {
             return true;
         }
 
-        event = *mEventQueue.begin();
-        mEventQueue.erase(mEventQueue.begin());
+        event = removeEvent_l(0);
+        latencyUs = nowUs - whenUs;
     }
 
-    event.mMessage->deliver();
+    event.mMessage->deliver(latencyUs);
 
     // NOTE: It's important to note that at this point our "ALooper" object
     // may no longer exist (its final reference may have gone away while
@@ -131,6 +131,10 @@ void ALooperRoster::dump(int fd, const Vector<String16>& args) {
         s.append("(verbose stats collection enabled, stats will be cleared)\n");
     }
 
+    // loopers are shared by handlers, their queue stats are reported once below.
+    // Declared before the lock so the references are released after it.
+    KeyedVector<ALooper *, sp<ALooper> > loopers;
+
     Mutex::Autolock autoLock(mLock);
     size_t n = mHandlers.size();
     s.appendFormat(" %zu registered handlers:\n", n);
@@ -141,6 +145,9 @@ void ALooperRoster::dump(int fd, const Vector<String16>& args) {
         sp<ALooper> looper = info.mLooper.promote();
         if (looper != NULL) {
             s.append(looper->getName());
+            if (loopers.indexOfKey(looper.get()) < 0) {
+                loopers.add(looper.get(), looper);
+            }
             sp<AHandler> handler = info.mHandler.promote();
             if (handler != NULL) {
                 bool deliveringMessages;
@@ -157,6 +164,11 @@ void ALooperRoster::dump(int fd, const Vector<String16>& args) {
                                deliveringMessages,
                                currentMessageWhat,
                                currentDeliveryDurationUs);
+                uint32_t latency[AHandler::kNumDispatchLatencyBuckets];
+                handler->getDispatchLatencyHistogram(latency, clear);
+                s.appendFormat("\n    dispatch latency "
+                               "<0.1ms: %u, <1ms: %u, <10ms: %u, <100ms: %u, >=100ms: %u",
+                               latency[0], latency[1], latency[2], latency[3], latency[4]);
                 if (verboseStats) {
                     for (size_t j = 0; j < handler->mMessages.size(); j++) {
                         char fourcc[15];
@@ -180,6 +192,16 @@ void ALooperRoster::dump(int fd, const Vector<String16>& args) {
         }
         s.append("\n");
     }
+
+    s.appendFormat(" %zu loopers:\n", loopers.size());
+    for (size_t i = 0; i < loopers.size(); i++) {
+        const sp<ALooper> &looper = loopers.valueAt(i);
+        size_t queueDepth;
+        size_t maxQueueDepth;
+        looper->getQueueStats(&queueDepth, &maxQueueDepth, clear);
+        s.appendFormat("  %s: queue depth %zu (max %zu)\n",
+                       looper->getName(), queueDepth, maxQueueDepth);
+    }
     (void)write(fd, s.c_str(), s.size());
 }
 
@@ -20,6 +20,8 @@
 
 #include <ctype.h>
 
+#include <algorithm>
+
 #include "AMessage.h"
 
 #include <log/log.h>
@@ -89,11 +91,11 @@ void AMessage::setTarget(const sp<const AHandler> &handler) {
 void AMessage::clear() {
     // Item needs to be handled delicately
     for (Item &item : mItems) {
-        delete[] item.mName;
-        item.mName = NULL;
+        item.freeName();
         freeItemValue(&item);
     }
     mItems.clear();
+    mIndex.clear();
 }
 
 void AMessage::freeItemValue(Item *item) {
@@ -150,20 +152,51 @@ static void reportStats() {
 }
 #endif
 
-inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
+// FNV-1a hash of |name|, also returns its length in |len|.
+__attribute__((no_sanitize("integer")))
+static inline uint32_t hashName(const char *name, size_t *len) {
+    uint32_t hash = 2166136261u;
+    const char *s = name;
+    for (; *s != '\0'; ++s) {
+        hash = (hash ^ (uint8_t)*s) * 16777619u;
+    }
+    *len = s - name;
+    return hash;
+}
+
+inline bool AMessage::Item::hasName(const char *name, size_t len, uint32_t hash) const {
+    // interned names match by pointer
+    return mName == name
+            || (mNameHash == hash && mNameLength == len && !memcmp(mName, name, len));
+}
+
+inline size_t AMessage::findItemIndex(const char *name, size_t len, uint32_t hash) const {
 #ifdef DUMP_STATS
     size_t memchecks = 0;
 #endif
     size_t i = 0;
-    for (; i < mItems.size(); i++) {
-        if (len != mItems[i].mNameLength) {
-            continue;
+    if (!mIndex.empty()) {
+        const size_t mask = mIndex.size() - 1;
+        i = mItems.size();
+        for (size_t slot = hash & mask; mIndex[slot] != 0; slot = (slot + 1) & mask) {
+#ifdef DUMP_STATS
+            ++memchecks;
+#endif
+            if (mItems[mIndex[slot] - 1].hasName(name, len, hash)) {
+                i = mIndex[slot] - 1;
+                break;
+            }
         }
+    } else {
+        for (; i < mItems.size(); i++) {
 #ifdef DUMP_STATS
-        ++memchecks;
+            if (mItems[i].mNameHash == hash) {
+                ++memchecks;
+            }
 #endif
-        if (!memcmp(mItems[i].mName, name, len)) {
-            break;
+            if (mItems[i].hasName(name, len, hash)) {
+                break;
+            }
         }
     }
 #ifdef DUMP_STATS
@@ -179,22 +212,123 @@ inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
     return i;
 }
 
+size_t AMessage::findItemIndex(const char *name) const {
+    size_t len;
+    uint32_t hash = hashName(name, &len);
+    return findItemIndex(name, len, hash);
+}
+
+void AMessage::addToIndex(size_t index) {
+    if (mItems.size() <= kMinIndexedItems) {
+        return;
+    }
+    if (mIndex.size() < 2 * mItems.size()) {
+        rebuildIndex();
+        return;
+    }
+    const size_t mask = mIndex.size() - 1;
+    size_t slot = mItems[index].mNameHash & mask;
+    while (mIndex[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    mIndex[slot] = index + 1;
+}
+
+void AMessage::rebuildIndex() {
+    mIndex.clear();
+    if (mItems.size() <= kMinIndexedItems) {
+        return;
+    }
+    // keep the table at most half full
+    size_t capacity = 4 * kMinIndexedItems;
+    while (capacity < 2 * mItems.size()) {
+        capacity *= 2;
+    }
+    mIndex.resize(capacity, 0);
+    for (size_t i = 0; i < mItems.size(); ++i) {
+        addToIndex(i);
+    }
+}
+
 // assumes item's name was uninitialized or NULL
-void AMessage::Item::setName(const char *name, size_t len) {
+void AMessage::Item::setName(const char *name, size_t len, uint32_t hash) {
     mNameLength = len;
+    mNameHash = hash;
     mName = new char[len + 1];
     memcpy((void*)mName, name, len + 1);
+    mNameOwned = true;
 }
 
-AMessage::Item::Item(const char *name, size_t len)
-    : mType(kTypeInt32) {
-    // mName and mNameLength are initialized by setName
-    setName(name, len);
+// assumes item's name was uninitialized or NULL
+void AMessage::Item::setInternedName(const char *name, size_t len, uint32_t hash) {
+    const char *atom = AAtomizer::Atomize(name);
+    if (atom == NULL) {
+        // the atom table is full, or the name is too long to intern
+        setName(name, len, hash);
+        return;
+    }
+    mNameLength = len;
+    mNameHash = hash;
+    mName = atom;
+    mNameOwned = false;
+}
+
+void AMessage::Item::freeName() {
+    if (mNameOwned) {
+        delete[] mName;
+    }
+    mName = nullptr;
+    mNameOwned = false;
+}
+
+AMessage::ItemVector::~ItemVector() {
+    if (mData != mInline) {
+        delete[] mData;
+    }
+}
+
+AMessage::ItemVector &AMessage::ItemVector::operator=(const ItemVector &other) {
+    if (this != &other) {
+        reserve(other.mSize);
+        std::copy(other.begin(), other.end(), mData);
+        mSize = other.mSize;
+    }
+    return *this;
+}
+
+AMessage::Item &AMessage::ItemVector::emplace_back() {
+    if (mSize == mCapacity) {
+        reserve(2 * mCapacity);
+    }
+    mData[mSize] = Item();
+    return mData[mSize++];
+}
+
+void AMessage::ItemVector::resize(size_t size) {
+    reserve(size);
+    for (size_t i = mSize; i < size; ++i) {
+        mData[i] = Item();
+    }
+    mSize = size;
+}
+
+void AMessage::ItemVector::reserve(size_t capacity) {
+    if (capacity <= mCapacity) {
+        return;
+    }
+    Item *data = new Item[capacity];
+    std::copy(begin(), end(), data);
+    if (mData != mInline) {
+        delete[] mData;
+    }
+    mData = data;
+    mCapacity = capacity;
 }
 
 AMessage::Item *AMessage::allocateItem(const char *name) {
-    size_t len = strlen(name);
-    size_t i = findItemIndex(name, len);
+    size_t len;
+    uint32_t hash = hashName(name, &len);
+    size_t i = findItemIndex(name, len, hash);
     Item *item;
 
     if (i < mItems.size()) {
@@ -204,8 +338,9 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
         CHECK(mItems.size() < kMaxNumItems);
         i = mItems.size();
         // place a 'blank' item at the end - this is of type kTypeInt32
-        mItems.emplace_back(name, len);
-        item = &mItems[i];
+        item = &mItems.emplace_back();
+        item->setInternedName(name, len, hash);
+        addToIndex(i);
     }
 
     return item;
@@ -213,7 +348,7 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
 
 const AMessage::Item *AMessage::findItem(
         const char *name, Type type) const {
-    size_t i = findItemIndex(name, strlen(name));
+    size_t i = findItemIndex(name);
     if (i < mItems.size()) {
         const Item *item = &mItems[i];
         return item->mType == type ? item : NULL;
@@ -223,7 +358,7 @@ const AMessage::Item *AMessage::findItem(
 }
 
 bool AMessage::findAsFloat(const char *name, float *value) const {
-    size_t i = findItemIndex(name, strlen(name));
+    size_t i = findItemIndex(name);
     if (i < mItems.size()) {
         const Item *item = &mItems[i];
         switch (item->mType) {
@@ -250,7 +385,7 @@ bool AMessage::findAsFloat(const char *name, float *value) const {
 }
 
 bool AMessage::findAsInt64(const char *name, int64_t *value) const {
-    size_t i = findItemIndex(name, strlen(name));
+    size_t i = findItemIndex(name);
     if (i < mItems.size()) {
         const Item *item = &mItems[i];
         switch (item->mType) {
@@ -268,7 +403,7 @@ bool AMessage::findAsInt64(const char *name, int64_t *value) const {
 }
 
 bool AMessage::contains(const char *name) const {
-    size_t i = findItemIndex(name, strlen(name));
+    size_t i = findItemIndex(name);
     return i < mItems.size();
 }
 
@@ -409,14 +544,14 @@ bool AMessage::findRect(
     return true;
 }
 
-void AMessage::deliver() {
+void AMessage::deliver(int64_t latencyUs) {
     sp<AHandler> handler = mHandler.promote();
     if (handler == NULL) {
         ALOGW("failed to deliver message as target handler %d is gone.", mTarget);
         return;
     }
 
-    handler->deliverMessage(this);
+    handler->deliverMessage(this, latencyUs);
 }
 
 status_t AMessage::post(int64_t delayUs) {
@@ -491,6 +626,7 @@ bool AMessage::senderAwaitsResponse(sp<AReplyToken> *replyToken) {
 sp<AMessage> AMessage::dup() const {
     sp<AMessage> msg = new AMessage(mWhat, mHandler.promote());
     msg->mItems = mItems;
+    msg->mIndex = mIndex;
 
 #ifdef DUMP_STATS
     {
@@ -505,7 +641,9 @@ sp<AMessage> AMessage::dup() const {
         const Item *from = &mItems[i];
         Item *to = &msg->mItems[i];
 
-        to->setName(from->mName, from->mNameLength);
+        if (from->mNameOwned) {
+            to->setName(from->mName, from->mNameLength, from->mNameHash);
+        }
         to->mType = from->mType;
 
         switch (from->mType) {
@@ -771,8 +909,11 @@ sp<AMessage> AMessage::FromParcel(const Parcel &parcel, size_t maxNestingLevel)
             }
         }
 
-        item->setName(name, strlen(name));
+        size_t len;
+        uint32_t hash = hashName(name, &len);
+        item->setName(name, len, hash);
     }
+    msg->rebuildIndex();
 
     return msg;
 }
@@ -1022,13 +1163,14 @@ status_t AMessage::setEntryNameAt(size_t index, const char *name) {
     if (!strcmp(name, mItems[index].mName)) {
         return OK; // name has not changed
     }
-    size_t len = strlen(name);
-    if (findItemIndex(name, len) < mItems.size()) {
+    size_t len;
+    uint32_t hash = hashName(name, &len);
+    if (findItemIndex(name, len, hash) < mItems.size()) {
         return ALREADY_EXISTS;
     }
-    delete[] mItems[index].mName;
-    mItems[index].mName = nullptr;
-    mItems[index].setName(name, len);
+    mItems[index].freeName();
+    mItems[index].setInternedName(name, len, hash);
+    rebuildIndex();
     return OK;
 }
 
@@ -1091,8 +1233,7 @@ status_t AMessage::removeEntryAt(size_t index) {
         return BAD_INDEX;
     }
     // delete entry data and objects
-    delete[] mItems[index].mName;
-    mItems[index].mName = nullptr;
+    mItems[index].freeName();
     freeItemValue(&mItems[index]);
 
     // swap entry with last entry and clear last entry's data
@@ -1100,9 +1241,11 @@ status_t AMessage::removeEntryAt(size_t index) {
     if (index < lastIndex) {
         mItems[index] = mItems[lastIndex];
         mItems[lastIndex].mName = nullptr;
+        mItems[lastIndex].mNameOwned = false;
         mItems[lastIndex].mType = kTypeInt32;
     }
     mItems.pop_back();
+    rebuildIndex();
     return OK;
 }
 
@@ -1146,7 +1289,7 @@ void AMessage::extend(const sp<AMessage> &other) {
 }
 
 size_t AMessage::findEntryByName(const char *name) const {
-    return name == nullptr ? countEntries() : findItemIndex(name, strlen(name));
+    return name == nullptr ? countEntries() : findItemIndex(name);
 }
 
 }  // namespace android
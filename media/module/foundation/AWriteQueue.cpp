@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AWriteQueue"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "AWriteQueue.h"
+
+namespace android {
+
+// Chunks kept around for reuse, enough for the worker to write one while the
+// next one fills up.
+static constexpr size_t kMaxFreeChunks = 2;
+
+AWriteQueue::AWriteQueue(int fd, size_t maxPendingBytes)
+    : mFd(fd),
+      mMaxPendingBytes(maxPendingBytes),
+      mStopping(false),
+      mError(OK),
+      mStartOffset(0),
+      mQueuedBytes(0),
+      mPendingBytes(0),
+      mStats() {
+}
+
+AWriteQueue::~AWriteQueue() {
+    stop();
+}
+
+status_t AWriteQueue::start(const char *name) {
+    Mutex::Autolock autoLock(mLock);
+    if (mThread.joinable() || mStopping) {
+        return INVALID_OPERATION;
+    }
+    mName = name;
+    // Offsets are meaningless for pipes and sockets, count from 0 for those.
+    mStartOffset = std::max((off64_t)lseek64(mFd, 0, SEEK_CUR), (off64_t)0);
+    mThread = std::thread(&AWriteQueue::threadLoop, this);
+    return OK;
+}
+
+status_t AWriteQueue::stop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    Mutex::Autolock autoLock(mLock);
+    return mError;
+}
+
+status_t AWriteQueue::write(const void *data, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+    status_t err = waitForSpace_l(size);
+    if (err == OK) {
+        append_l((const uint8_t *)data, size);
+    }
+    return err;
+}
+
+status_t AWriteQueue::writev(const struct iovec *iov, int iovcnt) {
+    size_t size = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        size += iov[i].iov_len;
+    }
+    Mutex::Autolock autoLock(mLock);
+    status_t err = waitForSpace_l(size);
+    if (err == OK) {
+        for (int i = 0; i < iovcnt; ++i) {
+            append_l((const uint8_t *)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+    return err;
+}
+
+status_t AWriteQueue::flush() {
+    Mutex::Autolock autoLock(mLock);
+    if (!mThread.joinable()) {
+        return mError == OK && mPendingBytes > 0 ? NO_INIT : mError;
+    }
+    while (mPendingBytes > 0 && mError == OK) {
+        mCondition.wait(mLock);
+    }
+    return mError;
+}
+
+off64_t AWriteQueue::tell() const {
+    Mutex::Autolock autoLock(mLock);
+    return mStartOffset + mQueuedBytes;
+}
+
+AWriteQueue::Stats AWriteQueue::getStats() const {
+    Mutex::Autolock autoLock(mLock);
+    return mStats;
+}
+
+status_t AWriteQueue::waitForSpace_l(size_t size) {
+    if (!mThread.joinable() || mStopping) {
+        return mError == OK ? INVALID_OPERATION : mError;
+    }
+    // A write larger than the bound is let through once the queue is empty.
+    nsecs_t stallStartNs = -1;
+    while (mError == OK && mPendingBytes > 0 && mPendingBytes + size > mMaxPendingBytes) {
+        if (stallStartNs < 0) {
+            stallStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+        mCondition.wait(mLock);
+    }
+    if (stallStartNs >= 0) {
+        int64_t stallUs = (systemTime(SYSTEM_TIME_MONOTONIC) - stallStartNs) / 1000;
+        ++mStats.stalls;
+        mStats.totalStallUs += stallUs;
+        mStats.maxStallUs = std::max(mStats.maxStallUs, stallUs);
+    }
+    return mError;
+}
+
+void AWriteQueue::append_l(const uint8_t *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (mChunks.empty() || mChunks.back().capacity() - mChunks.back().size() < size) {
+        if (!mFreeChunks.empty() && size <= kChunkSize) {
+            mChunks.splice(mChunks.end(), mFreeChunks, mFreeChunks.begin());
+        } else {
+            mChunks.emplace_back();
+            mChunks.back().reserve(std::max(size, kChunkSize));
+        }
+    }
+    mChunks.back().insert(mChunks.back().end(), data, data + size);
+    mPendingBytes += size;
+    mQueuedBytes += size;
+    mCondition.broadcast();
+}
+
+status_t AWriteQueue::writeFully(const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(mFd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status_t err = -errno;
+            ALOGE("%s: write of %zu bytes failed: %s", mName.c_str(), size, strerror(errno));
+            return err;
+        }
+        if (n == 0) {
+            ALOGE("%s: write of %zu bytes made no progress", mName.c_str(), size);
+            return -EIO;
+        }
+        data += n;
+        size -= n;
+    }
+    return OK;
+}
+
+void AWriteQueue::threadLoop() {
+    pthread_setname_np(pthread_self(), mName.c_str());
+
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        while (mChunks.empty() && !mStopping) {
+            mCondition.wait(mLock);
+        }
+        if (mChunks.empty()) {
+            break;
+        }
+        std::list<std::vector<uint8_t>> chunk;
+        chunk.splice(chunk.end(), mChunks, mChunks.begin());
+        const size_t size = chunk.front().size();
+
+        mLock.unlock();
+        nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        status_t err = writeFully(chunk.front().data(), size);
+        int64_t writeUs = (systemTime(SYSTEM_TIME_MONOTONIC) - startNs) / 1000;
+        mLock.lock();
+
+        ++mStats.writes;
+        mStats.maxWriteUs = std::max(mStats.maxWriteUs, writeUs);
+        if (err != OK) {
+            // Nothing after a failed write can end up in the right place.
+            mError = err;
+            mChunks.clear();
+            mPendingBytes = 0;
+        } else {
+            mStats.bytesWritten += size;
+            mPendingBytes -= size;
+            if (mFreeChunks.size() < kMaxFreeChunks
+                    && chunk.front().capacity() == kChunkSize) {
+                chunk.front().clear();
+                mFreeChunks.splice(mFreeChunks.end(), chunk);
+            }
+        }
+        mCondition.broadcast();
+    }
+}
+
+}  // namespace android
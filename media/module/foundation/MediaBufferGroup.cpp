@@ -17,13 +17,16 @@
 #define LOG_TAG "MediaBufferGroup"
 #include <utils/Log.h>
 
+#include <algorithm>
 #include <list>
+#include <vector>
 
 #include <binder/MemoryDealer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
 #include <utils/threads.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -36,11 +39,86 @@ constexpr T MIN(const T &a, const T &b) { return a <= b ? a : b; }
 static const size_t kSharedMemoryThreshold = MIN(
         (size_t)MediaBuffer::kSharedMemThreshold, (size_t)(4 * 1024));
 
+// Buffers that are grown to fit a request are allocated this much larger, so
+// that slowly growing requests do not reallocate every time.
+static size_t grownSize(size_t requestedSize) {
+    return requestedSize < SIZE_MAX / 3 * 2 /* NB: ordering */ ?
+            requestedSize * 3 / 2 : requestedSize;
+}
+
 struct MediaBufferGroup::InternalData {
     Mutex mLock;
     Condition mCondition;
     size_t mGrowthLimit;  // Do not automatically grow group larger than this.
     std::list<MediaBufferBase *> mBuffers;
+
+    // Buffers returned by their last local owner, bucketed by capacity so that
+    // acquire_buffer() does not need to scan all buffers. Bucket 0 holds
+    // buffers smaller than 2^kMinBucketShift bytes, bucket i > 0 buffers of
+    // [2^(kMinBucketShift + i - 1), 2^(kMinBucketShift + i)) bytes, and the
+    // last bucket everything larger. A buffer may still be referenced
+    // remotely, so refcount() is checked before it is handed out.
+    enum {
+        kMinBucketShift = 10,
+        kNumBuckets = 16,
+    };
+    std::vector<MediaBufferBase *> mFree[kNumBuckets];
+
+    size_t mWaiters;  // threads blocked in acquire_buffer()
+    uint64_t mAcquires;
+    uint64_t mWaits;
+    nsecs_t mTotalWaitNs;
+    nsecs_t mMaxWaitNs;
+
+    InternalData()
+        : mGrowthLimit(0),
+          mWaiters(0),
+          mAcquires(0),
+          mWaits(0),
+          mTotalWaitNs(0),
+          mMaxWaitNs(0) {
+    }
+
+    static size_t bucketFor(size_t size) {
+        size_t bucket = 0;
+        for (size >>= kMinBucketShift; size != 0 && bucket < kNumBuckets - 1; size >>= 1) {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void addFree_l(MediaBufferBase *buffer) {
+        std::vector<MediaBufferBase *> &bucket = mFree[bucketFor(buffer->size())];
+        if (std::find(bucket.begin(), bucket.end(), buffer) == bucket.end()) {
+            bucket.push_back(buffer);
+        }
+    }
+
+    void removeFree_l(MediaBufferBase *buffer) {
+        std::vector<MediaBufferBase *> &bucket = mFree[bucketFor(buffer->size())];
+        auto it = std::find(bucket.begin(), bucket.end(), buffer);
+        if (it != bucket.end()) {
+            *it = bucket.back();
+            bucket.pop_back();
+        }
+    }
+
+    // Returns a free buffer of at least |requestedSize| bytes, or nullptr.
+    MediaBufferBase *takeFree_l(size_t requestedSize) {
+        for (size_t i = bucketFor(requestedSize); i < kNumBuckets; ++i) {
+            std::vector<MediaBufferBase *> &bucket = mFree[i];
+            for (size_t j = bucket.size(); j > 0;) {
+                --j;
+                MediaBufferBase *buffer = bucket[j];
+                if (buffer->size() >= requestedSize && buffer->refcount() == 0) {
+                    bucket[j] = bucket.back();
+                    bucket.pop_back();
+                    return buffer;
+                }
+            }
+        }
+        return nullptr;
+    }
 };
 
 MediaBufferGroup::MediaBufferGroup(size_t growthLimit)
@@ -102,6 +180,9 @@ void MediaBufferGroup::init(size_t buffers, size_t buffer_size, size_t growthLim
 }
 
 MediaBufferGroup::~MediaBufferGroup() {
+    ALOGV("%llu acquires, %llu waited for %lld us in total, %lld us at most",
+            (unsigned long long)mInternal->mAcquires, (unsigned long long)mInternal->mWaits,
+            (long long)(mInternal->mTotalWaitNs / 1000), (long long)(mInternal->mMaxWaitNs / 1000));
     for (MediaBufferBase *buffer : mInternal->mBuffers) {
         if (buffer->refcount() != 0) {
             const int localRefcount = buffer->localRefcount();
@@ -137,6 +218,7 @@ void MediaBufferGroup::add_buffer(MediaBufferBase *buffer) {
             && mInternal->mBuffers.size() >= mInternal->mGrowthLimit
             && it != mInternal->mBuffers.end();) {
         if ((*it)->refcount() == 0) {
+            mInternal->removeFree_l(*it);
             (*it)->setObserver(nullptr);
             (*it)->release();
             it = mInternal->mBuffers.erase(it);
@@ -147,6 +229,9 @@ void MediaBufferGroup::add_buffer(MediaBufferBase *buffer) {
 
     buffer->setObserver(this);
     mInternal->mBuffers.emplace_back(buffer);
+    if (buffer->refcount() == 0) {
+        mInternal->addFree_l(buffer);
+    }
 }
 
 bool MediaBufferGroup::has_buffers() {
@@ -164,50 +249,57 @@ bool MediaBufferGroup::has_buffers() {
 status_t MediaBufferGroup::acquire_buffer(
         MediaBufferBase **out, bool nonBlocking, size_t requestedSize) {
     Mutex::Autolock autoLock(mInternal->mLock);
+    nsecs_t waitStartNs = -1;
     for (;;) {
-        size_t smallest = requestedSize;
-        size_t biggest = requestedSize;
-        MediaBufferBase *buffer = nullptr;
-        auto free = mInternal->mBuffers.end();
-        for (auto it = mInternal->mBuffers.begin(); it != mInternal->mBuffers.end(); ++it) {
-            const size_t size = (*it)->size();
-            if (size > biggest) {
-                biggest = size;
-            }
-            if ((*it)->refcount() == 0) {
-                if (size >= requestedSize) {
-                    buffer = *it;
-                    break;
+        MediaBufferBase *buffer = mInternal->takeFree_l(requestedSize);
+        if (buffer == nullptr) {
+            // No buffer on the free lists fits. Scan all buffers, as buffers
+            // released remotely or claimed are not on the free lists, and find
+            // the smallest free buffer to replace with a larger one.
+            size_t smallest = requestedSize;
+            size_t biggest = requestedSize;
+            auto free = mInternal->mBuffers.end();
+            for (auto it = mInternal->mBuffers.begin(); it != mInternal->mBuffers.end(); ++it) {
+                const size_t size = (*it)->size();
+                if (size > biggest) {
+                    biggest = size;
                 }
-                if (size < smallest) {
-                    smallest = size; // always free the smallest buf
-                    free = it;
+                if ((*it)->refcount() == 0) {
+                    if (size >= requestedSize) {
+                        buffer = *it;
+                        mInternal->removeFree_l(buffer);
+                        break;
+                    }
+                    if (size < smallest) {
+                        smallest = size; // always free the smallest buf
+                        free = it;
+                    }
                 }
             }
-        }
-        if (buffer == nullptr
-                && (free != mInternal->mBuffers.end()
-                    || mInternal->mBuffers.size() < mInternal->mGrowthLimit)) {
-            // We alloc before we free so failure leaves group unchanged.
-            const size_t allocateSize = requestedSize == 0 ? biggest :
-                    requestedSize < SIZE_MAX / 3 * 2 /* NB: ordering */ ?
-                    requestedSize * 3 / 2 : requestedSize;
-            buffer = new MediaBuffer(allocateSize);
-            if (buffer->data() == nullptr) {
-                ALOGE("Allocation failure for size %zu", allocateSize);
-                delete buffer; // Invalid alloc, prefer not to call release.
-                buffer = nullptr;
-            } else {
-                buffer->setObserver(this);
-                if (free != mInternal->mBuffers.end()) {
-                    ALOGV("reallocate buffer, requested size %zu vs available %zu",
-                            requestedSize, (*free)->size());
-                    (*free)->setObserver(nullptr);
-                    (*free)->release();
-                    *free = buffer; // in-place replace
+            if (buffer == nullptr
+                    && (free != mInternal->mBuffers.end()
+                        || mInternal->mBuffers.size() < mInternal->mGrowthLimit)) {
+                // We alloc before we free so failure leaves group unchanged.
+                const size_t allocateSize = requestedSize == 0 ? biggest :
+                        grownSize(requestedSize);
+                buffer = new MediaBuffer(allocateSize);
+                if (buffer->data() == nullptr) {
+                    ALOGE("Allocation failure for size %zu", allocateSize);
+                    delete buffer; // Invalid alloc, prefer not to call release.
+                    buffer = nullptr;
                 } else {
-                    ALOGV("allocate buffer, requested size %zu", requestedSize);
-                    mInternal->mBuffers.emplace_back(buffer);
+                    buffer->setObserver(this);
+                    if (free != mInternal->mBuffers.end()) {
+                        ALOGV("reallocate buffer, requested size %zu vs available %zu",
+                                requestedSize, (*free)->size());
+                        mInternal->removeFree_l(*free);
+                        (*free)->setObserver(nullptr);
+                        (*free)->release();
+                        *free = buffer; // in-place replace
+                    } else {
+                        ALOGV("allocate buffer, requested size %zu", requestedSize);
+                        mInternal->mBuffers.emplace_back(buffer);
+                    }
                 }
             }
         }
@@ -215,6 +307,13 @@ status_t MediaBufferGroup::acquire_buffer(
             buffer->add_ref();
             buffer->reset();
             *out = buffer;
+            ++mInternal->mAcquires;
+            if (waitStartNs >= 0) {
+                nsecs_t waitNs = systemTime(SYSTEM_TIME_MONOTONIC) - waitStartNs;
+                ++mInternal->mWaits;
+                mInternal->mTotalWaitNs += waitNs;
+                mInternal->mMaxWaitNs = std::max(mInternal->mMaxWaitNs, waitNs);
+            }
             return OK;
         }
         if (nonBlocking) {
@@ -222,7 +321,12 @@ status_t MediaBufferGroup::acquire_buffer(
             return WOULD_BLOCK;
         }
         // All buffers are in use, block until one of them is returned.
+        if (waitStartNs < 0) {
+            waitStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+        ++mInternal->mWaiters;
         mInternal->mCondition.wait(mInternal->mLock);
+        --mInternal->mWaiters;
     }
     // Never gets here.
 }
@@ -231,9 +335,25 @@ size_t MediaBufferGroup::buffers() const {
     return mInternal->mBuffers.size();
 }
 
-void MediaBufferGroup::signalBufferReturned(MediaBufferBase *) {
+MediaBufferGroup::WaitStats MediaBufferGroup::getWaitStats() const {
     Mutex::Autolock autoLock(mInternal->mLock);
-    mInternal->mCondition.signal();
+    WaitStats stats;
+    stats.acquires = mInternal->mAcquires;
+    stats.waits = mInternal->mWaits;
+    stats.totalWaitUs = mInternal->mTotalWaitNs / 1000;
+    stats.maxWaitUs = mInternal->mMaxWaitNs / 1000;
+    return stats;
+}
+
+void MediaBufferGroup::signalBufferReturned(MediaBufferBase *buffer) {
+    Mutex::Autolock autoLock(mInternal->mLock);
+    if (buffer != nullptr) {
+        mInternal->addFree_l(buffer);
+    }
+    // nobody to wake up unless acquire_buffer() is blocked
+    if (mInternal->mWaiters > 0) {
+        mInternal->mCondition.signal();
+    }
 }
 
 }  // namespace android
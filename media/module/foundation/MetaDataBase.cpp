@@ -17,13 +17,17 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MetaDataBase"
 #include <inttypes.h>
-#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <mutex>
+#include <new>
+#include <vector>
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AString.h>
@@ -41,7 +45,9 @@ struct MetaDataBase::typed_data {
     ~typed_data();
 
     typed_data(const MetaDataBase::typed_data &);
+    typed_data(MetaDataBase::typed_data &&) noexcept;
     typed_data &operator=(const MetaDataBase::typed_data &);
+    typed_data &operator=(MetaDataBase::typed_data &&) noexcept;
 
     void clear();
     void setData(uint32_t type, const void *data, size_t size);
@@ -50,12 +56,24 @@ struct MetaDataBase::typed_data {
     String8 asString(bool verbose) const;
 
 private:
+    // Values that do not fit in the reservoir are stored in a reference
+    // counted block. Values are never modified in place, so copies share it.
+    struct alignas(std::max_align_t) SharedData {
+        std::atomic<int32_t> mRefCount;
+
+        void *data() {
+            return this + 1;
+        }
+    };
+
     uint32_t mType;
     size_t mSize;
 
+    // large enough for all the scalar types, rects and short strings
     union {
-        void *ext_data;
-        float reservoir;
+        SharedData *ext_data;
+        int64_t align;
+        uint8_t reservoir[16];
     } u;
 
     bool usesReservoir() const {
@@ -66,11 +84,11 @@ private:
     void freeStorage();
 
     void *storage() {
-        return usesReservoir() ? &u.reservoir : u.ext_data;
+        return usesReservoir() ? u.reservoir : u.ext_data->data();
     }
 
     const void *storage() const {
-        return usesReservoir() ? &u.reservoir : u.ext_data;
+        return usesReservoir() ? u.reservoir : u.ext_data->data();
     }
 };
 
@@ -80,8 +98,26 @@ struct MetaDataBase::Rect {
 
 
 struct MetaDataBase::MetaDataInternal {
+    struct Item {
+        uint32_t mKey;
+        MetaDataBase::typed_data mData;
+    };
+
     std::mutex mLock;
-    KeyedVector<uint32_t, MetaDataBase::typed_data> mItems;
+    // Sorted by key. clear() keeps the capacity, so recycled objects such as
+    // the metadata of MediaBuffers in a MediaBufferGroup do not reallocate.
+    std::vector<Item> mItems;
+
+    std::vector<Item>::iterator lowerBound(uint32_t key) {
+        return std::lower_bound(
+                mItems.begin(), mItems.end(), key,
+                [](const Item &item, uint32_t key) { return item.mKey < key; });
+    }
+
+    ssize_t indexOfKey(uint32_t key) {
+        auto it = lowerBound(key);
+        return (it == mItems.end() || it->mKey != key) ? -1 : it - mItems.begin();
+    }
 };
 
 
@@ -111,13 +147,13 @@ void MetaDataBase::clear() {
 
 bool MetaDataBase::remove(uint32_t key) {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
+    ssize_t i = mInternalData->indexOfKey(key);
 
     if (i < 0) {
         return false;
     }
 
-    mInternalData->mItems.removeItemsAt(i);
+    mInternalData->mItems.erase(mInternalData->mItems.begin() + i);
 
     return true;
 }
@@ -258,17 +294,16 @@ bool MetaDataBase::setData(
     bool overwrote_existing = true;
 
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
-    if (i < 0) {
-        typed_data item;
-        i = mInternalData->mItems.add(key, item);
+    auto it = mInternalData->lowerBound(key);
+    if (it == mInternalData->mItems.end() || it->mKey != key) {
+        MetaDataInternal::Item item;
+        item.mKey = key;
+        it = mInternalData->mItems.insert(it, std::move(item));
 
         overwrote_existing = false;
     }
 
-    typed_data &item = mInternalData->mItems.editValueAt(i);
-
-    item.setData(type, data, size);
+    it->mData.setData(type, data, size);
 
     return overwrote_existing;
 }
@@ -276,13 +311,13 @@ bool MetaDataBase::setData(
 bool MetaDataBase::findData(uint32_t key, uint32_t *type,
                         const void **data, size_t *size) const {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
+    ssize_t i = mInternalData->indexOfKey(key);
 
     if (i < 0) {
         return false;
     }
 
-    const typed_data &item = mInternalData->mItems.valueAt(i);
+    const typed_data &item = mInternalData->mItems[i].mData;
 
     item.getData(type, data, size);
 
@@ -291,7 +326,7 @@ bool MetaDataBase::findData(uint32_t key, uint32_t *type,
 
 bool MetaDataBase::hasData(uint32_t key) const {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
-    ssize_t i = mInternalData->mItems.indexOfKey(key);
+    ssize_t i = mInternalData->indexOfKey(key);
 
     if (i < 0) {
         return false;
@@ -311,28 +346,50 @@ MetaDataBase::typed_data::~typed_data() {
 
 MetaDataBase::typed_data::typed_data(const typed_data &from)
     : mType(from.mType),
-      mSize(0) {
-
-    void *dst = allocateStorage(from.mSize);
-    if (dst) {
-        memcpy(dst, from.storage(), mSize);
+      mSize(from.mSize),
+      u(from.u) {
+    if (!usesReservoir()) {
+        u.ext_data->mRefCount.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
+MetaDataBase::typed_data::typed_data(typed_data &&from) noexcept
+    : mType(from.mType),
+      mSize(from.mSize),
+      u(from.u) {
+    from.mType = 0;
+    from.mSize = 0;
+}
+
 MetaDataBase::typed_data &MetaDataBase::typed_data::operator=(
         const MetaDataBase::typed_data &from) {
     if (this != &from) {
         clear();
         mType = from.mType;
-        void *dst = allocateStorage(from.mSize);
-        if (dst) {
-            memcpy(dst, from.storage(), mSize);
+        mSize = from.mSize;
+        u = from.u;
+        if (!usesReservoir()) {
+            u.ext_data->mRefCount.fetch_add(1, std::memory_order_relaxed);
         }
     }
 
     return *this;
 }
 
+MetaDataBase::typed_data &MetaDataBase::typed_data::operator=(
+        MetaDataBase::typed_data &&from) noexcept {
+    if (this != &from) {
+        clear();
+        mType = from.mType;
+        mSize = from.mSize;
+        u = from.u;
+        from.mType = 0;
+        from.mSize = 0;
+    }
+
+    return *this;
+}
+
 void MetaDataBase::typed_data::clear() {
     freeStorage();
 
@@ -362,23 +419,26 @@ void *MetaDataBase::typed_data::allocateStorage(size_t size) {
     mSize = size;
 
     if (usesReservoir()) {
-        return &u.reservoir;
+        return u.reservoir;
     }
 
-    u.ext_data = malloc(mSize);
-    if (u.ext_data == NULL) {
+    void *mem = malloc(sizeof(SharedData) + mSize);
+    if (mem == NULL) {
         ALOGE("Couldn't allocate %zu bytes for item", size);
         mSize = 0;
+        return NULL;
     }
-    return u.ext_data;
+    u.ext_data = new (mem) SharedData{1};
+    return u.ext_data->data();
 }
 
 void MetaDataBase::typed_data::freeStorage() {
     if (!usesReservoir()) {
-        if (u.ext_data) {
+        if (u.ext_data->mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            u.ext_data->~SharedData();
             free(u.ext_data);
-            u.ext_data = NULL;
         }
+        u.ext_data = NULL;
     }
 
     mSize = 0;
@@ -439,10 +499,10 @@ String8 MetaDataBase::toString() const {
     String8 s;
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
     for (int i = mInternalData->mItems.size(); --i >= 0;) {
-        int32_t key = mInternalData->mItems.keyAt(i);
+        int32_t key = mInternalData->mItems[i].mKey;
         char cc[5];
         MakeFourCCString(key, cc);
-        const typed_data &item = mInternalData->mItems.valueAt(i);
+        const typed_data &item = mInternalData->mItems[i].mData;
         s.appendFormat("%s: %s", cc, item.asString(false).c_str());
         if (i != 0) {
             s.append(", ");
@@ -454,10 +514,10 @@ String8 MetaDataBase::toString() const {
 void MetaDataBase::dumpToLog() const {
     std::lock_guard<std::mutex> guard(mInternalData->mLock);
     for (int i = mInternalData->mItems.size(); --i >= 0;) {
-        int32_t key = mInternalData->mItems.keyAt(i);
+        int32_t key = mInternalData->mItems[i].mKey;
         char cc[5];
         MakeFourCCString(key, cc);
-        const typed_data &item = mInternalData->mItems.valueAt(i);
+        const typed_data &item = mInternalData->mItems[i].mData;
         ALOGI("%s: %s", cc, item.asString(true /* verbose */).c_str());
     }
 }
@@ -472,8 +532,8 @@ status_t MetaDataBase::writeToParcel(Parcel &parcel) {
         return ret;
     }
     for (size_t i = 0; i < numItems; i++) {
-        int32_t key = mInternalData->mItems.keyAt(i);
-        const typed_data &item = mInternalData->mItems.valueAt(i);
+        int32_t key = mInternalData->mItems[i].mKey;
+        const typed_data &item = mInternalData->mItems[i].mData;
         uint32_t type;
         const void *data;
         size_t size;
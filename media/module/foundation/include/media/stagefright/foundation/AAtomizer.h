@@ -20,29 +20,43 @@
 
 #include <stdint.h>
 
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
 #include <media/stagefright/foundation/ABase.h>
-#include <media/stagefright/foundation/AString.h>
-#include <utils/List.h>
-#include <utils/Vector.h>
-#include <utils/threads.h>
 
 namespace android {
 
+// Interns strings: equal strings are mapped to the same pointer, which stays
+// valid for the lifetime of the process.
+//
+// As atoms are never freed, the table is bounded: once it holds kMaxAtoms
+// strings, or for strings longer than kMaxAtomLength, Atomize() returns NULL
+// for strings not interned yet, and callers keep a copy of their own.
 struct AAtomizer {
     static const char *Atomize(const char *name);
 
 private:
-    static AAtomizer gAtomizer;
+    enum {
+        kMaxAtoms = 1024,
+        kMaxAtomLength = 64,
+    };
 
-    Mutex mLock;
-    Vector<List<AString> > mAtoms;
+    // atoms are only ever added, so lookups of existing atoms share the lock
+    std::shared_mutex mLock;
+    // views into mStorage, so that lookups do not construct a string
+    std::unordered_set<std::string_view> mAtoms;
+    // deque elements do not move when it grows
+    std::deque<std::string> mStorage;
 
     AAtomizer();
 
     const char *atomize(const char *name);
 
-    static uint32_t Hash(const char *s);
-
     DISALLOW_EVIL_CONSTRUCTORS(AAtomizer);
 };
 
@@ -33,7 +33,8 @@ struct AHandler : public RefBase {
           mMessageCounter(0),
           mDeliveringMessage(false),
           mCurrentMessageWhat(0),
-          mCurrentMessageStartTimeUs(0){
+          mCurrentMessageStartTimeUs(0),
+          mDispatchLatencyHistogram{} {
     }
 
     ALooper::handler_id id() const {
@@ -72,15 +73,24 @@ private:
     uint64_t mMessageCounter;
     KeyedVector<uint32_t, uint32_t> mMessages;
 
+    enum {
+        kNumDispatchLatencyBuckets = 5,
+    };
+    // upper bounds of the dispatch latency buckets, the last one is unbounded
+    static const int64_t kDispatchLatencyBucketsUs[kNumDispatchLatencyBuckets - 1];
+
     Mutex mLock;
     bool mDeliveringMessage;
     uint32_t  mCurrentMessageWhat;
     int64_t mCurrentMessageStartTimeUs;
+    // number of messages by how long they waited past their due time
+    uint32_t mDispatchLatencyHistogram[kNumDispatchLatencyBuckets];
 
-    void deliverMessage(const sp<AMessage> &msg);
+    void deliverMessage(const sp<AMessage> &msg, int64_t latencyUs);
 
     void setDeliveryStatus(bool, uint32_t, int64_t);
     void getDeliveryStatus(bool&, uint32_t&, int64_t&);
+    void getDispatchLatencyHistogram(uint32_t *histogram, bool clear);
 
 
     DISALLOW_EVIL_CONSTRUCTORS(AHandler);
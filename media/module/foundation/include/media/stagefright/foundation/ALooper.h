@@ -26,6 +26,9 @@
 #include <utils/RefBase.h>
 #include <utils/threads.h>
 
+#include <unordered_map>
+#include <vector>
+
 namespace android {
 
 struct AHandler;
@@ -66,11 +69,18 @@ protected:
 
 private:
     friend struct AMessage;       // post()
+    friend struct ALooperRoster;  // getQueueStats()
 
     struct Event {
         int64_t mWhenUs;
+        // events due at the same time are delivered in posting order
+        uint64_t mSeq;
         sp<AMessage> mMessage;
         sp<RefBase> mToken;
+
+        bool isBefore(const Event &other) const {
+            return mWhenUs < other.mWhenUs || (mWhenUs == other.mWhenUs && mSeq < other.mSeq);
+        }
     };
 
     Mutex mLock;
@@ -78,7 +88,12 @@ private:
 
     AString mName;
 
-    List<Event> mEventQueue;
+    // binary min-heap of pending events, and the position of the event
+    // posted for each postUnique() token
+    std::vector<Event> mEventQueue;
+    std::unordered_map<const RefBase *, size_t> mTokenIndex;
+    uint64_t mNextEventSeq;
+    size_t mMaxQueueDepth;
 
     struct LooperThread;
     sp<LooperThread> mThread;
@@ -110,6 +125,15 @@ private:
 
     // END --- methods used only by AMessage
 
+    // adds |event| to the queue and returns its position
+    size_t pushEvent_l(Event &&event);
+    Event removeEvent_l(size_t index);
+    void setEvent_l(size_t index, Event &&event);
+    size_t siftUp_l(size_t index);
+    void siftDown_l(size_t index);
+
+    void getQueueStats(size_t *depth, size_t *maxDepth, bool clear);
+
     bool loop();
 
     DISALLOW_EVIL_CONSTRUCTORS(ALooper);
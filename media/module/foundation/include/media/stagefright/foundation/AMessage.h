@@ -307,18 +307,74 @@ private:
             AString *stringValue;
             Rect rectValue;
         } u;
+        // Names are interned through AAtomizer, except for names received
+        // from a parcel and names AAtomizer does not take, which are owned
+        // by the item.
         const char *mName;
-        size_t      mNameLength;
+        uint32_t    mNameLength;
+        uint32_t    mNameHash;
         Type mType;
-        void setName(const char *name, size_t len);
-        Item() : mName(nullptr), mNameLength(0), mType(kTypeInt32) { }
-        Item(const char *name, size_t length);
+        bool mNameOwned;
+        void setName(const char *name, size_t len, uint32_t hash);
+        void setInternedName(const char *name, size_t len, uint32_t hash);
+        void freeName();
+        bool hasName(const char *name, size_t len, uint32_t hash) const;
+        Item()
+            : mName(nullptr), mNameLength(0), mNameHash(0), mType(kTypeInt32),
+              mNameOwned(false) { }
     };
 
     enum {
-        kMaxNumItems = 256
+        kMaxNumItems = 256,
+        // number of items stored within the message itself. An Item is 40
+        // bytes on 64-bit builds, so this adds 160 bytes to every message;
+        // it covers notifications and buffer messages, which carry a few
+        // items, while formats with more keys allocate once.
+        kNumInlineItems = 4,
+        // messages with more items than this are looked up through mIndex
+        kMinIndexedItems = 16,
     };
-    std::vector<Item> mItems;
+
+    // Vector of items that does not allocate for small messages.
+    class ItemVector {
+    public:
+        ItemVector() : mData(mInline), mSize(0), mCapacity(kNumInlineItems) { }
+        ~ItemVector();
+
+        ItemVector &operator=(const ItemVector &other);
+
+        size_t size() const { return mSize; }
+        Item &operator[](size_t i) { return mData[i]; }
+        const Item &operator[](size_t i) const { return mData[i]; }
+        Item *begin() { return mData; }
+        Item *end() { return mData + mSize; }
+        const Item *begin() const { return mData; }
+        const Item *end() const { return mData + mSize; }
+
+        // appends a blank item
+        Item &emplace_back();
+        void pop_back() { --mSize; }
+        void resize(size_t size);
+        void clear() { mSize = 0; }
+
+    private:
+        Item mInline[kNumInlineItems];
+        Item *mData;
+        size_t mSize;
+        size_t mCapacity;
+
+        void reserve(size_t capacity);
+
+        ItemVector(const ItemVector &);
+    };
+    ItemVector mItems;
+
+    // Open addressing hash table of item index + 1 by name hash, or empty if
+    // the message has at most kMinIndexedItems items.
+    std::vector<uint16_t> mIndex;
+
+    void addToIndex(size_t index);
+    void rebuildIndex();
 
     /**
      * Allocates an item with the given key |name|. If the key already exists, the corresponding
@@ -349,9 +405,11 @@ private:
     void setObjectInternal(
             const char *name, const sp<RefBase> &obj, Type type);
 
-    size_t findItemIndex(const char *name, size_t len) const;
+    size_t findItemIndex(const char *name) const;
+    size_t findItemIndex(const char *name, size_t len, uint32_t hash) const;
 
-    void deliver();
+    // |latencyUs| is how long the message waited past its due time
+    void deliver(int64_t latencyUs);
 
     DISALLOW_EVIL_CONSTRUCTORS(AMessage);
 };
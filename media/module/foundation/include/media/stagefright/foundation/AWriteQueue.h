@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef A_WRITE_QUEUE_H_
+
+#define A_WRITE_QUEUE_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <list>
+#include <thread>
+#include <vector>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// Appends data to a file descriptor from a worker thread, so that the
+// threads producing the data do not block on storage. Writes are copied and
+// issued in order at the current file offset of the descriptor. At most
+// |maxPendingBytes| are held at a time; write() blocks once the bound is
+// reached, until the worker catches up.
+//
+// The first I/O error is sticky: queued data is dropped and every later
+// write(), flush() and stop() returns the error, as a negated errno value.
+//
+// The owner must not move the file offset or write to the descriptor itself
+// while data is pending. Call flush() first.
+struct AWriteQueue : public RefBase {
+    static constexpr size_t kDefaultMaxPendingBytes = 4 * 1024 * 1024;
+
+    explicit AWriteQueue(int fd, size_t maxPendingBytes = kDefaultMaxPendingBytes);
+
+    // Starts the worker thread. |name| is the name of the thread.
+    status_t start(const char *name = "AWriteQueue");
+
+    // Drains the queue, stops the worker thread and returns the first error
+    // the writes ran into, if any. Does not close the descriptor.
+    status_t stop();
+
+    status_t write(const void *data, size_t size);
+    status_t writev(const struct iovec *iov, int iovcnt);
+
+    // Waits until all queued data has been written to the descriptor.
+    status_t flush();
+
+    // File offset right after the last queued byte, assuming the offset was
+    // not moved since start() other than by the queue.
+    off64_t tell() const;
+
+    struct Stats {
+        uint64_t bytesWritten;
+        uint64_t writes;       // write() calls issued to the descriptor
+        int64_t maxWriteUs;    // longest write() call to the descriptor
+        uint64_t stalls;       // queue writes that blocked on a full queue
+        int64_t totalStallUs;
+        int64_t maxStallUs;
+    };
+    Stats getStats() const;
+
+protected:
+    virtual ~AWriteQueue();
+
+private:
+    // Small writes are coalesced into chunks of this size.
+    static constexpr size_t kChunkSize = 256 * 1024;
+
+    const int mFd;
+    const size_t mMaxPendingBytes;
+    AString mName;
+
+    mutable Mutex mLock;
+    Condition mCondition;
+    std::thread mThread;
+    bool mStopping;
+    status_t mError;
+    off64_t mStartOffset;
+    off64_t mQueuedBytes;
+    // bytes queued or being written
+    size_t mPendingBytes;
+    // the chunk being written by the worker is no longer on |mChunks|
+    std::list<std::vector<uint8_t>> mChunks;
+    std::list<std::vector<uint8_t>> mFreeChunks;
+    Stats mStats;
+
+    status_t waitForSpace_l(size_t size);
+    void append_l(const uint8_t *data, size_t size);
+    status_t writeFully(const uint8_t *data, size_t size);
+    void threadLoop();
+
+    DISALLOW_EVIL_CONSTRUCTORS(AWriteQueue);
+};
+
+}  // namespace android
+
+#endif  // A_WRITE_QUEUE_H_
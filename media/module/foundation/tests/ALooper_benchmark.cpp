@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+using namespace android;
+
+// Far enough in the future that delayed messages are never delivered while
+// the benchmark runs.
+static constexpr int64_t kFarDelayUs = 3600ll * 1000000;
+
+class CountingHandler : public AHandler {
+public:
+    void expect(size_t count) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending = count;
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mPending == 0; });
+    }
+
+protected:
+    void onMessageReceived(const sp<AMessage> &) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mPending > 0 && --mPending == 0) {
+            mCondition.notify_one();
+        }
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    size_t mPending = 0;
+};
+
+// Posts a batch of immediate messages and waits until all are delivered.
+static void BM_ALooperPostDispatch(benchmark::State& state) {
+    const size_t batch = state.range(0);
+    sp<ALooper> looper = new ALooper;
+    sp<CountingHandler> handler = new CountingHandler;
+    looper->registerHandler(handler);
+    looper->start();
+
+    for (auto _ : state) {
+        handler->expect(batch);
+        for (size_t i = 0; i < batch; ++i) {
+            (new AMessage(0, handler))->post();
+        }
+        handler->wait();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+
+    looper->unregisterHandler(handler->id());
+    looper->stop();
+}
+
+// Posts immediate messages while |pending| delayed messages sit in the queue,
+// which is the common case for loopers that keep timeouts and polls pending.
+static void BM_ALooperPostWithPendingDelayed(benchmark::State& state) {
+    const size_t pending = state.range(0);
+    constexpr size_t kBatch = 64;
+    sp<ALooper> looper = new ALooper;
+    sp<CountingHandler> handler = new CountingHandler;
+    looper->registerHandler(handler);
+    looper->start();
+
+    std::minstd_rand gen(42);
+    std::uniform_int_distribution<int64_t> delay(kFarDelayUs, 2 * kFarDelayUs);
+    for (size_t i = 0; i < pending; ++i) {
+        (new AMessage(0, handler))->post(delay(gen));
+    }
+
+    for (auto _ : state) {
+        handler->expect(kBatch);
+        for (size_t i = 0; i < kBatch; ++i) {
+            (new AMessage(0, handler))->post();
+        }
+        handler->wait();
+    }
+    state.SetItemsProcessed(state.iterations() * kBatch);
+
+    looper->unregisterHandler(handler->id());
+    looper->stop();
+}
+
+// Reschedules delayed unique messages, as done for timeouts.
+static void BM_ALooperPostUnique(benchmark::State& state) {
+    const size_t tokens = state.range(0);
+    sp<ALooper> looper = new ALooper;
+    sp<CountingHandler> handler = new CountingHandler;
+    looper->registerHandler(handler);
+    looper->start();
+
+    std::vector<sp<AMessage>> msgs;
+    for (size_t i = 0; i < tokens; ++i) {
+        msgs.push_back(new AMessage(0, handler));
+    }
+    std::minstd_rand gen(42);
+    std::uniform_int_distribution<int64_t> delay(kFarDelayUs, 2 * kFarDelayUs);
+
+    for (auto _ : state) {
+        for (const sp<AMessage> &msg : msgs) {
+            msg->postUnique(msg, delay(gen));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tokens);
+
+    looper->unregisterHandler(handler->id());
+    looper->stop();
+}
+
+static void QueueSizeArgs(benchmark::internal::Benchmark* b) {
+    for (int size : {1, 16, 256, 1024}) {
+        b->Args({size});
+    }
+}
+
+BENCHMARK(BM_ALooperPostDispatch)->Apply(QueueSizeArgs);
+BENCHMARK(BM_ALooperPostWithPendingDelayed)->Apply(QueueSizeArgs);
+BENCHMARK(BM_ALooperPostUnique)->Apply(QueueSizeArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <media/stagefright/foundation/AMessage.h>
+
+using namespace android;
+
+// Key counts of typical formats: a few keys for buffer metadata, 30-100 for
+// codec configuration formats.
+static void KeyCountArgs(benchmark::internal::Benchmark* b) {
+    for (int keys : {4, 8, 30, 100}) {
+        b->Args({keys});
+    }
+}
+
+static std::vector<std::string> makeKeys(size_t count) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("vendor.key-" + std::to_string(i));
+    }
+    return keys;
+}
+
+static sp<AMessage> makeMessage(const std::vector<std::string> &keys) {
+    sp<AMessage> msg = new AMessage;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        msg->setInt32(keys[i].c_str(), i);
+    }
+    return msg;
+}
+
+static void BM_AMessageSet(benchmark::State& state) {
+    const std::vector<std::string> keys = makeKeys(state.range(0));
+    for (auto _ : state) {
+        sp<AMessage> msg = makeMessage(keys);
+        benchmark::DoNotOptimize(msg.get());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+static void BM_AMessageFind(benchmark::State& state) {
+    const std::vector<std::string> keys = makeKeys(state.range(0));
+    sp<AMessage> msg = makeMessage(keys);
+    int32_t value;
+    for (auto _ : state) {
+        for (const std::string &key : keys) {
+            benchmark::DoNotOptimize(msg->findInt32(key.c_str(), &value));
+        }
+        benchmark::DoNotOptimize(msg->findInt32("nonexistent", &value));
+    }
+    state.SetItemsProcessed(state.iterations() * (keys.size() + 1));
+}
+
+static void BM_AMessageDup(benchmark::State& state) {
+    const std::vector<std::string> keys = makeKeys(state.range(0));
+    sp<AMessage> msg = makeMessage(keys);
+    for (auto _ : state) {
+        sp<AMessage> copy = msg->dup();
+        benchmark::DoNotOptimize(copy.get());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(BM_AMessageSet)->Apply(KeyCountArgs);
+BENCHMARK(BM_AMessageFind)->Apply(KeyCountArgs);
+BENCHMARK(BM_AMessageDup)->Apply(KeyCountArgs);
+
+BENCHMARK_MAIN();
@@ -17,6 +17,11 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "AData_test"
 
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <utils/RefBase.h>
@@ -169,6 +174,72 @@ TEST(AMessage_tests, settersAndGetters) {
   EXPECT_NE(OK, m1->removeEntryByName("notpresent"));
 }
 
+TEST(AMessage_tests, manyEntries) {
+  sp<AMessage> m1 = new AMessage();
+
+  // enough entries to spill out of the inline storage and use the index
+  constexpr int32_t kNumEntries = 100;
+  for (int32_t i = 0; i < kNumEntries; ++i) {
+    m1->setInt32(("key" + std::to_string(i)).c_str(), i);
+  }
+  EXPECT_EQ(kNumEntries, m1->countEntries());
+
+  int32_t i32;
+  for (int32_t i = 0; i < kNumEntries; ++i) {
+    EXPECT_TRUE(m1->findInt32(("key" + std::to_string(i)).c_str(), &i32));
+    EXPECT_EQ(i, i32);
+  }
+  EXPECT_FALSE(m1->findInt32("key100", &i32));
+
+  // overwriting does not add entries
+  m1->setInt32("key42", -42);
+  EXPECT_EQ(kNumEntries, m1->countEntries());
+  EXPECT_TRUE(m1->findInt32("key42", &i32));
+  EXPECT_EQ(-42, i32);
+
+  // removal and renaming keep the remaining entries reachable
+  EXPECT_EQ(OK, m1->removeEntryByName("key0"));
+  EXPECT_FALSE(m1->findInt32("key0", &i32));
+  size_t index = m1->findEntryByName("key99");
+  EXPECT_EQ(OK, m1->setEntryNameAt(index, "renamed"));
+  EXPECT_FALSE(m1->findInt32("key99", &i32));
+  EXPECT_TRUE(m1->findInt32("renamed", &i32));
+  EXPECT_EQ(99, i32);
+  EXPECT_EQ(ALREADY_EXISTS, m1->setEntryNameAt(index, "key1"));
+
+  sp<AMessage> m2 = m1->dup();
+  EXPECT_EQ(kNumEntries - 1, m2->countEntries());
+  for (int32_t i = 1; i < kNumEntries - 1; ++i) {
+    EXPECT_TRUE(m2->findInt32(("key" + std::to_string(i)).c_str(), &i32));
+    EXPECT_EQ(i == 42 ? -42 : i, i32);
+  }
+  EXPECT_TRUE(m2->findInt32("renamed", &i32));
+
+  // the copy is independent of the original
+  m2->setInt32("key1", 1000);
+  EXPECT_TRUE(m1->findInt32("key1", &i32));
+  EXPECT_EQ(1, i32);
+}
+
+TEST(AMessage_tests, uninternedNames) {
+  // more distinct names than are interned, and a name too long to intern
+  constexpr int32_t kNumNames = 3000;
+  const std::string longName(200, 'x');
+  int32_t i32;
+  for (int32_t i = 0; i < kNumNames; ++i) {
+    sp<AMessage> m1 = new AMessage();
+    std::string name = "dynamic-key-" + std::to_string(i);
+    m1->setInt32(name.c_str(), i);
+    m1->setInt32(longName.c_str(), -i);
+    sp<AMessage> m2 = m1->dup();
+    m1.clear();
+    EXPECT_TRUE(m2->findInt32(name.c_str(), &i32));
+    EXPECT_EQ(i, i32);
+    EXPECT_TRUE(m2->findInt32(longName.c_str(), &i32));
+    EXPECT_EQ(-i, i32);
+  }
+}
+
 TEST(AMessage_tests, deliversMultipleMessagesInOrderImmediately) {
   sp<NiceMock<MockHandler>> mockHandler = new NiceMock<MockHandler>;
   sp<LooperWithSettableClock> looper = new LooperWithSettableClock();
@@ -234,6 +305,49 @@ TEST(AMessage_tests, deliversDelayedMessagesInSequence) {
   nanosleep(&millis100, nullptr); // just enough time for the looper thread to run
 }
 
+class RecordingHandler : public AHandler {
+public:
+  std::vector<uint32_t> received;
+
+protected:
+  void onMessageReceived(const sp<AMessage> &msg) override {
+    received.push_back(msg->what());
+  }
+};
+
+TEST(AMessage_tests, deliversManyDelayedMessagesInOrder) {
+  sp<RecordingHandler> handler = new RecordingHandler;
+  sp<LooperWithSettableClock> looper = new LooperWithSettableClock();
+  looper->registerHandler(handler);
+
+  // several messages share each due time; those must keep their posting order
+  constexpr uint32_t kNumMessages = 200;
+  std::vector<std::pair<int64_t, uint32_t>> expected;
+  for (uint32_t i = 0; i < kNumMessages; ++i) {
+    int64_t delayUs = (i * 37) % 50;
+    (new AMessage(i, handler))->post(delayUs);
+    expected.emplace_back(delayUs, i);
+  }
+  // reschedule a unique message a few times, it must be delivered once
+  sp<AMessage> unique = new AMessage(kNumMessages, handler);
+  unique->postUnique(unique, 10);
+  unique->postUnique(unique, 45);
+  unique->postUnique(unique, 25);
+  expected.emplace_back(25, kNumMessages);
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  looper->setClockUs(50);
+  looper->start();
+  nanosleep(&millis100, nullptr); // just enough time for the looper thread to run
+  looper->stop();
+
+  ASSERT_EQ(expected.size(), handler->received.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i].second, handler->received[i]) << "at position " << i;
+  }
+}
+
 TEST(AMessage_tests, deliversDelayedUniqueMessage) {
   sp<NiceMock<MockHandler>> mockHandler = new NiceMock<MockHandler>;
   sp<LooperWithSettableClock> looper = new LooperWithSettableClock();
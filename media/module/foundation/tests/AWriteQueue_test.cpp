@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AWriteQueue_test"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/RefBase.h>
+
+#include <media/stagefright/foundation/AWriteQueue.h>
+
+using namespace android;
+
+// A fake disk: the write end of a pipe, drained by a thread that sleeps
+// |delayUs| for every |readSize| bytes it takes out, so that writes to the
+// descriptor block like writes to a slow or contended flash device.
+class SlowFd {
+public:
+    SlowFd(int64_t delayUs, size_t readSize)
+        : mDelayUs(delayUs),
+          mReadSize(readSize),
+          mBytesRead(0) {
+        int fds[2];
+        EXPECT_EQ(0, pipe(fds));
+        mReadFd = fds[0];
+        mWriteFd = fds[1];
+        // keep the pipe small so that it does not hide the latency
+        fcntl(mWriteFd, F_SETPIPE_SZ, 4096);
+        mThread = std::thread([this] {
+            std::vector<uint8_t> buf(mReadSize);
+            ssize_t n;
+            while ((n = read(mReadFd, buf.data(), buf.size())) > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(mDelayUs));
+                mData.insert(mData.end(), buf.data(), buf.data() + n);
+                mBytesRead += n;
+            }
+        });
+    }
+
+    ~SlowFd() {
+        closeWriteEnd();
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+        close(mReadFd);
+    }
+
+    int fd() const {
+        return mWriteFd;
+    }
+
+    // Bytes the fake disk may hold without them being read yet.
+    size_t capacity() const {
+        return fcntl(mWriteFd, F_GETPIPE_SZ) + mReadSize;
+    }
+
+    size_t bytesRead() const {
+        return mBytesRead;
+    }
+
+    // Closes the descriptor and waits for everything written to it.
+    const std::vector<uint8_t> &finish() {
+        closeWriteEnd();
+        mThread.join();
+        return mData;
+    }
+
+private:
+    const int64_t mDelayUs;
+    const size_t mReadSize;
+    int mReadFd;
+    int mWriteFd;
+    std::thread mThread;
+    std::vector<uint8_t> mData;
+    std::atomic<size_t> mBytesRead;
+
+    void closeWriteEnd() {
+        if (mWriteFd >= 0) {
+            close(mWriteFd);
+            mWriteFd = -1;
+        }
+    }
+};
+
+static std::vector<uint8_t> pattern(size_t size, uint8_t seed) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = (uint8_t)(seed + i * 31);
+    }
+    return data;
+}
+
+static int64_t elapsedUs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(AWriteQueue_test, WritesArriveInOrder) {
+    SlowFd disk(100 /* delayUs */, 1024 /* readSize */);
+    sp<AWriteQueue> queue = new AWriteQueue(disk.fd(), 64 * 1024);
+    ASSERT_EQ(OK, queue->start());
+
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < 200; ++i) {
+        // mix of small writes, which are coalesced, and writes larger than the bound
+        std::vector<uint8_t> data = pattern(i % 50 == 0 ? 100000 : 1 + i * 37 % 3000, i);
+        if (i % 3 == 0) {
+            size_t half = data.size() / 2;
+            struct iovec iov[2] = {
+                { data.data(), half },
+                { data.data() + half, data.size() - half },
+            };
+            ASSERT_EQ(OK, queue->writev(iov, 2));
+        } else {
+            ASSERT_EQ(OK, queue->write(data.data(), data.size()));
+        }
+        expected.insert(expected.end(), data.begin(), data.end());
+        ASSERT_EQ((off64_t)expected.size(), queue->tell());
+    }
+    ASSERT_EQ(OK, queue->stop());
+
+    AWriteQueue::Stats stats = queue->getStats();
+    EXPECT_EQ(expected.size(), stats.bytesWritten);
+    EXPECT_EQ(expected, disk.finish());
+}
+
+// Writes below the bound return without waiting for the disk.
+TEST(AWriteQueue_test, SlowDiskDoesNotBlockWriter) {
+    SlowFd disk(20000 /* delayUs */, 4096 /* readSize */);
+    sp<AWriteQueue> queue = new AWriteQueue(disk.fd(), 1024 * 1024);
+    ASSERT_EQ(OK, queue->start());
+
+    // The fake disk takes more than 2 seconds to take this in.
+    std::vector<uint8_t> data = pattern(4096, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 128; ++i) {
+        ASSERT_EQ(OK, queue->write(data.data(), data.size()));
+    }
+    EXPECT_LT(elapsedUs(start), 500000);
+    EXPECT_EQ(0u, queue->getStats().stalls);
+
+    ASSERT_EQ(OK, queue->stop());
+    EXPECT_EQ(128u * 4096, disk.finish().size());
+}
+
+// Once the bound is reached, writes wait for the disk, so memory use stays
+// bounded no matter how far behind the disk falls.
+TEST(AWriteQueue_test, PendingBytesAreBounded) {
+    constexpr size_t kMaxPendingBytes = 64 * 1024;
+    SlowFd disk(1000 /* delayUs */, 4096 /* readSize */);
+    sp<AWriteQueue> queue = new AWriteQueue(disk.fd(), kMaxPendingBytes);
+    ASSERT_EQ(OK, queue->start());
+
+    std::vector<uint8_t> data = pattern(16 * 1024, 0);
+    for (size_t i = 0; i < 64; ++i) {
+        ASSERT_EQ(OK, queue->write(data.data(), data.size()));
+        EXPECT_LE((size_t)queue->tell() - disk.bytesRead(), kMaxPendingBytes + disk.capacity());
+    }
+    AWriteQueue::Stats stats = queue->getStats();
+    EXPECT_GT(stats.stalls, 0u);
+    EXPECT_GT(stats.maxStallUs, 0);
+
+    ASSERT_EQ(OK, queue->stop());
+    EXPECT_EQ(64u * 16 * 1024, disk.finish().size());
+}
+
+TEST(AWriteQueue_test, FlushWritesQueuedData) {
+    FILE *file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    int fd = fileno(file);
+    std::vector<uint8_t> header = pattern(100, 1);
+    ASSERT_EQ((ssize_t)header.size(), write(fd, header.data(), header.size()));
+
+    sp<AWriteQueue> queue = new AWriteQueue(fd);
+    ASSERT_EQ(OK, queue->start());
+    std::vector<uint8_t> data = pattern(300000, 2);
+    ASSERT_EQ(OK, queue->write(data.data(), data.size()));
+    EXPECT_EQ((off64_t)(header.size() + data.size()), queue->tell());
+    ASSERT_EQ(OK, queue->flush());
+
+    // the owner may write to the descriptor itself after a flush
+    EXPECT_EQ((off64_t)(header.size() + data.size()), lseek64(fd, 0, SEEK_CUR));
+    std::vector<uint8_t> readBack(data.size());
+    ASSERT_EQ((ssize_t)data.size(), pread(fd, readBack.data(), readBack.size(), header.size()));
+    EXPECT_EQ(data, readBack);
+
+    ASSERT_EQ(OK, queue->stop());
+    fclose(file);
+}
+
+TEST(AWriteQueue_test, ErrorsAreSticky) {
+    signal(SIGPIPE, SIG_IGN);
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    close(fds[0]);
+
+    sp<AWriteQueue> queue = new AWriteQueue(fds[1]);
+    ASSERT_EQ(OK, queue->start());
+    uint8_t data[16] = {};
+    ASSERT_EQ(OK, queue->write(data, sizeof(data)));
+    EXPECT_EQ(-EPIPE, queue->flush());
+    EXPECT_EQ(-EPIPE, queue->write(data, sizeof(data)));
+    EXPECT_EQ(-EPIPE, queue->stop());
+    EXPECT_EQ(0u, queue->getStats().bytesWritten);
+    close(fds[1]);
+}
+
+TEST(AWriteQueue_test, WriteAfterStopFails) {
+    SlowFd disk(0 /* delayUs */, 4096 /* readSize */);
+    sp<AWriteQueue> queue = new AWriteQueue(disk.fd());
+    uint8_t data[16] = {};
+    EXPECT_NE(OK, queue->write(data, sizeof(data)));
+    ASSERT_EQ(OK, queue->start());
+    ASSERT_EQ(OK, queue->stop());
+    EXPECT_NE(OK, queue->write(data, sizeof(data)));
+    EXPECT_TRUE(disk.finish().empty());
+}
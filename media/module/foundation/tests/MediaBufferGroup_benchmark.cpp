@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include <media/stagefright/MediaBufferGroup.h>
+
+using namespace android;
+
+static constexpr size_t kNumBuffers = 8;
+static constexpr size_t kBufferSize = 8192;
+
+static std::unique_ptr<MediaBufferGroup> gGroup;
+
+// Threads acquire and release buffers of mixed sizes from a shared group, as
+// extractor and encoder sources do per sample. With more threads than
+// buffers, acquires block until another thread returns a buffer.
+static void BM_AcquireRelease(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        gGroup.reset(new MediaBufferGroup(kNumBuffers, kBufferSize, kNumBuffers));
+    }
+    const size_t sizes[] = {0, kBufferSize / 4, kBufferSize / 2, kBufferSize};
+    size_t i = state.thread_index();
+
+    for (auto _ : state) {
+        MediaBufferBase *buffer;
+        gGroup->acquire_buffer(&buffer, false /* nonBlocking */, sizes[i++ % 4]);
+        benchmark::DoNotOptimize(buffer->data());
+        buffer->release();
+    }
+
+    if (state.thread_index() == 0) {
+        MediaBufferGroup::WaitStats stats = gGroup->getWaitStats();
+        state.counters["waits"] = stats.waits;
+        state.counters["maxWaitUs"] = stats.maxWaitUs;
+        state.counters["avgWaitUs"] =
+                stats.waits == 0 ? 0 : (double)stats.totalWaitUs / stats.waits;
+        gGroup.reset();
+    }
+}
+
+BENCHMARK(BM_AcquireRelease)->ThreadRange(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
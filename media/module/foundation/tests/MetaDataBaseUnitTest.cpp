@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <fstream>
 #include <memory>
+#include <vector>
 
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaDataBase.h>
@@ -276,4 +277,39 @@ TEST_F(MetaDataBaseUnitTest, ConvertToStringTest) {
                                 << info.length();
 }
 
+TEST_F(MetaDataBaseUnitTest, CopyTest) {
+    std::unique_ptr<MetaDataBase> metaData(new MetaDataBase());
+    ASSERT_NE(metaData, nullptr) << "Failed to create meta data";
+
+    // values larger than the inline storage are shared between copies
+    std::vector<uint8_t> csd(100, 0xab);
+    metaData->setData(kKeyOpaqueCSD0, MetaDataBase::Type::TYPE_NONE, csd.data(), csd.size());
+    metaData->setInt64(kKeyDuration, kDurationUs);
+    metaData->setRect(kKeyCropRect, kLeft, kTop, kRight, kBottom);
+
+    MetaDataBase copy(*metaData);
+    metaData->setData(kKeyOpaqueCSD0, MetaDataBase::Type::TYPE_NONE, csd.data(), 10);
+    metaData->remove(kKeyDuration);
+
+    uint32_t type;
+    const void *data;
+    size_t size;
+    ASSERT_TRUE(copy.findData(kKeyOpaqueCSD0, &type, &data, &size)) << "Copied value not found";
+    ASSERT_EQ(size, csd.size()) << "Copied value changed with the original";
+    ASSERT_EQ(memcmp(data, csd.data(), size), 0) << "Copied value changed with the original";
+    int64_t duration;
+    ASSERT_TRUE(copy.findInt64(kKeyDuration, &duration)) << "Copied value removed with the original";
+    ASSERT_EQ(duration, kDurationUs);
+    int32_t left, top, right, bottom;
+    ASSERT_TRUE(copy.findRect(kKeyCropRect, &left, &top, &right, &bottom));
+    ASSERT_EQ(left, kLeft);
+    ASSERT_EQ(bottom, kBottom);
+
+    // assignment replaces all values
+    copy = *metaData;
+    ASSERT_FALSE(copy.hasData(kKeyDuration)) << "Removed value present after assignment";
+    ASSERT_TRUE(copy.findData(kKeyOpaqueCSD0, &type, &data, &size));
+    ASSERT_EQ(size, 10);
+}
+
 }  // namespace android
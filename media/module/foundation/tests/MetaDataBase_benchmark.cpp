@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <atomic>
+
+#include <benchmark/benchmark.h>
+
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferGroup.h>
+#include <media/stagefright/MetaDataBase.h>
+
+using namespace android;
+
+static std::atomic<size_t> gAllocations(0);
+
+void *operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if (p == nullptr) {
+        abort();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+// The metadata traffic of one extracted and muxed sample: the extractor
+// fills in the metadata of a recycled buffer, and the writer copies it.
+static void BM_SampleMetaData(benchmark::State& state) {
+    MediaBufferGroup group(4 /* growthLimit */);
+    MetaDataBase writerMeta;
+    int64_t timeUs = 0;
+    size_t allocations = 0;
+
+    for (auto _ : state) {
+        MediaBufferBase *buffer;
+        group.acquire_buffer(&buffer, false /* nonBlocking */, 1024 /* requestedSize */);
+
+        size_t before = gAllocations.load(std::memory_order_relaxed);
+        MetaDataBase &meta = buffer->meta_data();
+        meta.setInt64(kKeyTime, timeUs);
+        meta.setInt64(kKeyDuration, 33333);
+        meta.setInt32(kKeyIsSyncFrame, (timeUs % 30) == 0);
+        meta.setInt64(kKeySampleFileOffset, timeUs * 100);
+        writerMeta = meta;
+        int64_t value;
+        benchmark::DoNotOptimize(writerMeta.findInt64(kKeyTime, &value));
+        allocations += gAllocations.load(std::memory_order_relaxed) - before;
+
+        buffer->release();
+        ++timeUs;
+    }
+    state.counters["allocs/sample"] =
+            benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+// Copies of track formats, which carry codec specific data.
+static void BM_FormatCopy(benchmark::State& state) {
+    MetaDataBase format;
+    uint8_t csd[64] = {};
+    format.setCString(kKeyMIMEType, "video/avc");
+    format.setInt32(kKeyWidth, 1920);
+    format.setInt32(kKeyHeight, 1080);
+    format.setInt64(kKeyDuration, 60000000);
+    format.setData(kKeyAVCC, MetaDataBase::Type::TYPE_NONE, csd, sizeof(csd));
+    for (auto _ : state) {
+        MetaDataBase copy(format);
+        benchmark::DoNotOptimize(copy.hasData(kKeyAVCC));
+    }
+}
+
+BENCHMARK(BM_SampleMetaData);
+BENCHMARK(BM_FormatCopy);
+
+BENCHMARK_MAIN();
@@ -24,8 +24,97 @@
 #include <sys/prctl.h>
 #include <utils/AndroidThreads.h>
 
+#include <algorithm>
+
 namespace android {
 
+// Most samples written to the muxer between two checks of the writer state.
+static constexpr size_t kMaxSamplesPerBatch = 64;
+
+/**
+ * Unbounded single producer, single consumer queue of a track's samples. Samples are stored in
+ * fixed size blocks that are linked as the queue grows, so neither side ever waits for the other.
+ */
+class MediaSampleWriter::TrackQueue {
+public:
+    TrackQueue() : mTail(new Block), mHead(mTail), mHeadIndex(0) {}
+
+    ~TrackQueue() {
+        while (mHead != nullptr) {
+            Block* next = mHead->mNext.load(std::memory_order_relaxed);
+            delete mHead;
+            mHead = next;
+        }
+    }
+
+    // Producer side.
+    void push(const std::shared_ptr<MediaSample>& sample) {
+        size_t index = mTail->mWritten.load(std::memory_order_relaxed);
+        if (index == kBlockSize) {
+            Block* block = new Block;
+            mTail->mNext.store(block, std::memory_order_release);
+            mTail = block;
+            index = 0;
+        }
+        // Count the sample before publishing it, so that the counts never go below zero.
+        mPushedBytes.fetch_add(sample->info.size, std::memory_order_relaxed);
+        mPushed.fetch_add(1, std::memory_order_relaxed);
+        mTail->mSamples[index] = sample;
+        mTail->mWritten.store(index + 1, std::memory_order_release);
+    }
+
+    // Consumer side. Returns the oldest sample, or nullptr if the queue is empty.
+    MediaSample* front() {
+        if (mHeadIndex == kBlockSize) {
+            Block* next = mHead->mNext.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return nullptr;
+            }
+            delete mHead;
+            mHead = next;
+            mHeadIndex = 0;
+        }
+        if (mHeadIndex == mHead->mWritten.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return mHead->mSamples[mHeadIndex].get();
+    }
+
+    // Consumer side. Removes the sample returned by front().
+    std::shared_ptr<MediaSample> pop() {
+        std::shared_ptr<MediaSample> sample = std::move(mHead->mSamples[mHeadIndex++]);
+        mPoppedBytes += sample->info.size;
+        ++mPopped;
+        return sample;
+    }
+
+    // Consumer side. Samples and bytes that were pushed but not popped yet.
+    size_t queuedSamples() const { return mPushed.load(std::memory_order_relaxed) - mPopped; }
+    size_t queuedBytes() const {
+        return mPushedBytes.load(std::memory_order_relaxed) - mPoppedBytes;
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64;
+
+    struct Block {
+        std::shared_ptr<MediaSample> mSamples[kBlockSize];
+        std::atomic<size_t> mWritten = 0;
+        std::atomic<Block*> mNext = nullptr;
+    };
+
+    // Producer side.
+    Block* mTail;
+    std::atomic<uint64_t> mPushed = 0;
+    std::atomic<uint64_t> mPushedBytes = 0;
+
+    // Consumer side.
+    Block* mHead;
+    size_t mHeadIndex;
+    uint64_t mPopped = 0;
+    uint64_t mPoppedBytes = 0;
+};
+
 class DefaultMuxer : public MediaSampleWriterMuxerInterface {
 public:
     // MediaSampleWriterMuxerInterface
@@ -147,28 +236,45 @@ MediaSampleWriter::MediaSampleConsumerFunction MediaSampleWriter::addTrack(
         durationUs = 0;
     }
 
-    mTracks.emplace(trackIndex, durationUs);
-    std::shared_ptr<MediaSampleWriter> thisWriter = shared_from_this();
+    auto queue = std::make_shared<TrackQueue>();
+    mTracks.emplace(trackIndex, durationUs).first->second.mQueue = queue;
 
-    return [self = shared_from_this(), trackIndex](const std::shared_ptr<MediaSample>& sample) {
-        self->addSampleToTrack(trackIndex, sample);
+    return [self = shared_from_this(), queue](const std::shared_ptr<MediaSample>& sample) {
+        self->addSampleToTrack(queue.get(), sample);
     };
 }
 
-void MediaSampleWriter::addSampleToTrack(size_t trackIndex,
+void MediaSampleWriter::addSampleToTrack(TrackQueue* queue,
                                          const std::shared_ptr<MediaSample>& sample) {
     if (sample == nullptr) return;
 
-    bool wasEmpty;
-    {
-        std::scoped_lock lock(mMutex);
-        wasEmpty = mSampleQueue.empty();
-        mSampleQueue.push(std::make_pair(trackIndex, sample));
-    }
+    queue->push(sample);
 
-    if (wasEmpty) {
+    // Pairs with the fence in runWriterLoop(): either the writer thread sees the sample before
+    // it waits, or this sees that the writer thread waits.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWriterWaiting.load(std::memory_order_relaxed)) {
+        // The writer thread holds the lock until it waits, so it cannot miss the signal.
+        { std::scoped_lock lock(mMutex); }
         mSampleSignal.notify_one();
+        mProducerSignals.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool MediaSampleWriter::hasQueuedSamples() {
+    for (auto& [trackIndex, track] : mTracks) {
+        if (track.mQueue->front() != nullptr) {
+            return true;
+        }
     }
+    return false;
+}
+
+MediaSampleWriter::Stats MediaSampleWriter::getStats() {
+    std::scoped_lock lock(mMutex);
+    Stats stats = mStats;
+    stats.producerSignals = mProducerSignals.load(std::memory_order_relaxed);
+    return stats;
 }
 
 bool MediaSampleWriter::start() {
@@ -250,6 +356,13 @@ media_status_t MediaSampleWriter::runWriterLoop(bool* wasStopped) NO_THREAD_SAFE
         }
     }
 
+    // Tracks in index order, which breaks timestamp ties.
+    std::vector<std::pair<size_t, TrackRecord*>> tracks;
+    for (auto& [trackIndex, track] : mTracks) {
+        tracks.emplace_back(trackIndex, &track);
+    }
+    std::sort(tracks.begin(), tracks.end());
+
     std::chrono::microseconds updateInterval(mHeartBeatIntervalUs);
     std::chrono::steady_clock::time_point nextUpdateTime =
             std::chrono::steady_clock::now() + updateInterval;
@@ -259,11 +372,14 @@ media_status_t MediaSampleWriter::runWriterLoop(bool* wasStopped) NO_THREAD_SAFE
             break;
         }
 
-        size_t trackIndex;
-        std::shared_ptr<MediaSample> sample;
         {
             std::unique_lock lock(mMutex);
-            while (mSampleQueue.empty() && mState == STARTED) {
+            // Pairs with the fence in addSampleToTrack().
+            mWriterWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool waited = false;
+            while (!hasQueuedSamples() && mState == STARTED) {
+                waited = true;
                 if (mHeartBeatIntervalUs <= 0) {
                     mSampleSignal.wait(lock);
                     continue;
@@ -280,70 +396,109 @@ media_status_t MediaSampleWriter::runWriterLoop(bool* wasStopped) NO_THREAD_SAFE
                     nextUpdateTime += updateInterval;
                 }
             }
+            mWriterWaiting.store(false, std::memory_order_relaxed);
 
             if (mState == STOPPED) {
                 *wasStopped = true;
                 return AMEDIA_OK;
             }
 
-            auto& topEntry = mSampleQueue.top();
-            trackIndex = topEntry.first;
-            sample = topEntry.second;
-            mSampleQueue.pop();
+            // Account for the samples that piled up since the last batch.
+            for (const auto& [trackIndex, track] : tracks) {
+                mStats.maxQueuedSamples =
+                        std::max(mStats.maxQueuedSamples, track->mQueue->queuedSamples());
+                mStats.maxQueuedBytes =
+                        std::max(mStats.maxQueuedBytes, track->mQueue->queuedBytes());
+            }
+            mStats.writerWaits += waited;
+            ++mStats.batches;
         }
 
-        TrackRecord& track = mTracks[trackIndex];
-
-        if (sample->info.flags & SAMPLE_FLAG_END_OF_STREAM) {
-            if (track.mReachedEos) {
-                continue;
+        // Write out what is queued without taking the lock, picking the track whose next sample
+        // goes first each time.
+        size_t samplesWritten = 0;
+        size_t bytesWritten = 0;
+        while (samplesWritten < kMaxSamplesPerBatch && trackEosCount < mTracks.size()) {
+            TrackRecord* nextTrack = nullptr;
+            SampleEntry nextEntry;
+            SampleComparator comparator;
+            for (const auto& [trackIndex, track] : tracks) {
+                const MediaSample* head = track->mQueue->front();
+                if (head == nullptr) {
+                    continue;
+                }
+                SampleEntry entry(trackIndex, head);
+                if (nextTrack == nullptr || comparator(nextEntry, entry)) {
+                    nextTrack = track;
+                    nextEntry = entry;
+                }
+            }
+            if (nextTrack == nullptr) {
+                break;
             }
 
-            // Track reached end of stream.
-            track.mReachedEos = true;
-            trackEosCount++;
+            const size_t trackIndex = nextEntry.first;
+            TrackRecord& track = *nextTrack;
+            std::shared_ptr<MediaSample> sample = track.mQueue->pop();
 
-            // Preserve source track duration by setting the appropriate timestamp on the
-            // empty End-Of-Stream sample.
-            if (track.mDurationUs > 0 && track.mFirstSampleTimeSet) {
-                sample->info.presentationTimeUs = track.mDurationUs + track.mFirstSampleTimeUs;
-            }
-        }
+            if (sample->info.flags & SAMPLE_FLAG_END_OF_STREAM) {
+                if (track.mReachedEos) {
+                    continue;
+                }
 
-        track.mPrevSampleTimeUs = sample->info.presentationTimeUs;
-        if (!track.mFirstSampleTimeSet) {
-            // Record the first sample's timestamp in order to translate duration to EOS
-            // time for tracks that does not start at 0.
-            track.mFirstSampleTimeUs = sample->info.presentationTimeUs;
-            track.mFirstSampleTimeSet = true;
-        }
+                // Track reached end of stream.
+                track.mReachedEos = true;
+                trackEosCount++;
 
-        bufferInfo.offset = sample->dataOffset;
-        bufferInfo.size = sample->info.size;
-        bufferInfo.flags = sample->info.flags;
-        bufferInfo.presentationTimeUs = sample->info.presentationTimeUs;
+                // Preserve source track duration by setting the appropriate timestamp on the
+                // empty End-Of-Stream sample.
+                if (track.mDurationUs > 0 && track.mFirstSampleTimeSet) {
+                    sample->info.presentationTimeUs = track.mDurationUs + track.mFirstSampleTimeUs;
+                }
+            }
 
-        media_status_t status = mMuxer->writeSampleData(trackIndex, sample->buffer, &bufferInfo);
-        if (status != AMEDIA_OK) {
-            LOG(ERROR) << "writeSampleData returned " << status;
-            return status;
-        }
-        sample.reset();
+            track.mPrevSampleTimeUs = sample->info.presentationTimeUs;
+            if (!track.mFirstSampleTimeSet) {
+                // Record the first sample's timestamp in order to translate duration to EOS
+                // time for tracks that does not start at 0.
+                track.mFirstSampleTimeUs = sample->info.presentationTimeUs;
+                track.mFirstSampleTimeSet = true;
+            }
 
-        // TODO(lnilsson): Add option to toggle progress reporting on/off.
-        if (trackIndex == primaryTrackIndex) {
-            const int64_t elapsed = track.mPrevSampleTimeUs - track.mFirstSampleTimeUs;
-            int32_t progress = (elapsed * 100) / track.mDurationUs;
-            progress = std::clamp(progress, 0, 100);
+            bufferInfo.offset = sample->dataOffset;
+            bufferInfo.size = sample->info.size;
+            bufferInfo.flags = sample->info.flags;
+            bufferInfo.presentationTimeUs = sample->info.presentationTimeUs;
 
-            if (progress > lastProgressUpdate) {
-                if (auto callbacks = mCallbacks.lock()) {
-                    callbacks->onProgressUpdate(this, progress);
+            media_status_t status =
+                    mMuxer->writeSampleData(trackIndex, sample->buffer, &bufferInfo);
+            if (status != AMEDIA_OK) {
+                LOG(ERROR) << "writeSampleData returned " << status;
+                return status;
+            }
+            sample.reset();
+            ++samplesWritten;
+            bytesWritten += bufferInfo.size;
+
+            // TODO(lnilsson): Add option to toggle progress reporting on/off.
+            if (trackIndex == primaryTrackIndex) {
+                const int64_t elapsed = track.mPrevSampleTimeUs - track.mFirstSampleTimeUs;
+                int32_t progress = (elapsed * 100) / track.mDurationUs;
+                progress = std::clamp(progress, 0, 100);
+
+                if (progress > lastProgressUpdate) {
+                    if (auto callbacks = mCallbacks.lock()) {
+                        callbacks->onProgressUpdate(this, progress);
+                    }
+                    lastProgressUpdate = progress;
                 }
-                lastProgressUpdate = progress;
             }
+            progressSinceLastReport = true;
         }
-        progressSinceLastReport = true;
+
+        std::scoped_lock lock(mMutex);
+        mStats.samplesWritten += samplesWritten;
+        mStats.bytesWritten += bytesWritten;
     }
 
     return AMEDIA_OK;
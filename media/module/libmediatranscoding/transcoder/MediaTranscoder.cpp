@@ -18,6 +18,7 @@
 #define LOG_TAG "MediaTranscoder"
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <fcntl.h>
 #include <media/MediaSampleReaderNDK.h>
 #include <media/MediaSampleWriter.h>
@@ -30,6 +31,10 @@
 
 namespace android {
 
+// Whether video tracks are transcoded in pipelined mode, see VideoTrackTranscoder.
+static const bool kPipelinedVideoTranscoding =
+        base::GetBoolProperty("debug.media.transcoding.video_pipelined", false);
+
 static std::shared_ptr<AMediaFormat> createVideoTrackFormat(AMediaFormat* srcFormat,
                                                             AMediaFormat* options) {
     if (srcFormat == nullptr || options == nullptr) {
@@ -333,7 +338,8 @@ media_status_t MediaTranscoder::configureTrackFormat(size_t trackIndex,
             }
         }
 
-        transcoder = VideoTrackTranscoder::create(shared_from_this(), mPid, mUid);
+        transcoder = VideoTrackTranscoder::create(shared_from_this(), mPid, mUid,
+                                                  kPipelinedVideoTranscoding);
 
         trackFormat = createVideoTrackFormat(srcTrackFormat, destinationOptions);
         if (trackFormat == nullptr) {
@@ -469,6 +475,13 @@ media_status_t MediaTranscoder::cancel() {
     return AMEDIA_OK;
 }
 
+MediaSampleWriter::Stats MediaTranscoder::getSampleWriterStats() const {
+    if (mSampleWriter == nullptr) {
+        return {};
+    }
+    return mSampleWriter->getStats();
+}
+
 media_status_t MediaTranscoder::resume() {
     // TODO: restore internal states from parcel.
     return start();
@@ -52,6 +52,8 @@ static constexpr int32_t kDefaultBitrateMbps = 10 * 1000 * 1000;
 static constexpr int32_t kDefaultFrameRate = 30;
 // Default codec complexity
 static constexpr int32_t kDefaultCodecComplexity = 1;
+// Most source samples the input thread reads ahead of the decoder in pipelined mode.
+static constexpr size_t kMaxInputReadAheadSamples = 8;
 
 template <typename T>
 void VideoTrackTranscoder::BlockingQueue<T>::push(T const& value, bool front) {
@@ -121,8 +123,12 @@ struct AsyncCodecCallbackDispatch {
                 static_cast<VideoTrackTranscoder::CodecWrapper*>(userdata);
         if (auto transcoder = wrapper->getTranscoder()) {
             if (codec == transcoder->mDecoder) {
-                transcoder->mCodecMessageQueue.push(
-                        [transcoder, index] { transcoder->enqueueInputSample(index); });
+                if (transcoder->mPipelined) {
+                    transcoder->pushInputBuffer(index);
+                } else {
+                    transcoder->mCodecMessageQueue.push(
+                            [transcoder, index] { transcoder->enqueueInputSample(index); });
+                }
             }
         }
     }
@@ -172,9 +178,9 @@ struct AsyncCodecCallbackDispatch {
 // static
 std::shared_ptr<VideoTrackTranscoder> VideoTrackTranscoder::create(
         const std::weak_ptr<MediaTrackTranscoderCallback>& transcoderCallback, pid_t pid,
-        uid_t uid) {
+        uid_t uid, bool pipelined) {
     return std::shared_ptr<VideoTrackTranscoder>(
-            new VideoTrackTranscoder(transcoderCallback, pid, uid));
+            new VideoTrackTranscoder(transcoderCallback, pid, uid, pipelined));
 }
 
 VideoTrackTranscoder::~VideoTrackTranscoder() {
@@ -450,6 +456,132 @@ void VideoTrackTranscoder::enqueueInputSample(int32_t bufferIndex) {
     }
 }
 
+void VideoTrackTranscoder::pushInputBuffer(int32_t bufferIndex) {
+    {
+        std::scoped_lock lock(mInputMutex);
+        if (mInputAborted) {
+            return;
+        }
+        mInputBufferIndices.push_back(bufferIndex);
+    }
+    mInputCondition.notify_one();
+}
+
+void VideoTrackTranscoder::abortInputLoop() {
+    {
+        std::scoped_lock lock(mInputMutex);
+        mInputAborted = true;
+        mInputBufferIndices.clear();
+    }
+    mInputCondition.notify_one();
+}
+
+media_status_t VideoTrackTranscoder::readInputSample(InputSample* sample) {
+    media_status_t status = mMediaSampleReader->getSampleInfoForTrack(mTrackIndex, &sample->info);
+    if (status == AMEDIA_ERROR_END_OF_STREAM) {
+        sample->endOfStream = true;
+        return AMEDIA_OK;
+    } else if (status != AMEDIA_OK) {
+        LOG(ERROR) << "Error getting next sample info: " << status;
+        return status;
+    }
+
+    // Buffers are reused, so this only allocates while the samples keep growing.
+    sample->endOfStream = false;
+    sample->data.resize(sample->info.size);
+    status = mMediaSampleReader->readSampleDataForTrack(mTrackIndex, sample->data.data(),
+                                                        sample->info.size);
+    if (status != AMEDIA_OK) {
+        LOG(ERROR) << "Unable to read next sample data. Aborting transcode.";
+    }
+    return status;
+}
+
+media_status_t VideoTrackTranscoder::queueInputSample(int32_t bufferIndex,
+                                                      const InputSample& sample) {
+    if (!sample.endOfStream) {
+        size_t bufferSize = 0;
+        uint8_t* sourceBuffer = AMediaCodec_getInputBuffer(mDecoder, bufferIndex, &bufferSize);
+        if (sourceBuffer == nullptr) {
+            LOG(ERROR) << "Decoder returned a NULL input buffer.";
+            return AMEDIA_ERROR_UNKNOWN;
+        } else if (bufferSize < sample.info.size) {
+            LOG(ERROR) << "Decoder returned an input buffer that is smaller than the sample.";
+            return AMEDIA_ERROR_UNKNOWN;
+        }
+        memcpy(sourceBuffer, sample.data.data(), sample.info.size);
+
+        if (sample.info.size) {
+            ++mInputFrameCount;
+        }
+    } else {
+        LOG(DEBUG) << "EOS from source.";
+    }
+
+    media_status_t status =
+            AMediaCodec_queueInputBuffer(mDecoder, bufferIndex, 0, sample.info.size,
+                                         sample.info.presentationTimeUs, sample.info.flags);
+    if (status != AMEDIA_OK) {
+        LOG(ERROR) << "Unable to queue input buffer for decode: " << status;
+    }
+    return status;
+}
+
+void VideoTrackTranscoder::runInputLoop() NO_THREAD_SAFETY_ANALYSIS {
+    prctl(PR_SET_NAME, (unsigned long)"VideInputTrd", 0, 0, 0);
+
+    std::deque<InputSample> readAhead;
+    std::vector<InputSample> freeSamples;
+    bool endOfStreamRead = false;
+
+    while (true) {
+        int32_t bufferIndex = -1;
+        {
+            std::unique_lock lock(mInputMutex);
+            while (!mInputAborted && mInputBufferIndices.empty() &&
+                   (endOfStreamRead || readAhead.size() >= kMaxInputReadAheadSamples)) {
+                mInputCondition.wait(lock);
+            }
+            if (mInputAborted) {
+                return;
+            }
+            if (!mInputBufferIndices.empty()) {
+                bufferIndex = mInputBufferIndices.front();
+                mInputBufferIndices.pop_front();
+            }
+        }
+
+        // Read the next sample while the decoder has no buffer for it, or when it needs one now.
+        media_status_t status = AMEDIA_OK;
+        if (readAhead.empty() || bufferIndex < 0) {
+            readAhead.emplace_back();
+            if (!freeSamples.empty()) {
+                readAhead.back() = std::move(freeSamples.back());
+                freeSamples.pop_back();
+            }
+            status = readInputSample(&readAhead.back());
+            endOfStreamRead = readAhead.back().endOfStream;
+        }
+
+        if (status == AMEDIA_OK && bufferIndex >= 0) {
+            status = queueInputSample(bufferIndex, readAhead.front());
+            if (status == AMEDIA_OK) {
+                if (readAhead.front().endOfStream) {
+                    return;
+                }
+                freeSamples.push_back(std::move(readAhead.front()));
+                readAhead.pop_front();
+            }
+        }
+
+        if (status != AMEDIA_OK) {
+            // Report the error on the transcoding thread, which owns the status.
+            mCodecMessageQueue.push([this, status] { mStatus = status; }, true /* front */);
+            return;
+        }
+    }
+}
+
 void VideoTrackTranscoder::transferBuffer(int32_t bufferIndex, AMediaCodecBufferInfo bufferInfo) {
     if (bufferIndex >= 0) {
         bool needsRender = bufferInfo.size > 0;
@@ -597,6 +729,10 @@ void VideoTrackTranscoder::updateTrackFormat(AMediaFormat* outputFormat, bool fr
 media_status_t VideoTrackTranscoder::runTranscodeLoop(bool* stopped) {
     prctl(PR_SET_NAME, (unsigned long)"VideTranscodTrd", 0, 0, 0);
 
+    if (mPipelined) {
+        mInputThread = std::thread(&VideoTrackTranscoder::runInputLoop, this);
+    }
+
     // Push start decoder and encoder as two messages, so that these are subject to the
     // stop request as well. If the session is cancelled (or paused) immediately after start,
     // we don't need to waste time start then stop the codecs.
@@ -628,6 +764,11 @@ media_status_t VideoTrackTranscoder::runTranscodeLoop(bool* stopped) {
     }
 
     mCodecMessageQueue.abort();
+    if (mInputThread.joinable()) {
+        // The input thread uses the decoder, so it has to be done before the decoder is stopped.
+        abortInputLoop();
+        mInputThread.join();
+    }
     AMediaCodec_stop(mDecoder);
 
     // Signal if transcoding was stopped before it finished.
@@ -642,6 +783,9 @@ void VideoTrackTranscoder::abortTranscodeLoop() {
     if (mStopRequest == STOP_NOW) {
         // Wake up transcoder thread.
         mCodecMessageQueue.push([] {}, true /* front */);
+        if (mPipelined) {
+            abortInputLoop();
+        }
     }
 }
 
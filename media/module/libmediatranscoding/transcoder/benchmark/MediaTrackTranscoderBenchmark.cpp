@@ -344,7 +344,8 @@ static bool ConfigureSampleReader(const std::shared_ptr<MediaTrackTranscoder>& t
 
 static void BenchmarkTranscoder(benchmark::State& state, const std::string& srcFileName,
                                 bool mockReader, MediaType mediaType,
-                                const TrackFormatEditCallback& formatEditor = nullptr) {
+                                const TrackFormatEditCallback& formatEditor = nullptr,
+                                bool pipelined = false) {
     static pthread_once_t once = PTHREAD_ONCE_INIT;
     pthread_once(&once, ABinderProcess_startThreadPool);
 
@@ -354,7 +355,8 @@ static void BenchmarkTranscoder(benchmark::State& state, const std::string& srcF
         std::shared_ptr<MediaTrackTranscoder> transcoder;
 
         if (mediaType == kVideo) {
-            transcoder = VideoTrackTranscoder::create(callbacks);
+            transcoder = VideoTrackTranscoder::create(callbacks, AMEDIACODEC_CALLING_PID,
+                                                      AMEDIACODEC_CALLING_UID, pipelined);
         } else {
             transcoder = std::make_shared<PassthroughTrackTranscoder>(callbacks);
         }
@@ -393,7 +395,7 @@ static void BenchmarkTranscoder(benchmark::State& state, const std::string& srcF
 
 static void BenchmarkTranscoderWithOperatingRate(benchmark::State& state,
                                                  const std::string& srcFile, bool mockReader,
-                                                 MediaType mediaType) {
+                                                 MediaType mediaType, bool pipelined = false) {
     TrackFormatEditCallback editor;
     const int32_t operatingRate = state.range(0);
     const int32_t priority = state.range(1);
@@ -404,7 +406,7 @@ static void BenchmarkTranscoderWithOperatingRate(benchmark::State& state,
             AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_PRIORITY, priority);
         };
     }
-    BenchmarkTranscoder(state, srcFile, mockReader, mediaType, editor);
+    BenchmarkTranscoder(state, srcFile, mockReader, mediaType, editor, pipelined);
 }
 
 //-------------------------------- AVC to AVC Benchmarks -------------------------------------------
@@ -419,6 +421,12 @@ static void BM_VideoTranscode_AVC2AVC_NoExtractor(benchmark::State& state) {
     BenchmarkTranscoderWithOperatingRate(state, srcFile, true /* mockReader */, kVideo);
 }
 
+static void BM_VideoTranscode_AVC2AVC_Pipelined(benchmark::State& state) {
+    const char* srcFile = "video_1920x1080_3648frame_h264_22Mbps_30fps_aac.mp4";
+    BenchmarkTranscoderWithOperatingRate(state, srcFile, false /* mockReader */, kVideo,
+                                         true /* pipelined */);
+}
+
 //-------------------------------- HEVC to AVC Benchmarks ------------------------------------------
 
 static void BM_VideoTranscode_HEVC2AVC(benchmark::State& state) {
@@ -431,6 +439,27 @@ static void BM_VideoTranscode_HEVC2AVC_NoExtractor(benchmark::State& state) {
     BenchmarkTranscoderWithOperatingRate(state, srcFile, true /* mockReader */, kVideo);
 }
 
+static void BM_VideoTranscode_HEVC2AVC_Pipelined(benchmark::State& state) {
+    const char* srcFile = "video_1920x1080_3863frame_hevc_4Mbps_30fps_aac.mp4";
+    BenchmarkTranscoderWithOperatingRate(state, srcFile, false /* mockReader */, kVideo,
+                                         true /* pipelined */);
+}
+
+//-------------------------------- 4K HEVC to AVC Benchmarks ---------------------------------------
+// Reading and decoding the large 4K samples take long enough for the input thread of the
+// pipelined mode to make a difference in wall clock time. Compare the real time of the two runs.
+
+static void BM_VideoTranscode_4K_HEVC2AVC(benchmark::State& state) {
+    const char* srcFile = "tx_bm_3840_2160_30fps_hevc_42Mbps.mp4";
+    BenchmarkTranscoder(state, srcFile, false /* mockReader */, kVideo);
+}
+
+static void BM_VideoTranscode_4K_HEVC2AVC_Pipelined(benchmark::State& state) {
+    const char* srcFile = "tx_bm_3840_2160_30fps_hevc_42Mbps.mp4";
+    BenchmarkTranscoder(state, srcFile, false /* mockReader */, kVideo,
+                        nullptr /* formatEditor */, true /* pipelined */);
+}
+
 //-------------------------------- Benchmark Registration ------------------------------------------
 
 // Benchmark registration wrapper for transcoding.
@@ -448,8 +477,13 @@ static void BM_VideoTranscode_HEVC2AVC_NoExtractor(benchmark::State& state) {
 
 TRANSCODER_OPERATING_RATE_BENCHMARK(BM_VideoTranscode_AVC2AVC);
 TRANSCODER_OPERATING_RATE_BENCHMARK(BM_VideoTranscode_AVC2AVC_NoExtractor);
+TRANSCODER_OPERATING_RATE_BENCHMARK(BM_VideoTranscode_AVC2AVC_Pipelined);
 
 TRANSCODER_OPERATING_RATE_BENCHMARK(BM_VideoTranscode_HEVC2AVC);
 TRANSCODER_OPERATING_RATE_BENCHMARK(BM_VideoTranscode_HEVC2AVC_NoExtractor);
+TRANSCODER_OPERATING_RATE_BENCHMARK(BM_VideoTranscode_HEVC2AVC_Pipelined);
+
+TRANSCODER_BENCHMARK(BM_VideoTranscode_4K_HEVC2AVC);
+TRANSCODER_BENCHMARK(BM_VideoTranscode_4K_HEVC2AVC_Pipelined);
 
 BENCHMARK_MAIN();
@@ -35,6 +35,7 @@
 #include <media/MediaTranscoder.h>
 #include <media/NdkCommon.h>
 
+#include <algorithm>
 #include <iostream>
 
 #include "BenchmarkCommon.h"
@@ -42,6 +43,13 @@
 using namespace android;
 
 const std::string PARAM_VIDEO_FRAME_RATE = "VideoFrameRate";
+// Sample writer counters, see MediaSampleWriter::Stats.
+const std::string PARAM_WRITER_SAMPLE_RATE = "WriterSampleRate";
+const std::string PARAM_WRITER_BYTE_RATE = "WriterByteRate";
+const std::string PARAM_WRITER_WAITS = "WriterWaits";
+const std::string PARAM_WRITER_PRODUCER_SIGNALS = "WriterProducerSignals";
+const std::string PARAM_WRITER_MAX_QUEUED_SAMPLES = "WriterMaxQueuedSamples";
+const std::string PARAM_WRITER_MAX_QUEUED_BYTES = "WriterMaxQueuedBytes";
 
 class TranscoderCallbacks : public MediaTranscoder::CallbackInterface {
 public:
@@ -131,6 +139,9 @@ static void TranscodeMediaFile(benchmark::State& state, const std::string& srcFi
 
     media_status_t status = AMEDIA_OK;
 
+    // Sample writer counters, summed over all iterations.
+    MediaSampleWriter::Stats writerStats;
+
     if ((srcFd = open(srcPath.c_str(), O_RDONLY)) < 0) {
         state.SkipWithError("Unable to open source file: " + srcPath);
         goto exit;
@@ -223,8 +234,30 @@ static void TranscodeMediaFile(benchmark::State& state, const std::string& srcFi
             state.SkipWithError("Transcoder error when running");
             goto exit;
         }
+
+        const MediaSampleWriter::Stats stats = transcoder->getSampleWriterStats();
+        writerStats.samplesWritten += stats.samplesWritten;
+        writerStats.bytesWritten += stats.bytesWritten;
+        writerStats.writerWaits += stats.writerWaits;
+        writerStats.producerSignals += stats.producerSignals;
+        writerStats.maxQueuedSamples = std::max(writerStats.maxQueuedSamples,
+                                                stats.maxQueuedSamples);
+        writerStats.maxQueuedBytes = std::max(writerStats.maxQueuedBytes, stats.maxQueuedBytes);
     }
 
+    // Report how fast the sample writer drained its queues and how often the writer thread and
+    // the track transcoders had to wait for each other.
+    state.counters[PARAM_WRITER_SAMPLE_RATE] =
+            benchmark::Counter(writerStats.samplesWritten, benchmark::Counter::kIsRate);
+    state.counters[PARAM_WRITER_BYTE_RATE] =
+            benchmark::Counter(writerStats.bytesWritten, benchmark::Counter::kIsRate);
+    state.counters[PARAM_WRITER_WAITS] =
+            benchmark::Counter(writerStats.writerWaits, benchmark::Counter::kAvgIterations);
+    state.counters[PARAM_WRITER_PRODUCER_SIGNALS] =
+            benchmark::Counter(writerStats.producerSignals, benchmark::Counter::kAvgIterations);
+    state.counters[PARAM_WRITER_MAX_QUEUED_SAMPLES] = writerStats.maxQueuedSamples;
+    state.counters[PARAM_WRITER_MAX_QUEUED_BYTES] = writerStats.maxQueuedBytes;
+
     // Set transcoding configuration params in benchmark label
     state.SetLabel(srcFileName + "," +
                    std::to_string(width) + "x" + std::to_string(height) + "," +
@@ -527,6 +560,12 @@ static void BM_3840x2160_Hevc42Mbps2Avc20Mbps(benchmark::State& state) {
                        });
 }
 
+static void BM_3840x2160_Hevc42Mbps2HevcPassthrough(benchmark::State& state) {
+    TranscodeMediaFile(state, "tx_bm_3840_2160_30fps_hevc_42Mbps.mp4",
+                       "tx_bm_3840_2160_30fps_hevc_42Mbps_passthrough_V.mp4",
+                       false /* includeAudio */, false /* transcodeVideo */);
+}
+
 //-------------------------------- Benchmark Registration ------------------------------------------
 
 // Benchmark registration wrapper for transcoding.
@@ -573,6 +612,7 @@ TRANSCODER_BENCHMARK(BM_1080x1920_Avc15Mbps2Avc8Mbps);
 TRANSCODER_BENCHMARK(BM_720x1280_Avc10Mbps2Avc4Mbps);
 
 TRANSCODER_BENCHMARK(BM_3840x2160_Hevc42Mbps2Avc20Mbps);
+TRANSCODER_BENCHMARK(BM_3840x2160_Hevc42Mbps2HevcPassthrough);
 
 class CustomCsvReporter : public benchmark::BenchmarkReporter {
 public:
@@ -589,6 +629,12 @@ private:
         "IncludeAudio",  "TranscodeVideo", "TargetMime", "TargetBirate(bps)",
         "real_time(ms)", "cpu_time(ms)",   PARAM_VIDEO_FRAME_RATE
     };
+    // Counters printed after the frame rate, in this order.
+    std::vector<std::string> mCounters = {
+        PARAM_WRITER_SAMPLE_RATE, PARAM_WRITER_BYTE_RATE, PARAM_WRITER_WAITS,
+        PARAM_WRITER_PRODUCER_SIGNALS, PARAM_WRITER_MAX_QUEUED_SAMPLES,
+        PARAM_WRITER_MAX_QUEUED_BYTES
+    };
 };
 
 bool CustomCsvReporter::ReportContext(const Context& context __unused) {
@@ -604,6 +650,9 @@ void CustomCsvReporter::ReportRuns(const std::vector<Run>& reports) {
             Out << *header++;
             if (header != mHeaders.end()) Out << ",";
         }
+        for (const auto& counter : mCounters) {
+            Out << "," << counter;
+        }
         Out << "\n";
         mPrintedHeader = true;
     }
@@ -630,6 +679,15 @@ void CustomCsvReporter::PrintRunData(const Run& run) {
     } else {
         Out << frameRate->second << ",";
     }
+    for (const auto& name : mCounters) {
+        auto counter = run.counters.find(name);
+        if (counter == run.counters.end()) {
+            Out << "NA"
+                << ",";
+        } else {
+            Out << counter->second << ",";
+        }
+    }
     Out << '\n';
 }
 
@@ -23,13 +23,14 @@
 #include <media/NdkMediaFormat.h>
 #include <utils/Mutex.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 
@@ -64,14 +65,17 @@ public:
 };
 
 /**
- * MediaSampleWriter is a wrapper around a muxer. The sample writer puts samples on a queue that
- * is serviced by an internal thread to minimize blocking time for clients. MediaSampleWriter also
- * provides progress reporting. The default muxer interface implementation is based
- * directly on AMediaMuxer.
+ * MediaSampleWriter is a wrapper around a muxer. The sample writer puts samples on per-track
+ * queues that are serviced by an internal thread to minimize blocking time for clients. The
+ * internal thread merges the tracks in timestamp order. MediaSampleWriter also provides progress
+ * reporting. The default muxer interface implementation is based directly on AMediaMuxer.
  */
 class MediaSampleWriter : public std::enable_shared_from_this<MediaSampleWriter> {
 public:
-    /** Function prototype for delivering media samples to the writer. */
+    /**
+     * Function prototype for delivering media samples to the writer. The consumer of a track
+     * must not be called concurrently from multiple threads.
+     */
     using MediaSampleConsumerFunction =
             std::function<void(const std::shared_ptr<MediaSample>& sample)>;
 
@@ -151,10 +155,30 @@ public:
      */
     void stop();
 
+    /** Sample queue counters, for dumps and benchmarks. */
+    struct Stats {
+        uint64_t samplesWritten = 0;
+        uint64_t bytesWritten = 0;
+        // Times the writer thread woke up and found samples to write.
+        uint64_t batches = 0;
+        // Times the writer thread ran out of samples and had to wait.
+        uint64_t writerWaits = 0;
+        // Samples whose producer had to wake up the writer thread.
+        uint64_t producerSignals = 0;
+        // Most samples and bytes seen queued on a single track.
+        size_t maxQueuedSamples = 0;
+        size_t maxQueuedBytes = 0;
+    };
+
+    /** Returns the sample queue counters. */
+    Stats getStats();
+
     /** Destructor. */
     ~MediaSampleWriter();
 
 private:
+    class TrackQueue;
+
     struct TrackRecord {
         TrackRecord(int64_t durationUs)
               : mDurationUs(durationUs),
@@ -170,13 +194,14 @@ private:
         int64_t mPrevSampleTimeUs;
         bool mFirstSampleTimeSet;
         bool mReachedEos;
+        std::shared_ptr<TrackQueue> mQueue;
     };
 
-    // Track index and sample.
-    using SampleEntry = std::pair<size_t, std::shared_ptr<MediaSample>>;
+    // Track index and the next sample queued on the track.
+    using SampleEntry = std::pair<size_t, const MediaSample*>;
 
     struct SampleComparator {
-        // Return true if lhs should come after rhs in the sample queue.
+        // Return true if lhs should be written after rhs.
         bool operator()(const SampleEntry& lhs, const SampleEntry& rhs) {
             const bool lhsEos = lhs.second->info.flags & SAMPLE_FLAG_END_OF_STREAM;
             const bool rhsEos = rhs.second->info.flags & SAMPLE_FLAG_END_OF_STREAM;
@@ -197,11 +222,14 @@ private:
     std::shared_ptr<MediaSampleWriterMuxerInterface> mMuxer;
     int64_t mHeartBeatIntervalUs;
 
-    std::mutex mMutex;  // Protects sample queue and state.
+    std::mutex mMutex;  // Protects state and stats. Track queues are lock free.
     std::condition_variable mSampleSignal;
     std::unordered_map<size_t, TrackRecord> mTracks;
-    std::priority_queue<SampleEntry, std::vector<SampleEntry>, SampleComparator> mSampleQueue
-            GUARDED_BY(mMutex);
+    // Set while the writer thread waits for samples, so that producers only take the lock to
+    // wake it up.
+    std::atomic_bool mWriterWaiting = false;
+    std::atomic<uint64_t> mProducerSignals = 0;
+    Stats mStats GUARDED_BY(mMutex);
 
     enum : int {
         UNINITIALIZED,
@@ -211,7 +239,8 @@ private:
     } mState GUARDED_BY(mMutex);
 
     MediaSampleWriter() : mState(UNINITIALIZED){};
-    void addSampleToTrack(size_t trackIndex, const std::shared_ptr<MediaSample>& sample);
+    void addSampleToTrack(TrackQueue* queue, const std::shared_ptr<MediaSample>& sample);
+    bool hasQueuedSamples();
     media_status_t writeSamples(bool* wasStopped);
     media_status_t runWriterLoop(bool* wasStopped);
 };
@@ -120,6 +120,12 @@ public:
      */
     media_status_t cancel();
 
+    /**
+     * Returns the sample writer's queue counters. Meant for benchmarks, the counters are complete
+     * once the transcoder has finished.
+     */
+    MediaSampleWriter::Stats getSampleWriterStats() const;
+
     virtual ~MediaTranscoder() = default;
 
 private:
@@ -22,9 +22,12 @@
 #include <media/NdkMediaCodecPlatform.h>
 #include <media/NdkMediaFormat.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 namespace android {
 
@@ -33,13 +36,18 @@ namespace android {
  * internally. The two media codecs are run in asynchronous mode and shares uncompressed buffers
  * using a native surface (ANativeWindow). Codec callback events are placed on a message queue and
  * serviced in order on the transcoding thread managed by MediaTrackTranscoder.
+ *
+ * In pipelined mode the decoder is fed from a separate input thread instead. The input thread reads
+ * a bounded number of samples ahead of the decoder, so reading from the container overlaps with
+ * decoding and encoding, and a slow read no longer holds up the encoder output.
  */
 class VideoTrackTranscoder : public std::enable_shared_from_this<VideoTrackTranscoder>,
                              public MediaTrackTranscoder {
 public:
     static std::shared_ptr<VideoTrackTranscoder> create(
             const std::weak_ptr<MediaTrackTranscoderCallback>& transcoderCallback,
-            pid_t pid = AMEDIACODEC_CALLING_PID, uid_t uid = AMEDIACODEC_CALLING_UID);
+            pid_t pid = AMEDIACODEC_CALLING_PID, uid_t uid = AMEDIACODEC_CALLING_UID,
+            bool pipelined = false);
 
     virtual ~VideoTrackTranscoder() override;
 
@@ -63,9 +71,19 @@ private:
     };
     class CodecWrapper;
 
+    // Source sample read ahead of the decoder by the input thread.
+    struct InputSample {
+        MediaSampleInfo info;
+        std::vector<uint8_t> data;
+        bool endOfStream = false;
+    };
+
     VideoTrackTranscoder(const std::weak_ptr<MediaTrackTranscoderCallback>& transcoderCallback,
-                         pid_t pid, uid_t uid)
-          : MediaTrackTranscoder(transcoderCallback), mPid(pid), mUid(uid){};
+                         pid_t pid, uid_t uid, bool pipelined)
+          : MediaTrackTranscoder(transcoderCallback),
+            mPid(pid),
+            mUid(uid),
+            mPipelined(pipelined){};
 
     // MediaTrackTranscoder
     media_status_t runTranscodeLoop(bool* stopped) override;
@@ -78,6 +96,15 @@ private:
     // Enqueues an input sample with the decoder.
     void enqueueInputSample(int32_t bufferIndex);
 
+    // Pipelined mode: hands a decoder input buffer to the input thread.
+    void pushInputBuffer(int32_t bufferIndex);
+    // Pipelined mode: stops the input thread from reading or queueing more samples.
+    void abortInputLoop();
+    // Pipelined mode: the input thread's loop.
+    void runInputLoop();
+    media_status_t readInputSample(InputSample* sample);
+    media_status_t queueInputSample(int32_t bufferIndex, const InputSample& sample);
+
     // Moves a decoded buffer from the decoder's output to the encoder's input.
     void transferBuffer(int32_t bufferIndex, AMediaCodecBufferInfo bufferInfo);
 
@@ -100,9 +127,17 @@ private:
     std::shared_ptr<AMediaFormat> mActualOutputFormat;
     pid_t mPid;
     uid_t mUid;
-    uint64_t mInputFrameCount = 0;
+    std::atomic<uint64_t> mInputFrameCount = 0;
     uint64_t mOutputFrameCount = 0;
     int32_t mConfiguredBitrate = 0;
+
+    const bool mPipelined;
+    std::thread mInputThread;
+    std::mutex mInputMutex;
+    std::condition_variable mInputCondition;
+    // Decoder input buffers waiting for a sample, oldest first.
+    std::deque<int32_t> mInputBufferIndices GUARDED_BY(mInputMutex);
+    bool mInputAborted GUARDED_BY(mInputMutex) = false;
 };
 
 }  // namespace android
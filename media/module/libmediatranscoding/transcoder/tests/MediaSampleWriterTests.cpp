@@ -29,6 +29,8 @@
 #include <condition_variable>
 #include <list>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 namespace android {
 
@@ -509,6 +511,80 @@ static std::shared_ptr<MediaSample> readSampleAndAdvance(AMediaExtractor* extrac
     return sample;
 }
 
+TEST_F(MediaSampleWriterTests, TestConcurrentTracks) {
+    std::shared_ptr<MediaSampleWriter> writer = MediaSampleWriter::Create();
+    EXPECT_TRUE(writer->init(mTestMuxer, mTestCallbacks));
+
+    static constexpr int kNumTracks = 3;
+    static constexpr int kSamplesPerTrack = 1000;
+    MediaSampleWriter::MediaSampleConsumerFunction sampleConsumers[kNumTracks];
+    const TestMediaSource& mediaSource = getMediaSource();
+
+    for (int trackIdx = 0; trackIdx < kNumTracks; ++trackIdx) {
+        auto trackFormat = mediaSource.mTrackFormats[trackIdx % mediaSource.mTrackCount];
+        sampleConsumers[trackIdx] = writer->addTrack(trackFormat);
+        EXPECT_NE(sampleConsumers[trackIdx], nullptr);
+        EXPECT_EQ(mTestMuxer->popEvent(), TestMuxer::AddTrack(trackFormat.get()));
+    }
+
+    ASSERT_TRUE(writer->start());
+
+    // Each track is fed by its own thread while the writer is running.
+    std::vector<std::thread> producers;
+    for (int trackIdx = 0; trackIdx < kNumTracks; ++trackIdx) {
+        producers.emplace_back([&sampleConsumers, trackIdx] {
+            for (int i = 0; i < kSamplesPerTrack; ++i) {
+                sampleConsumers[trackIdx](
+                        newSample(i * kNumTracks + trackIdx, 0, 1 /* size */, 0, nullptr));
+                if (i % 100 == 0) {
+                    std::this_thread::yield();
+                }
+            }
+            sampleConsumers[trackIdx](newSampleEos());
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    mTestCallbacks->waitForWritingFinished();
+    EXPECT_EQ(mTestMuxer->popEvent(), TestMuxer::Start());
+
+    // Samples of each track are written in the order they were added, followed by EOS.
+    int64_t lastPts[kNumTracks];
+    int sampleCount[kNumTracks] = {};
+    bool reachedEos[kNumTracks] = {};
+    std::fill(lastPts, lastPts + kNumTracks, -1);
+    for (int i = 0; i < kNumTracks * (kSamplesPerTrack + 1); ++i) {
+        const TestMuxer::Event& event = mTestMuxer->popEvent();
+        ASSERT_EQ(event.type, TestMuxer::Event::WriteSample);
+        ASSERT_LT(event.trackIndex, static_cast<size_t>(kNumTracks));
+        const size_t trackIndex = event.trackIndex;
+        EXPECT_FALSE(reachedEos[trackIndex]);
+
+        if (event.info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+            reachedEos[trackIndex] = true;
+            continue;
+        }
+        EXPECT_GT(event.info.presentationTimeUs, lastPts[trackIndex]);
+        lastPts[trackIndex] = event.info.presentationTimeUs;
+        sampleCount[trackIndex]++;
+    }
+
+    for (int trackIndex = 0; trackIndex < kNumTracks; ++trackIndex) {
+        EXPECT_EQ(sampleCount[trackIndex], kSamplesPerTrack);
+        EXPECT_TRUE(reachedEos[trackIndex]);
+    }
+    EXPECT_EQ(mTestMuxer->popEvent(), TestMuxer::Stop());
+    EXPECT_TRUE(mTestCallbacks->hasFinished());
+
+    const MediaSampleWriter::Stats stats = writer->getStats();
+    EXPECT_EQ(stats.samplesWritten, static_cast<uint64_t>(kNumTracks * (kSamplesPerTrack + 1)));
+    EXPECT_EQ(stats.bytesWritten, static_cast<uint64_t>(kNumTracks * kSamplesPerTrack));
+    EXPECT_GT(stats.batches, 0u);
+    EXPECT_GT(stats.maxQueuedSamples, 0u);
+}
+
 TEST_F(MediaSampleWriterTests, TestDefaultMuxer) {
     // Write samples straight from an extractor and validate output file.
     static const char* destinationPath =
@@ -90,16 +90,18 @@ public:
         return transcoder->mConfiguredBitrate;
     }
 
+    void testSampleSoundness(bool pipelined);
+
     std::shared_ptr<MediaSampleReader> mMediaSampleReader;
     int mTrackIndex;
     std::shared_ptr<AMediaFormat> mSourceFormat;
     std::shared_ptr<AMediaFormat> mDestinationFormat;
 };
 
-TEST_F(VideoTrackTranscoderTests, SampleSoundness) {
-    LOG(DEBUG) << "Testing SampleSoundness";
+void VideoTrackTranscoderTests::testSampleSoundness(bool pipelined) {
     auto callback = std::make_shared<TestTrackTranscoderCallback>();
-    auto transcoder = VideoTrackTranscoder::create(callback);
+    auto transcoder = VideoTrackTranscoder::create(callback, AMEDIACODEC_CALLING_PID,
+                                                   AMEDIACODEC_CALLING_UID, pipelined);
 
     EXPECT_EQ(mMediaSampleReader->selectTrack(mTrackIndex), AMEDIA_OK);
     EXPECT_EQ(transcoder->configure(mMediaSampleReader, mTrackIndex, mDestinationFormat),
@@ -139,6 +141,34 @@ TEST_F(VideoTrackTranscoderTests, SampleSoundness) {
     });
 
     EXPECT_EQ(callback->waitUntilFinished(), AMEDIA_OK);
+    EXPECT_TRUE(eos);
+}
+
+TEST_F(VideoTrackTranscoderTests, SampleSoundness) {
+    LOG(DEBUG) << "Testing SampleSoundness";
+    testSampleSoundness(false /* pipelined */);
+}
+
+TEST_F(VideoTrackTranscoderTests, PipelinedSampleSoundness) {
+    LOG(DEBUG) << "Testing PipelinedSampleSoundness";
+    testSampleSoundness(true /* pipelined */);
+}
+
+// Stopping has to stop the input thread of the pipelined mode as well.
+TEST_F(VideoTrackTranscoderTests, PipelinedStop) {
+    LOG(DEBUG) << "Testing PipelinedStop";
+    auto callback = std::make_shared<TestTrackTranscoderCallback>();
+    auto transcoder = VideoTrackTranscoder::create(callback, AMEDIACODEC_CALLING_PID,
+                                                   AMEDIACODEC_CALLING_UID, true /* pipelined */);
+
+    EXPECT_EQ(mMediaSampleReader->selectTrack(mTrackIndex), AMEDIA_OK);
+    ASSERT_EQ(transcoder->configure(mMediaSampleReader, mTrackIndex, mDestinationFormat),
+              AMEDIA_OK);
+    ASSERT_TRUE(transcoder->start());
+
+    callback->waitUntilTrackFormatAvailable();
+    transcoder->stop();
+    EXPECT_EQ(callback->waitUntilFinished(), AMEDIA_OK);
 }
 
 TEST_F(VideoTrackTranscoderTests, PreserveBitrate) {
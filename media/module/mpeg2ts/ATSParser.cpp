@@ -43,6 +43,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/Vector.h>
 
+#include <algorithm>
 #include <inttypes.h>
 
 namespace android {
@@ -59,6 +60,7 @@ typedef hidl::memory::V1_0::IMemory TMemory;
     do { unsigned tmp = y; ALOGV(x, tmp); } while (0)
 
 static const size_t kTSPacketSize = 188;
+static const size_t kNumPIDs = 1 << 13;
 
 struct ATSParser::Program : public RefBase {
     Program(ATSParser *parser, unsigned programNumber, unsigned programMapPID,
@@ -67,15 +69,8 @@ struct ATSParser::Program : public RefBase {
     bool parsePSISection(
             unsigned pid, ABitReader *br, status_t *err);
 
-    // Pass to appropriate stream according to pid, and set event if it's a PES
-    // with a sync frame.
-    // Note that the method itself does not touch event.
-    bool parsePID(
-            unsigned pid, unsigned continuity_counter,
-            unsigned payload_unit_start_indicator,
-            unsigned transport_scrambling_control,
-            unsigned random_access_indicator,
-            ABitReader *br, status_t *err, SyncEvent *event);
+    // Point the entries of the PIDs of our streams to them.
+    void addStreamsToPIDTable(PIDTableEntry *table);
 
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
@@ -321,27 +316,10 @@ bool ATSParser::Program::parsePSISection(
     return true;
 }
 
-bool ATSParser::Program::parsePID(
-        unsigned pid, unsigned continuity_counter,
-        unsigned payload_unit_start_indicator,
-        unsigned transport_scrambling_control,
-        unsigned random_access_indicator,
-        ABitReader *br, status_t *err, SyncEvent *event) {
-    *err = OK;
-
-    ssize_t index = mStreams.indexOfKey(pid);
-    if (index < 0) {
-        return false;
+void ATSParser::Program::addStreamsToPIDTable(PIDTableEntry *table) {
+    for (size_t i = 0; i < mStreams.size(); ++i) {
+        table[mStreams.keyAt(i)].mStream = mStreams.valueAt(i).get();
     }
-
-    *err = mStreams.editValueAt(index)->parse(
-            continuity_counter,
-            payload_unit_start_indicator,
-            transport_scrambling_control,
-            random_access_indicator,
-            br, event);
-
-    return true;
 }
 
 void ATSParser::Program::signalDiscontinuity(
@@ -408,6 +386,7 @@ bool ATSParser::Program::switchPIDs(const Vector<StreamInfo> &infos) {
             }
 
             mStreams.clear();
+            mParser->invalidatePIDTable();
             for (i = 0; i < temp.size(); ++i) {
                 // The two checks below shouldn't happen,
                 // we already checked above the stream count matches
@@ -759,6 +738,7 @@ status_t ATSParser::Program::parseProgramMap(ABitReader *br) {
 
             isAddingScrambledStream |= info.mCADescriptor.mSystemID >= 0;
             mStreams.add(info.mPID, stream);
+            mParser->invalidatePIDTable();
         }
         else if (index >= 0 && mStreams.editValueAt(index)->isAudio()
                  && audioPresentationsChanged) {
@@ -1053,7 +1033,12 @@ bool ATSParser::Stream::ensureBufferCapacity(size_t neededSize) {
         ALOGD("[stream %d] created shared buffer for descrambling, size %zu",
                 mElementaryPID, neededSize);
     } else {
-        // Align to multiples of 64K.
+        // Grow geometrically, so that a large PES packet (e.g. a video key
+        // frame) is not copied over again every 64K, and align to multiples
+        // of 64K.
+        if (mBuffer != NULL) {
+            neededSize = std::max(neededSize, 2 * mBuffer->capacity());
+        }
         neededSize = (neededSize + 65535) & ~65535;
     }
 
@@ -1892,6 +1877,7 @@ void ATSParser::Stream::setCasInfo(
 
 ATSParser::ATSParser(uint32_t flags)
     : mFlags(flags),
+      mPIDTableValid(false),
       mAbsoluteTimeAnchorUs(-1LL),
       mTimeOffsetValid(false),
       mTimeOffsetUs(0LL),
@@ -1916,6 +1902,32 @@ status_t ATSParser::feedTSPacket(const void *data, size_t size,
     return parseTS(&br, event);
 }
 
+status_t ATSParser::feedTSPackets(
+        const void *data, size_t size, size_t stride,
+        SyncEvent *event, size_t *bytesConsumed) {
+    *bytesConsumed = 0;
+    if (stride < kTSPacketSize) {
+        ALOGE("Wrong TS packet stride");
+        return BAD_VALUE;
+    }
+
+    const uint8_t *packet = (const uint8_t *)data + (stride - kTSPacketSize);
+    off64_t offset = (event != NULL) ? event->getOffset() : 0;
+    status_t err = OK;
+    while (err == OK && size - *bytesConsumed >= stride) {
+        SyncEvent packetEvent(offset + *bytesConsumed);
+        ABitReader br(packet + *bytesConsumed, kTSPacketSize);
+        err = parseTS(&br, (event != NULL) ? &packetEvent : NULL);
+        *bytesConsumed += stride;
+
+        if (packetEvent.hasReturnedData()) {
+            *event = packetEvent;
+            break;
+        }
+    }
+    return err;
+}
+
 status_t ATSParser::setMediaCas(const sp<ICas> &cas) {
     status_t err = mCasManager->setMediaCas(cas);
     if (err != OK) {
@@ -2045,6 +2057,7 @@ void ATSParser::parseProgramAssociationTable(ABitReader *br) {
 
             if (mPSISections.indexOfKey(programMapPID) < 0) {
                 mPSISections.add(programMapPID, new PSISection);
+                invalidatePIDTable();
             }
         }
     }
@@ -2059,10 +2072,14 @@ status_t ATSParser::parsePID(
         unsigned transport_scrambling_control,
         unsigned random_access_indicator,
         SyncEvent *event) {
-    ssize_t sectionIndex = mPSISections.indexOfKey(PID);
+    if (!mPIDTableValid) {
+        rebuildPIDTable();
+    }
+    // Copy the entry, as parsing a section may rebuild the table.
+    PIDTableEntry entry = mPIDTable[PID];
 
-    if (sectionIndex >= 0) {
-        sp<PSISection> section = mPSISections.valueAt(sectionIndex);
+    if (entry.mSection != NULL) {
+        sp<PSISection> section = entry.mSection;
 
         if (payload_unit_start_indicator) {
             if (!section->isEmpty()) {
@@ -2114,6 +2131,7 @@ status_t ATSParser::parsePID(
 
             if (!handled) {
                 mPSISections.removeItem(PID);
+                invalidatePIDTable();
                 section.clear();
             }
         }
@@ -2125,27 +2143,16 @@ status_t ATSParser::parsePID(
         return OK;
     }
 
-    bool handled = false;
-    for (size_t i = 0; i < mPrograms.size(); ++i) {
-        status_t err;
-        if (mPrograms.editItemAt(i)->parsePID(
-                    PID, continuity_counter,
-                    payload_unit_start_indicator,
-                    transport_scrambling_control,
-                    random_access_indicator,
-                    br, &err, event)) {
-            if (err != OK) {
-                return err;
-            }
-
-            handled = true;
-            break;
-        }
+    if (entry.mStream != NULL) {
+        return entry.mStream->parse(
+                continuity_counter,
+                payload_unit_start_indicator,
+                transport_scrambling_control,
+                random_access_indicator,
+                br, event);
     }
 
-    if (!handled) {
-        handled = mCasManager->parsePID(br, PID);
-    }
+    bool handled = mCasManager->parsePID(br, PID);
 
     if (!handled) {
         ALOGV("PID 0x%04x not handled.", PID);
@@ -2154,6 +2161,24 @@ status_t ATSParser::parsePID(
     return OK;
 }
 
+void ATSParser::rebuildPIDTable() {
+    mPIDTable.assign(kNumPIDs, PIDTableEntry{NULL, NULL});
+
+    // Programs are filled in reverse order, so that the first program
+    // carrying a PID gets its packets.
+    for (size_t i = mPrograms.size(); i > 0;) {
+        --i;
+        mPrograms.editItemAt(i)->addStreamsToPIDTable(mPIDTable.data());
+    }
+
+    // PSI sections take precedence over streams.
+    for (size_t i = 0; i < mPSISections.size(); ++i) {
+        mPIDTable[mPSISections.keyAt(i)].mSection = mPSISections.valueAt(i).get();
+    }
+
+    mPIDTableValid = true;
+}
+
 status_t ATSParser::parseAdaptationField(
         ABitReader *br, unsigned PID, unsigned *random_access_indicator) {
     *random_access_indicator = 0;
@@ -122,6 +122,20 @@ struct ATSParser : public RefBase {
     status_t feedTSPacket(
             const void *data, size_t size, SyncEvent *event = NULL);
 
+    // Feed consecutive TS packets into the parser. |data| holds packets of
+    // |stride| bytes each, the TS packet being the last 188 bytes of every
+    // stride (i.e. |stride| is 192 for streams with a 4 byte timecode before
+    // each packet). A trailing partial packet is not fed.
+    //
+    // |event|, if not NULL, is an uninitialized event with the start offset
+    // of |data|. Feeding stops after the first packet that initializes it
+    // (see feedTSPacket()) or fails, so that the caller sees every sync point.
+    // The number of bytes fed, including that packet, goes in
+    // |*bytesConsumed|.
+    status_t feedTSPackets(
+            const void *data, size_t size, size_t stride,
+            SyncEvent *event, size_t *bytesConsumed);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -215,6 +229,18 @@ private:
     // Keyed by PID
     KeyedVector<unsigned, sp<PSISection> > mPSISections;
 
+    // Flat PID -> section/stream lookup for parsePID(). It is rebuilt lazily
+    // once the sections or the streams of any program have changed.
+    struct PIDTableEntry {
+        PSISection *mSection;
+        Stream *mStream;
+    };
+    std::vector<PIDTableEntry> mPIDTable;
+    bool mPIDTableValid;
+
+    void invalidatePIDTable() { mPIDTableValid = false; }
+    void rebuildPIDTable();
+
     int64_t mAbsoluteTimeAnchorUs;
 
     bool mTimeOffsetValid;
@@ -139,6 +139,15 @@ private:
 
     sp<ABuffer> dequeueScrambledAccessUnit();
 
+    // Access units are handed out as slices referencing mBuffer rather than
+    // copies. Consumed data is skipped by advancing the buffer's offset and is
+    // only reclaimed by appendData once no slice refers to the buffer anymore.
+    // Access units smaller than 1/kMaxSliceOverhead of the buffer are copied
+    // instead, so that they do not pin a much larger buffer.
+    enum { kMaxSliceOverhead = 16 };
+    sp<ABuffer> sliceBuffer(size_t offset, size_t size);
+    void consumeBuffer(size_t size);
+
     DISALLOW_EVIL_CONSTRUCTORS(ElementaryStreamQueue);
 };
 
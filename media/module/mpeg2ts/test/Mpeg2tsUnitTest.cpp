@@ -22,12 +22,21 @@
 #include <stdint.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <vector>
+
 #include <datasource/FileSource.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaDataBase.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/AUtils.h>
 #include <mpeg2ts/AnotherPacketSource.h>
 #include <mpeg2ts/ATSParser.h>
+#include <mpeg2ts/ESQueue.h>
 
 #include "Mpeg2tsUnitTestEnvironment.h"
 
@@ -216,12 +225,395 @@ TEST_P(Mpeg2tsUnitTest, MediaInfoTest) {
     }
 }
 
+TEST_P(Mpeg2tsUnitTest, AccessUnitThroughput) {
+    constexpr int kNumRuns = 3;
+    std::vector<uint8_t> data(mTotalPackets * kTSPacketSize);
+    ASSERT_EQ(mSource->readAt(0, data.data(), data.size()), (ssize_t)data.size())
+            << "Failed to read the input file";
+
+    static const ATSParser::SourceType mediaType[] = {ATSParser::VIDEO, ATSParser::AUDIO,
+                                                      ATSParser::META};
+    double bestMBps = 0;
+    size_t numAccessUnits = 0;
+    for (int run = 0; run < kNumRuns; ++run) {
+        sp<ATSParser> parser = new ATSParser();
+        numAccessUnits = 0;
+        auto start = std::chrono::steady_clock::now();
+        size_t consumed;
+        ASSERT_EQ(parser->feedTSPackets(data.data(), data.size(), kTSPacketSize, nullptr,
+                                        &consumed),
+                  (status_t)OK);
+        for (ATSParser::SourceType type : mediaType) {
+            sp<AnotherPacketSource> source = parser->getSource(type);
+            if (source == nullptr) {
+                continue;
+            }
+            status_t finalResult;
+            sp<ABuffer> accessUnit;
+            while (source->hasBufferAvailable(&finalResult)) {
+                if (source->dequeueAccessUnit(&accessUnit) == OK) {
+                    ++numAccessUnits;
+                }
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bestMBps = std::max(bestMBps, data.size() / 1E6 / elapsed.count());
+    }
+    EXPECT_GT(numAccessUnits, 0u) << "No access units found";
+
+    cout << "[   INFO   ] " << get<0>(GetParam()) << ": " << numAccessUnits
+         << " access units, " << bestMBps << " MB/s" << endl;
+}
+
 INSTANTIATE_TEST_SUITE_P(
         infoTest, Mpeg2tsUnitTest,
         ::testing::Values(make_tuple("crowd_1920x1080_25fps_6700kbps_h264.ts", 0x01, 1),
                           make_tuple("segment000001.ts", 0x03, 2),
                           make_tuple("bbb_44100hz_2ch_128kbps_mp3_5mins.ts", 0x02, 1)));
 
+namespace {
+
+// Muxes a synthetic broadcast style stream: every program carries an MPEG audio stream and a
+// timed metadata stream, which stands in for video with its large PES packets.
+class MultiProgramStreamWriter {
+  public:
+    static constexpr unsigned kAudioFrameSize = 417;  // MPEG-1 layer 3, 128kbps, 44.1kHz
+    static constexpr uint64_t kAudioFrameDurationPts = 1152 * 90000 / 44100;
+
+    MultiProgramStreamWriter(size_t numPrograms, size_t stride)
+        : mNumPrograms(numPrograms), mStride(stride) {}
+
+    // Appends |numFrames| audio frames per program, along with the metadata and the PSI.
+    void writeFrames(size_t numFrames) {
+        std::vector<uint8_t> audio(kAudioFrameSize, 0x55);
+        audio[0] = 0xff;
+        audio[1] = 0xfb;
+        audio[2] = 0x90;
+        audio[3] = 0x00;
+
+        for (size_t frame = 0; frame < numFrames; ++frame, ++mFrame) {
+            if (mFrame % 16 == 0) {
+                writePSI();
+            }
+            uint64_t pts = 90000 + mFrame * kAudioFrameDurationPts;
+            for (size_t i = 0; i < mNumPrograms; ++i) {
+                writePES(audioPID(i), 0xc0, pts, audio);
+                if (mFrame % 8 == 0) {
+                    // some of them exceed the initial size of the PES buffer
+                    std::vector<uint8_t> metadata(mFrame % 128 == 0 ? 300000 : 20000,
+                                                  (uint8_t)mFrame);
+                    writePES(metadataPID(i), 0xbd, pts, metadata);
+                }
+            }
+        }
+    }
+
+    const std::vector<uint8_t> &data() const { return mData; }
+
+  private:
+    size_t mNumPrograms;
+    size_t mStride;
+    size_t mFrame = 0;
+    std::map<unsigned, uint8_t> mContinuityCounters;
+    std::vector<uint8_t> mData;
+
+    static unsigned programMapPID(size_t program) { return 0x100 + program; }
+    static unsigned audioPID(size_t program) { return 0x1000 + 16 * program; }
+    static unsigned metadataPID(size_t program) { return 0x1001 + 16 * program; }
+
+    static uint32_t crc32(const uint8_t *data, size_t size) {
+        uint32_t crc = 0xffffffff;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= (uint32_t)data[i] << 24;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    void writeSection(unsigned pid, std::vector<uint8_t> section) {
+        size_t sectionLength = section.size() + 4 - 3;
+        section[1] = 0xb0 | (sectionLength >> 8);
+        section[2] = sectionLength & 0xff;
+        uint32_t crc = crc32(section.data(), section.size());
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            section.push_back((crc >> shift) & 0xff);
+        }
+        section.insert(section.begin(), 0x00);  // pointer_field
+        writePayload(pid, section, true /* unitStart */);
+    }
+
+    void writePSI() {
+        std::vector<uint8_t> pat = {0x00, 0, 0, 0x00, 0x01, 0xc1, 0x00, 0x00};
+        for (size_t i = 0; i < mNumPrograms; ++i) {
+            unsigned programNumber = i + 1;
+            pat.insert(pat.end(), {(uint8_t)(programNumber >> 8), (uint8_t)programNumber,
+                                   (uint8_t)(0xe0 | (programMapPID(i) >> 8)),
+                                   (uint8_t)programMapPID(i)});
+        }
+        writeSection(0 /* pid */, pat);
+
+        for (size_t i = 0; i < mNumPrograms; ++i) {
+            unsigned programNumber = i + 1;
+            std::vector<uint8_t> pmt = {0x02, 0, 0, (uint8_t)(programNumber >> 8),
+                                        (uint8_t)programNumber, 0xc1, 0x00, 0x00,
+                                        (uint8_t)(0xe0 | (audioPID(i) >> 8)),
+                                        (uint8_t)audioPID(i), 0xf0, 0x00};
+            pmt.insert(pmt.end(), {0x03 /* MPEG-1 audio */, (uint8_t)(0xe0 | (audioPID(i) >> 8)),
+                                   (uint8_t)audioPID(i), 0xf0, 0x00});
+            pmt.insert(pmt.end(), {0x15 /* metadata */, (uint8_t)(0xe0 | (metadataPID(i) >> 8)),
+                                   (uint8_t)metadataPID(i), 0xf0, 0x00});
+            writeSection(programMapPID(i), pmt);
+        }
+    }
+
+    void writePES(unsigned pid, uint8_t streamId, uint64_t pts,
+                  const std::vector<uint8_t> &payload) {
+        size_t length = 3 + 5 + payload.size();
+        if (length > 0xffff) {
+            length = 0;  // unbounded
+        }
+        std::vector<uint8_t> pes = {0x00, 0x00, 0x01, streamId,
+                                    (uint8_t)(length >> 8), (uint8_t)length, 0x80, 0x80, 0x05,
+                                    (uint8_t)(0x21 | ((pts >> 29) & 0x0e)),
+                                    (uint8_t)(pts >> 22), (uint8_t)(((pts >> 14) & 0xfe) | 1),
+                                    (uint8_t)(pts >> 7), (uint8_t)(((pts << 1) & 0xfe) | 1)};
+        pes.insert(pes.end(), payload.begin(), payload.end());
+        writePayload(pid, pes, true /* unitStart */);
+    }
+
+    void writePayload(unsigned pid, const std::vector<uint8_t> &payload, bool unitStart) {
+        size_t offset = 0;
+        while (offset < payload.size()) {
+            // timecode prefix for strides larger than a TS packet
+            mData.insert(mData.end(), mStride - kTSPacketSize, 0x00);
+
+            size_t size = std::min(payload.size() - offset, kTSPacketSize - 4);
+            uint8_t &continuityCounter = mContinuityCounters[pid];
+            mData.insert(mData.end(), {kTSSyncByte,
+                                       (uint8_t)((unitStart && offset == 0 ? 0x40 : 0x00)
+                                                 | (pid >> 8)),
+                                       (uint8_t)pid,
+                                       (uint8_t)((size < kTSPacketSize - 4 ? 0x30 : 0x10)
+                                                 | continuityCounter)});
+            continuityCounter = (continuityCounter + 1) & 0x0f;
+
+            // pad the last packet with an adaptation field
+            size_t stuffing = kTSPacketSize - 4 - size;
+            if (stuffing > 0) {
+                mData.push_back(stuffing - 1);
+                if (stuffing > 1) {
+                    mData.push_back(0x00);
+                    mData.insert(mData.end(), stuffing - 2, 0xff);
+                }
+            }
+            mData.insert(mData.end(), payload.begin() + offset, payload.begin() + offset + size);
+            offset += size;
+        }
+    }
+};
+
+struct SyncPoint {
+    off64_t offset;
+    int64_t timeUs;
+    ATSParser::SourceType type;
+
+    bool operator==(const SyncPoint &other) const {
+        return offset == other.offset && timeUs == other.timeUs && type == other.type;
+    }
+};
+
+// Feeds |data| one packet at a time, the way clients did before feedTSPackets().
+status_t feedPackets(const sp<ATSParser> &parser, const std::vector<uint8_t> &data,
+                     std::vector<SyncPoint> *syncPoints) {
+    for (size_t offset = 0; offset + kTSPacketSize <= data.size(); offset += kTSPacketSize) {
+        ATSParser::SyncEvent event(offset);
+        status_t err = parser->feedTSPacket(data.data() + offset, kTSPacketSize, &event);
+        if (err != OK) {
+            return err;
+        }
+        if (event.hasReturnedData() && syncPoints != nullptr) {
+            syncPoints->push_back({event.getOffset(), event.getTimeUs(), event.getType()});
+        }
+    }
+    return OK;
+}
+
+// Feeds |data| in chunks of |chunkSize| bytes, as MPEG2TSExtractor does.
+status_t feedChunks(const sp<ATSParser> &parser, const std::vector<uint8_t> &data,
+                    size_t stride, size_t chunkSize, std::vector<SyncPoint> *syncPoints) {
+    size_t offset = 0;
+    while (offset + stride <= data.size()) {
+        size_t size = std::min(chunkSize, data.size() - offset);
+        size_t end = offset + size;
+        while (offset + stride <= end) {
+            ATSParser::SyncEvent event(offset);
+            size_t consumed;
+            status_t err = parser->feedTSPackets(data.data() + offset, end - offset, stride,
+                                                 &event, &consumed);
+            if (err != OK) {
+                return err;
+            }
+            offset += consumed;
+            if (event.hasReturnedData() && syncPoints != nullptr) {
+                syncPoints->push_back({event.getOffset(), event.getTimeUs(), event.getType()});
+            }
+        }
+    }
+    return OK;
+}
+
+// MPEG-1 layer III, 128 kbps, 44.1 kHz
+constexpr size_t kMPEGAudioFrameSize = 417;
+
+void makeMPEGAudioFrame(size_t index, uint8_t *frame) {
+    static const uint8_t kHeader[] = {0xff, 0xfb, 0x90, 0x00};
+    memcpy(frame, kHeader, sizeof(kHeader));
+    for (size_t i = sizeof(kHeader); i < kMPEGAudioFrameSize; ++i) {
+        frame[i] = (uint8_t)((i * 7 + index) & 0x7f);
+    }
+}
+
+}  // namespace
+
+TEST(Mpeg2tsESQueueTest, AccessUnitsSurviveLaterAppends) {
+    constexpr size_t kFramesPerPES = 3;
+    constexpr size_t kNumPES = 200;
+    ElementaryStreamQueue queue(ElementaryStreamQueue::MPEG_AUDIO);
+    uint8_t pes[kFramesPerPES * kMPEGAudioFrameSize];
+    uint8_t expected[kMPEGAudioFrameSize];
+
+    std::vector<sp<ABuffer>> accessUnits;
+    size_t numFrames = 0;
+    for (size_t i = 0; i < kNumPES; ++i) {
+        for (size_t j = 0; j < kFramesPerPES; ++j) {
+            makeMPEGAudioFrame(numFrames + j, pes + j * kMPEGAudioFrameSize);
+        }
+        numFrames += kFramesPerPES;
+        ASSERT_EQ(queue.appendData(pes, sizeof(pes), i * 100000), (status_t)OK);
+
+        sp<ABuffer> accessUnit;
+        while ((accessUnit = queue.dequeueAccessUnit()) != nullptr) {
+            accessUnits.push_back(accessUnit);
+        }
+        ASSERT_EQ(accessUnits.size(), numFrames);
+
+        // Access units of the first half are all kept alive, afterwards they are released
+        // right away so that the queue can reuse its buffer.
+        if (i >= kNumPES / 2) {
+            for (size_t k = 0; k < accessUnits.size(); ++k) {
+                makeMPEGAudioFrame(k, expected);
+                ASSERT_EQ(accessUnits[k]->size(), kMPEGAudioFrameSize);
+                ASSERT_EQ(memcmp(accessUnits[k]->data(), expected, kMPEGAudioFrameSize), 0)
+                        << "access unit " << k << " was overwritten";
+            }
+            accessUnits.clear();
+            numFrames = 0;
+        }
+    }
+}
+
+// Small access units are copied out of the queue buffer, large ones are
+// slices of it; both must stay intact while the queue grows and wraps.
+TEST(Mpeg2tsESQueueTest, MixedSizeAccessUnitsSurviveLaterAppends) {
+    constexpr size_t kSizes[] = {100, 30000, 2000, 70000};
+    constexpr size_t kNumAppends = 64;
+    ElementaryStreamQueue queue(ElementaryStreamQueue::METADATA);
+
+    auto fill = [](size_t index, size_t size) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = (uint8_t)(i * 13 + index);
+        }
+        return data;
+    };
+
+    std::vector<sp<ABuffer>> accessUnits;
+    for (size_t i = 0; i < kNumAppends; ++i) {
+        std::vector<uint8_t> data = fill(i, kSizes[i % std::size(kSizes)]);
+        ASSERT_EQ(queue.appendData(data.data(), data.size(), i * 100000), (status_t)OK);
+        sp<ABuffer> accessUnit = queue.dequeueAccessUnit();
+        ASSERT_NE(accessUnit, nullptr);
+        accessUnits.push_back(accessUnit);
+    }
+    for (size_t i = 0; i < kNumAppends; ++i) {
+        std::vector<uint8_t> expected = fill(i, kSizes[i % std::size(kSizes)]);
+        ASSERT_EQ(accessUnits[i]->size(), expected.size());
+        ASSERT_EQ(memcmp(accessUnits[i]->data(), expected.data(), expected.size()), 0)
+                << "access unit " << i << " was overwritten";
+    }
+}
+
+TEST(Mpeg2tsDemuxTest, BatchedFeedMatchesSinglePackets) {
+    MultiProgramStreamWriter writer(4 /* numPrograms */, kTSPacketSize);
+    writer.writeFrames(300);
+
+    std::vector<SyncPoint> expected;
+    sp<ATSParser> parser = new ATSParser();
+    ASSERT_EQ(feedPackets(parser, writer.data(), &expected), (status_t)OK);
+    ASSERT_TRUE(parser->hasSource(ATSParser::AUDIO));
+    ASSERT_TRUE(parser->hasSource(ATSParser::META));
+    ASSERT_FALSE(expected.empty()) << "No sync points found";
+
+    for (size_t chunkSize : {kTSPacketSize, 64 * kTSPacketSize, 1000 * kTSPacketSize + 17}) {
+        std::vector<SyncPoint> syncPoints;
+        parser = new ATSParser();
+        ASSERT_EQ(feedChunks(parser, writer.data(), kTSPacketSize, chunkSize, &syncPoints),
+                  (status_t)OK);
+        EXPECT_TRUE(syncPoints == expected) << "chunk size " << chunkSize;
+    }
+
+    // The same packets, each preceded by a 4 byte timecode.
+    MultiProgramStreamWriter timecodeWriter(4 /* numPrograms */, kTSPacketSize + 4);
+    timecodeWriter.writeFrames(300);
+    std::vector<SyncPoint> syncPoints;
+    parser = new ATSParser();
+    ASSERT_EQ(feedChunks(parser, timecodeWriter.data(), kTSPacketSize + 4,
+                         64 * (kTSPacketSize + 4), &syncPoints),
+              (status_t)OK);
+    ASSERT_EQ(syncPoints.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(syncPoints[i].offset,
+                  (off64_t)(expected[i].offset / kTSPacketSize * (kTSPacketSize + 4)));
+        EXPECT_EQ(syncPoints[i].timeUs, expected[i].timeUs);
+    }
+}
+
+TEST(Mpeg2tsDemuxTest, DemuxThroughput) {
+    constexpr int kNumRuns = 3;
+    MultiProgramStreamWriter writer(16 /* numPrograms */, kTSPacketSize);
+    writer.writeFrames(200);
+    const std::vector<uint8_t> &data = writer.data();
+
+    auto measure = [&data](const std::function<status_t(const sp<ATSParser> &)> &feed) {
+        double bestMBps = 0;
+        for (int run = 0; run < kNumRuns; ++run) {
+            sp<ATSParser> parser = new ATSParser();
+            auto start = std::chrono::steady_clock::now();
+            status_t err = feed(parser);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            EXPECT_EQ(err, (status_t)OK);
+            bestMBps = std::max(bestMBps, data.size() / 1E6 / elapsed.count());
+        }
+        return bestMBps;
+    };
+
+    std::vector<SyncPoint> packetSyncPoints, chunkSyncPoints;
+    double packetMBps = measure([&](const sp<ATSParser> &parser) {
+        packetSyncPoints.clear();
+        return feedPackets(parser, data, &packetSyncPoints);
+    });
+    double chunkMBps = measure([&](const sp<ATSParser> &parser) {
+        chunkSyncPoints.clear();
+        return feedChunks(parser, data, kTSPacketSize, 64 * kTSPacketSize, &chunkSyncPoints);
+    });
+    EXPECT_TRUE(packetSyncPoints == chunkSyncPoints);
+
+    cout << "[   INFO   ] " << data.size() / 1E6 << " MB, 16 programs: " << packetMBps
+         << " MB/s packet by packet, " << chunkMBps << " MB/s in chunks of 64 packets" << endl;
+}
+
 int32_t main(int argc, char **argv) {
     gEnv = new Mpeg2tsUnitTestEnvironment();
     ::testing::AddGlobalTestEnvironment(gEnv);
@@ -35,6 +35,7 @@ int32_t C2Encoder::createCodec2Component(string compName, AMediaFormat *format)
     }
     // Configure the plugin with Input properties
     std::vector<C2Param *> configParam;
+    C2StreamEncodingParallelismTuning::output parallelism(0u, mNumThreads, mNumSlices);
     if (!strncmp(mime, "audio/", 6)) {
         mIsAudioEncoder = true;
         int32_t numChannels;
@@ -67,6 +68,9 @@ int32_t C2Encoder::createCodec2Component(string compName, AMediaFormat *format)
             (mFrameRate <= 0)) {
             mFrameRate = KDefaultFrameRate;
         }
+        if (mNumThreads > 0 || mNumSlices > 0) {
+            configParam.push_back(&parallelism);
+        }
     }
 
     int64_t sTime = mStats->getCurTime();
@@ -34,10 +34,19 @@ class C2Encoder : public BenchmarkC2Common {
           mWidth(0),
           mHeight(0),
           mNumInputFrame(0),
+          mNumThreads(0),
+          mNumSlices(0),
           mComponent(nullptr) {}
 
     int32_t createCodec2Component(string codecName, AMediaFormat *format);
 
+    // Request encoder threading and slicing for video encoders; 0 keeps the
+    // component default. Applied by the next createCodec2Component().
+    void setParallelism(uint32_t numThreads, uint32_t numSlices) {
+        mNumThreads = numThreads;
+        mNumSlices = numSlices;
+    }
+
     int32_t encodeFrames(ifstream &eleStream, size_t inputBufferSize);
 
     int32_t getInputMaxBufSize();
@@ -60,6 +69,9 @@ class C2Encoder : public BenchmarkC2Common {
     int32_t mNumInputFrame;
     int32_t mInputMaxBufSize;
 
+    uint32_t mNumThreads;
+    uint32_t mNumSlices;
+
     std::shared_ptr<android::Codec2Client::Listener> mListener;
     std::shared_ptr<android::Codec2Client::Component> mComponent;
 };
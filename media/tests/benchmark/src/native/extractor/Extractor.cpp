@@ -111,6 +111,32 @@ int32_t Extractor::extract(int32_t trackId) {
     return AMEDIA_OK;
 }
 
+int32_t Extractor::extractAllTracks(int64_t *bytesRead) {
+    size_t trackCount = AMediaExtractor_getTrackCount(mExtractor);
+    for (size_t trackId = 0; trackId < trackCount; ++trackId) {
+        media_status_t status = AMediaExtractor_selectTrack(mExtractor, trackId);
+        if (status != AMEDIA_OK) return status;
+    }
+
+    int32_t numSamples = 0;
+    *bytesRead = 0;
+    mStats->setStartTime();
+    while (1) {
+        ssize_t size = AMediaExtractor_readSampleData(mExtractor, mFrameBuf, kMaxBufferSize);
+        if (size < 0) break;
+        mStats->addFrameSize(size);
+        mStats->addOutputTime();
+        *bytesRead += size;
+        ++numSamples;
+        if (!AMediaExtractor_advance(mExtractor)) break;
+    }
+
+    for (size_t trackId = 0; trackId < trackCount; ++trackId) {
+        AMediaExtractor_unselectTrack(mExtractor, trackId);
+    }
+    return numSamples;
+}
+
 void Extractor::dumpStatistics(string inputReference, string componentName, string statsFile) {
     string operation = "extract";
     mStats->dumpStatistics(operation, inputReference, mDurationUs, componentName, "", statsFile);
@@ -45,6 +45,10 @@ class Extractor {
 
     int32_t extract(int32_t trackId);
 
+    // Selects all tracks and reads their samples in file order. Returns the number of samples
+    // read and stores the number of sample bytes read to |bytesRead|, or returns a negative error.
+    int32_t extractAllTracks(int64_t *bytesRead);
+
     void dumpStatistics(string inputReference, string componentName = "", string statsFile = "");
 
     void deInitExtractor();
@@ -24,6 +24,12 @@
 
 int32_t Muxer::initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat) {
     if (!mFormat) mFormat = mExtractor->getFormat();
+    vector<AMediaFormat *> trackFormats = {mFormat};
+    return initMuxer(fd, outputFormat, trackFormats);
+}
+
+int32_t Muxer::initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat,
+                         vector<AMediaFormat *> &trackFormats) {
     if (!mStats) mStats = new Stats();
 
     int64_t sTime = mStats->getCurTime();
@@ -36,10 +42,12 @@ int32_t Muxer::initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat) {
      * AMediaMuxer_addTrack returns the index of the new track or a negative value
      * in case of failure, which can be interpreted as a media_status_t.
      */
-    ssize_t index = AMediaMuxer_addTrack(mMuxer, mFormat);
-    if (index < 0) {
-        ALOGV("Format not supported");
-        return index;
+    for (AMediaFormat *format : trackFormats) {
+        ssize_t index = AMediaMuxer_addTrack(mMuxer, format);
+        if (index < 0) {
+            ALOGV("Format not supported");
+            return index;
+        }
     }
     AMediaMuxer_start(mMuxer);
     int64_t eTime = mStats->getCurTime();
@@ -73,12 +81,19 @@ void Muxer::dumpStatistics(string inputReference, string componentName, string s
 }
 
 int32_t Muxer::mux(uint8_t *inputBuffer, vector<AMediaCodecBufferInfo> &frameInfos) {
+    vector<size_t> trackIds(frameInfos.size(), 0);
+    return mux(inputBuffer, frameInfos, trackIds);
+}
+
+int32_t Muxer::mux(uint8_t *inputBuffer, vector<AMediaCodecBufferInfo> &frameInfos,
+                   vector<size_t> &trackIds) {
     // Mux frame data
     size_t frameIdx = 0;
     mStats->setStartTime();
     while (frameIdx < frameInfos.size()) {
         AMediaCodecBufferInfo info = frameInfos.at(frameIdx);
-        media_status_t status = AMediaMuxer_writeSampleData(mMuxer, 0, inputBuffer, &info);
+        media_status_t status =
+                AMediaMuxer_writeSampleData(mMuxer, trackIds.at(frameIdx), inputBuffer, &info);
         if (status != 0) {
             ALOGE("Error in AMediaMuxer_writeSampleData");
             return status;
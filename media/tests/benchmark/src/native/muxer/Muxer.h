@@ -45,11 +45,17 @@ class Muxer {
 
     /* Muxer related utilities */
     int32_t initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat);
+    /* Adds one track per format, in order, instead of the current extractor track */
+    int32_t initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat,
+                      vector<AMediaFormat *> &trackFormats);
     void deInitMuxer();
     void resetMuxer();
 
     /* Process the frames and give Muxed output */
     int32_t mux(uint8_t *inputBuffer, vector<AMediaCodecBufferInfo> &frameSizes);
+    /* Writes frameInfos[i] to the muxer track trackIds[i] */
+    int32_t mux(uint8_t *inputBuffer, vector<AMediaCodecBufferInfo> &frameInfos,
+                vector<size_t> &trackIds);
 
     void dumpStatistics(string inputReference, string codecName = "", string statsFile = "");
 
@@ -46,6 +46,15 @@ class C2EncoderTest : public ::testing::TestWithParam<pair<string, string>> {
 
     void setupC2EncoderTest();
 
+    // Decodes the current track of |decoder|'s extractor into |outputFileName|
+    // to be used as raw encoder input.
+    void decodeTrack(Decoder *decoder, size_t fileSize, const string &outputFileName);
+
+    // Encodes the raw frames in |eleStream| with |codecName| and dumps the
+    // statistics under |statsName|.
+    void encodeWith(const string &codecName, AMediaFormat *format, ifstream &eleStream,
+                    size_t eleSize, int64_t durationUs, const string &statsName);
+
     vector<string> mCodecList;
     C2Encoder *mEncoder;
 };
@@ -61,6 +70,59 @@ void C2EncoderTest::setupC2EncoderTest() {
     ASSERT_GT(mCodecList.size(), 0) << "Codec2 client didn't recognise any component";
 }
 
+void C2EncoderTest::decodeTrack(Decoder *decoder, size_t fileSize,
+                                const string &outputFileName) {
+    Extractor *extractor = decoder->getExtractor();
+    std::unique_ptr<uint8_t[]> inputBuffer(new (std::nothrow) uint8_t[fileSize]);
+    ASSERT_NE(inputBuffer, nullptr) << "Insufficient memory";
+
+    vector<AMediaCodecBufferInfo> frameInfo;
+    AMediaCodecBufferInfo info;
+    uint32_t inputBufferOffset = 0;
+
+    // Get frame data
+    while (1) {
+        int32_t status = extractor->getFrameSample(info);
+        if (status || !info.size) break;
+        // copy the meta data and buffer to be passed to decoder
+        ASSERT_LE(inputBufferOffset + info.size, fileSize) << "Memory allocated not sufficient";
+
+        memcpy(inputBuffer.get() + inputBufferOffset, extractor->getFrameBuf(), info.size);
+        frameInfo.push_back(info);
+        inputBufferOffset += info.size;
+    }
+
+    string decName = "";
+    FILE *outFp = fopen(outputFileName.c_str(), "wb");
+    ASSERT_NE(outFp, nullptr) << "Unable to open output file" << outputFileName
+                              << " for dumping decoder's output";
+
+    decoder->setupDecoder();
+    int32_t status = decoder->decode(inputBuffer.get(), frameInfo, decName,
+                                     false /*asyncMode */, outFp);
+    ASSERT_EQ(status, AMEDIA_OK) << "Decode returned error : " << status;
+}
+
+void C2EncoderTest::encodeWith(const string &codecName, AMediaFormat *format,
+                               ifstream &eleStream, size_t eleSize, int64_t durationUs,
+                               const string &statsName) {
+    int32_t status = mEncoder->createCodec2Component(codecName, format);
+    ASSERT_EQ(status, 0) << "Create component failed for " << codecName;
+
+    // Send the inputs to C2 Encoder and wait till all buffers are returned.
+    eleStream.seekg(0, ifstream::beg);
+    status = mEncoder->encodeFrames(eleStream, eleSize);
+    ASSERT_EQ(status, 0) << "Encoder failed for " << codecName;
+
+    mEncoder->waitOnInputConsumption();
+    ASSERT_TRUE(mEncoder->mEos) << "Test Failed. Didn't receive EOS \n";
+
+    mEncoder->deInitCodec();
+    ALOGV("codec : %s", statsName.c_str());
+    mEncoder->dumpStatistics(GetParam().first, durationUs, statsName, gEnv->getStatsFile());
+    mEncoder->resetEncoder();
+}
+
 TEST_P(C2EncoderTest, Codec2Encode) {
     ALOGV("Encodes the input using codec2 framework");
     string inputFile = gEnv->getRes() + GetParam().first;
@@ -89,35 +151,8 @@ TEST_P(C2EncoderTest, Codec2Encode) {
         int32_t status = extractor->setupTrackFormat(curTrack);
         ASSERT_EQ(status, 0) << "Track Format invalid";
 
-        std::unique_ptr<uint8_t[]> inputBuffer(new (std::nothrow) uint8_t[fileSize]);
-        ASSERT_NE(inputBuffer, nullptr) << "Insufficient memory";
-
-        vector<AMediaCodecBufferInfo> frameInfo;
-        AMediaCodecBufferInfo info;
-        uint32_t inputBufferOffset = 0;
-
-        // Get frame data
-        while (1) {
-            status = extractor->getFrameSample(info);
-            if (status || !info.size) break;
-            // copy the meta data and buffer to be passed to decoder
-            ASSERT_LE(inputBufferOffset + info.size, fileSize) << "Memory allocated not sufficient";
-
-            memcpy(inputBuffer.get() + inputBufferOffset, extractor->getFrameBuf(), info.size);
-            frameInfo.push_back(info);
-            inputBufferOffset += info.size;
-        }
-
-        string decName = "";
         string outputFileName = "/data/local/tmp/decode.out";
-        FILE *outFp = fopen(outputFileName.c_str(), "wb");
-        ASSERT_NE(outFp, nullptr) << "Unable to open output file" << outputFileName
-                                  << " for dumping decoder's output";
-
-        decoder->setupDecoder();
-        status = decoder->decode(inputBuffer.get(), frameInfo, decName,
-                                 false /*asyncMode */, outFp);
-        ASSERT_EQ(status, AMEDIA_OK) << "Decode returned error : " << status;
+        ASSERT_NO_FATAL_FAILURE(decodeTrack(decoder.get(), fileSize, outputFileName));
 
         // Encode the given input stream for all C2 codecs supported by device
         AMediaFormat *format = extractor->getFormat();
@@ -125,26 +160,12 @@ TEST_P(C2EncoderTest, Codec2Encode) {
         eleStream.open(outputFileName.c_str(), ifstream::binary | ifstream::ate);
         ASSERT_EQ(eleStream.is_open(), true) << outputFileName.c_str() << " - file not found";
         size_t eleSize = eleStream.tellg();
+        int64_t durationUs = extractor->getClipDuration();
 
         for (string codecName : mCodecList) {
             if (codecName.find(GetParam().second) != string::npos) {
-                status = mEncoder->createCodec2Component(codecName, format);
-                ASSERT_EQ(status, 0) << "Create component failed for " << codecName;
-
-                // Send the inputs to C2 Encoder and wait till all buffers are returned.
-                eleStream.seekg(0, ifstream::beg);
-                status = mEncoder->encodeFrames(eleStream, eleSize);
-                ASSERT_EQ(status, 0) << "Encoder failed for " << codecName;
-
-                mEncoder->waitOnInputConsumption();
-                ASSERT_TRUE(mEncoder->mEos) << "Test Failed. Didn't receive EOS \n";
-
-                mEncoder->deInitCodec();
-                int64_t durationUs = extractor->getClipDuration();
-                ALOGV("codec : %s", codecName.c_str());
-                mEncoder->dumpStatistics(GetParam().first, durationUs, codecName,
-                                         gEnv->getStatsFile());
-                mEncoder->resetEncoder();
+                ASSERT_NO_FATAL_FAILURE(encodeWith(codecName, format, eleStream, eleSize,
+                                                   durationUs, codecName));
             }
         }
 
@@ -158,6 +179,74 @@ TEST_P(C2EncoderTest, Codec2Encode) {
     mEncoder = nullptr;
 }
 
+class C2EncoderThreadScalingTest : public C2EncoderTest {};
+
+// Encodes the same input with increasing thread counts (and one slice per
+// thread for AVC; the HEVC encoder does not slice). Each run is dumped to the
+// stats file as "<codec>@<n>threads".
+TEST_P(C2EncoderThreadScalingTest, Codec2EncodeThreadScaling) {
+    ALOGV("Encodes the input with varying encoder parallelism");
+    string inputFile = gEnv->getRes() + GetParam().first;
+    FILE *inputFp = fopen(inputFile.c_str(), "rb");
+    ASSERT_NE(inputFp, nullptr) << "Unable to open input file for reading";
+
+    std::unique_ptr<Decoder> decoder(new (std::nothrow) Decoder());
+    ASSERT_NE(decoder, nullptr) << "Decoder creation failed";
+
+    Extractor *extractor = decoder->getExtractor();
+    ASSERT_NE(extractor, nullptr) << "Extractor creation failed";
+
+    struct stat buf;
+    stat(inputFile.c_str(), &buf);
+    size_t fileSize = buf.st_size;
+    int32_t fd = fileno(inputFp);
+
+    ASSERT_LE(fileSize, kMaxBufferSize)
+            << "Input file size is greater than the threshold memory dedicated to the test";
+
+    int32_t trackCount = extractor->initExtractor(fd, fileSize);
+    ASSERT_GT(trackCount, 0) << "initExtractor failed";
+
+    // Only the first track is used; the inputs are video-only clips.
+    int32_t status = extractor->setupTrackFormat(0);
+    ASSERT_EQ(status, 0) << "Track Format invalid";
+
+    string outputFileName = "/data/local/tmp/decode.out";
+    ASSERT_NO_FATAL_FAILURE(decodeTrack(decoder.get(), fileSize, outputFileName));
+
+    AMediaFormat *format = extractor->getFormat();
+    ifstream eleStream;
+    eleStream.open(outputFileName.c_str(), ifstream::binary | ifstream::ate);
+    ASSERT_EQ(eleStream.is_open(), true) << outputFileName.c_str() << " - file not found";
+    size_t eleSize = eleStream.tellg();
+    int64_t durationUs = extractor->getClipDuration();
+
+    for (string codecName : mCodecList) {
+        // The parallelism parameter is implemented by the software encoders.
+        if (codecName.find(GetParam().second) == string::npos ||
+            codecName.rfind("c2.android.", 0) != 0) {
+            continue;
+        }
+        bool canSlice = GetParam().second == "avc";
+        for (uint32_t numThreads : {1u, 2u, 4u}) {
+            mEncoder->setParallelism(numThreads, canSlice ? numThreads : 0);
+            ASSERT_NO_FATAL_FAILURE(
+                    encodeWith(codecName, format, eleStream, eleSize, durationUs,
+                               codecName + "@" + to_string(numThreads) + "threads"));
+        }
+    }
+
+    decoder->deInitCodec();
+    decoder->resetDecoder();
+    fclose(inputFp);
+    extractor->deInitExtractor();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        VideoEncoderThreadScalingTest, C2EncoderThreadScalingTest,
+        ::testing::Values(make_pair("crowd_1920x1080_25fps_6700kbps_h264.ts", "avc"),
+                          make_pair("crowd_1920x1080_25fps_4000kbps_h265.mkv", "hevc")));
+
 INSTANTIATE_TEST_SUITE_P(
         AudioEncoderTest, C2EncoderTest,
         ::testing::Values(make_pair("bbb_44100hz_2ch_128kbps_aac_30sec.mp4", "aac"),
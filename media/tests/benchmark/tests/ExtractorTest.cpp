@@ -17,6 +17,9 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "extractorTest"
 
+#include <chrono>
+#include <fstream>
+#include <iostream>
 #include <memory>
 
 #include <gtest/gtest.h>
@@ -75,6 +78,64 @@ INSTANTIATE_TEST_SUITE_P(ExtractorTestAll, ExtractorTest,
                                            make_pair("bbb_48000hz_2ch_100kbps_opus_5mins.webm",
                                                      0)));
 
+// Returns the number of read syscalls issued by this process so far, or -1 if unknown.
+static int64_t getReadSyscallCount() {
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    int64_t value;
+    while (io >> key >> value) {
+        if (key == "syscr:") return value;
+    }
+    return -1;
+}
+
+class ExtractorMultiTrackTest : public ::testing::TestWithParam<string> {};
+
+// Extracts all tracks in file order and reports read syscalls per sample and throughput.
+TEST_P(ExtractorMultiTrackTest, ExtractAllTracks) {
+    std::unique_ptr<Extractor> extractObj(new (std::nothrow) Extractor());
+    ASSERT_NE(extractObj, nullptr) << "Extractor creation failed";
+
+    string inputFile = gEnv->getRes() + GetParam();
+    FILE *inputFp = fopen(inputFile.c_str(), "rb");
+    ASSERT_NE(inputFp, nullptr) << "Unable to open " << inputFile << " file for reading";
+
+    struct stat buf;
+    stat(inputFile.c_str(), &buf);
+    size_t fileSize = buf.st_size;
+    int32_t fd = fileno(inputFp);
+
+    int32_t trackCount = extractObj->initExtractor(fd, fileSize);
+    ASSERT_GT(trackCount, 0) << "initExtractor failed";
+
+    int64_t syscallsBefore = getReadSyscallCount();
+    auto start = std::chrono::steady_clock::now();
+    int64_t bytesRead = 0;
+    int32_t numSamples = extractObj->extractAllTracks(&bytesRead);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    int64_t syscallsAfter = getReadSyscallCount();
+    ASSERT_GT(numSamples, 0) << "Extraction failed";
+
+    std::cout << "[   INFO   ] " << GetParam() << ": " << trackCount << " tracks, " << numSamples
+              << " samples, " << bytesRead / elapsed.count() / 1e6 << " MB/s";
+    if (syscallsBefore >= 0 && syscallsAfter >= 0) {
+        std::cout << ", " << (double)(syscallsAfter - syscallsBefore) / numSamples
+                  << " read syscalls/sample";
+    }
+    std::cout << std::endl;
+
+    extractObj->deInitExtractor();
+    extractObj->dumpStatistics(GetParam(), "", gEnv->getStatsFile());
+
+    fclose(inputFp);
+}
+
+INSTANTIATE_TEST_SUITE_P(ExtractorMultiTrackTestAll, ExtractorMultiTrackTest,
+                         ::testing::Values("crowd_1920x1080_25fps_6000kbps_mpeg4.mp4",
+                                           "crowd_1920x1080_25fps_7300kbps_mpeg2.mp4",
+                                           "crowd_1920x1080_25fps_4000kbps_h265.mkv",
+                                           "bbb_44100hz_2ch_128kbps_aac_5mins.mp4"));
+
 int main(int argc, char **argv) {
     ABinderProcess_startThreadPool();
     gEnv = new (std::nothrow) BenchmarkTestEnvironment();
@@ -18,6 +18,9 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "muxerTest"
 
+#include <sys/resource.h>
+
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -50,12 +53,45 @@ static MUXER_OUTPUT_T getMuxerOutFormat(string fmt) {
     return format;
 }
 
+// Opens |inputFile| and initializes |extractor| with it.
+static void openInput(const string &inputFile, Extractor *extractor, FILE **inputFp,
+                      int32_t *trackCount) {
+    *inputFp = fopen(inputFile.c_str(), "rb");
+    ASSERT_NE(*inputFp, nullptr) << "Unable to open " << inputFile << " file for reading";
+
+    // Read file properties
+    struct stat buf;
+    stat(inputFile.c_str(), &buf);
+    size_t fileSize = buf.st_size;
+
+    *trackCount = extractor->initExtractor(fileno(*inputFp), fileSize);
+    ASSERT_GT(*trackCount, 0) << "initExtractor failed";
+}
+
+// Selects |trackId| and appends all of its samples to |inputBuffer| at |*inputBufferOffset|.
+static void readTrackSamples(Extractor *extractor, int32_t trackId, uint8_t *inputBuffer,
+                             size_t bufferSize, uint32_t *inputBufferOffset,
+                             vector<AMediaCodecBufferInfo> &frameInfos) {
+    int32_t status = extractor->setupTrackFormat(trackId);
+    ASSERT_EQ(status, 0) << "Track Format invalid";
+
+    // AMediaCodecBufferInfo : <size of frame> <flags> <presentationTimeUs> <offset>
+    AMediaCodecBufferInfo info;
+    while (1) {
+        status = extractor->getFrameSample(info);
+        if (status || !info.size) break;
+        // copy the meta data and buffer to be passed to muxer
+        ASSERT_LE(*inputBufferOffset + info.size, bufferSize) << "Memory allocated not sufficient";
+
+        memcpy(inputBuffer + *inputBufferOffset, extractor->getFrameBuf(), info.size);
+        info.offset = *inputBufferOffset;
+        frameInfos.push_back(info);
+        *inputBufferOffset += info.size;
+    }
+}
+
 TEST_P(MuxerTest, Mux) {
     ALOGV("Mux the samples given by extractor");
-    string inputFile = gEnv->getRes() + GetParam().first;
-    FILE *inputFp = fopen(inputFile.c_str(), "rb");
-    ASSERT_NE(inputFp, nullptr) << "Unable to open " << inputFile << " file for reading";
-
     string fmt = GetParam().second;
     MUXER_OUTPUT_T outputFormat = getMuxerOutFormat(fmt);
     ASSERT_NE(outputFormat, MUXER_OUTPUT_FORMAT_INVALID) << "Invalid muxer output format";
@@ -66,40 +102,19 @@ TEST_P(MuxerTest, Mux) {
     Extractor *extractor = muxerObj->getExtractor();
     ASSERT_NE(extractor, nullptr) << "Extractor creation failed";
 
-    // Read file properties
-    struct stat buf;
-    stat(inputFile.c_str(), &buf);
-    size_t fileSize = buf.st_size;
-    int32_t fd = fileno(inputFp);
-
-    int32_t trackCount = extractor->initExtractor(fd, fileSize);
-    ASSERT_GT(trackCount, 0) << "initExtractor failed";
+    FILE *inputFp = nullptr;
+    int32_t trackCount = 0;
+    ASSERT_NO_FATAL_FAILURE(
+            openInput(gEnv->getRes() + GetParam().first, extractor, &inputFp, &trackCount));
 
     for (int curTrack = 0; curTrack < trackCount; curTrack++) {
-        int32_t status = extractor->setupTrackFormat(curTrack);
-        ASSERT_EQ(status, 0) << "Track Format invalid";
-
         std::unique_ptr<uint8_t[]> inputBuffer(new (std::nothrow) uint8_t[kMaxBufferSize]);
         ASSERT_NE(inputBuffer, nullptr) << "Insufficient memory";
 
-        // AMediaCodecBufferInfo : <size of frame> <flags> <presentationTimeUs> <offset>
         vector<AMediaCodecBufferInfo> frameInfos;
-        AMediaCodecBufferInfo info;
         uint32_t inputBufferOffset = 0;
-
-        // Get Frame Data
-        while (1) {
-            status = extractor->getFrameSample(info);
-            if (status || !info.size) break;
-            // copy the meta data and buffer to be passed to muxer
-            ASSERT_LE(inputBufferOffset + info.size, kMaxBufferSize)
-                    << "Memory allocated not sufficient";
-
-            memcpy(inputBuffer.get() + inputBufferOffset, extractor->getFrameBuf(), info.size);
-            info.offset = inputBufferOffset;
-            frameInfos.push_back(info);
-            inputBufferOffset += info.size;
-        }
+        ASSERT_NO_FATAL_FAILURE(readTrackSamples(extractor, curTrack, inputBuffer.get(),
+                                                 kMaxBufferSize, &inputBufferOffset, frameInfos));
 
         string outputFileName = OUTPUT_FILE_NAME;
         FILE *outputFp = fopen(outputFileName.c_str(), "w+b");
@@ -107,7 +122,7 @@ TEST_P(MuxerTest, Mux) {
                 << "Unable to open output file" << outputFileName << " for writing";
 
         int32_t fd = fileno(outputFp);
-        status = muxerObj->initMuxer(fd, outputFormat);
+        int32_t status = muxerObj->initMuxer(fd, outputFormat);
         ASSERT_EQ(status, 0) << "initMuxer failed";
 
         status = muxerObj->mux(inputBuffer.get(), frameInfos);
@@ -144,6 +159,137 @@ INSTANTIATE_TEST_SUITE_P(
                           make_pair("bbb_8000hz_1ch_8kbps_amrnb_5mins.3gp", "3gpp"),
                           make_pair("bbb_16000hz_1ch_9kbps_amrwb_5mins.3gp", "3gpp")));
 
+// Returns the number of write syscalls issued by this process so far, or -1 if unknown.
+static int64_t getWriteSyscallCount() {
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    int64_t value;
+    while (io >> key >> value) {
+        if (key == "syscw:") return value;
+    }
+    return -1;
+}
+
+// Returns the user plus system CPU time used by this process so far, in seconds.
+static double getCpuTimeSec() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+class MuxerWriteTest : public ::testing::TestWithParam<pair<vector<string>, string>> {};
+
+// Muxes the first track of each input into one file and reports the write syscalls and CPU
+// time it took. The writer batches chunk writes only when it has more than one track, so the
+// inputs are paired to get an audio and a video track.
+TEST_P(MuxerWriteTest, MuxWriteSyscalls) {
+    const vector<string> &inputFiles = GetParam().first;
+    string fmt = GetParam().second;
+    MUXER_OUTPUT_T outputFormat = getMuxerOutFormat(fmt);
+    ASSERT_NE(outputFormat, MUXER_OUTPUT_FORMAT_INVALID) << "Invalid muxer output format";
+
+    std::unique_ptr<Muxer> muxerObj(new (std::nothrow) Muxer());
+    ASSERT_NE(muxerObj, nullptr) << "Muxer creation failed";
+
+    size_t bufferSize = kMaxBufferSize * inputFiles.size();
+    std::unique_ptr<uint8_t[]> inputBuffer(new (std::nothrow) uint8_t[bufferSize]);
+    ASSERT_NE(inputBuffer, nullptr) << "Insufficient memory";
+
+    string inputName;
+    vector<AMediaFormat *> trackFormats;
+    vector<AMediaCodecBufferInfo> frameInfos;
+    vector<size_t> trackIds;
+    uint32_t inputBufferOffset = 0;
+    for (size_t trackId = 0; trackId < inputFiles.size(); ++trackId) {
+        std::unique_ptr<Extractor> extractor(new (std::nothrow) Extractor());
+        ASSERT_NE(extractor, nullptr) << "Extractor creation failed";
+
+        FILE *inputFp = nullptr;
+        int32_t trackCount = 0;
+        ASSERT_NO_FATAL_FAILURE(openInput(gEnv->getRes() + inputFiles[trackId], extractor.get(),
+                                          &inputFp, &trackCount));
+
+        vector<AMediaCodecBufferInfo> trackFrameInfos;
+        readTrackSamples(extractor.get(), 0, inputBuffer.get(), bufferSize, &inputBufferOffset,
+                         trackFrameInfos);
+        trackFormats.push_back(extractor->getFormat());
+        fclose(inputFp);
+        extractor->deInitExtractor();
+        ASSERT_FALSE(HasFatalFailure());
+        ASSERT_GT(trackFrameInfos.size(), 0u) << "No samples extracted";
+
+        // Interleave the samples of all tracks in presentation time order, like a recorder.
+        vector<AMediaCodecBufferInfo> mergedFrameInfos;
+        vector<size_t> mergedTrackIds;
+        size_t i = 0;
+        for (const AMediaCodecBufferInfo &info : trackFrameInfos) {
+            while (i < frameInfos.size() &&
+                   frameInfos[i].presentationTimeUs <= info.presentationTimeUs) {
+                mergedFrameInfos.push_back(frameInfos[i]);
+                mergedTrackIds.push_back(trackIds[i]);
+                ++i;
+            }
+            mergedFrameInfos.push_back(info);
+            mergedTrackIds.push_back(trackId);
+        }
+        mergedFrameInfos.insert(mergedFrameInfos.end(), frameInfos.begin() + i, frameInfos.end());
+        mergedTrackIds.insert(mergedTrackIds.end(), trackIds.begin() + i, trackIds.end());
+        frameInfos.swap(mergedFrameInfos);
+        trackIds.swap(mergedTrackIds);
+
+        inputName += (inputName.empty() ? "" : "+") + inputFiles[trackId];
+    }
+
+    string outputFileName = OUTPUT_FILE_NAME;
+    FILE *outputFp = fopen(outputFileName.c_str(), "w+b");
+    ASSERT_NE(outputFp, nullptr)
+            << "Unable to open output file" << outputFileName << " for writing";
+
+    int64_t syscallsBefore = getWriteSyscallCount();
+    double cpuBefore = getCpuTimeSec();
+    auto start = std::chrono::steady_clock::now();
+
+    int32_t status = muxerObj->initMuxer(fileno(outputFp), outputFormat, trackFormats);
+    ASSERT_EQ(status, 0) << "initMuxer failed";
+    status = muxerObj->mux(inputBuffer.get(), frameInfos, trackIds);
+    ASSERT_EQ(status, 0) << "Mux failed";
+    // Stopping the muxer drains the chunks still buffered by the writer thread.
+    muxerObj->deInitMuxer();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double cpu = getCpuTimeSec() - cpuBefore;
+    int64_t syscallsAfter = getWriteSyscallCount();
+
+    std::cout << "[   INFO   ] " << inputName << "." << fmt << ": " << frameInfos.size()
+              << " samples, " << inputBufferOffset / elapsed.count() / 1e6 << " MB/s, cpu "
+              << cpu * 1000 << " ms";
+    if (syscallsBefore >= 0 && syscallsAfter >= 0) {
+        int64_t syscalls = syscallsAfter - syscallsBefore;
+        std::cout << ", " << syscalls << " write syscalls, " << syscalls / elapsed.count()
+                  << " syscalls/sec, " << (double)syscalls / frameInfos.size()
+                  << " syscalls/sample";
+    }
+    std::cout << std::endl;
+
+    fclose(outputFp);
+    for (AMediaFormat *format : trackFormats) {
+        AMediaFormat_delete(format);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        MuxerWriteTestAll, MuxerWriteTest,
+        ::testing::Values(make_pair(vector<string>{"crowd_1920x1080_25fps_6700kbps_h264.ts",
+                                                   "bbb_44100hz_2ch_128kbps_aac_5mins.mp4"},
+                                    "mp4"),
+                          make_pair(vector<string>{"crowd_1920x1080_25fps_4000kbps_h265.mkv",
+                                                   "bbb_44100hz_2ch_128kbps_aac_5mins.mp4"},
+                                    "mp4"),
+                          make_pair(vector<string>{"crowd_1920x1080_25fps_6000kbps_mpeg4.mp4",
+                                                   "bbb_8000hz_1ch_8kbps_amrnb_5mins.3gp"},
+                                    "3gpp")));
+
 int main(int argc, char **argv) {
     gEnv = new (std::nothrow) BenchmarkTestEnvironment();
     ::testing::AddGlobalTestEnvironment(gEnv);